@@ -0,0 +1,242 @@
+﻿#include "AssetStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+
+#include "MeshFile.h"
+#include "Profiler.h"
+
+// コンストラクタ
+AssetStreamer::AssetStreamer(const VERTEX_FORMAT& vertexFormat, uint32_t threadNum, uint32_t queueCapacity):
+	m_VertexFormat(vertexFormat),
+	m_Workers(),
+	m_Mutex(),
+	m_Condition(),
+	m_Jobs(),
+	m_Exit(false),
+	m_Completed(queueCapacity),
+	m_PendingLoads(0),
+	m_BytesInFlight(0),
+	m_Deferred(nullptr),
+	m_States(),
+	m_Meshes(),
+	m_UploadBudget(1024 * 1024),
+	m_Statistics({ 0 }) {
+
+	for (uint32_t i = 0; i < max(threadNum, 1u); ++i) {
+		m_Workers.emplace_back(&AssetStreamer::WorkerMain, this);
+	}
+}
+
+// デストラクタ (読み込み中のものは捨てる)
+AssetStreamer::~AssetStreamer() {
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_Exit = true;
+	}
+	m_Condition.notify_all();
+	for (thread& worker : m_Workers) { worker.join(); }
+}
+
+// ワーカースレッドの処理
+void AssetStreamer::WorkerMain() {
+
+	while (true) {
+		STREAM_JOB job;
+		{
+			unique_lock<mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this] { return m_Exit || !m_Jobs.empty(); });
+			if (m_Exit) { return; }
+			job = move(m_Jobs.front());
+			m_Jobs.pop_front();
+		}
+
+		unique_ptr<STREAMED_MESH> mesh = Load(job);
+		m_BytesInFlight += mesh->Vertices.size() + mesh->Indices.size();
+
+		// キューが満杯ならレンダースレッドが取り出すまで待つ
+		while (!m_Completed.TryPush(mesh)) {
+			if (m_Exit) { return; }
+			this_thread::yield();
+		}
+		--m_PendingLoads;
+	}
+}
+
+// 読み込んで共有バッファの形式に詰める
+unique_ptr<AssetStreamer::STREAMED_MESH> AssetStreamer::Load(const STREAM_JOB& job) const {
+	PROFILE_ZONE("AssetStreamer::Load");
+
+	unique_ptr<STREAMED_MESH> mesh = make_unique<STREAMED_MESH>();
+	mesh->Request = job.Request;
+	mesh->Succeeded = false;
+	mesh->VertexNum = 0;
+	mesh->IndexNum = 0;
+
+	try {
+		if (job.Generator) {
+			unique_ptr<RenderObject> object = job.Generator();
+			if (object != nullptr) {
+				mesh->Succeeded = Pack(VertexFormat::Full(), object->GetVertices(), static_cast<uint32_t>(object->GetVertexNum()), INDEX_FORMAT::R32_UINT, object->GetIndices(), static_cast<uint32_t>(object->GetIndexNum()), mesh.get());
+			}
+		}
+		else {
+			// マップしたファイルから直接詰めるので、読み込み用の中間バッファは作らない
+			MeshFile file;
+			if (file.Open(job.Path.c_str())) {
+				const MESH_FILE_HEADER& header = file.GetHeader();
+				mesh->Succeeded = Pack(file.GetVertexFormat(), file.GetVertexData(), header.VertexNum, file.GetIndexFormat(), file.GetIndexData(), header.IndexNum, mesh.get());
+			}
+		}
+	}
+	catch (exception&) {
+		mesh->Succeeded = false;
+	}
+
+	if (!mesh->Succeeded) {
+		mesh->Vertices.clear();
+		mesh->Indices.clear();
+	}
+	return mesh;
+}
+
+// 共有バッファの形式に詰める (16 ビットに収まらないインデックスか、量子化の範囲を超える位置があれば false)
+// インデックスは頂点数が 65536 以下なら 16 ビットにし、16 ビットで来たものは広げない (MeshRegistry と同じ選び方)
+bool AssetStreamer::Pack(const VERTEX_FORMAT& vertexFormat, const void* vertices, uint32_t vertexNum, INDEX_FORMAT indexFormat, const void* indices, uint32_t indexNum, STREAMED_MESH* mesh) const {
+
+	VertexFormat target(m_VertexFormat);
+	mesh->VertexNum = vertexNum;
+	mesh->IndexNum = indexNum;
+	mesh->IndexFormat = indexFormat == INDEX_FORMAT::R16_UINT ? INDEX_FORMAT::R16_UINT : VertexFormat::SelectIndexFormat(vertexNum);
+	mesh->Vertices.resize(static_cast<size_t>(vertexNum) * target.GetStride());
+	mesh->Indices.resize(static_cast<size_t>(indexNum) * VertexFormat::GetIndexSize(mesh->IndexFormat));
+
+	// 頂点 (形式が同じならそのままコピーし、違えば展開してから詰める)
+	if (VertexFormat::IsSameFormat(vertexFormat, m_VertexFormat)) {
+		if (vertexNum > 0) { memcpy(mesh->Vertices.data(), vertices, mesh->Vertices.size()); }
+	}
+	else if (VertexFormat::IsSameFormat(vertexFormat, VertexFormat::Full())) {
+		if (!target.CanEncode(static_cast<const VERTEX*>(vertices), vertexNum)) { return false; }
+		target.Encode(static_cast<const VERTEX*>(vertices), vertexNum, mesh->Vertices.data());
+	}
+	else {
+		vector<VERTEX> decoded(vertexNum);
+		VertexFormat(vertexFormat).Decode(vertices, vertexNum, decoded.data());
+		if (!target.CanEncode(decoded.data(), vertexNum)) { return false; }
+		target.Encode(decoded.data(), vertexNum, mesh->Vertices.data());
+	}
+
+	// インデックス
+	if (indexFormat == mesh->IndexFormat) {
+		if (indexNum > 0) { memcpy(mesh->Indices.data(), indices, mesh->Indices.size()); }
+	}
+	else {
+		const uint32_t* source = static_cast<const uint32_t*>(indices);
+		uint16_t* dest = reinterpret_cast<uint16_t*>(mesh->Indices.data());
+		for (uint32_t i = 0; i < indexNum; ++i) {
+			if (source[i] > 0xFFFF) { return false; }
+			dest[i] = static_cast<uint16_t>(source[i]);
+		}
+	}
+	return true;
+}
+
+// 要求をワーカーに渡す
+STREAM_REQUEST AssetStreamer::AddJob(STREAM_JOB&& job) {
+
+	STREAM_REQUEST request = static_cast<STREAM_REQUEST>(m_States.size());
+	m_States.push_back(STREAM_STATE::PENDING);
+	m_Meshes.push_back(INVALID_MESH_HANDLE);
+
+	job.Request = request;
+	++m_Statistics.QueueDepth;
+	++m_PendingLoads;
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_Jobs.push_back(move(job));
+	}
+	m_Condition.notify_one();
+	return request;
+}
+
+// メッシュファイルの読み込みを要求する
+STREAM_REQUEST AssetStreamer::Request(const char* path) {
+	return AddJob({ INVALID_STREAM_REQUEST, path, nullptr });
+}
+
+// メッシュを作る処理を要求する
+STREAM_REQUEST AssetStreamer::Request(const MESH_GENERATOR& generator) {
+	return AddJob({ INVALID_STREAM_REQUEST, string(), generator });
+}
+
+// 読み終えたものを予算の範囲で登録する
+uint32_t AssetStreamer::Update(MeshRegistry& registry) {
+	PROFILE_ZONE("AssetStreamer::Update");
+
+	auto start = chrono::steady_clock::now();
+
+	uint64_t uploadBytes = 0;
+	uint32_t registeredNum = 0;
+	while (m_Deferred != nullptr || m_Completed.TryPop(&m_Deferred)) {
+		STREAMED_MESH& mesh = *m_Deferred;
+		uint64_t size = mesh.Vertices.size() + mesh.Indices.size();
+
+		// 予算を超えるなら次のフレームへ回す (予算より大きいものもフレームの最初なら通す)
+		if (uploadBytes > 0 && uploadBytes + size > m_UploadBudget) { break; }
+
+		MESH_HANDLE handle = INVALID_MESH_HANDLE;
+		if (mesh.Succeeded) {
+			handle = registry.Register(m_VertexFormat, mesh.Vertices.data(), mesh.VertexNum, mesh.IndexFormat, mesh.Indices.data(), mesh.IndexNum);
+		}
+
+		m_Meshes[mesh.Request] = handle;
+		m_States[mesh.Request] = handle != INVALID_MESH_HANDLE ? STREAM_STATE::RESIDENT : STREAM_STATE::FAILED;
+		if (handle != INVALID_MESH_HANDLE) {
+			++m_Statistics.ResidentNum;
+			uploadBytes += size;
+			++registeredNum;
+		}
+		else {
+			++m_Statistics.FailedNum;
+		}
+
+		m_BytesInFlight -= size;
+		--m_Statistics.QueueDepth;
+		m_Deferred = nullptr;
+	}
+
+	double time = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	m_Statistics.LastUploadBytes = uploadBytes;
+	m_Statistics.LastUploadTime = time;
+	m_Statistics.MaxUploadTime = max(m_Statistics.MaxUploadTime, time);
+	m_Statistics.TotalUploadTime += time;
+	m_Statistics.TotalUploadBytes += uploadBytes;
+	++m_Statistics.FrameNum;
+	return registeredNum;
+}
+
+// 1 フレームに転送するバイト数の上限を設定
+void AssetStreamer::SetUploadBudget(uint64_t bytes) {
+	m_UploadBudget = bytes;
+}
+
+// 要求の状態を取得
+STREAM_STATE AssetStreamer::GetState(STREAM_REQUEST request) const {
+	return request < m_States.size() ? m_States[request] : STREAM_STATE::FAILED;
+}
+
+// 登録したメッシュを取得 (まだなら INVALID_MESH_HANDLE)
+MESH_HANDLE AssetStreamer::GetMesh(STREAM_REQUEST request) const {
+	return request < m_Meshes.size() ? m_Meshes[request] : INVALID_MESH_HANDLE;
+}
+
+// 統計情報を取得
+STREAMING_STATISTICS AssetStreamer::GetStatistics() const {
+	STREAMING_STATISTICS statistics = m_Statistics;
+	statistics.PendingLoads = m_PendingLoads;
+	statistics.BytesInFlight = m_BytesInFlight;
+	statistics.UploadBudget = m_UploadBudget;
+	return statistics;
+}
@@ -0,0 +1,126 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LockFreeQueue.h"
+#include "MeshRegistry.h"
+#include "RenderObject.h"
+#include "VertexFormat.h"
+
+using namespace std;
+
+// 読み込み要求の番号
+typedef uint32_t STREAM_REQUEST;
+static const STREAM_REQUEST INVALID_STREAM_REQUEST = UINT32_MAX;
+
+// 読み込み要求の状態
+enum class STREAM_STATE {
+	PENDING,  // 読み込み中か転送待ち
+	RESIDENT, // 共有バッファに登録済み
+	FAILED,   // 読めなかったか共有バッファに入らなかった
+};
+
+// メッシュを作る処理 (ワーカースレッドで呼ばれる)
+typedef function<unique_ptr<RenderObject>()> MESH_GENERATOR;
+
+// ストリーミングの統計情報
+struct STREAMING_STATISTICS {
+	uint32_t QueueDepth;      // 読み込み待ちと転送待ちの要求の数
+	uint32_t PendingLoads;    // ワーカーがまだ読み終えていない要求の数
+	uint64_t BytesInFlight;   // 読み終えてまだ転送していないバイト数
+	uint64_t UploadBudget;    // 1 フレームに転送するバイト数の上限
+	uint64_t LastUploadBytes; // 直前のフレームで転送したバイト数
+	double LastUploadTime;    // 直前のフレームで登録にかかった時間 (ミリ秒)
+	double MaxUploadTime;
+	double TotalUploadTime;
+	uint64_t TotalUploadBytes;
+	uint32_t FrameNum;
+	uint32_t ResidentNum;
+	uint32_t FailedNum;
+};
+
+// アセットのストリーミング
+// ワーカースレッドでメッシュファイルを読み、共有バッファの形式に詰め直してからロックフリーキューでレンダースレッドへ渡す
+// レンダースレッドは Update で 1 フレームの予算に収まる分だけ共有バッファへ登録する (予算より大きいものはそれだけで 1 フレームを使う)
+// Request と Update はレンダースレッドから呼ぶこと
+class AssetStreamer {
+
+private:
+	// ワーカーへの要求
+	struct STREAM_JOB {
+		STREAM_REQUEST Request;
+		string Path;
+		MESH_GENERATOR Generator;
+	};
+
+	// 読み終えたメッシュ (共有バッファの形式に詰めてある)
+	struct STREAMED_MESH {
+		STREAM_REQUEST Request;
+		bool Succeeded;
+		uint32_t VertexNum;
+		uint32_t IndexNum;
+		INDEX_FORMAT IndexFormat;
+		vector<uint8_t> Vertices;
+		vector<uint8_t> Indices;
+	};
+
+	// 詰める先の頂点の形式 (インデックスの形式はメッシュの頂点数で決める)
+	VERTEX_FORMAT m_VertexFormat;
+
+	// ワーカーと読み込み待ちの要求
+	vector<thread> m_Workers;
+	mutex m_Mutex;
+	condition_variable m_Condition;
+	deque<STREAM_JOB> m_Jobs;
+	atomic<bool> m_Exit;
+
+	// 読み終えたメッシュ (ワーカーからレンダースレッドへ)
+	LockFreeQueue<unique_ptr<STREAMED_MESH>> m_Completed;
+	atomic<uint32_t> m_PendingLoads;
+	atomic<uint64_t> m_BytesInFlight;
+
+	// 予算に収まらず次のフレームに回したメッシュ
+	unique_ptr<STREAMED_MESH> m_Deferred;
+
+	// 要求ごとの状態と登録したメッシュ (要求の番号が添え字)
+	vector<STREAM_STATE> m_States;
+	vector<MESH_HANDLE> m_Meshes;
+
+	uint64_t m_UploadBudget;
+	STREAMING_STATISTICS m_Statistics;
+
+	void WorkerMain();
+	unique_ptr<STREAMED_MESH> Load(const STREAM_JOB& job) const;
+	bool Pack(const VERTEX_FORMAT& vertexFormat, const void* vertices, uint32_t vertexNum, INDEX_FORMAT indexFormat, const void* indices, uint32_t indexNum, STREAMED_MESH* mesh) const;
+	STREAM_REQUEST AddJob(STREAM_JOB&& job);
+
+public:
+	// 詰める先の頂点の形式は共有バッファに合わせる
+	AssetStreamer(const VERTEX_FORMAT& vertexFormat, uint32_t threadNum = 1, uint32_t queueCapacity = 64);
+	~AssetStreamer();
+	AssetStreamer(const AssetStreamer&) = delete;
+	AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+	// メッシュファイルか、メッシュを作る処理を渡して読み込みを要求する
+	STREAM_REQUEST Request(const char* path);
+	STREAM_REQUEST Request(const MESH_GENERATOR& generator);
+
+	// 読み終えたものを予算の範囲で登録する (毎フレーム、共有バッファを GPU へ送る前に呼ぶ)
+	uint32_t Update(MeshRegistry& registry);
+
+	// 1 フレームに転送するバイト数の上限
+	void SetUploadBudget(uint64_t bytes);
+
+	STREAM_STATE GetState(STREAM_REQUEST request) const;
+	MESH_HANDLE GetMesh(STREAM_REQUEST request) const;
+	STREAMING_STATISTICS GetStatistics() const;
+};
@@ -0,0 +1,816 @@
+﻿#include "D3D12Backend.h"
+
+#if defined(_WIN32)
+
+// アサート
+static void Assert(bool result, const char* file, size_t line, const char* message) {
+	if (result) {
+		stringstream stream;
+		stream << "File : " << file << endl;
+		stream << "Line : " << line << endl;
+		stream << system_category().message(result) << endl;
+		stream << message << endl;
+		throw exception(stream.str().c_str());
+	}
+}
+
+// ウィンドウプロシージャ
+static LRESULT WindowProc(HWND hWindow, UINT msg, WPARAM wParam, LPARAM lParam) {
+	if (msg == WM_DESTROY) { PostQuitMessage(0); }
+	return DefWindowProc(hWindow, msg, wParam, lParam);
+}
+
+// リソースの状態を変換
+static D3D12_RESOURCE_STATES ToD3D12(RESOURCE_STATE state) {
+	switch (state) {
+	case RESOURCE_STATE::PRESENT: return D3D12_RESOURCE_STATE_PRESENT;
+	case RESOURCE_STATE::RENDER_TARGET: return D3D12_RESOURCE_STATE_RENDER_TARGET;
+	case RESOURCE_STATE::COPY_DEST: return D3D12_RESOURCE_STATE_COPY_DEST;
+	case RESOURCE_STATE::VERTEX_AND_CONSTANT_BUFFER: return D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
+	case RESOURCE_STATE::INDEX_BUFFER: return D3D12_RESOURCE_STATE_INDEX_BUFFER;
+	case RESOURCE_STATE::GENERIC_READ: return D3D12_RESOURCE_STATE_GENERIC_READ;
+	default: return D3D12_RESOURCE_STATE_COMMON;
+	}
+}
+
+// 頂点要素の形式を変換
+static DXGI_FORMAT ToD3D12(ELEMENT_FORMAT format) {
+	switch (format) {
+	case ELEMENT_FORMAT::R32G32B32_FLOAT: return DXGI_FORMAT_R32G32B32_FLOAT;
+	case ELEMENT_FORMAT::R32G32B32A32_FLOAT: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+	case ELEMENT_FORMAT::R16G16B16A16_FLOAT: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+	case ELEMENT_FORMAT::R16G16B16A16_SNORM: return DXGI_FORMAT_R16G16B16A16_SNORM;
+	case ELEMENT_FORMAT::R8G8B8A8_UNORM: return DXGI_FORMAT_R8G8B8A8_UNORM;
+	default: return DXGI_FORMAT_UNKNOWN;
+	}
+}
+
+// インデックスの形式を変換
+static DXGI_FORMAT ToD3D12(INDEX_FORMAT format) {
+	switch (format) {
+	case INDEX_FORMAT::R16_UINT: return DXGI_FORMAT_R16_UINT;
+	case INDEX_FORMAT::R32_UINT: return DXGI_FORMAT_R32_UINT;
+	default: return DXGI_FORMAT_UNKNOWN;
+	}
+}
+
+// プリミティブの種類を変換
+static D3D_PRIMITIVE_TOPOLOGY ToD3D12(PRIMITIVE_TOPOLOGY topology) {
+	switch (topology) {
+	case PRIMITIVE_TOPOLOGY::TRIANGLELIST: return D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	default: return D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	}
+}
+
+// ディスクリプタヒープの種類を変換
+static D3D12_DESCRIPTOR_HEAP_TYPE ToD3D12(DESCRIPTOR_HEAP_TYPE type) {
+	switch (type) {
+	case DESCRIPTOR_HEAP_TYPE::RTV: return D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+	case DESCRIPTOR_HEAP_TYPE::DSV: return D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+	default: return D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	}
+}
+
+// パイプラインのキーに混ぜる固定ステート (詰め物を含む構造体はメンバごとに混ぜる)
+static uint64_t ComputeBackendKey(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) {
+	PipelineHash hash;
+	hash.AddString("D3D12");
+	hash.AddValue(desc.RasterizerState);
+	hash.AddValue(desc.BlendState.AlphaToCoverageEnable);
+	hash.AddValue(desc.BlendState.IndependentBlendEnable);
+	for (const D3D12_RENDER_TARGET_BLEND_DESC& blend : desc.BlendState.RenderTarget) {
+		hash.AddValue(blend.BlendEnable);
+		hash.AddValue(blend.LogicOpEnable);
+		hash.AddValue(blend.SrcBlend);
+		hash.AddValue(blend.DestBlend);
+		hash.AddValue(blend.BlendOp);
+		hash.AddValue(blend.SrcBlendAlpha);
+		hash.AddValue(blend.DestBlendAlpha);
+		hash.AddValue(blend.BlendOpAlpha);
+		hash.AddValue(blend.LogicOp);
+		hash.AddValue(blend.RenderTargetWriteMask);
+	}
+	hash.AddValue(desc.DepthStencilState.DepthEnable);
+	hash.AddValue(desc.DepthStencilState.StencilEnable);
+	hash.AddValue(desc.SampleMask);
+	hash.AddValue(desc.PrimitiveTopologyType);
+	hash.AddValue(desc.NumRenderTargets);
+	hash.AddValue(desc.RTVFormats);
+	hash.AddValue(desc.DSVFormat);
+	hash.AddValue(desc.SampleDesc);
+	return hash.GetValue();
+}
+
+// コンストラクタ
+D3D12CommandList::D3D12CommandList(D3D12Backend* backend):
+	m_Backend(backend),
+	m_CommandAllocator(),
+	m_CommandList(nullptr) {
+
+	HRESULT result;
+
+	// コマンドアロケータ
+	for (uint32_t i = 0; i < m_Backend->m_FrameLatency; ++i) {
+		ID3D12CommandAllocator* allocator = nullptr;
+		result = m_Backend->m_Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&allocator));
+		Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+		m_CommandAllocator.emplace_back(allocator);
+	}
+
+	// コマンドリスト
+	ID3D12GraphicsCommandList* list = nullptr;
+	result = m_Backend->m_Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_CommandAllocator[0].get(), nullptr, IID_PPV_ARGS(&list));
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+	m_CommandList.reset(list);
+
+	m_CommandList->Close();
+}
+
+// 記録を始める
+void D3D12CommandList::Reset(uint32_t frameIndex) {
+	HRESULT result;
+	result = m_CommandAllocator[frameIndex]->Reset();
+	result = m_CommandList->Reset(m_CommandAllocator[frameIndex].get(), nullptr);
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+}
+
+// 記録を終える
+void D3D12CommandList::Close() { m_CommandList->Close(); }
+
+// リソースバリア
+void D3D12CommandList::ResourceBarrier(uint32_t num, const RESOURCE_BARRIER* barriers) {
+
+	D3D12_RESOURCE_BARRIER descs[8] = {};
+	for (uint32_t i = 0; i < num; i += _countof(descs)) {
+		uint32_t count = min(num - i, static_cast<uint32_t>(_countof(descs)));
+		for (uint32_t j = 0; j < count; ++j) {
+			descs[j].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+			descs[j].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+			descs[j].Transition.pResource = m_Backend->m_Resources[barriers[i + j].Resource].get();
+			descs[j].Transition.StateBefore = ToD3D12(barriers[i + j].StateBefore);
+			descs[j].Transition.StateAfter = ToD3D12(barriers[i + j].StateAfter);
+			descs[j].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+		}
+		m_CommandList->ResourceBarrier(count, descs);
+	}
+}
+
+// バッファのコピー
+void D3D12CommandList::CopyBufferRegion(RESOURCE_HANDLE dest, uint64_t destOffset, RESOURCE_HANDLE src, uint64_t srcOffset, uint64_t size) {
+	m_CommandList->CopyBufferRegion(m_Backend->m_Resources[dest].get(), destOffset, m_Backend->m_Resources[src].get(), srcOffset, size);
+}
+
+// レンダーターゲットを設定
+void D3D12CommandList::OMSetRenderTarget(RESOURCE_HANDLE renderTarget) {
+	D3D12_CPU_DESCRIPTOR_HANDLE handle = m_Backend->GetRenderTargetView(renderTarget);
+	m_CommandList->OMSetRenderTargets(1, &handle, FALSE, nullptr);
+}
+
+// レンダーターゲットを塗りつぶす
+void D3D12CommandList::ClearRenderTargetView(RESOURCE_HANDLE renderTarget, const float color[4]) {
+	m_CommandList->ClearRenderTargetView(m_Backend->GetRenderTargetView(renderTarget), color, 0, nullptr);
+}
+
+// ルートシグニチャを設定
+void D3D12CommandList::SetGraphicsRootSignature(ROOT_SIGNATURE_HANDLE rootSignature) {
+	m_CommandList->SetGraphicsRootSignature(m_Backend->m_RootSignatures[rootSignature].get());
+}
+
+// ディスクリプタヒープを設定
+void D3D12CommandList::SetDescriptorHeaps(uint32_t num, const DESCRIPTOR_HEAP_HANDLE* heaps) {
+	ID3D12DescriptorHeap* descs[4] = {};
+	num = min(num, static_cast<uint32_t>(_countof(descs)));
+	for (uint32_t i = 0; i < num; ++i) { descs[i] = m_Backend->m_DescriptorHeaps[heaps[i]].get(); }
+	m_CommandList->SetDescriptorHeaps(num, descs);
+}
+
+// 定数バッファビューを設定
+void D3D12CommandList::SetGraphicsRootConstantBufferView(uint32_t parameterIndex, GPU_ADDRESS address) {
+	m_CommandList->SetGraphicsRootConstantBufferView(parameterIndex, address);
+}
+
+// パイプラインステートを設定
+void D3D12CommandList::SetPipelineState(PIPELINE_HANDLE pipelineState) {
+	m_CommandList->SetPipelineState(m_Backend->m_PipelineStates[pipelineState].get());
+}
+
+// プリミティブの種類を設定
+void D3D12CommandList::IASetPrimitiveTopology(PRIMITIVE_TOPOLOGY topology) {
+	m_CommandList->IASetPrimitiveTopology(ToD3D12(topology));
+}
+
+// 頂点バッファを設定
+void D3D12CommandList::IASetVertexBuffers(uint32_t startSlot, uint32_t num, const VERTEX_BUFFER_VIEW* views) {
+	D3D12_VERTEX_BUFFER_VIEW descs[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT] = {};
+	for (uint32_t i = 0; i < num; ++i) {
+		descs[i].BufferLocation = views[i].BufferLocation;
+		descs[i].SizeInBytes = views[i].SizeInBytes;
+		descs[i].StrideInBytes = views[i].StrideInBytes;
+	}
+	m_CommandList->IASetVertexBuffers(startSlot, num, descs);
+}
+
+// インデックスバッファを設定
+void D3D12CommandList::IASetIndexBuffer(const INDEX_BUFFER_VIEW* view) {
+	D3D12_INDEX_BUFFER_VIEW desc = {};
+	desc.BufferLocation = view->BufferLocation;
+	desc.SizeInBytes = view->SizeInBytes;
+	desc.Format = ToD3D12(view->Format);
+	m_CommandList->IASetIndexBuffer(&desc);
+}
+
+// ビューポートを設定
+void D3D12CommandList::RSSetViewports(uint32_t num, const VIEWPORT* viewports) {
+	D3D12_VIEWPORT descs[D3D12_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE] = {};
+	for (uint32_t i = 0; i < num; ++i) {
+		descs[i].TopLeftX = viewports[i].TopLeftX;
+		descs[i].TopLeftY = viewports[i].TopLeftY;
+		descs[i].Width = viewports[i].Width;
+		descs[i].Height = viewports[i].Height;
+		descs[i].MinDepth = viewports[i].MinDepth;
+		descs[i].MaxDepth = viewports[i].MaxDepth;
+	}
+	m_CommandList->RSSetViewports(num, descs);
+}
+
+// シザー矩形を設定
+void D3D12CommandList::RSSetScissorRects(uint32_t num, const SCISSOR_RECT* rects) {
+	D3D12_RECT descs[D3D12_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE] = {};
+	for (uint32_t i = 0; i < num; ++i) {
+		descs[i].left = rects[i].Left;
+		descs[i].top = rects[i].Top;
+		descs[i].right = rects[i].Right;
+		descs[i].bottom = rects[i].Bottom;
+	}
+	m_CommandList->RSSetScissorRects(num, descs);
+}
+
+// 描画
+void D3D12CommandList::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) {
+	m_CommandList->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+// コンストラクタ
+D3D12Backend::D3D12Backend():
+	m_InstanceHandle(nullptr),
+	m_WindowHandle(nullptr),
+	m_ClassName(nullptr),
+	m_WindowName(nullptr),
+	m_WindowWidth(0),
+	m_WindowHeight(0),
+	m_FrameCount(0),
+	m_FrameLatency(0),
+	m_Device(nullptr),
+	m_Queue(nullptr),
+	m_SwapChain(nullptr),
+	m_Resources(),
+	m_RootSignatures(),
+	m_PipelineStates(),
+	m_DescriptorHeaps(),
+	m_PipelineCache(nullptr),
+	m_RootSignatureKeys(),
+	m_ShaderBlobs(),
+	m_BackBuffers(),
+	m_HeapRTV(nullptr),
+	m_AllocatorRTV(nullptr),
+	m_HandleRTV(),
+	m_Fence(nullptr),
+	m_FenceEvent(nullptr) {}
+
+// ウィンドウを作成
+void D3D12Backend::CreateWindow() {
+
+	m_InstanceHandle = GetModuleHandle(nullptr);
+	Assert(m_InstanceHandle == nullptr, __FILE__, __LINE__, "インスタンスハンドルの取得に失敗しました。");
+
+	WNDCLASSEX wndClass = {};
+	wndClass.cbSize = sizeof(WNDCLASSEX);
+	wndClass.style = CS_HREDRAW | CS_VREDRAW;
+	wndClass.lpfnWndProc = WindowProc;
+	wndClass.hIcon = LoadIcon(m_InstanceHandle, IDI_APPLICATION);
+	wndClass.hCursor = LoadCursor(m_InstanceHandle, IDC_ARROW);
+	wndClass.hbrBackground = GetSysColorBrush(COLOR_BACKGROUND);
+	wndClass.lpszMenuName = nullptr;
+	wndClass.lpszClassName = m_ClassName;
+	wndClass.hIconSm = LoadIcon(m_InstanceHandle, IDI_APPLICATION);
+	Assert(!RegisterClassEx(&wndClass), __FILE__, __LINE__, "ウィンドウクラスの登録に失敗しました。");
+
+	RECT rect = {};
+	rect.right = static_cast<LONG>(m_WindowWidth);
+	rect.bottom = static_cast<LONG>(m_WindowHeight);
+
+	auto style = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU;
+	AdjustWindowRect(&rect, style, FALSE);
+
+	int width = rect.right - rect.left;
+	int height = rect.bottom - rect.top;
+	m_WindowHandle = CreateWindowEx(0, m_ClassName, m_WindowName, style, CW_USEDEFAULT, CW_USEDEFAULT, width, height, nullptr, nullptr, m_InstanceHandle, nullptr);
+	Assert(m_WindowHandle == nullptr, __FILE__, __LINE__, "ウィンドウの生成に失敗しました。");
+
+	if (m_WindowHandle != nullptr) {
+		ShowWindow(m_WindowHandle, SW_SHOWNORMAL);
+		UpdateWindow(m_WindowHandle);
+		SetFocus(m_WindowHandle);
+	}
+}
+
+// 描画インターフェースを作成
+void D3D12Backend::CreateInterface() {
+
+	HRESULT result;
+
+#if defined(DEBUG) || defined(_DEBUG)
+	{
+		ID3D12Debug* debug = nullptr;
+		result = D3D12GetDebugInterface(IID_PPV_ARGS(&debug));
+		if (SUCCEEDED(result)) { m_Debug.reset(debug); }
+	}
+#endif
+
+	// デバイスの作成
+	{
+		ID3D12Device* device = nullptr;
+		result = D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device));
+		Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+		m_Device.reset(device);
+	}
+
+	// コマンドキューの作成
+	{
+		D3D12_COMMAND_QUEUE_DESC desc = {};
+		desc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+		desc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+		desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+		desc.NodeMask = 0;
+
+		ID3D12CommandQueue* queue = nullptr;
+		result = m_Device->CreateCommandQueue(&desc, IID_PPV_ARGS(&queue));
+		Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+		m_Queue.reset(queue);
+	}
+
+	// スワップチェインの作成
+	{
+		IDXGIFactory4* factory = nullptr;
+		IDXGISwapChain* swapChain = nullptr;
+		try {
+			result = CreateDXGIFactory1(IID_PPV_ARGS(&factory));
+			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+
+			DXGI_SWAP_CHAIN_DESC desc = {};
+			desc.BufferDesc.Width = m_WindowWidth;
+			desc.BufferDesc.Height = m_WindowHeight;
+			desc.BufferDesc.RefreshRate.Numerator = 60;
+			desc.BufferDesc.RefreshRate.Denominator = 1;
+			desc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
+			desc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
+			desc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			desc.SampleDesc.Count = 1;
+			desc.SampleDesc.Quality = 0;
+			desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+			desc.BufferCount = m_FrameCount;
+			desc.OutputWindow = m_WindowHandle;
+			desc.Windowed = TRUE;
+			desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+			desc.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+
+			result = factory->CreateSwapChain(m_Queue.get(), &desc, &swapChain);
+			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+
+			IDXGISwapChain3* swapChain_;
+			result = swapChain->QueryInterface(IID_PPV_ARGS(&swapChain_));
+			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+			m_SwapChain.reset(swapChain_);
+		}
+		catch (exception e) {
+			if (factory != nullptr) { factory->Release(); }
+			if (swapChain != nullptr) { swapChain->Release(); }
+			throw exception(e.what());
+		}
+		if (factory != nullptr) { factory->Release(); }
+		if (swapChain != nullptr) { swapChain->Release(); }
+	}
+
+	// レンダーターゲットビュー
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC desc = {};
+		desc.NumDescriptors = m_HeapRTVSize;
+		desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+		desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+		desc.NodeMask = 0;
+
+		ID3D12DescriptorHeap* heap = nullptr;
+		result = m_Device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&heap));
+		Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+		m_HeapRTV.reset(heap);
+		m_AllocatorRTV = make_unique<DescriptorAllocator>(m_HeapRTVSize);
+
+		D3D12_CPU_DESCRIPTOR_HANDLE start = m_HeapRTV->GetCPUDescriptorHandleForHeapStart();
+		uint32_t incrementSize = m_Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+
+		for (uint32_t i = 0; i < m_FrameCount; ++i) {
+			ID3D12Resource* buffer = nullptr;
+			result = m_SwapChain->GetBuffer(i, IID_PPV_ARGS(&buffer));
+			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+			m_BackBuffers.push_back(AddResource(buffer));
+
+			D3D12_RENDER_TARGET_VIEW_DESC viewDesc = {};
+			viewDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+			viewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+			viewDesc.Texture2D.MipSlice = 0;
+			viewDesc.Texture2D.PlaneSlice = 0;
+
+			DESCRIPTOR_RANGE range = {};
+			Assert(!m_AllocatorRTV->Allocate(1, &range), __FILE__, __LINE__, "レンダーターゲットビューのヒープの容量が不足しています。");
+
+			D3D12_CPU_DESCRIPTOR_HANDLE handle = start;
+			handle.ptr += static_cast<unsigned long long>(incrementSize) * range.Index;
+			m_Device->CreateRenderTargetView(buffer, &viewDesc, handle);
+
+			m_HandleRTV.push_back(handle);
+		}
+	}
+
+	// フェンス
+	{
+		ID3D12Fence* fence = nullptr;
+		result = m_Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence));
+		Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+		m_Fence.reset(fence);
+
+		m_FenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		Assert(m_FenceEvent == nullptr, __FILE__, __LINE__, "フェンスイベントの生成に失敗しました。");
+	}
+}
+
+// ウィンドウを削除
+void D3D12Backend::DeleteWindow() {
+	if (m_InstanceHandle) { UnregisterClass(m_ClassName, m_InstanceHandle); }
+	m_InstanceHandle = nullptr;
+	m_WindowHandle = nullptr;
+}
+
+// リソースを登録
+RESOURCE_HANDLE D3D12Backend::AddResource(ID3D12Resource* resource) {
+	m_Resources.emplace_back(resource);
+	return static_cast<RESOURCE_HANDLE>(m_Resources.size() - 1);
+}
+
+// バックバッファのレンダーターゲットビューを取得
+D3D12_CPU_DESCRIPTOR_HANDLE D3D12Backend::GetRenderTargetView(RESOURCE_HANDLE renderTarget) const {
+	for (size_t i = 0; i < m_BackBuffers.size(); ++i) {
+		if (m_BackBuffers[i] == renderTarget) { return m_HandleRTV[i]; }
+	}
+	return D3D12_CPU_DESCRIPTOR_HANDLE{ 0 };
+}
+
+// シェーダーのバイトコードを読む (同じファイルは一度だけ読む)
+ID3DBlob* D3D12Backend::LoadShader(const wchar_t* path) {
+
+	auto it = m_ShaderBlobs.find(path);
+	if (it != m_ShaderBlobs.end()) { return it->second.get(); }
+
+	ID3DBlob* blob = nullptr;
+	HRESULT result = D3DReadFileToBlob(path, &blob);
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+
+	m_ShaderBlobs.emplace(path, blob);
+	return blob;
+}
+
+// 初期化
+void D3D12Backend::Initialize(const BACKEND_DESC& desc) {
+	m_ClassName = desc.ClassName;
+	m_WindowName = desc.WindowName;
+	m_WindowWidth = desc.Width;
+	m_WindowHeight = desc.Height;
+	m_FrameCount = desc.FrameCount;
+	m_FrameLatency = desc.FrameLatency;
+	m_PipelineCache = desc.PipelineStateCache;
+
+	CreateWindow();
+	CreateInterface();
+}
+
+// 終了処理
+void D3D12Backend::Terminate() {
+	if (m_FenceEvent != nullptr) { CloseHandle(m_FenceEvent); }
+	m_FenceEvent = nullptr;
+	DeleteWindow();
+}
+
+// メッセージを 1 つ処理する
+bool D3D12Backend::ProcessMessage(bool* quit) {
+	MSG msg = {};
+	if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+		*quit = msg.message == WM_QUIT;
+		return true;
+	}
+	*quit = false;
+	return false;
+}
+
+// バッファを作成
+RESOURCE_HANDLE D3D12Backend::CreateBuffer(HEAP_TYPE heapType, uint64_t size, RESOURCE_STATE initialState) {
+	PROFILE_ZONE("D3D12Backend::CreateBuffer");
+
+	HRESULT result;
+
+	D3D12_HEAP_PROPERTIES prop = {};
+	prop.Type = heapType == HEAP_TYPE::UPLOAD ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT;
+	prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	prop.CreationNodeMask = 1;
+	prop.VisibleNodeMask = 1;
+
+	D3D12_RESOURCE_DESC desc = {};
+	desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	desc.Alignment = 0;
+	desc.Width = size;
+	desc.Height = 1;
+	desc.DepthOrArraySize = 1;
+	desc.MipLevels = 1;
+	desc.Format = DXGI_FORMAT_UNKNOWN;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	ID3D12Resource* buffer = nullptr;
+	result = m_Device->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &desc, ToD3D12(initialState), nullptr, IID_PPV_ARGS(&buffer));
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+	return AddResource(buffer);
+}
+
+// バッファをマップ (アンマップはせず、解放まで CPU から書き込める)
+void* D3D12Backend::Map(RESOURCE_HANDLE resource) {
+
+	HRESULT result;
+
+	void* data = nullptr;
+	D3D12_RANGE readRange = { 0, 0 };
+	result = m_Resources[resource]->Map(0, &readRange, &data);
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+	return data;
+}
+
+// GPU 上のアドレスを取得
+GPU_ADDRESS D3D12Backend::GetGPUVirtualAddress(RESOURCE_HANDLE resource) {
+	return m_Resources[resource]->GetGPUVirtualAddress();
+}
+
+// リソースを解放 (ハンドルは使い回さないので空のまま残す)
+void D3D12Backend::ReleaseResource(RESOURCE_HANDLE resource) {
+	m_Resources[resource].reset();
+}
+
+// ディスクリプタヒープを作成
+DESCRIPTOR_HEAP_HANDLE D3D12Backend::CreateDescriptorHeap(DESCRIPTOR_HEAP_TYPE type, uint32_t num, bool shaderVisible) {
+	PROFILE_ZONE("D3D12Backend::CreateDescriptorHeap");
+
+	HRESULT result;
+
+	D3D12_DESCRIPTOR_HEAP_DESC desc = {};
+	desc.Type = ToD3D12(type);
+	desc.NumDescriptors = num;
+	desc.Flags = shaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	desc.NodeMask = 0;
+
+	ID3D12DescriptorHeap* heap = nullptr;
+	result = m_Device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&heap));
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+
+	m_DescriptorHeaps.emplace_back(heap);
+	return static_cast<DESCRIPTOR_HEAP_HANDLE>(m_DescriptorHeaps.size() - 1);
+}
+
+// 定数バッファビューを作成
+void D3D12Backend::CreateConstantBufferView(DESCRIPTOR_HEAP_HANDLE heap, uint32_t index, GPU_ADDRESS address, uint32_t size) {
+
+	UINT incrSize = m_Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = m_DescriptorHeaps[heap]->GetCPUDescriptorHandleForHeapStart();
+	cpuHandle.ptr += static_cast<unsigned long long>(incrSize) * index;
+
+	D3D12_CONSTANT_BUFFER_VIEW_DESC desc = {};
+	desc.BufferLocation = address;
+	desc.SizeInBytes = size;
+
+	m_Device->CreateConstantBufferView(&desc, cpuHandle);
+}
+
+// ルートシグニチャを作成
+ROOT_SIGNATURE_HANDLE D3D12Backend::CreateRootSignature(const ROOT_SIGNATURE_DESC& rootDesc) {
+	PROFILE_ZONE("D3D12Backend::CreateRootSignature");
+
+	HRESULT result;
+
+	auto flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+	flags |= D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS;
+	flags |= D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS;
+	flags |= D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
+
+	vector<D3D12_ROOT_PARAMETER> params(rootDesc.ParameterNum);
+	for (uint32_t i = 0; i < rootDesc.ParameterNum; ++i) {
+		params[i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+		params[i].Descriptor.ShaderRegister = rootDesc.Parameters[i].ShaderRegister;
+		params[i].Descriptor.RegisterSpace = 0;
+		params[i].ShaderVisibility = rootDesc.Parameters[i].VertexOnly ? D3D12_SHADER_VISIBILITY_VERTEX : D3D12_SHADER_VISIBILITY_ALL;
+	}
+
+	D3D12_ROOT_SIGNATURE_DESC desc = {};
+	desc.NumParameters = rootDesc.ParameterNum;
+	desc.NumStaticSamplers = 0;
+	desc.pParameters = params.data();
+	desc.pStaticSamplers = nullptr;
+	desc.Flags = flags;
+
+	PipelineHash backendKey;
+	backendKey.AddString("D3D12");
+	backendKey.AddValue(flags);
+	uint64_t key = PipelineCache::ComputeRootSignatureKey(rootDesc, backendKey.GetValue());
+
+	// キャッシュにあればシリアライズし直さない
+	ID3D12RootSignature* rootSignature = nullptr;
+	const void* cached = nullptr;
+	size_t cachedSize = 0;
+	if (m_PipelineCache != nullptr && m_PipelineCache->Find(key, &cached, &cachedSize)) {
+		result = m_Device->CreateRootSignature(0, cached, cachedSize, IID_PPV_ARGS(&rootSignature));
+		if (FAILED(result)) {
+			m_PipelineCache->Reject(key);
+			rootSignature = nullptr;
+		}
+	}
+
+	if (rootSignature == nullptr) {
+		ID3DBlob *blob = nullptr, *errorBlob = nullptr;
+		result = D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1_0, &blob, &errorBlob);
+		Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+
+		result = m_Device->CreateRootSignature(0, blob->GetBufferPointer(), blob->GetBufferSize(), IID_PPV_ARGS(&rootSignature));
+		if (SUCCEEDED(result) && m_PipelineCache != nullptr) { m_PipelineCache->Store(key, blob->GetBufferPointer(), blob->GetBufferSize()); }
+		blob->Release();
+		Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+	}
+
+	m_RootSignatures.emplace_back(rootSignature);
+	m_RootSignatureKeys.push_back(key);
+	return static_cast<ROOT_SIGNATURE_HANDLE>(m_RootSignatures.size() - 1);
+}
+
+// パイプラインステートを作成
+PIPELINE_HANDLE D3D12Backend::CreatePipelineState(const PIPELINE_DESC& pipelineDesc) {
+	PROFILE_ZONE("D3D12Backend::CreatePipelineState");
+
+	HRESULT result;
+
+	vector<D3D12_INPUT_ELEMENT_DESC> elements(pipelineDesc.InputElementNum);
+	for (uint32_t i = 0; i < pipelineDesc.InputElementNum; ++i) {
+		const INPUT_ELEMENT_DESC& element = pipelineDesc.InputElements[i];
+		elements[i].SemanticName = element.SemanticName;
+		elements[i].SemanticIndex = element.SemanticIndex;
+		elements[i].Format = ToD3D12(element.Format);
+		elements[i].InputSlot = element.InputSlot;
+		elements[i].AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
+		elements[i].InputSlotClass = element.InputSlotClass == INPUT_CLASSIFICATION::PER_INSTANCE_DATA ? D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA : D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
+		elements[i].InstanceDataStepRate = element.InstanceDataStepRate;
+	}
+
+	D3D12_RASTERIZER_DESC descRS = {};
+	descRS.FillMode = D3D12_FILL_MODE_SOLID;
+	descRS.CullMode = D3D12_CULL_MODE_NONE;
+	descRS.FrontCounterClockwise = FALSE;
+	descRS.DepthBias = D3D12_DEFAULT_DEPTH_BIAS;
+	descRS.DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
+	descRS.SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
+	descRS.DepthClipEnable = FALSE;
+	descRS.MultisampleEnable = FALSE;
+	descRS.AntialiasedLineEnable = FALSE;
+	descRS.ForcedSampleCount = 0;
+	descRS.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
+
+	D3D12_RENDER_TARGET_BLEND_DESC descRTBS = {};
+	descRTBS.BlendEnable = FALSE;
+	descRTBS.LogicOpEnable = FALSE;
+	descRTBS.SrcBlend = D3D12_BLEND_ONE;
+	descRTBS.DestBlend = D3D12_BLEND_ZERO;
+	descRTBS.BlendOp = D3D12_BLEND_OP_ADD;
+	descRTBS.SrcBlendAlpha = D3D12_BLEND_ONE;
+	descRTBS.DestBlendAlpha = D3D12_BLEND_ZERO;
+	descRTBS.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+	descRTBS.LogicOp = D3D12_LOGIC_OP_NOOP;
+	descRTBS.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+
+	D3D12_BLEND_DESC descBS = {};
+	descBS.AlphaToCoverageEnable = FALSE;
+	descBS.IndependentBlendEnable = FALSE;
+	for (int i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i) {
+		descBS.RenderTarget[i] = descRTBS;
+	}
+
+	ID3DBlob* vsBlob = LoadShader(pipelineDesc.VertexShader);
+	ID3DBlob* psBlob = LoadShader(pipelineDesc.PixelShader);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = {};
+	desc.InputLayout = { elements.data(), static_cast<UINT>(elements.size()) };
+	desc.pRootSignature = m_RootSignatures[pipelineDesc.RootSignature].get();
+	desc.VS = { vsBlob->GetBufferPointer(), vsBlob->GetBufferSize() };
+	desc.PS = { psBlob->GetBufferPointer(), psBlob->GetBufferSize() };
+	desc.RasterizerState = descRS;
+	desc.BlendState = descBS;
+	desc.DepthStencilState.DepthEnable = FALSE;
+	desc.DepthStencilState.StencilEnable = FALSE;
+	desc.SampleMask = UINT_MAX;
+	desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	desc.NumRenderTargets = 1;
+	desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+	desc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+
+	// キャッシュにあればドライバーがコンパイルしたものを渡す
+	uint64_t key = 0;
+	if (m_PipelineCache != nullptr) {
+		key = PipelineCache::ComputePipelineKey(pipelineDesc, m_RootSignatureKeys[pipelineDesc.RootSignature],
+			vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), psBlob->GetBufferPointer(), psBlob->GetBufferSize(), ComputeBackendKey(desc));
+
+		const void* cached = nullptr;
+		size_t cachedSize = 0;
+		if (m_PipelineCache->Find(key, &cached, &cachedSize)) { desc.CachedPSO = { cached, cachedSize }; }
+	}
+
+	ID3D12PipelineState* pipelineState = nullptr;
+	result = m_Device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pipelineState));
+
+	// ドライバーやアダプタが変わっていると受け付けられないので、捨てて作り直す
+	if (FAILED(result) && desc.CachedPSO.pCachedBlob != nullptr) {
+		m_PipelineCache->Reject(key);
+		desc.CachedPSO = {};
+		result = m_Device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pipelineState));
+	}
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+
+	// 新しく作ったものはキャッシュに格納する
+	if (m_PipelineCache != nullptr && desc.CachedPSO.pCachedBlob == nullptr) {
+		ID3DBlob* blob = nullptr;
+		if (SUCCEEDED(pipelineState->GetCachedBlob(&blob))) {
+			m_PipelineCache->Store(key, blob->GetBufferPointer(), blob->GetBufferSize());
+			blob->Release();
+		}
+	}
+
+	m_PipelineStates.emplace_back(pipelineState);
+	return static_cast<PIPELINE_HANDLE>(m_PipelineStates.size() - 1);
+}
+
+// コマンドリストを作成
+unique_ptr<CommandList> D3D12Backend::CreateCommandList() {
+	return make_unique<D3D12CommandList>(this);
+}
+
+// コマンドリストを実行
+void D3D12Backend::ExecuteCommandLists(uint32_t num, CommandList* const* lists) {
+	vector<ID3D12CommandList*> commandLists(num);
+	for (uint32_t i = 0; i < num; ++i) {
+		commandLists[i] = static_cast<D3D12CommandList*>(lists[i])->m_CommandList.get();
+	}
+	m_Queue->ExecuteCommandLists(num, commandLists.data());
+}
+
+// バックバッファを取得
+RESOURCE_HANDLE D3D12Backend::GetBackBuffer(uint32_t index) { return m_BackBuffers[index]; }
+
+// 現在のバックバッファの番号を取得
+uint32_t D3D12Backend::GetCurrentBackBufferIndex() { return m_SwapChain->GetCurrentBackBufferIndex(); }
+
+// 表示
+void D3D12Backend::Present() {
+	PROFILE_ZONE("D3D12Backend::Present");
+	HRESULT result;
+	result = m_SwapChain->Present(1, 0);
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+}
+
+// フェンスに値を書き込む
+void D3D12Backend::Signal(uint64_t value) {
+	HRESULT result;
+	result = m_Queue->Signal(m_Fence.get(), value);
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+}
+
+// 完了したフェンス値を取得
+uint64_t D3D12Backend::GetCompletedValue() { return m_Fence->GetCompletedValue(); }
+
+// フェンス値を待つ
+void D3D12Backend::WaitForValue(uint64_t value) {
+	PROFILE_ZONE("D3D12Backend::WaitForValue");
+	HRESULT result;
+	if (m_Fence->GetCompletedValue() >= value) { return; }
+	result = m_Fence->SetEventOnCompletion(value, m_FenceEvent);
+	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+	WaitForSingleObjectEx(m_FenceEvent, INFINITE, FALSE);
+}
+
+#endif
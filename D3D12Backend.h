@@ -0,0 +1,175 @@
+﻿#pragma once
+
+#if defined(_WIN32)
+
+#include <cassert>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+#include <Windows.h>
+#include <d3d12.h>
+#include <d3dcompiler.h>
+#include <dxgi1_4.h>
+
+#include "DescriptorAllocator.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "RenderBackend.h"
+
+#pragma comment(lib, "d3d12.lib")
+#pragma comment(lib, "d3dcompiler.lib")
+#pragma comment(lib, "dxgi.lib")
+#pragma commend(lib, "dxguid.lib")
+
+#undef CreateWindow
+
+using namespace std;
+
+// COMデリータ
+class UComDeleter {
+public:
+	void operator()(IUnknown* ptr) const {
+		if (ptr) { ptr->Release(); }
+	}
+};
+
+// ユニークなCOMポインタ
+template <typename T>
+using unique_com_ptr = unique_ptr<T, UComDeleter>;
+
+class D3D12Backend;
+
+// D3D12 のコマンドリスト
+class D3D12CommandList : public CommandList {
+
+	friend class D3D12Backend;
+
+private:
+	D3D12Backend* m_Backend;
+	vector<unique_com_ptr<ID3D12CommandAllocator>> m_CommandAllocator;
+	unique_com_ptr<ID3D12GraphicsCommandList> m_CommandList;
+
+public:
+	D3D12CommandList(D3D12Backend* backend);
+
+	void Reset(uint32_t frameIndex) override;
+	void Close() override;
+
+	void ResourceBarrier(uint32_t num, const RESOURCE_BARRIER* barriers) override;
+	void CopyBufferRegion(RESOURCE_HANDLE dest, uint64_t destOffset, RESOURCE_HANDLE src, uint64_t srcOffset, uint64_t size) override;
+
+	void OMSetRenderTarget(RESOURCE_HANDLE renderTarget) override;
+	void ClearRenderTargetView(RESOURCE_HANDLE renderTarget, const float color[4]) override;
+
+	void SetGraphicsRootSignature(ROOT_SIGNATURE_HANDLE rootSignature) override;
+	void SetDescriptorHeaps(uint32_t num, const DESCRIPTOR_HEAP_HANDLE* heaps) override;
+	void SetGraphicsRootConstantBufferView(uint32_t parameterIndex, GPU_ADDRESS address) override;
+	void SetPipelineState(PIPELINE_HANDLE pipelineState) override;
+
+	void IASetPrimitiveTopology(PRIMITIVE_TOPOLOGY topology) override;
+	void IASetVertexBuffers(uint32_t startSlot, uint32_t num, const VERTEX_BUFFER_VIEW* views) override;
+	void IASetIndexBuffer(const INDEX_BUFFER_VIEW* view) override;
+	void RSSetViewports(uint32_t num, const VIEWPORT* viewports) override;
+	void RSSetScissorRects(uint32_t num, const SCISSOR_RECT* rects) override;
+
+	void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) override;
+};
+
+// D3D12 の描画バックエンド
+class D3D12Backend : public RenderBackend {
+
+	friend class D3D12CommandList;
+
+// メンバ変数
+private:
+	// ウィンドウ関連
+	HINSTANCE m_InstanceHandle;
+	HWND m_WindowHandle;
+	LPCWCHAR m_ClassName;
+	LPCWCHAR m_WindowName;
+	uint32_t m_WindowWidth;
+	uint32_t m_WindowHeight;
+	uint32_t m_FrameCount;
+	uint32_t m_FrameLatency;
+
+	// デバッグレイヤー
+#if defined(DEBUG) || defined(_DEBUG)
+	unique_com_ptr<ID3D12Debug> m_Debug;
+#endif
+
+	// 描画デバイス
+	unique_com_ptr<ID3D12Device> m_Device;
+	unique_com_ptr<ID3D12CommandQueue> m_Queue;
+	unique_com_ptr<IDXGISwapChain3> m_SwapChain;
+
+	// リソース (ハンドルが添え字)
+	vector<unique_com_ptr<ID3D12Resource>> m_Resources;
+	vector<unique_com_ptr<ID3D12RootSignature>> m_RootSignatures;
+	vector<unique_com_ptr<ID3D12PipelineState>> m_PipelineStates;
+	vector<unique_com_ptr<ID3D12DescriptorHeap>> m_DescriptorHeaps;
+
+	// パイプラインキャッシュ (ルートシグニチャごとのキーを覚えておき、パイプラインのキーに混ぜる)
+	PipelineCache* m_PipelineCache;
+	vector<uint64_t> m_RootSignatureKeys;
+
+	// 読み込んだシェーダーのバイトコード (同じファイルは一度だけ読む)
+	unordered_map<wstring, unique_com_ptr<ID3DBlob>> m_ShaderBlobs;
+
+	// バックバッファとレンダーターゲットビュー (RTV のヒープは CPU 専用なので永続領域だけで割り当てる)
+	static const uint32_t m_HeapRTVSize = 64;
+	vector<RESOURCE_HANDLE> m_BackBuffers;
+	unique_com_ptr<ID3D12DescriptorHeap> m_HeapRTV;
+	unique_ptr<DescriptorAllocator> m_AllocatorRTV;
+	vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_HandleRTV;
+
+	// フェンス
+	unique_com_ptr<ID3D12Fence> m_Fence;
+	HANDLE m_FenceEvent;
+
+// メソッド
+private:
+	void CreateWindow();
+	void CreateInterface();
+	void DeleteWindow();
+	RESOURCE_HANDLE AddResource(ID3D12Resource* resource);
+	D3D12_CPU_DESCRIPTOR_HANDLE GetRenderTargetView(RESOURCE_HANDLE renderTarget) const;
+	ID3DBlob* LoadShader(const wchar_t* path);
+
+public:
+	D3D12Backend();
+	~D3D12Backend() = default;
+
+	void Initialize(const BACKEND_DESC& desc) override;
+	void Terminate() override;
+	bool ProcessMessage(bool* quit) override;
+
+	RESOURCE_HANDLE CreateBuffer(HEAP_TYPE heapType, uint64_t size, RESOURCE_STATE initialState) override;
+	void* Map(RESOURCE_HANDLE resource) override;
+	GPU_ADDRESS GetGPUVirtualAddress(RESOURCE_HANDLE resource) override;
+	void ReleaseResource(RESOURCE_HANDLE resource) override;
+
+	DESCRIPTOR_HEAP_HANDLE CreateDescriptorHeap(DESCRIPTOR_HEAP_TYPE type, uint32_t num, bool shaderVisible) override;
+	void CreateConstantBufferView(DESCRIPTOR_HEAP_HANDLE heap, uint32_t index, GPU_ADDRESS address, uint32_t size) override;
+
+	ROOT_SIGNATURE_HANDLE CreateRootSignature(const ROOT_SIGNATURE_DESC& desc) override;
+	PIPELINE_HANDLE CreatePipelineState(const PIPELINE_DESC& desc) override;
+
+	unique_ptr<CommandList> CreateCommandList() override;
+	void ExecuteCommandLists(uint32_t num, CommandList* const* lists) override;
+
+	RESOURCE_HANDLE GetBackBuffer(uint32_t index) override;
+	uint32_t GetCurrentBackBufferIndex() override;
+	void Present() override;
+
+	void Signal(uint64_t value) override;
+	uint64_t GetCompletedValue() override;
+	void WaitForValue(uint64_t value) override;
+};
+
+#endif
@@ -0,0 +1,252 @@
+﻿#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+// 空きブロックの先頭ではない
+static const uint8_t DESCRIPTOR_NOT_FREE = 0xFF;
+
+// 空きリストの終端
+static const uint32_t DESCRIPTOR_NONE = UINT32_MAX;
+
+// num 個を収める最小のブロックの大きさ (2 の何乗か)
+static uint32_t GetOrder(uint32_t num) {
+	return static_cast<uint32_t>(bit_width(num - 1));
+}
+
+// コンストラクタ
+DescriptorAllocator::DescriptorAllocator(uint32_t capacity, uint32_t frameCapacity):
+	m_Capacity(capacity),
+	m_PersistentCapacity(capacity - min(frameCapacity, capacity)),
+	m_FreeOrder(),
+	m_FreeNext(),
+	m_FreePrev(),
+	m_FreeHeads(),
+	m_FreeMask(0),
+	m_PersistentUsed(0),
+	m_PersistentAllocations(0),
+	m_FrameCapacity(min(frameCapacity, capacity)),
+	m_Head(0),
+	m_Tail(0),
+	m_Frames(),
+	m_FrameDescriptors(0),
+	m_LastFrameDescriptors(0),
+	m_StallCount(0),
+	m_FailedCount(0) {
+
+	m_FreeOrder.resize(m_PersistentCapacity, DESCRIPTOR_NOT_FREE);
+	m_FreeNext.resize(m_PersistentCapacity, DESCRIPTOR_NONE);
+	m_FreePrev.resize(m_PersistentCapacity, DESCRIPTOR_NONE);
+	fill(begin(m_FreeHeads), end(m_FreeHeads), DESCRIPTOR_NONE);
+
+	// 永続領域を、先頭の番号がその大きさで揃う 2 のべき乗のブロックに分けて空きリストに入れる
+	uint32_t index = 0;
+	while (index < m_PersistentCapacity) {
+		uint32_t alignOrder = index == 0 ? m_OrderNum - 1 : static_cast<uint32_t>(countr_zero(index));
+		uint32_t sizeOrder = static_cast<uint32_t>(bit_width(m_PersistentCapacity - index)) - 1;
+		uint32_t order = min(alignOrder, sizeOrder);
+		PushFree(index, order);
+		index += 1u << order;
+	}
+}
+
+// 空きリストに入れる
+void DescriptorAllocator::PushFree(uint32_t index, uint32_t order) {
+	m_FreeOrder[index] = static_cast<uint8_t>(order);
+	m_FreePrev[index] = DESCRIPTOR_NONE;
+	m_FreeNext[index] = m_FreeHeads[order];
+	if (m_FreeHeads[order] != DESCRIPTOR_NONE) { m_FreePrev[m_FreeHeads[order]] = index; }
+	m_FreeHeads[order] = index;
+	m_FreeMask |= 1u << order;
+}
+
+// 空きリストから外す
+void DescriptorAllocator::RemoveFree(uint32_t index, uint32_t order) {
+	uint32_t prev = m_FreePrev[index];
+	uint32_t next = m_FreeNext[index];
+	if (prev != DESCRIPTOR_NONE) { m_FreeNext[prev] = next; }
+	else { m_FreeHeads[order] = next; }
+	if (next != DESCRIPTOR_NONE) { m_FreePrev[next] = prev; }
+
+	m_FreeOrder[index] = DESCRIPTOR_NOT_FREE;
+	if (m_FreeHeads[order] == DESCRIPTOR_NONE) { m_FreeMask &= ~(1u << order); }
+}
+
+// 永続領域から割り当てる
+bool DescriptorAllocator::Allocate(uint32_t num, DESCRIPTOR_RANGE* range) {
+
+	if (num == 0 || num > m_PersistentCapacity) {
+		++m_FailedCount;
+		return false;
+	}
+
+	// 空きのある大きさのうち、収まる最小のものを選ぶ
+	uint32_t order = GetOrder(num);
+	uint32_t candidates = order < m_OrderNum ? m_FreeMask & ~((1u << order) - 1) : 0;
+	if (candidates == 0) {
+		++m_FailedCount;
+		return false;
+	}
+	uint32_t found = static_cast<uint32_t>(countr_zero(candidates));
+	uint32_t index = m_FreeHeads[found];
+	RemoveFree(index, found);
+
+	// 余った後ろ半分を空きリストに戻しながら半分にしていく
+	while (found > order) {
+		--found;
+		PushFree(index + (1u << found), found);
+	}
+
+	m_PersistentUsed += 1u << order;
+	++m_PersistentAllocations;
+
+	range->Index = index;
+	range->Num = num;
+	return true;
+}
+
+// 永続領域に返す
+void DescriptorAllocator::Free(const DESCRIPTOR_RANGE& range) {
+
+	if (range.Num == 0 || range.Index >= m_PersistentCapacity) { return; }
+
+	uint32_t order = GetOrder(range.Num);
+	uint32_t index = range.Index;
+	m_PersistentUsed -= 1u << order;
+	--m_PersistentAllocations;
+
+	// 相方のブロックが同じ大きさで空いている間はまとめる
+	while (order + 1 < m_OrderNum) {
+		uint32_t buddy = index ^ (1u << order);
+		if (buddy >= m_PersistentCapacity || m_PersistentCapacity - buddy < (1u << order)) { break; }
+		if (m_FreeOrder[buddy] != order) { break; }
+		RemoveFree(buddy, order);
+		index = min(index, buddy);
+		++order;
+	}
+
+	PushFree(index, order);
+}
+
+// 線形領域から今フレームの分を割り当てる
+bool DescriptorAllocator::AllocateFrame(uint32_t num, DESCRIPTOR_RANGE* range) {
+
+	if (num == 0 || num > m_FrameCapacity) {
+		++m_FailedCount;
+		return false;
+	}
+
+	// 末尾をまたぐ場合は残りを捨てて先頭から割り当てる (ディスクリプタテーブルは連続している必要がある)
+	uint32_t offset = static_cast<uint32_t>(m_Head % m_FrameCapacity);
+	uint64_t head = m_Head + num;
+	if (offset + num > m_FrameCapacity) {
+		head = m_Head + (m_FrameCapacity - offset) + num;
+		offset = 0;
+	}
+
+	// GPU で使用中の範囲に追いついた
+	if (head - m_Tail > m_FrameCapacity) {
+		if (!m_Frames.empty()) { ++m_StallCount; }
+		else { ++m_FailedCount; }
+		return false;
+	}
+
+	m_Head = head;
+	m_FrameDescriptors += num;
+
+	range->Index = m_PersistentCapacity + offset;
+	range->Num = num;
+	return true;
+}
+
+// 今フレームの割り当てをフェンス値に結びつける
+void DescriptorAllocator::FinishFrame(uint64_t fenceValue) {
+	m_Frames.push_back({ fenceValue, m_Head });
+	m_LastFrameDescriptors = m_FrameDescriptors;
+	m_FrameDescriptors = 0;
+}
+
+// 完了したフェンス値までの線形領域を回収する
+void DescriptorAllocator::Retire(uint64_t completedFenceValue) {
+	while (!m_Frames.empty() && m_Frames.front().FenceValue <= completedFenceValue) {
+		m_Tail = m_Frames.front().End;
+		m_Frames.pop_front();
+	}
+}
+
+// 回収待ちのうち最も古いフェンス値
+uint64_t DescriptorAllocator::GetOldestFenceValue() const {
+	return m_Frames.empty() ? 0 : m_Frames.front().FenceValue;
+}
+
+// 容量を取得
+uint32_t DescriptorAllocator::GetCapacity() const { return m_Capacity; }
+
+// 統計情報を取得
+DESCRIPTOR_STATISTICS DescriptorAllocator::GetStatistics() const {
+	DESCRIPTOR_STATISTICS statistics = {};
+	statistics.Capacity = m_Capacity;
+	statistics.PersistentCapacity = m_PersistentCapacity;
+	statistics.PersistentUsed = m_PersistentUsed;
+	statistics.PersistentAllocations = m_PersistentAllocations;
+	statistics.LargestFreeBlock = m_FreeMask != 0 ? 1u << (bit_width(m_FreeMask) - 1) : 0;
+	uint32_t freeNum = m_PersistentCapacity - m_PersistentUsed;
+	statistics.Fragmentation = freeNum > 0 ? 1.0f - static_cast<float>(statistics.LargestFreeBlock) / static_cast<float>(freeNum) : 0.0f;
+	statistics.FrameCapacity = m_FrameCapacity;
+	statistics.FrameInFlight = static_cast<uint32_t>(m_Head - m_Tail);
+	statistics.LastFrameDescriptors = m_LastFrameDescriptors;
+	statistics.StallCount = m_StallCount;
+	statistics.FailedCount = m_FailedCount;
+	return statistics;
+}
+
+// 割り当てと解放の時間を計測して出力する
+void DescriptorAllocator::RunBenchmark(uint32_t num) {
+
+	const uint32_t churnNum = 1000000;
+	const uint32_t frameNum = 240;
+	const uint32_t frameLatency = 3;
+	num = max(num, 1u);
+
+	// 1 〜 8 個のビューを num 個持ち続けながら、ランダムに 1 つ解放して割り当て直す
+	// 割り当てに失敗した範囲は無効なまま残るので、解放せずに割り当てだけをやり直す
+	DescriptorAllocator allocator(num * 16 + num * 8 * frameLatency, num * 8 * frameLatency);
+	mt19937 random(1);
+	uniform_int_distribution<uint32_t> sizes(1, 8);
+	vector<DESCRIPTOR_RANGE> live(num);
+	for (DESCRIPTOR_RANGE& range : live) { allocator.Allocate(sizes(random), &range); }
+
+	auto begin = chrono::steady_clock::now();
+	for (uint32_t i = 0; i < churnNum; ++i) {
+		DESCRIPTOR_RANGE& range = live[random() % num];
+		if (range.Num > 0) { allocator.Free(range); }
+		if (!allocator.Allocate(sizes(random), &range)) { range = {}; }
+	}
+	double churnTime = chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count();
+	DESCRIPTOR_STATISTICS persistent = allocator.GetStatistics();
+
+	// フレームごとに 1 〜 8 個のテーブルを num 個割り当て、frameLatency フレーム前の分が終わったことにして回収する
+	uint64_t frameAllocations = 0;
+	begin = chrono::steady_clock::now();
+	for (uint64_t frame = 1; frame <= frameNum; ++frame) {
+		if (frame > frameLatency) { allocator.Retire(frame - frameLatency); }
+		DESCRIPTOR_RANGE range = {};
+		for (uint32_t i = 0; i < num; ++i) {
+			if (allocator.AllocateFrame(sizes(random), &range)) { ++frameAllocations; }
+		}
+		allocator.FinishFrame(frame);
+	}
+	double frameTime = chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count();
+	DESCRIPTOR_STATISTICS frame = allocator.GetStatistics();
+
+	cout << "live allocations : " << persistent.PersistentAllocations << endl;
+	cout << "persistent free + allocate : " << churnTime / churnNum << " ns" << endl;
+	cout << "persistent occupancy : " << persistent.PersistentUsed << " / " << persistent.PersistentCapacity << " (" << 100.0 * persistent.PersistentUsed / persistent.PersistentCapacity << " %)" << endl;
+	cout << "persistent fragmentation : " << persistent.Fragmentation * 100.0f << " % (largest free block " << persistent.LargestFreeBlock << ")" << endl;
+	cout << "frame allocate : " << frameTime / max<uint64_t>(frameAllocations, 1) << " ns" << endl;
+	cout << "frame descriptors : " << frame.LastFrameDescriptors << " / frame (" << frame.FrameInFlight << " / " << frame.FrameCapacity << " in flight)" << endl;
+	cout << "stalls : " << frame.StallCount << ", failed : " << frame.FailedCount << endl;
+}
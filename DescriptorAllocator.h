@@ -0,0 +1,102 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+// ディスクリプタの範囲 (ヒープ先頭からの番号と個数)
+struct DESCRIPTOR_RANGE {
+	uint32_t Index;
+	uint32_t Num;
+};
+
+// ディスクリプタの割り当ての統計情報
+struct DESCRIPTOR_STATISTICS {
+	uint32_t Capacity;
+	uint32_t PersistentCapacity;
+	uint32_t PersistentUsed;       // 2 のべき乗に切り上げた個数の合計
+	uint32_t PersistentAllocations;
+	uint32_t LargestFreeBlock;
+	float Fragmentation;           // 1 - 最大の空きブロック / 空きの合計
+	uint32_t FrameCapacity;
+	uint32_t FrameInFlight;        // GPU で使用中のフレームの分も含めた使用量
+	uint32_t LastFrameDescriptors;
+	uint64_t StallCount;
+	uint64_t FailedCount;
+};
+
+// ディスクリプタアロケータ
+// 1 つのヒープを、長く使うビュー用の永続領域 (先頭) と、フレームごとに使い捨てる線形領域 (末尾) に分けて管理する
+// 永続領域はバディ方式で、大きさごとの空きリストと空きのある大きさのビットマスクで割り当ても解放も定数時間で済ませる
+// 線形領域はフレーム末尾で記録したフェンス値が完了した時点で回収する (UploadRingAllocator と同じ)
+// ヒープの実体には触れないので、シェーダーから見えるヒープにも RTV / DSV の CPU 専用のヒープにも使える
+class DescriptorAllocator {
+
+private:
+	static const uint32_t m_OrderNum = 32;
+
+	// フレームごとの使用範囲
+	struct FRAME_RANGE {
+		uint64_t FenceValue;
+		uint64_t End;
+	};
+
+	uint32_t m_Capacity;
+
+	// 永続領域 (ブロックの先頭の番号で引く空きリスト)
+	uint32_t m_PersistentCapacity;
+	vector<uint8_t> m_FreeOrder;  // 空きブロックの先頭なら大きさ (2 の何乗か)、そうでなければ 0xFF
+	vector<uint32_t> m_FreeNext;
+	vector<uint32_t> m_FreePrev;
+	uint32_t m_FreeHeads[m_OrderNum];
+	uint32_t m_FreeMask;          // 空きのある大きさのビット
+	uint32_t m_PersistentUsed;
+	uint32_t m_PersistentAllocations;
+
+	// 線形領域 (割り当て位置は単調増加し、容量で割った余りが実際のオフセット)
+	uint32_t m_FrameCapacity;
+	uint64_t m_Head;
+	uint64_t m_Tail;
+	deque<FRAME_RANGE> m_Frames;
+	uint32_t m_FrameDescriptors;
+	uint32_t m_LastFrameDescriptors;
+
+	uint64_t m_StallCount;
+	uint64_t m_FailedCount;
+
+	void PushFree(uint32_t index, uint32_t order);
+	void RemoveFree(uint32_t index, uint32_t order);
+
+public:
+	// 末尾の frameCapacity 個を線形領域にする (0 なら永続領域だけ)
+	DescriptorAllocator(uint32_t capacity, uint32_t frameCapacity = 0);
+	~DescriptorAllocator() = default;
+	DescriptorAllocator(const DescriptorAllocator&) = delete;
+	DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+	// 永続領域から連続した num 個を割り当てる (2 のべき乗に切り上げる、空きがなければ false)
+	bool Allocate(uint32_t num, DESCRIPTOR_RANGE* range);
+
+	// 永続領域に返す (隣のブロックが空いていればまとめる)
+	void Free(const DESCRIPTOR_RANGE& range);
+
+	// 線形領域から今フレームの分を割り当てる (空きがなければ false を返すので、最古のフェンスを待って Retire してから再試行する)
+	bool AllocateFrame(uint32_t num, DESCRIPTOR_RANGE* range);
+
+	// 今フレームの割り当てをフェンス値に結びつける
+	void FinishFrame(uint64_t fenceValue);
+
+	// 完了したフェンス値までの線形領域を回収する
+	void Retire(uint64_t completedFenceValue);
+
+	// 回収待ちのうち最も古いフェンス値 (なければ 0)
+	uint64_t GetOldestFenceValue() const;
+
+	uint32_t GetCapacity() const;
+	DESCRIPTOR_STATISTICS GetStatistics() const;
+
+	// 割り当てと解放の時間を計測して出力する
+	static void RunBenchmark(uint32_t num);
+};
@@ -0,0 +1,95 @@
+﻿#include "FrameScheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Profiler.h"
+
+// 2 つの時刻の差 (ミリ秒)
+static double Milliseconds(chrono::steady_clock::time_point begin, chrono::steady_clock::time_point end) {
+	return chrono::duration<double, milli>(end - begin).count();
+}
+
+// コンストラクタ
+FrameScheduler::FrameScheduler(RenderBackend* backend, uint32_t frameLatency):
+	m_Backend(backend),
+	m_Slots(),
+	m_SlotIndex(0),
+	m_NextFenceValue(1),
+	m_Statistics({ 0 }) {
+
+	if (frameLatency < m_MinFrameLatency || frameLatency > m_MaxFrameLatency) {
+		throw runtime_error("同時に処理できるフレーム数は 1 〜 4 です。");
+	}
+	m_Slots.resize(frameLatency, { 0, chrono::steady_clock::time_point(), false });
+}
+
+// GPU が終えたフレームの遅延を記録する
+void FrameScheduler::CollectCompleted(uint64_t completedValue) {
+	auto now = chrono::steady_clock::now();
+	for (FRAME_SLOT& slot : m_Slots) {
+		if (!slot.Pending || slot.FenceValue > completedValue) { continue; }
+		slot.Pending = false;
+
+		double latency = Milliseconds(slot.BeginTime, now);
+		++m_Statistics.CompletedNum;
+		m_Statistics.LastLatency = latency;
+		m_Statistics.TotalLatency += latency;
+		m_Statistics.MaxLatency = max(m_Statistics.MaxLatency, latency);
+	}
+}
+
+// フレームを始める
+uint32_t FrameScheduler::BeginFrame() {
+
+	FRAME_SLOT& slot = m_Slots[m_SlotIndex];
+
+	// このスロットを前に使ったフレームが終わっていなければ待つ
+	double waitTime = 0.0;
+	if (slot.Pending && m_Backend->GetCompletedValue() < slot.FenceValue) {
+		PROFILE_ZONE("FrameScheduler::Wait");
+		auto begin = chrono::steady_clock::now();
+		m_Backend->WaitForValue(slot.FenceValue);
+		waitTime = Milliseconds(begin, chrono::steady_clock::now());
+
+		++m_Statistics.WaitCount;
+		m_Statistics.TotalWaitTime += waitTime;
+		m_Statistics.MaxWaitTime = max(m_Statistics.MaxWaitTime, waitTime);
+	}
+	m_Statistics.LastWaitTime = waitTime;
+
+	CollectCompleted(m_Backend->GetCompletedValue());
+
+	slot.BeginTime = chrono::steady_clock::now();
+	return m_SlotIndex;
+}
+
+// フレームを終える
+uint64_t FrameScheduler::EndFrame() {
+
+	FRAME_SLOT& slot = m_Slots[m_SlotIndex];
+	slot.FenceValue = m_NextFenceValue++;
+	slot.Pending = true;
+	m_Backend->Signal(slot.FenceValue);
+
+	++m_Statistics.FrameNum;
+	m_SlotIndex = (m_SlotIndex + 1) % static_cast<uint32_t>(m_Slots.size());
+	return slot.FenceValue;
+}
+
+// すべてのフレームが終わるまで待つ
+void FrameScheduler::WaitForIdle() {
+	if (m_NextFenceValue > 1) {
+		m_Backend->WaitForValue(m_NextFenceValue - 1);
+		CollectCompleted(m_Backend->GetCompletedValue());
+	}
+}
+
+// 同時に処理できるフレーム数を取得
+uint32_t FrameScheduler::GetFrameLatency() const { return static_cast<uint32_t>(m_Slots.size()); }
+
+// 現在のスロット番号を取得
+uint32_t FrameScheduler::GetSlotIndex() const { return m_SlotIndex; }
+
+// 統計情報を取得
+FRAME_STATISTICS FrameScheduler::GetStatistics() const { return m_Statistics; }
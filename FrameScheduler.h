@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "RenderBackend.h"
+
+using namespace std;
+
+// フレームの統計情報 (時間はミリ秒)
+struct FRAME_STATISTICS {
+	uint64_t FrameNum;
+	uint64_t WaitCount;
+	double LastWaitTime;
+	double TotalWaitTime;
+	double MaxWaitTime;
+	uint64_t CompletedNum;
+	double LastLatency;
+	double TotalLatency;
+	double MaxLatency;
+};
+
+// フレームのスケジューラ
+// 同時に処理中にできるフレーム数 (1 〜 4) だけフレームごとのリソースを持ち、
+// これから使うスロットのフレームを GPU がまだ処理しているときだけ CPU を待たせる
+// 待ち時間と、フレームを始めてから GPU が終えるまでの時間 (遅延) を記録する
+class FrameScheduler {
+
+public:
+	static const uint32_t m_MinFrameLatency = 1;
+	static const uint32_t m_MaxFrameLatency = 4;
+
+private:
+	// スロットごとのフレーム
+	struct FRAME_SLOT {
+		uint64_t FenceValue;
+		chrono::steady_clock::time_point BeginTime;
+		bool Pending;
+	};
+
+	RenderBackend* m_Backend;
+	vector<FRAME_SLOT> m_Slots;
+	uint32_t m_SlotIndex;
+	uint64_t m_NextFenceValue;
+	FRAME_STATISTICS m_Statistics;
+
+	void CollectCompleted(uint64_t completedValue);
+
+public:
+	FrameScheduler(RenderBackend* backend, uint32_t frameLatency);
+	~FrameScheduler() = default;
+
+	// フレームを始める (スロットが空くまで待ち、スロット番号を返す)
+	uint32_t BeginFrame();
+
+	// フレームを終える (フェンスを発行してその値を返す)
+	uint64_t EndFrame();
+
+	// すべてのフレームが終わるまで待つ
+	void WaitForIdle();
+
+	uint32_t GetFrameLatency() const;
+	uint32_t GetSlotIndex() const;
+	FRAME_STATISTICS GetStatistics() const;
+};
@@ -0,0 +1,348 @@
+﻿#include "FrustumCuller.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+
+// 判定に使う平面 (SoA に展開したもの)
+struct CULLING_PLANES {
+	float NX[6], NY[6], NZ[6], D[6];
+	float AX[6], AY[6], AZ[6];
+};
+
+// 平面を展開
+static CULLING_PLANES MakePlanes(const FRUSTUM& frustum) {
+	CULLING_PLANES planes = {};
+	for (int i = 0; i < 6; ++i) {
+		const XMFLOAT4& p = frustum.Planes[i];
+		planes.NX[i] = p.x;
+		planes.NY[i] = p.y;
+		planes.NZ[i] = p.z;
+		planes.D[i] = p.w;
+		planes.AX[i] = fabsf(p.x);
+		planes.AY[i] = fabsf(p.y);
+		planes.AZ[i] = fabsf(p.z);
+	}
+	return planes;
+}
+
+// スカラー版
+static uint32_t CullScalar(const float* const* soa, size_t begin, size_t end, const CULLING_PLANES& planes, uint32_t* visible) {
+	const float *cx = soa[0], *cy = soa[1], *cz = soa[2], *ex = soa[3], *ey = soa[4], *ez = soa[5], *r = soa[6];
+	uint32_t count = 0;
+	for (size_t i = begin; i < end; ++i) {
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p) {
+			float distance = planes.NX[p] * cx[i] + planes.NY[p] * cy[i] + planes.NZ[p] * cz[i] + planes.D[p];
+			float boxRadius = planes.AX[p] * ex[i] + planes.AY[p] * ey[i] + planes.AZ[p] * ez[i];
+			outside = distance < -fminf(r[i], boxRadius);
+		}
+		if (!outside) { visible[count++] = static_cast<uint32_t>(i); }
+	}
+	return count;
+}
+
+#if defined(SIMD_X86)
+
+// SSE 版 (4 個ずつ)
+static uint32_t CullSSE(const float* const* soa, size_t count, const CULLING_PLANES& planes, uint32_t* visible, size_t* processed) {
+	const float *cx = soa[0], *cy = soa[1], *cz = soa[2], *ex = soa[3], *ey = soa[4], *ez = soa[5], *r = soa[6];
+	uint32_t visibleNum = 0;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 vcx = _mm_loadu_ps(cx + i), vcy = _mm_loadu_ps(cy + i), vcz = _mm_loadu_ps(cz + i);
+		__m128 vex = _mm_loadu_ps(ex + i), vey = _mm_loadu_ps(ey + i), vez = _mm_loadu_ps(ez + i);
+		__m128 vr = _mm_loadu_ps(r + i);
+		__m128 outside = _mm_setzero_ps();
+
+		for (int p = 0; p < 6; ++p) {
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(vcx, _mm_set1_ps(planes.NX[p])), _mm_mul_ps(vcy, _mm_set1_ps(planes.NY[p]))),
+				_mm_add_ps(_mm_mul_ps(vcz, _mm_set1_ps(planes.NZ[p])), _mm_set1_ps(planes.D[p])));
+			__m128 boxRadius = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(vex, _mm_set1_ps(planes.AX[p])), _mm_mul_ps(vey, _mm_set1_ps(planes.AY[p]))),
+				_mm_mul_ps(vez, _mm_set1_ps(planes.AZ[p])));
+			__m128 radius = _mm_min_ps(vr, boxRadius);
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		int mask = ~_mm_movemask_ps(outside) & 0xF;
+		while (mask != 0) {
+			int bit = 0;
+			while (((mask >> bit) & 1) == 0) { ++bit; }
+			visible[visibleNum++] = static_cast<uint32_t>(i + bit);
+			mask &= mask - 1;
+		}
+	}
+	*processed = i;
+	return visibleNum;
+}
+
+// AVX2 版 (8 個ずつ)
+SIMD_TARGET_AVX2 static uint32_t CullAVX2(const float* const* soa, size_t count, const CULLING_PLANES& planes, uint32_t* visible, size_t* processed) {
+	const float *cx = soa[0], *cy = soa[1], *cz = soa[2], *ex = soa[3], *ey = soa[4], *ez = soa[5], *r = soa[6];
+	uint32_t visibleNum = 0;
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 vcx = _mm256_loadu_ps(cx + i), vcy = _mm256_loadu_ps(cy + i), vcz = _mm256_loadu_ps(cz + i);
+		__m256 vex = _mm256_loadu_ps(ex + i), vey = _mm256_loadu_ps(ey + i), vez = _mm256_loadu_ps(ez + i);
+		__m256 vr = _mm256_loadu_ps(r + i);
+		__m256 outside = _mm256_setzero_ps();
+
+		for (int p = 0; p < 6; ++p) {
+			__m256 distance = _mm256_fmadd_ps(vcx, _mm256_set1_ps(planes.NX[p]),
+				_mm256_fmadd_ps(vcy, _mm256_set1_ps(planes.NY[p]),
+				_mm256_fmadd_ps(vcz, _mm256_set1_ps(planes.NZ[p]), _mm256_set1_ps(planes.D[p]))));
+			__m256 boxRadius = _mm256_fmadd_ps(vex, _mm256_set1_ps(planes.AX[p]),
+				_mm256_fmadd_ps(vey, _mm256_set1_ps(planes.AY[p]),
+				_mm256_mul_ps(vez, _mm256_set1_ps(planes.AZ[p]))));
+			__m256 radius = _mm256_min_ps(vr, boxRadius);
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+
+		int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+		while (mask != 0) {
+			int bit = 0;
+			while (((mask >> bit) & 1) == 0) { ++bit; }
+			visible[visibleNum++] = static_cast<uint32_t>(i + bit);
+			mask &= mask - 1;
+		}
+	}
+	*processed = i;
+	return visibleNum;
+}
+
+#endif
+
+// ビュー・射影行列から視錐台を取り出す
+FRUSTUM FrustumCuller::ExtractFrustum(FXMMATRIX viewProject) {
+
+	// 行ベクトル形式なので、クリップ座標は行列の列との内積になる
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, viewProject);
+
+	XMFLOAT4 column[4];
+	for (int i = 0; i < 4; ++i) { column[i] = XMFLOAT4(m.m[0][i], m.m[1][i], m.m[2][i], m.m[3][i]); }
+
+	auto add = [](const XMFLOAT4& a, const XMFLOAT4& b) { return XMFLOAT4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); };
+	auto sub = [](const XMFLOAT4& a, const XMFLOAT4& b) { return XMFLOAT4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); };
+
+	FRUSTUM frustum = {};
+	frustum.Planes[0] = add(column[3], column[0]);	// 左
+	frustum.Planes[1] = sub(column[3], column[0]);	// 右
+	frustum.Planes[2] = add(column[3], column[1]);	// 下
+	frustum.Planes[3] = sub(column[3], column[1]);	// 上
+	frustum.Planes[4] = column[2];					// 近 (0 <= z)
+	frustum.Planes[5] = sub(column[3], column[2]);	// 遠
+
+	for (XMFLOAT4& plane : frustum.Planes) {
+		float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+		if (length > 0.0f) {
+			plane.x /= length;
+			plane.y /= length;
+			plane.z /= length;
+			plane.w /= length;
+		}
+	}
+	return frustum;
+}
+
+// コンストラクタ
+FrustumCuller::FrustumCuller():
+	m_CenterX(),
+	m_CenterY(),
+	m_CenterZ(),
+	m_ExtentX(),
+	m_ExtentY(),
+	m_ExtentZ(),
+	m_Radius(),
+	m_Visible(),
+	m_Statistics({ 0 }) {}
+
+// 境界ボリュームを追加
+uint32_t FrustumCuller::Add(const BOUNDS& bounds) {
+	uint32_t index = GetCount();
+	m_CenterX.push_back(0.0f);
+	m_CenterY.push_back(0.0f);
+	m_CenterZ.push_back(0.0f);
+	m_ExtentX.push_back(0.0f);
+	m_ExtentY.push_back(0.0f);
+	m_ExtentZ.push_back(0.0f);
+	m_Radius.push_back(0.0f);
+	Set(index, bounds);
+	return index;
+}
+
+// 境界ボリュームを書き換える
+void FrustumCuller::Set(uint32_t index, const BOUNDS& bounds) {
+	m_CenterX[index] = bounds.Center.x;
+	m_CenterY[index] = bounds.Center.y;
+	m_CenterZ[index] = bounds.Center.z;
+	m_ExtentX[index] = max(bounds.Max.x - bounds.Center.x, bounds.Center.x - bounds.Min.x);
+	m_ExtentY[index] = max(bounds.Max.y - bounds.Center.y, bounds.Center.y - bounds.Min.y);
+	m_ExtentZ[index] = max(bounds.Max.z - bounds.Center.z, bounds.Center.z - bounds.Min.z);
+	m_Radius[index] = bounds.Radius;
+}
+
+// 領域を予約
+void FrustumCuller::Reserve(size_t count) {
+	m_CenterX.reserve(count);
+	m_CenterY.reserve(count);
+	m_CenterZ.reserve(count);
+	m_ExtentX.reserve(count);
+	m_ExtentY.reserve(count);
+	m_ExtentZ.reserve(count);
+	m_Radius.reserve(count);
+}
+
+// 境界ボリュームを全て削除
+void FrustumCuller::Clear() {
+	m_CenterX.clear();
+	m_CenterY.clear();
+	m_CenterZ.clear();
+	m_ExtentX.clear();
+	m_ExtentY.clear();
+	m_ExtentZ.clear();
+	m_Radius.clear();
+	m_Visible.clear();
+}
+
+// 境界ボリュームの数を取得
+uint32_t FrustumCuller::GetCount() const { return static_cast<uint32_t>(m_Radius.size()); }
+
+// 視錐台と判定
+uint32_t FrustumCuller::Cull(const FRUSTUM& frustum) {
+
+	const size_t count = m_Radius.size();
+	const float* soa[] = { m_CenterX.data(), m_CenterY.data(), m_CenterZ.data(), m_ExtentX.data(), m_ExtentY.data(), m_ExtentZ.data(), m_Radius.data() };
+	const CULLING_PLANES planes = MakePlanes(frustum);
+
+	m_Visible.resize(count);
+
+	uint32_t visibleNum = 0;
+	size_t processed = 0;
+
+#if defined(SIMD_X86)
+	if (IsAVX2Supported()) { visibleNum = CullAVX2(soa, count, planes, m_Visible.data(), &processed); }
+	else { visibleNum = CullSSE(soa, count, planes, m_Visible.data(), &processed); }
+#endif
+
+	visibleNum += CullScalar(soa, processed, count, planes, m_Visible.data() + visibleNum);
+	m_Visible.resize(visibleNum);
+
+	m_Statistics.Tested = static_cast<uint32_t>(count);
+	m_Statistics.Visible = visibleNum;
+	m_Statistics.Culled = static_cast<uint32_t>(count) - visibleNum;
+	return visibleNum;
+}
+
+// 見えているオブジェクトの番号を取得
+const uint32_t* FrustumCuller::GetVisible() const { return m_Visible.data(); }
+
+// 見えているオブジェクトの数を取得
+uint32_t FrustumCuller::GetVisibleNum() const { return static_cast<uint32_t>(m_Visible.size()); }
+
+// 統計情報を取得
+CULLING_STATISTICS FrustumCuller::GetStatistics() const { return m_Statistics; }
+
+// スカラー版と SIMD 版の判定の速さを計測する
+void FrustumCuller::RunBenchmark(uint32_t boundsNum) {
+
+	const uint32_t repeatNum = 20;
+	boundsNum = max(boundsNum, 1u);
+
+	// 視錐台の周りにばらまいた大きさの異なる箱 (半分ほどが見える)
+	mt19937 random(1);
+	uniform_real_distribution<float> position(-60.0f, 60.0f), depth(-110.0f, 10.0f), extent(0.1f, 2.0f);
+	FrustumCuller culler;
+	culler.Reserve(boundsNum);
+	for (uint32_t i = 0; i < boundsNum; ++i) {
+		XMFLOAT3 center(position(random), position(random), depth(random));
+		XMFLOAT3 half(extent(random), extent(random), extent(random));
+		BOUNDS bounds = {};
+		bounds.Center = center;
+		bounds.Min = XMFLOAT3(center.x - half.x, center.y - half.y, center.z - half.z);
+		bounds.Max = XMFLOAT3(center.x + half.x, center.y + half.y, center.z + half.z);
+		bounds.Radius = sqrtf(half.x * half.x + half.y * half.y + half.z * half.z);
+		culler.Add(bounds);
+	}
+
+	XMMATRIX view = XMMatrixLookAtRH(XMVectorSet(0.0f, 0.0f, 5.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX project = XMMatrixPerspectiveFovRH(XMConvertToRadians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	const CULLING_PLANES planes = MakePlanes(ExtractFrustum(XMMatrixMultiply(view, project)));
+	const float* soa[] = { culler.m_CenterX.data(), culler.m_CenterY.data(), culler.m_CenterZ.data(), culler.m_ExtentX.data(), culler.m_ExtentY.data(), culler.m_ExtentZ.data(), culler.m_Radius.data() };
+
+	// 1 回分の時間 (ミリ秒) の平均を返す
+	vector<uint32_t> visible(boundsNum);
+	uint32_t visibleNum = 0;
+	auto measure = [&](const function<uint32_t()>& function) {
+		double total = 0.0;
+		for (uint32_t repeat = 0; repeat < repeatNum; ++repeat) {
+			auto begin = chrono::steady_clock::now();
+			visibleNum = function();
+			total += chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+		}
+		return total / repeatNum;
+	};
+
+	// スカラー版と見えている番号を比べる
+	// FMA の丸めで結果が変わりうるので、平面との距離が境界の半径とほぼ等しいものの違いは許す
+	double scalarTime = measure([&] { return CullScalar(soa, 0, boundsNum, planes, visible.data()); });
+	vector<uint32_t> expected(visible.begin(), visible.begin() + visibleNum);
+	bool matched = true;
+	uint32_t borderlineNum = 0;
+	auto check = [&] {
+		vector<uint32_t> difference;
+		set_symmetric_difference(expected.begin(), expected.end(), visible.begin(), visible.begin() + visibleNum, back_inserter(difference));
+		for (uint32_t index : difference) {
+			float margin = FLT_MAX;
+			for (int p = 0; p < 6; ++p) {
+				float distance = planes.NX[p] * soa[0][index] + planes.NY[p] * soa[1][index] + planes.NZ[p] * soa[2][index] + planes.D[p];
+				float boxRadius = planes.AX[p] * soa[3][index] + planes.AY[p] * soa[4][index] + planes.AZ[p] * soa[5][index];
+				margin = min(margin, fabsf(distance + fminf(soa[6][index], boxRadius)));
+			}
+			if (margin < 1e-4f) { ++borderlineNum; }
+			else { matched = false; }
+		}
+	};
+
+	// 1 秒あたりの境界ボリュームの数 (百万)
+	auto rate = [boundsNum](double milliseconds) { return boundsNum / (milliseconds * 1000.0); };
+
+	cout << "bounds : " << boundsNum << endl;
+	cout << "visible : " << expected.size() << ", culled : " << boundsNum - expected.size() << endl;
+	cout << "scalar : " << scalarTime << " ms (" << rate(scalarTime) << " M bounds/s)" << endl;
+
+#if defined(SIMD_X86)
+	// 端数はスカラーで処理する
+	auto simd = [&](uint32_t (*kernel)(const float* const*, size_t, const CULLING_PLANES&, uint32_t*, size_t*)) {
+		size_t processed = 0;
+		uint32_t num = kernel(soa, boundsNum, planes, visible.data(), &processed);
+		return num + CullScalar(soa, processed, boundsNum, planes, visible.data() + num);
+	};
+
+	double sseTime = measure([&] { return simd(CullSSE); });
+	check();
+	cout << "sse : " << sseTime << " ms (" << rate(sseTime) << " M bounds/s, x" << scalarTime / sseTime << ")" << endl;
+
+	if (IsAVX2Supported()) {
+		double avx2Time = measure([&] { return simd(CullAVX2); });
+		check();
+		cout << "avx2 : " << avx2Time << " ms (" << rate(avx2Time) << " M bounds/s, x" << scalarTime / avx2Time << ")" << endl;
+	}
+#endif
+
+	// Cull を通した場合 (AVX2 / SSE の選択と結果の詰め直しを含む)
+	double cullTime = measure([&] { return culler.Cull(ExtractFrustum(XMMatrixMultiply(view, project))); });
+	visible.assign(culler.GetVisible(), culler.GetVisible() + culler.GetVisibleNum());
+	check();
+	cout << "Cull : " << cullTime << " ms (" << rate(cullTime) << " M bounds/s)" << endl;
+
+	cout << "borderline : " << borderlineNum << endl;
+	cout << "result : " << (matched ? "matched" : "MISMATCH") << endl;
+}
@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "RenderObject.h"
+
+using namespace std;
+using namespace DirectX;
+
+// 視錐台 (ax + by + cz + d >= 0 が内側になる 6 平面)
+struct FRUSTUM {
+	XMFLOAT4 Planes[6];
+};
+
+// カリングの統計情報
+struct CULLING_STATISTICS {
+	uint32_t Tested;
+	uint32_t Visible;
+	uint32_t Culled;
+};
+
+// 視錐台カリング
+// 境界ボリュームを SoA で持ち、8 個 (AVX2) / 4 個 (SSE) ずつ 6 平面と判定する
+// 平面ごとに境界球と境界箱の半径の小さい方を使うので、どちらか一方で外側と分かれば除外される
+class FrustumCuller {
+
+private:
+	// 境界ボリューム (SoA)
+	vector<float> m_CenterX;
+	vector<float> m_CenterY;
+	vector<float> m_CenterZ;
+	vector<float> m_ExtentX;
+	vector<float> m_ExtentY;
+	vector<float> m_ExtentZ;
+	vector<float> m_Radius;
+
+	// 見えているオブジェクトの番号
+	vector<uint32_t> m_Visible;
+
+	CULLING_STATISTICS m_Statistics;
+
+public:
+	FrustumCuller();
+	~FrustumCuller() = default;
+
+	// ビュー・射影行列 (ワールド行列を含めてもよい) から視錐台を取り出す
+	static FRUSTUM ExtractFrustum(FXMMATRIX viewProject);
+
+	// 境界ボリュームを追加して番号を返す
+	uint32_t Add(const BOUNDS& bounds);
+	void Set(uint32_t index, const BOUNDS& bounds);
+	void Reserve(size_t count);
+	void Clear();
+	uint32_t GetCount() const;
+
+	// 視錐台と判定して見えている数を返す
+	uint32_t Cull(const FRUSTUM& frustum);
+
+	const uint32_t* GetVisible() const;
+	uint32_t GetVisibleNum() const;
+	CULLING_STATISTICS GetStatistics() const;
+
+	// boundsNum 個のランダムな境界ボリュームでスカラー版と SIMD 版の判定の速さを計測して出力する (見えている番号を比べる)
+	static void RunBenchmark(uint32_t boundsNum);
+};
@@ -1,543 +1,229 @@
 ﻿#include "Graphic.h"
 
-// アサート
-static void Assert(bool result, const char* file, size_t line, const char* message) {
-	if (result) {
-		stringstream stream;
-		stream << "File : " << file << endl;
-		stream << "Line : " << line << endl;
-		stream << system_category().message(result) << endl;
-		stream << message << endl;
-		throw exception(stream.str().c_str());
-	}
-}
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
 
-// ウィンドウプロシージャ
-static LRESULT WindowProc(HWND hWindow, UINT msg, WPARAM wParam, LPARAM lParam) {
-	if (msg == WM_DESTROY) { PostQuitMessage(0); }
-	return DefWindowProc(hWindow, msg, wParam, lParam);
-}
+#include "NullBackend.h"
+#include "Profiler.h"
+#include "SoftwareBackend.h"
+
+// 定数バッファビューのアドレスの境界 (D3D12 の要件)
+static const uint64_t CONSTANT_BUFFER_ALIGNMENT = 256;
 
 // 唯一のインスタンス
 unique_ptr<Graphic> Graphic::m_Instance = nullptr;
 
 // コンストラクタ
-Graphic::Graphic(LPCWCHAR className, LPCWCHAR windowName, uint32_t windowWidth, uint32_t windowHeight):
+Graphic::Graphic(const wchar_t* className, const wchar_t* windowName, uint32_t windowWidth, uint32_t windowHeight, uint32_t threadNum, uint32_t frameLatency, const VERTEX_FORMAT& vertexFormat, const char* pipelineCachePath):
 	m_Hexahedron(make_unique<Hexahedron>()),
 	m_Octahedron(make_unique<Octahedron>()),
-	m_InstanceHandle(nullptr),
-	m_WindowHandle(nullptr),
+	m_MeshRegistry(make_unique<MeshRegistry>(m_VertexCapacity, m_IndexCapacity, vertexFormat)),
+	m_HexahedronMesh(INVALID_MESH_HANDLE),
+	m_OctahedronMesh(INVALID_MESH_HANDLE),
+	m_MeshOptimizations(),
+	m_AssetStreamer(make_unique<AssetStreamer>(m_MeshRegistry->GetVertexFormat().GetFormat())),
+	m_LodSelector(make_unique<LodSelector>()),
+	m_InstanceBatcher(make_unique<InstanceBatcher>()),
+	m_TransformHierarchy(make_unique<TransformHierarchy>()),
+	m_Scene(make_unique<Scene>()),
+	m_VisibleObjects(),
+	m_ObjectMeshes(),
+	m_ObjectWorlds(),
+	m_ObjectPasses(),
+	m_FrameCallback(),
+	m_JobSystem(make_unique<JobSystem>(threadNum)),
+	m_DrawItems(),
+	m_RenderQueue(make_unique<RenderQueue>()),
+	m_SortedDrawItems(),
+	m_FrameLatency(frameLatency),
+	m_FrameScheduler(nullptr),
 	m_ClassName(className),
 	m_WindowName(windowName),
 	m_WindowWidth(windowWidth),
 	m_WindowHeight(windowHeight),
-	m_Device(nullptr),
-	m_Queue(nullptr),
-	m_SwapChain(nullptr),
-	m_CommandAllocator(),
+	m_Backend(nullptr),
 	m_CommandList(nullptr),
-	m_RootSignature(nullptr),
-	m_PipelineState(nullptr),
+	m_DrawCommandLists(),
+	m_StateFilterEnabled(true),
+	m_PresentCommandList(nullptr),
+	m_RootSignature(INVALID_HANDLE),
+	m_PipelineState(INVALID_HANDLE),
+	m_InstancedPipelineState(INVALID_HANDLE),
+	m_PipelineCachePath(pipelineCachePath),
+	m_PipelineCache(nullptr),
+	m_PipelineStartupTime(0.0),
 	m_Viewport({ 0 }),
 	m_Scissor({ 0 }),
-	m_RenderTarget(),
-	m_VertexBuffer(nullptr),
-	m_IndexBuffer(nullptr),
-	m_ConstantBuffer(),
+	m_UploadBuffer(INVALID_HANDLE),
+	m_RetiredBuffers(),
+	m_VertexBuffer(INVALID_HANDLE),
+	m_IndexBuffer(INVALID_HANDLE),
+	m_MeshBufferInitialized(false),
+	m_UploadAllocator(nullptr),
+	m_FrameConstants(),
+	m_ConstantStatistics({ 0 }),
 	m_VertexBufferView({ 0 }),
-	m_IndexBufferView({ 0 }),
+	m_IndexBufferViews(),
+	m_InstanceBufferViews(),
 	m_ConstantBufferView(),
-	m_HeapRTV(nullptr),
-	m_HeapCBV(nullptr),
-	m_HandleRTV(),
-	m_Fence(nullptr),
-	m_FenceEvent(nullptr),
-	m_FenceCounter(),
-	m_FrameIndex(0) {
-
-	for (int i = 0; i < m_FrameCount; ++i) {
-		m_CommandAllocator[i] = nullptr;
-		m_RenderTarget[i] = nullptr;
-		m_ConstantBuffer[i] = nullptr;
-		m_ConstantBufferView[i] = { 0 };
-		m_HandleRTV[i] = { 0 };
-		m_FenceCounter[i] = 0;
-	}
+	m_FrameIndex(0),
+	m_BackBufferIndex(0) {
 
+	m_Hexahedron->Scale(XMFLOAT3(0.5f, 0.5f, 0.5f));
+	m_Hexahedron->Translate(XMFLOAT3(-1.5f, 0.0f, 0.0f));
 	m_Octahedron->Translate(XMFLOAT3(1.0f, 0.0f, 0.0f));
-}
 
-// ウィンドウを作成
-bool Graphic::CreateWindow() {
+	// 登録する前に頂点を並べ替えておく
+	// パイプラインは深度テストも背面の除外もしないので、描く順が変わらないように三角形の順は保つ
+	m_MeshOptimizations.push_back(MeshOptimizer::OptimizeKeepingOrder(*m_Hexahedron));
+	m_MeshOptimizations.push_back(MeshOptimizer::OptimizeKeepingOrder(*m_Octahedron));
 
-	try {
-		m_InstanceHandle = GetModuleHandle(nullptr);
-		Assert(m_InstanceHandle == nullptr, __FILE__, __LINE__, "インスタンスハンドルの取得に失敗しました。");
-
-		WNDCLASSEX wndClass = {};
-		wndClass.cbSize = sizeof(WNDCLASSEX);
-		wndClass.style = CS_HREDRAW | CS_VREDRAW;
-		wndClass.lpfnWndProc = WindowProc;
-		wndClass.hIcon = LoadIcon(m_InstanceHandle, IDI_APPLICATION);
-		wndClass.hCursor = LoadCursor(m_InstanceHandle, IDC_ARROW);
-		wndClass.hbrBackground = GetSysColorBrush(COLOR_BACKGROUND);
-		wndClass.lpszMenuName = nullptr;
-		wndClass.lpszClassName = m_ClassName;
-		wndClass.hIconSm = LoadIcon(m_InstanceHandle, IDI_APPLICATION);
-		Assert(!RegisterClassEx(&wndClass), __FILE__, __LINE__, "ウィンドウクラスの登録に失敗しました。");
-
-		RECT rect = {};
-		rect.right = static_cast<LONG>(m_WindowWidth);
-		rect.bottom = static_cast<LONG>(m_WindowHeight);
-
-		auto style = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU;
-		AdjustWindowRect(&rect, style, FALSE);
-
-		int width = rect.right - rect.left;
-		int height = rect.bottom - rect.top;
-		m_WindowHandle = CreateWindowEx(0, m_ClassName, m_WindowName, style, CW_USEDEFAULT, CW_USEDEFAULT, width, height, nullptr, nullptr, m_InstanceHandle, nullptr);
-		Assert(m_WindowHandle == nullptr, __FILE__, __LINE__, "ウィンドウの生成に失敗しました。");
-
-		if (m_WindowHandle != nullptr) {
-			ShowWindow(m_WindowHandle, SW_SHOWNORMAL);
-			UpdateWindow(m_WindowHandle);
-			SetFocus(m_WindowHandle);
-		}
-	}
-	catch (exception e) {
-		cerr << e.what() << endl;
-		return false;
-	}
+	m_HexahedronMesh = m_MeshRegistry->Register(*m_Hexahedron);
+	m_OctahedronMesh = m_MeshRegistry->Register(*m_Octahedron);
 
-	return true;
+	// シーンにはメッシュのハンドルを値として入れる
+	m_Scene->Insert(m_Hexahedron.get(), m_Hexahedron->GetBounds(), m_HexahedronMesh);
+	m_Scene->Insert(m_Octahedron.get(), m_Octahedron->GetBounds(), m_OctahedronMesh);
 }
 
 // 描画インターフェースを作成
-bool Graphic::CreateInterface() {
-
-	HRESULT result;
-
-#if defined(DEBUG) || defined(_DEBUG)
-	{
-		ID3D12Debug* debug = nullptr;
-		result = D3D12GetDebugInterface(IID_PPV_ARGS(&debug));
-		if (SUCCEEDED(result)) { m_Debug.reset(debug); }
-	}
-#endif
+bool Graphic::CreateInterface(BACKEND_TYPE type) {
+	PROFILE_ZONE("Graphic::CreateInterface");
 
 	try {
-		// デバイスの作成
-		{
-			ID3D12Device* device = nullptr;
-			result = D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_Device.reset(device);
-		}
-
-		// コマンドキューの作成
-		{
-			D3D12_COMMAND_QUEUE_DESC desc = {};
-			desc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
-			desc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
-			desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
-			desc.NodeMask = 0;
-
-			ID3D12CommandQueue* queue = nullptr;
-			result = m_Device->CreateCommandQueue(&desc, IID_PPV_ARGS(&queue));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_Queue.reset(queue);
-		}
-
-		// スワップチェインの作成
-		{
-			IDXGIFactory4* factory = nullptr;
-			IDXGISwapChain* swapChain = nullptr;
-			try {
-				result = CreateDXGIFactory1(IID_PPV_ARGS(&factory));
-				Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-
-				DXGI_SWAP_CHAIN_DESC desc = {};
-				desc.BufferDesc.Width = m_WindowWidth;
-				desc.BufferDesc.Height = m_WindowHeight;
-				desc.BufferDesc.RefreshRate.Numerator = 60;
-				desc.BufferDesc.RefreshRate.Denominator = 1;
-				desc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-				desc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
-				desc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-				desc.SampleDesc.Count = 1;
-				desc.SampleDesc.Quality = 0;
-				desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-				desc.BufferCount = m_FrameCount;
-				desc.OutputWindow = m_WindowHandle;
-				desc.Windowed = TRUE;
-				desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-				desc.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
-
-				result = factory->CreateSwapChain(m_Queue.get(), &desc, &swapChain);
-				Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-				
-				IDXGISwapChain3* swapChain_;
-				result = swapChain->QueryInterface(IID_PPV_ARGS(&swapChain_));
-				Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-				m_SwapChain.reset(swapChain_);
-			}
-			catch (exception e) {
-				if (factory != nullptr) { factory->Release(); }
-				if (swapChain != nullptr) { swapChain->Release(); }
-				throw exception(e.what());
-			}
-			if (factory != nullptr) { factory->Release(); }
-			if (swapChain != nullptr) { swapChain->Release(); }
-		}
-
-		// コマンドアロケータ
-		{
-			for (int i = 0; i < m_FrameCount; ++i) {
-				ID3D12CommandAllocator* allocator = nullptr;
-				result = m_Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&allocator));
-				Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-				m_CommandAllocator[i].reset(allocator);
-			}
+		// パイプラインキャッシュ (ファイルが壊れていても空から始めるので失敗はしない)
+		if (m_PipelineCachePath != nullptr) {
+			m_PipelineCache = make_unique<PipelineCache>();
+			m_PipelineCache->Open(m_PipelineCachePath);
 		}
 
-		// コマンドリスト
+		// バックエンド (ウィンドウ・デバイス・スワップチェイン・フェンス)
 		{
-			ID3D12GraphicsCommandList* list = nullptr;
-			result = m_Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_CommandAllocator[m_FrameIndex].get(), nullptr, IID_PPV_ARGS(&list));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_CommandList.reset(list);
+			BACKEND_DESC desc = {};
+			desc.ClassName = m_ClassName;
+			desc.WindowName = m_WindowName;
+			desc.Width = m_WindowWidth;
+			desc.Height = m_WindowHeight;
+			desc.FrameCount = max(m_FrameLatency, 2u);
+			desc.FrameLatency = m_FrameLatency;
+			desc.PipelineStateCache = m_PipelineCache.get();
+
+			m_Backend = RenderBackend::Create(type);
+			m_Backend->Initialize(desc);
 		}
 
-		// レンダーターゲットビュー
-		{
-			D3D12_DESCRIPTOR_HEAP_DESC desc = {};
-			desc.NumDescriptors = m_FrameCount;
-			desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-			desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-			desc.NodeMask = 0;
-
-			ID3D12DescriptorHeap* heap = nullptr;
-			result = m_Device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&heap));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_HeapRTV.reset(heap);
-
-			D3D12_CPU_DESCRIPTOR_HANDLE handle = m_HeapRTV->GetCPUDescriptorHandleForHeapStart();
-			uint32_t incrementSize = m_Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-
-			for (int i = 0; i < m_FrameCount; ++i) {
-				ID3D12Resource* buffer = nullptr;
-				result = m_SwapChain->GetBuffer(i, IID_PPV_ARGS(&buffer));
-				Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-				m_RenderTarget[i].reset(buffer);
-
-				D3D12_RENDER_TARGET_VIEW_DESC viewDesc = {};
-				viewDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
-				viewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-				viewDesc.Texture2D.MipSlice = 0;
-				viewDesc.Texture2D.PlaneSlice = 0;
-
-				m_Device->CreateRenderTargetView(m_RenderTarget[i].get(), &viewDesc, handle);
-
-				m_HandleRTV[i] = handle;
-				handle.ptr += incrementSize;
-			}
-		}
-
-		// フェンス
-		{
-			memset(m_FenceCounter, 0, m_FrameCount);
-
-			ID3D12Fence* fence = nullptr;
-			result = m_Device->CreateFence(m_FenceCounter[m_FrameIndex], D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_Fence.reset(fence);
-
-			++m_FenceCounter[m_FrameIndex];
+		// フレームの進行 (フレーム数が範囲外なら例外を投げる)
+		m_FrameScheduler = make_unique<FrameScheduler>(m_Backend.get(), m_FrameLatency);
 
-			m_FenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-			Assert(m_FenceEvent == nullptr, __FILE__, __LINE__, "フェンスイベントの生成に失敗しました。");
+		// コマンドリスト (前処理用、スレッドごとのドロー用、表示用)
+		m_CommandList = m_Backend->CreateCommandList();
+		for (uint32_t i = 0; i < m_JobSystem->GetThreadNum(); ++i) {
+			m_DrawCommandLists.push_back(make_unique<StateFilterCommandList>(m_Backend->CreateCommandList()));
+			m_DrawCommandLists.back()->SetEnabled(m_StateFilterEnabled);
 		}
+		m_PresentCommandList = m_Backend->CreateCommandList();
 	}
-	catch (exception e) {
+	catch (exception& e) {
 		cerr << e.what() << endl;
 		return false;
 	}
 
-	m_CommandList->Close();
 	return true;
 }
 
 // レンダリングの前処理
 bool Graphic::BeforeRendering() {
-
-	HRESULT result;
+	PROFILE_ZONE("Graphic::BeforeRendering");
 
 	try {
-		// 頂点バッファ
+		// アップロードバッファ
 		{
-			D3D12_HEAP_PROPERTIES prop = {};
-			prop.Type = D3D12_HEAP_TYPE_UPLOAD;
-			prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-			prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-			prop.CreationNodeMask = 1;
-			prop.VisibleNodeMask = 1;
-
-			D3D12_RESOURCE_DESC desc = {};
-			desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-			desc.Alignment = 0;
-			desc.Width = m_Octahedron->GetVertexNum() * sizeof(VERTEX);
-			desc.Height = 1;
-			desc.DepthOrArraySize = 1;
-			desc.MipLevels = 1;
-			desc.Format = DXGI_FORMAT_UNKNOWN;
-			desc.SampleDesc.Count = 1;
-			desc.SampleDesc.Quality = 0;
-			desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-			desc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-			ID3D12Resource* vertexBuffer = nullptr;
-			result = m_Device->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&vertexBuffer));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_VertexBuffer.reset(vertexBuffer);
-
-			void* data = nullptr;
-			result = m_VertexBuffer->Map(0, nullptr, &data);
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-
-			memcpy(data, m_Octahedron->GetVertices(), m_Octahedron->GetVertexNum() * sizeof(VERTEX));
-
-			m_VertexBuffer->Unmap(0, nullptr);
-
-			m_VertexBufferView.BufferLocation = m_VertexBuffer->GetGPUVirtualAddress();
-			m_VertexBufferView.SizeInBytes = static_cast<UINT>(m_Octahedron->GetVertexNum() * sizeof(VERTEX));
-			m_VertexBufferView.StrideInBytes = static_cast<UINT>(sizeof(VERTEX));
-		}
+			m_UploadBuffer = m_Backend->CreateBuffer(HEAP_TYPE::UPLOAD, m_UploadBufferSize, RESOURCE_STATE::GENERIC_READ);
 
-		// インデックスバッファ
-		{
-			uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
-
-			D3D12_HEAP_PROPERTIES prop = {};
-			prop.Type = D3D12_HEAP_TYPE_UPLOAD;
-			prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-			prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-			prop.CreationNodeMask = 1;
-			prop.VisibleNodeMask = 1;
-
-			D3D12_RESOURCE_DESC desc = {};
-			desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-			desc.Alignment = 0;
-			desc.Width = m_Octahedron->GetIndexNum() * sizeof(uint32_t);
-			desc.Height = 1;
-			desc.DepthOrArraySize = 1;
-			desc.MipLevels = 1;
-			desc.Format = DXGI_FORMAT_UNKNOWN;
-			desc.SampleDesc.Count = 1;
-			desc.SampleDesc.Quality = 0;
-			desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-			desc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-			ID3D12Resource* buffer = nullptr;
-			result = m_Device->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_IndexBuffer.reset(buffer);
-
-			void* ptr = nullptr;
-			result = m_IndexBuffer->Map(0, nullptr, &ptr);
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-
-			memcpy(ptr, m_Octahedron->GetIndices(), m_Octahedron->GetIndexNum() * sizeof(uint32_t));
-
-			m_IndexBuffer->Unmap(0, nullptr);
-
-			m_IndexBufferView.BufferLocation = m_IndexBuffer->GetGPUVirtualAddress();
-			m_IndexBufferView.Format = DXGI_FORMAT_R32_UINT;
-			m_IndexBufferView.SizeInBytes = m_Octahedron->GetIndexNum() * sizeof(uint32_t);
+			// アップロードバッファはマップしたままにしておく
+			void* data = m_Backend->Map(m_UploadBuffer);
+			m_UploadAllocator = make_unique<UploadRingAllocator>(data, m_UploadBufferSize);
 		}
 
+		// 共有頂点バッファと共有インデックスバッファ
+		CreateMeshBuffers();
+
 		// 定数バッファ
 		{
-			D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-			heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-			heapDesc.NumDescriptors = m_FrameCount;
-			heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-			heapDesc.NodeMask = 0;
-
-			ID3D12DescriptorHeap* heap = nullptr;
-			result = m_Device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&heap));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_HeapCBV.reset(heap);
-
-			D3D12_HEAP_PROPERTIES prop = {};
-			prop.Type = D3D12_HEAP_TYPE_UPLOAD;
-			prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-			prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-			prop.CreationNodeMask = 1;
-			prop.VisibleNodeMask = 1;
-
-			D3D12_RESOURCE_DESC bufferDesc = {};
-			bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-			bufferDesc.Alignment = 0;
-			bufferDesc.Width = sizeof(TRANSFORM);
-			bufferDesc.Height = 1;
-			bufferDesc.DepthOrArraySize = 1;
-			bufferDesc.MipLevels = 1;
-			bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
-			bufferDesc.SampleDesc.Count = 1;
-			bufferDesc.SampleDesc.Quality = 0;
-			bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-			bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-			UINT incrSize = m_Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-			for (int i = 0; i < m_FrameCount; ++i) {
-
-				ID3D12Resource* buffer = nullptr;
-				result = m_Device->CreateCommittedResource(&prop, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer));
-				Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-				m_ConstantBuffer[i].reset(buffer);
-
-				D3D12_GPU_VIRTUAL_ADDRESS address = m_ConstantBuffer[i]->GetGPUVirtualAddress();
-				D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = m_HeapCBV->GetCPUDescriptorHandleForHeapStart();
-				D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = m_HeapCBV->GetGPUDescriptorHandleForHeapStart();
-
-				cpuHandle.ptr += static_cast<unsigned long long>(incrSize) * i;
-				gpuHandle.ptr += static_cast<unsigned long long>(incrSize) * i;
-
-				m_ConstantBufferView[i].CPUHandle = cpuHandle;
-				m_ConstantBufferView[i].GPUHandle = gpuHandle;
-				m_ConstantBufferView[i].Desc.BufferLocation = address;
-				m_ConstantBufferView[i].Desc.SizeInBytes = sizeof(TRANSFORM);
-
-				m_Device->CreateConstantBufferView(&m_ConstantBufferView[i].Desc, cpuHandle);
-
-				result = m_ConstantBuffer[i]->Map(0, nullptr, reinterpret_cast<void**>(&m_ConstantBufferView[i].Buffer));
-				Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-				
-				XMVECTOR eyePos = XMVectorSet(0.0f, 0.0f, 5.0f, 0.0f);
-				XMVECTOR targetPos = XMVectorZero();
-				XMVECTOR upWard = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-
-				constexpr float fovY = XMConvertToRadians(37.5f);
-				float aspect = static_cast<float>(m_WindowWidth) / static_cast<float>(m_WindowHeight);
-
-				m_ConstantBufferView[i].Buffer->m_World = XMMatrixIdentity();
-				m_ConstantBufferView[i].Buffer->m_View = XMMatrixLookAtRH(eyePos, targetPos, upWard);
-				m_ConstantBufferView[i].Buffer->m_Project = XMMatrixPerspectiveFovRH(fovY, aspect, 1.0f, 1000.0f);
-			}
+			// バッファの実体はアップロードバッファから毎フレーム割り当て、ルートの定数バッファビューで直接渡す
+			// テーブルで渡すビューがないので、シェーダーから見えるディスクリプタヒープは作らない
+			m_ConstantBufferView.resize(m_FrameLatency, { 0 });
+
+			XMVECTOR eyePos = XMVectorSet(0.0f, 0.0f, 5.0f, 0.0f);
+			XMVECTOR targetPos = XMVectorZero();
+			XMVECTOR upWard = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+
+			constexpr float fovY = XMConvertToRadians(37.5f);
+			float aspect = static_cast<float>(m_WindowWidth) / static_cast<float>(m_WindowHeight);
+
+			m_FrameConstants.m_View = XMMatrixLookAtRH(eyePos, targetPos, upWard);
+			m_FrameConstants.m_Project = XMMatrixPerspectiveFovRH(fovY, aspect, 1.0f, 1000.0f);
+			m_FrameConstants.m_ViewProject = XMMatrixMultiply(m_FrameConstants.m_View, m_FrameConstants.m_Project);
+			m_FrameConstants.m_PositionScale = m_MeshRegistry->GetVertexFormat().GetPositionScale();
 		}
 
-		// ルートシグニチャ
+		// ルートシグニチャとパイプラインを作る時間を計る (キャッシュが効いているかどうかの比較用)
+		auto pipelineStart = chrono::steady_clock::now();
+
+		// ルートシグニチャ (b0 がフレームごとの定数、b1 がオブジェクトごとの定数)
 		{
-			auto flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
-			flags |= D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS;
-			flags |= D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS;
-			flags |= D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
-
-			D3D12_ROOT_PARAMETER param = {};
-			param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-			param.Descriptor.ShaderRegister = 0;
-			param.Descriptor.RegisterSpace = 0;
-			param.ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-
-			D3D12_ROOT_SIGNATURE_DESC desc = {};
-			desc.NumParameters = 1;
-			desc.NumStaticSamplers = 0;
-			desc.pParameters = &param;
-			desc.pStaticSamplers = nullptr;
-			desc.Flags = flags;
-
-			ID3DBlob *blob = nullptr, *errorBlob = nullptr;
-			result = D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1_0, &blob, &errorBlob);
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-
-			ID3D12RootSignature* rootSignature = nullptr;
-			result = m_Device->CreateRootSignature(0, blob->GetBufferPointer(), blob->GetBufferSize(), IID_PPV_ARGS(&rootSignature));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_RootSignature.reset(rootSignature);
+			ROOT_PARAMETER params[2] = {};
+			params[0].ShaderRegister = 0;
+			params[0].VertexOnly = true;
+			params[1].ShaderRegister = 1;
+			params[1].VertexOnly = true;
+
+			ROOT_SIGNATURE_DESC desc = {};
+			desc.Parameters = params;
+			desc.ParameterNum = 2;
+
+			m_RootSignature = m_Backend->CreateRootSignature(desc);
 		}
 
 		// パイプラインステート
 		{
-			D3D12_INPUT_ELEMENT_DESC elements[2]{};
-
-			elements[0].SemanticName = "POSITION";
-			elements[0].SemanticIndex = 0;
-			elements[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
-			elements[0].InputSlot = 0;
-			elements[0].AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
-			elements[0].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
-			elements[0].InstanceDataStepRate = 0;
-
-			elements[1].SemanticName = "COLOR";
-			elements[1].SemanticIndex = 0;
-			elements[1].Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-			elements[1].InputSlot = 0;
-			elements[1].AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
-			elements[1].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
-			elements[1].InstanceDataStepRate = 0;
-
-			D3D12_RASTERIZER_DESC descRS = {};
-			descRS.FillMode = D3D12_FILL_MODE_SOLID;
-			descRS.CullMode = D3D12_CULL_MODE_NONE;
-			descRS.FrontCounterClockwise = FALSE;
-			descRS.DepthBias = D3D12_DEFAULT_DEPTH_BIAS;
-			descRS.DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
-			descRS.SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
-			descRS.DepthClipEnable = FALSE;
-			descRS.MultisampleEnable = FALSE;
-			descRS.AntialiasedLineEnable = FALSE;
-			descRS.ForcedSampleCount = 0;
-			descRS.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
-
-			D3D12_RENDER_TARGET_BLEND_DESC descRTBS = {};
-			descRTBS.BlendEnable = FALSE;
-			descRTBS.LogicOpEnable = FALSE;
-			descRTBS.SrcBlend = D3D12_BLEND_ONE;
-			descRTBS.DestBlend = D3D12_BLEND_ZERO;
-			descRTBS.BlendOp = D3D12_BLEND_OP_ADD;
-			descRTBS.SrcBlendAlpha = D3D12_BLEND_ONE;
-			descRTBS.DestBlendAlpha = D3D12_BLEND_ZERO;
-			descRTBS.BlendOpAlpha = D3D12_BLEND_OP_ADD;
-			descRTBS.LogicOp = D3D12_LOGIC_OP_NOOP;
-			descRTBS.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
-
-			D3D12_BLEND_DESC descBS = {};
-			descBS.AlphaToCoverageEnable = FALSE;
-			descBS.IndependentBlendEnable = FALSE;
-			for (int i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i) {
-				descBS.RenderTarget[i] = descRTBS;
+			// 頂点の入力レイアウトは頂点形式から作る
+			INPUT_ELEMENT_DESC elements[2]{};
+			m_MeshRegistry->GetVertexFormat().GetInputElements(elements, 0);
+
+			PIPELINE_DESC desc = {};
+			desc.RootSignature = m_RootSignature;
+			desc.VertexShader = L"SimpleVS.cso";
+			desc.PixelShader = L"SimplePS.cso";
+			desc.InputElements = elements;
+			desc.InputElementNum = 2;
+
+			m_PipelineState = m_Backend->CreatePipelineState(desc);
+
+			// インスタンス描画用 (2 番目のスロットからワールド・ビュー・射影行列を読む)
+			INPUT_ELEMENT_DESC instancedElements[6]{};
+			instancedElements[0] = elements[0];
+			instancedElements[1] = elements[1];
+
+			for (uint32_t i = 0; i < 4; ++i) {
+				instancedElements[2 + i] = { "WVP", i, ELEMENT_FORMAT::R32G32B32A32_FLOAT, 1, INPUT_CLASSIFICATION::PER_INSTANCE_DATA, 1 };
 			}
 
-			ID3DBlob* vsBlob = nullptr;
-			result = D3DReadFileToBlob(L"SimpleVS.cso", &vsBlob);
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-
-			ID3DBlob* psBlob = nullptr;
-			result = D3DReadFileToBlob(L"SimplePS.cso", &psBlob);
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-
-			D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = {};
-			desc.InputLayout = { elements, _countof(elements) };
-			desc.pRootSignature = m_RootSignature.get();
-			desc.VS = { vsBlob->GetBufferPointer(), vsBlob->GetBufferSize() };
-			desc.PS = { psBlob->GetBufferPointer(), psBlob->GetBufferSize() };
-			desc.RasterizerState = descRS;
-			desc.BlendState = descBS;
-			desc.DepthStencilState.DepthEnable = FALSE;
-			desc.DepthStencilState.StencilEnable = FALSE;
-			desc.SampleMask = UINT_MAX;
-			desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-			desc.NumRenderTargets = 1;
-			desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
-			desc.DSVFormat = DXGI_FORMAT_UNKNOWN;
-			desc.SampleDesc.Count = 1;
-			desc.SampleDesc.Quality = 0;
-
-			ID3D12PipelineState* pipelineState = nullptr;
-			result = m_Device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pipelineState));
-			Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-			m_PipelineState.reset(pipelineState);
+			desc.VertexShader = L"InstancedVS.cso";
+			desc.InputElements = instancedElements;
+			desc.InputElementNum = 6;
+
+			m_InstancedPipelineState = m_Backend->CreatePipelineState(desc);
+		}
+
+		m_PipelineStartupTime = chrono::duration<double, milli>(chrono::steady_clock::now() - pipelineStart).count();
+
+		// 新しく作ったものがあればキャッシュを書き出す (書き出せなくても次回作り直すだけ)
+		if (m_PipelineCache != nullptr && !m_PipelineCache->Save()) {
+			cerr << "パイプラインキャッシュを書き出せませんでした。" << endl;
 		}
 
 		// ビューポイントとシザー矩形
@@ -549,13 +235,13 @@ bool Graphic::BeforeRendering() {
 			m_Viewport.MinDepth = 0.0f;
 			m_Viewport.MaxDepth = 1.0f;
 
-			m_Scissor.left = 0;
-			m_Scissor.right = m_WindowWidth;
-			m_Scissor.top = 0;
-			m_Scissor.bottom = m_WindowHeight;
+			m_Scissor.Left = 0;
+			m_Scissor.Right = m_WindowWidth;
+			m_Scissor.Top = 0;
+			m_Scissor.Bottom = m_WindowHeight;
 		}
 	}
-	catch (exception e) {
+	catch (exception& e) {
 		cerr << e.what() << endl;
 		return false;
 	}
@@ -563,101 +249,398 @@ bool Graphic::BeforeRendering() {
 	return true;
 }
 
+// アップロードバッファにデータを書き込む
+GPU_ADDRESS Graphic::Upload(const void* data, uint64_t size, uint64_t alignment, void** cpuAddress) {
+
+	// 空きがなければ最も古いフレームの完了を待ち、待つものがなければ (1 フレームで容量を超えた) バッファを大きくする
+	UPLOAD_ALLOCATION allocation = {};
+	while (!m_UploadAllocator->Allocate(size, alignment, &allocation)) {
+		uint64_t fenceValue = m_UploadAllocator->GetOldestFenceValue();
+		if (fenceValue == 0) {
+			GrowUploadBuffer(size + alignment);
+			continue;
+		}
+
+		PROFILE_ZONE("Graphic::Upload wait");
+		m_Backend->WaitForValue(fenceValue);
+		m_UploadAllocator->Retire(m_Backend->GetCompletedValue());
+	}
+
+	if (data != nullptr) { memcpy(allocation.CPUAddress, data, size); }
+	if (cpuAddress != nullptr) { *cpuAddress = allocation.CPUAddress; }
+
+	return m_Backend->GetGPUVirtualAddress(m_UploadBuffer) + allocation.Offset;
+}
+
+// アップロードバッファを倍の容量 (足りなければ size 以上) で作り直す
+// 前のバッファはこのフレームで記録したコマンドが参照しているので、GPU が終えるまで残す
+void Graphic::GrowUploadBuffer(uint64_t size) {
+	PROFILE_ZONE("Graphic::GrowUploadBuffer");
+
+	uint64_t capacity = m_UploadAllocator->GetCapacity() * 2;
+	while (capacity < size) { capacity *= 2; }
+
+	RetireBuffer(m_UploadBuffer);
+	m_UploadBuffer = m_Backend->CreateBuffer(HEAP_TYPE::UPLOAD, capacity, RESOURCE_STATE::GENERIC_READ);
+	m_UploadAllocator->Rebind(m_Backend->Map(m_UploadBuffer), capacity);
+}
+
+// 使わなくなったバッファを解放待ちに回す (フェンス値はこのフレームを終えたときに付ける)
+void Graphic::RetireBuffer(RESOURCE_HANDLE buffer) {
+	m_RetiredBuffers.push_back({ buffer, 0 });
+}
+
+// GPU が使い終えたバッファを解放する
+void Graphic::ReleaseRetiredBuffers(uint64_t completedValue) {
+	auto released = remove_if(m_RetiredBuffers.begin(), m_RetiredBuffers.end(), [&](const RETIRED_BUFFER& retired) {
+		if (retired.FenceValue == 0 || retired.FenceValue > completedValue) { return false; }
+		m_Backend->ReleaseResource(retired.Buffer);
+		return true;
+	});
+	m_RetiredBuffers.erase(released, m_RetiredBuffers.end());
+}
+
+// アップロードバッファを経由して GPU 上のバッファへ書き込む
+void Graphic::CopyToBuffer(RESOURCE_HANDLE dest, uint64_t destOffset, const void* data, uint64_t size) {
+
+	// リングを占有しないように分割してコピーする
+	const uint64_t chunkSize = m_UploadBufferSize / 4;
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	for (uint64_t offset = 0; offset < size; offset += chunkSize) {
+		uint64_t length = min(chunkSize, size - offset);
+		GPU_ADDRESS address = Upload(bytes + offset, length, sizeof(uint32_t));
+		uint64_t srcOffset = address - m_Backend->GetGPUVirtualAddress(m_UploadBuffer);
+		m_CommandList->CopyBufferRegion(dest, destOffset + offset, m_UploadBuffer, srcOffset, length);
+	}
+}
+
+// 共有頂点バッファと共有インデックスバッファをメッシュレジストリの容量で作る
+// 作り直すときは前のバッファを記録済みのコマンドが参照しているので、GPU が終えるまで残す
+void Graphic::CreateMeshBuffers() {
+	PROFILE_ZONE("Graphic::CreateMeshBuffers");
+
+	if (m_VertexBuffer != INVALID_HANDLE) { RetireBuffer(m_VertexBuffer); }
+	if (m_IndexBuffer != INVALID_HANDLE) { RetireBuffer(m_IndexBuffer); }
+
+	uint64_t vertexSize = static_cast<uint64_t>(m_MeshRegistry->GetVertexCapacity()) * m_MeshRegistry->GetVertexStride();
+	uint64_t indexSize = m_MeshRegistry->GetIndexCapacity();
+
+	m_VertexBuffer = m_Backend->CreateBuffer(HEAP_TYPE::DEFAULT, vertexSize, RESOURCE_STATE::COMMON);
+	m_IndexBuffer = m_Backend->CreateBuffer(HEAP_TYPE::DEFAULT, indexSize, RESOURCE_STATE::COMMON);
+	m_MeshBufferInitialized = false;
+
+	m_VertexBufferView.BufferLocation = m_Backend->GetGPUVirtualAddress(m_VertexBuffer);
+	m_VertexBufferView.SizeInBytes = static_cast<uint32_t>(vertexSize);
+	m_VertexBufferView.StrideInBytes = m_MeshRegistry->GetVertexStride();
+
+	// インデックスの形式はメッシュごとに違うので、同じバッファを両方の形式で見られるようにしておく
+	for (INDEX_FORMAT format : { INDEX_FORMAT::R16_UINT, INDEX_FORMAT::R32_UINT }) {
+		INDEX_BUFFER_VIEW& view = m_IndexBufferViews[static_cast<uint32_t>(format)];
+		view.BufferLocation = m_Backend->GetGPUVirtualAddress(m_IndexBuffer);
+		view.SizeInBytes = static_cast<uint32_t>(indexSize);
+		view.Format = format;
+	}
+}
+
+// 共有バッファの更新された範囲を GPU へ送る
+void Graphic::UploadMeshes() {
+	PROFILE_ZONE("Graphic::UploadMeshes");
+
+	// メッシュレジストリが容量を広げていれば作り直す (広げた時点で全体が更新された範囲になっている)
+	if (static_cast<uint64_t>(m_MeshRegistry->GetVertexCapacity()) * m_MeshRegistry->GetVertexStride() > m_VertexBufferView.SizeInBytes
+		|| m_MeshRegistry->GetIndexCapacity() > m_IndexBufferViews[0].SizeInBytes) {
+		CreateMeshBuffers();
+	}
+
+	MESH_DIRTY_RANGE vertices = {}, indices = {};
+	bool dirtyVertices = m_MeshRegistry->GetDirtyVertices(&vertices);
+	bool dirtyIndices = m_MeshRegistry->GetDirtyIndices(&indices);
+	if (!dirtyVertices && !dirtyIndices) { return; }
+
+	RESOURCE_BARRIER barriers[2] = {};
+	barriers[0].Resource = m_VertexBuffer;
+	barriers[0].StateBefore = m_MeshBufferInitialized ? RESOURCE_STATE::VERTEX_AND_CONSTANT_BUFFER : RESOURCE_STATE::COMMON;
+	barriers[0].StateAfter = RESOURCE_STATE::COPY_DEST;
+	barriers[1].Resource = m_IndexBuffer;
+	barriers[1].StateBefore = m_MeshBufferInitialized ? RESOURCE_STATE::INDEX_BUFFER : RESOURCE_STATE::COMMON;
+	barriers[1].StateAfter = RESOURCE_STATE::COPY_DEST;
+	m_CommandList->ResourceBarrier(2, barriers);
+
+	if (dirtyVertices) {
+		uint64_t offset = static_cast<uint64_t>(vertices.Begin) * m_MeshRegistry->GetVertexStride();
+		uint64_t size = static_cast<uint64_t>(vertices.End - vertices.Begin) * m_MeshRegistry->GetVertexStride();
+		CopyToBuffer(m_VertexBuffer, offset, m_MeshRegistry->GetVertexData() + offset, size);
+	}
+
+	if (dirtyIndices) {
+		uint64_t offset = indices.Begin;
+		uint64_t size = indices.End - indices.Begin;
+		CopyToBuffer(m_IndexBuffer, offset, m_MeshRegistry->GetIndexData() + offset, size);
+	}
+
+	barriers[0].StateBefore = RESOURCE_STATE::COPY_DEST;
+	barriers[0].StateAfter = RESOURCE_STATE::VERTEX_AND_CONSTANT_BUFFER;
+	barriers[1].StateBefore = RESOURCE_STATE::COPY_DEST;
+	barriers[1].StateAfter = RESOURCE_STATE::INDEX_BUFFER;
+	m_CommandList->ResourceBarrier(2, barriers);
+
+	m_MeshRegistry->ClearDirty();
+	m_MeshBufferInitialized = true;
+}
+
+// 今フレームのドローを並べる (カリングとインスタンスの振り分けも行う)
+void Graphic::BuildDrawItems() {
+	PROFILE_ZONE("Graphic::BuildDrawItems");
+
+	m_DrawItems.clear();
+	m_RenderQueue->Clear();
+
+	// ドローを積み、パス・パイプライン・メッシュ・奥行きからソートキーを作る
+	// 奥行きは射影した z (0 が手前、1 が奥) で、インスタンスのグループはまとめて 0 とする
+	XMMATRIX viewProject = m_FrameConstants.m_ViewProject;
+	auto submit = [this, &viewProject](const DRAW_ITEM& item, MESH_HANDLE mesh, RENDER_PASS pass, FXMVECTOR position) {
+		float depth = XMVectorGetZ(XMVector3TransformCoord(position, viewProject));
+		m_RenderQueue->Submit(RenderQueue::MakeKey(pass, item.Pipeline, mesh, depth), static_cast<uint32_t>(m_DrawItems.size()));
+		m_DrawItems.push_back(item);
+	};
+
+	// 視錐台の外にあるオブジェクトは描画しない
+	m_Scene->QueryFrustum(FrustumCuller::ExtractFrustum(viewProject), &m_VisibleObjects);
+
+	// 見えるオブジェクトの定数を 1 つの領域に並べ、ドローからはオフセットで指す
+	// 定数バッファビューのアドレスは 256 バイト境界でなければならないので、その間隔で並べる
+	uint32_t visibleNum = static_cast<uint32_t>(m_VisibleObjects.size());
+	m_ConstantStatistics.ObjectNum = visibleNum;
+	m_ConstantStatistics.ObjectBytes = static_cast<uint64_t>(visibleNum) * CONSTANT_BUFFER_ALIGNMENT;
+	if (visibleNum > 0) {
+		void* buffer = nullptr;
+		GPU_ADDRESS objectConstants = Upload(nullptr, m_ConstantStatistics.ObjectBytes, CONSTANT_BUFFER_ALIGNMENT, &buffer);
+
+		for (uint32_t i = 0; i < visibleNum; ++i) {
+			SCENE_OBJECT visible = m_VisibleObjects[i];
+			MESH_HANDLE meshHandle = m_Scene->GetValue(visible);
+			const MESH_ENTRY* mesh = m_MeshRegistry->GetMesh(meshHandle);
+			if (mesh == nullptr) { continue; }
+
+			// 実験用プリミティブは原点に置くので、ビュー・射影行列がそのままワールド・ビュー・射影行列になる
+			OBJECT_CONSTANTS* constants = reinterpret_cast<OBJECT_CONSTANTS*>(static_cast<uint8_t*>(buffer) + i * CONSTANT_BUFFER_ALIGNMENT);
+			XMStoreFloat4x4(&constants->m_WorldViewProject, viewProject);
+
+			DRAW_ITEM item = { m_PipelineState, mesh->IndexNum, mesh->StartIndex, mesh->IndexFormat, static_cast<int32_t>(mesh->BaseVertex), 1, 0, objectConstants + i * CONSTANT_BUFFER_ALIGNMENT };
+			submit(item, meshHandle, RENDER_PASS::STATE_SORTED, XMLoadFloat3(&m_Scene->GetBounds(visible).Center));
+		}
+	}
+
+	// インスタンスのストリーム (まとめたインスタンスの後ろに個別のオブジェクトを並べる)
+	// ワールド行列にビュー・射影行列をまとめて掛け、頂点シェーダーでは 1 回だけ掛ければ済むようにする
+	// リングを占有しないように m_InstanceChunkNum 個ずつ別の領域へアップロードし、ドローもその境目で分ける
+	m_InstanceBatcher->Build();
+	uint32_t batchedNum = m_InstanceBatcher->GetInstanceNum();
+	uint32_t instanceNum = batchedNum + static_cast<uint32_t>(m_ObjectWorlds.size());
+	m_ConstantStatistics.InstanceNum = instanceNum;
+	m_ConstantStatistics.InstanceBytes = static_cast<uint64_t>(instanceNum) * sizeof(INSTANCE_DATA);
+	m_InstanceBufferViews.clear();
+	for (uint32_t first = 0; first < instanceNum; first += m_InstanceChunkNum) {
+		uint32_t num = min(m_InstanceChunkNum, instanceNum - first);
+		uint64_t size = static_cast<uint64_t>(num) * sizeof(INSTANCE_DATA);
+
+		void* buffer = nullptr;
+		VERTEX_BUFFER_VIEW view = {};
+		view.BufferLocation = Upload(nullptr, size, 16, &buffer);
+		view.SizeInBytes = static_cast<uint32_t>(size);
+		view.StrideInBytes = static_cast<uint32_t>(sizeof(INSTANCE_DATA));
+		m_InstanceBufferViews.push_back(view);
+
+		// 分割した範囲がまとめたインスタンスと個別のオブジェクトにまたがることがある
+		INSTANCE_DATA* instances = static_cast<INSTANCE_DATA*>(buffer);
+		uint32_t split = min(max(batchedNum, first), first + num);
+		if (split > first) { MatrixBatch::Multiply(&m_InstanceBatcher->GetInstances()[first].World, split - first, viewProject, &instances->World, nullptr, m_JobSystem.get()); }
+		if (first + num > split) { MatrixBatch::Multiply(&m_ObjectWorlds[split - batchedNum].World, first + num - split, viewProject, &instances[split - first].World, nullptr, m_JobSystem.get()); }
+	}
+
+	// インスタンス描画 (メッシュごとに 1 回のドロー、ストリームの境目をまたぐグループは分ける)
+	for (uint32_t i = 0; i < m_InstanceBatcher->GetGroupNum(); ++i) {
+		const INSTANCE_GROUP& group = m_InstanceBatcher->GetGroups()[i];
+		const MESH_ENTRY* mesh = m_MeshRegistry->GetMesh(group.Mesh);
+		if (mesh == nullptr) { continue; }
+		for (uint32_t first = group.FirstInstance; first < group.FirstInstance + group.InstanceNum;) {
+			uint32_t chunk = first / m_InstanceChunkNum;
+			uint32_t num = min(group.FirstInstance + group.InstanceNum, (chunk + 1) * m_InstanceChunkNum) - first;
+			DRAW_ITEM item = { m_InstancedPipelineState, mesh->IndexNum, mesh->StartIndex, mesh->IndexFormat, static_cast<int32_t>(mesh->BaseVertex), num, first % m_InstanceChunkNum, 0, chunk };
+			m_RenderQueue->Submit(RenderQueue::MakeKey(RENDER_PASS::STATE_SORTED, item.Pipeline, group.Mesh, 0.0f), static_cast<uint32_t>(m_DrawItems.size()));
+			m_DrawItems.push_back(item);
+			first += num;
+		}
+	}
+
+	// 個別のオブジェクト (1 つにつき 1 回のドロー)
+	for (size_t i = 0; i < m_ObjectMeshes.size(); ++i) {
+		const MESH_ENTRY* mesh = m_MeshRegistry->GetMesh(m_ObjectMeshes[i]);
+		if (mesh == nullptr) { continue; }
+		uint32_t instance = batchedNum + static_cast<uint32_t>(i);
+		DRAW_ITEM item = { m_InstancedPipelineState, mesh->IndexNum, mesh->StartIndex, mesh->IndexFormat, static_cast<int32_t>(mesh->BaseVertex), 1, instance % m_InstanceChunkNum, 0, instance / m_InstanceChunkNum };
+		const XMFLOAT4X4& world = m_ObjectWorlds[i].World;
+		submit(item, m_ObjectMeshes[i], m_ObjectPasses[i], XMVectorSet(world.m[3][0], world.m[3][1], world.m[3][2], 1.0f));
+	}
+
+	m_InstanceBatcher->Clear();
+	m_ObjectMeshes.clear();
+	m_ObjectWorlds.clear();
+	m_ObjectPasses.clear();
+
+	// キーの順に並べ替える
+	m_RenderQueue->Sort(m_JobSystem.get());
+	const uint32_t* order = m_RenderQueue->GetValues();
+	m_SortedDrawItems.resize(m_DrawItems.size());
+	for (size_t i = 0; i < m_DrawItems.size(); ++i) { m_SortedDrawItems[i] = m_DrawItems[order[i]]; }
+	m_DrawItems.swap(m_SortedDrawItems);
+}
+
+// [begin, end) のドローを記録する (ワーカースレッドから呼ばれる)
+void Graphic::RecordDraws(CommandList* commandList, uint32_t begin, uint32_t end) {
+	PROFILE_ZONE("Graphic::RecordDraws");
+
+	commandList->Reset(m_FrameIndex);
+
+	if (begin < end) {
+		commandList->OMSetRenderTarget(m_Backend->GetBackBuffer(m_BackBufferIndex));
+		commandList->SetGraphicsRootSignature(m_RootSignature);
+		commandList->SetGraphicsRootConstantBufferView(0, m_ConstantBufferView[m_FrameIndex].BufferLocation);
+
+		commandList->IASetPrimitiveTopology(PRIMITIVE_TOPOLOGY::TRIANGLELIST);
+		commandList->RSSetViewports(1, &m_Viewport);
+		commandList->RSSetScissorRects(1, &m_Scissor);
+
+		// ドローごとに必要な状態をすべて設定する (変わらないものはコマンドリストの側で省かれる)
+		VERTEX_BUFFER_VIEW views[2] = { m_VertexBufferView, {} };
+		for (uint32_t i = begin; i < end; ++i) {
+			const DRAW_ITEM& item = m_DrawItems[i];
+			bool instanced = item.Pipeline == m_InstancedPipelineState;
+			if (instanced) { views[1] = m_InstanceBufferViews[item.InstanceChunk]; }
+			commandList->SetPipelineState(item.Pipeline);
+			commandList->IASetVertexBuffers(0, instanced ? 2 : 1, views);
+			commandList->IASetIndexBuffer(&m_IndexBufferViews[static_cast<uint32_t>(item.IndexFormat)]);
+			if (item.ObjectConstants != 0) { commandList->SetGraphicsRootConstantBufferView(1, item.ObjectConstants); }
+			commandList->DrawIndexedInstanced(item.IndexNum, item.InstanceNum, item.StartIndex, item.BaseVertex, item.FirstInstance);
+		}
+	}
+
+	commandList->Close();
+}
+
 // 描画を行う
 void Graphic::Render() {
+	PROFILE_ZONE("Graphic::Render");
 
-	HRESULT result;
+	// このフレームのリソースを前に使ったフレームが GPU で終わるまでだけ待つ
+	m_FrameIndex = m_FrameScheduler->BeginFrame();
+	m_BackBufferIndex = m_Backend->GetCurrentBackBufferIndex();
 
-	result = m_CommandAllocator[m_FrameIndex]->Reset();
-	result = m_CommandList->Reset(m_CommandAllocator[m_FrameIndex].get(), nullptr);
-	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+	m_CommandList->Reset(m_FrameIndex);
 
-	D3D12_RESOURCE_BARRIER barrier = {};
-	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	barrier.Transition.pResource = m_RenderTarget[m_FrameIndex].get();
-	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+	// 完了したフレームのアップロード領域と、作り直す前のバッファを回収
+	uint64_t completedValue = m_Backend->GetCompletedValue();
+	m_UploadAllocator->Retire(completedValue);
+	ReleaseRetiredBuffers(completedValue);
 
-	m_CommandList->ResourceBarrier(1, &barrier);
+	// 読み終えたメッシュを予算の範囲で共有バッファへ登録する (GPU へはこのフレームの UploadMeshes で送る)
+	m_AssetStreamer->Update(*m_MeshRegistry);
 
-	m_CommandList->OMSetRenderTargets(1, &m_HandleRTV[m_FrameIndex], FALSE, nullptr);
+	// LOD の選択に使うビュー・射影行列とビューポート
+	m_LodSelector->BeginFrame(m_FrameConstants.m_View, m_FrameConstants.m_Project, m_Viewport.Height);
 
-	float clearColor[] = { 0.25f, 0.25f, 0.25f, 1.0f };
+	// 動かしたノードのワールド行列だけを計算し直す
+	m_TransformHierarchy->Update(m_JobSystem.get());
 
-	m_CommandList->ClearRenderTargetView(m_HandleRTV[m_FrameIndex], clearColor, 0, nullptr);
+	// アプリケーションが描くもの (LOD の選択はここから使える)
+	if (m_FrameCallback) { m_FrameCallback(); }
 
-	{
-		ID3D12DescriptorHeap* heap = m_HeapCBV.get();
+	// 共有バッファの更新
+	UploadMeshes();
 
-		m_CommandList->SetGraphicsRootSignature(m_RootSignature.get());
-		m_CommandList->SetDescriptorHeaps(1, &heap);
-		m_CommandList->SetGraphicsRootConstantBufferView(0, m_ConstantBufferView[m_FrameIndex].Desc.BufferLocation);
-		m_CommandList->SetPipelineState(m_PipelineState.get());
+	// 定数バッファ
+	{
+		void* buffer = nullptr;
+		CONSTANT_BUFFER_VIEW<FRAME_CONSTANTS>& view = m_ConstantBufferView[m_FrameIndex];
+		view.BufferLocation = Upload(&m_FrameConstants, sizeof(FRAME_CONSTANTS), CONSTANT_BUFFER_ALIGNMENT, &buffer);
+		view.Buffer = static_cast<FRAME_CONSTANTS*>(buffer);
+		m_ConstantStatistics.FrameBytes = sizeof(FRAME_CONSTANTS);
+	}
 
-		m_CommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		m_CommandList->IASetVertexBuffers(0, 1, &m_VertexBufferView);
-		m_CommandList->IASetIndexBuffer(&m_IndexBufferView);
-		m_CommandList->RSSetViewports(1, &m_Viewport);
-		m_CommandList->RSSetScissorRects(1, &m_Scissor);
+	// アップロードはここまでにメインスレッドで済ませる
+	BuildDrawItems();
 
-		m_CommandList->DrawIndexedInstanced(m_Octahedron->GetIndexNum(), 1, 0, 0, 0);
-	}
+	RESOURCE_HANDLE renderTarget = m_Backend->GetBackBuffer(m_BackBufferIndex);
 
-	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	barrier.Transition.pResource = m_RenderTarget[m_FrameIndex].get();
-	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+	RESOURCE_BARRIER barrier = {};
+	barrier.Resource = renderTarget;
+	barrier.StateBefore = RESOURCE_STATE::PRESENT;
+	barrier.StateAfter = RESOURCE_STATE::RENDER_TARGET;
 
 	m_CommandList->ResourceBarrier(1, &barrier);
 
+	m_CommandList->OMSetRenderTarget(renderTarget);
+
+	float clearColor[] = { 0.25f, 0.25f, 0.25f, 1.0f };
+
+	m_CommandList->ClearRenderTargetView(renderTarget, clearColor);
+
 	m_CommandList->Close();
 
-	ID3D12CommandList* commandLists[] = { m_CommandList.get() };
-	m_Queue->ExecuteCommandLists(1, commandLists);
+	// ドローを連続した範囲に分け、スレッドごとのコマンドリストに記録する
+	const uint32_t listNum = static_cast<uint32_t>(m_DrawCommandLists.size());
+	const uint32_t itemNum = static_cast<uint32_t>(m_DrawItems.size());
+	m_JobSystem->Run(listNum, [this, listNum, itemNum](uint32_t job, uint32_t thread) {
+		uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(itemNum) * job / listNum);
+		uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(itemNum) * (job + 1) / listNum);
+		RecordDraws(m_DrawCommandLists[job].get(), begin, end);
+	});
+
+	m_PresentCommandList->Reset(m_FrameIndex);
 
-	result = m_SwapChain->Present(1, 0);
-	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+	barrier.StateBefore = RESOURCE_STATE::RENDER_TARGET;
+	barrier.StateAfter = RESOURCE_STATE::PRESENT;
 
-	const uint64_t currentValue = m_FenceCounter[m_FrameIndex];
-	result = m_Queue->Signal(m_Fence.get(), currentValue);
-	Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
+	m_PresentCommandList->ResourceBarrier(1, &barrier);
 
-	m_FrameIndex = m_SwapChain->GetCurrentBackBufferIndex();
+	m_PresentCommandList->Close();
 
-	if (m_Fence->GetCompletedValue() < m_FenceCounter[m_FrameIndex]) {
-		result = m_Fence->SetEventOnCompletion(m_FenceCounter[m_FrameIndex], m_FenceEvent);
-		Assert(FAILED(result), __FILE__, __LINE__, system_category().message(result).c_str());
-		WaitForSingleObjectEx(m_FenceEvent, INFINITE, FALSE);
+	// まとめて 1 回で実行する
+	vector<CommandList*> commandLists;
+	commandLists.reserve(listNum + 2);
+	commandLists.push_back(m_CommandList.get());
+	for (unique_ptr<StateFilterCommandList>& list : m_DrawCommandLists) { commandLists.push_back(list->GetCommandList()); }
+	commandLists.push_back(m_PresentCommandList.get());
+	m_Backend->ExecuteCommandLists(static_cast<uint32_t>(commandLists.size()), commandLists.data());
+
+	{
+		PROFILE_ZONE("Graphic::Present");
+		m_Backend->Present();
 	}
 
-	m_FenceCounter[m_FrameIndex] = currentValue + 1;
-}
+	// 待たずに次のフレームへ進む
+	uint64_t fenceValue = m_FrameScheduler->EndFrame();
+	m_UploadAllocator->FinishFrame(fenceValue);
+	for (RETIRED_BUFFER& retired : m_RetiredBuffers) {
+		if (retired.FenceValue == 0) { retired.FenceValue = fenceValue; }
+	}
 
-// ウィンドウを削除
-void Graphic::DeleteWindow() {
-	if (m_InstanceHandle) { UnregisterClass(m_ClassName, m_InstanceHandle); }
-	m_InstanceHandle = nullptr;
-	m_WindowHandle = nullptr;
+	// 記録した区間をフレームごとに読み出す (スレッドごとのバッファがあふれないように)
+	if (Profiler::IsEnabled()) { Profiler::Collect(); }
 }
 
 // 描画インターフェースを削除
 void Graphic::DeleteInterface() {
 
-	assert(m_Queue != nullptr);
-	assert(m_Fence != nullptr);
-	assert(m_FenceEvent != nullptr);
-
-	m_Queue->Signal(m_Fence.get(), m_FenceCounter[m_FrameIndex]);
+	assert(m_Backend != nullptr);
 
-	m_Fence->SetEventOnCompletion(m_FenceCounter[m_FrameIndex], m_FenceEvent);
+	if (m_FrameScheduler != nullptr) { m_FrameScheduler->WaitForIdle(); }
 
-	WaitForSingleObjectEx(m_FenceEvent, INFINITE, FALSE);
-
-	++m_FenceCounter[m_FrameIndex];
+	m_CommandList = nullptr;
+	m_DrawCommandLists.clear();
+	m_PresentCommandList = nullptr;
+	m_Backend->Terminate();
 }
 
 // インスタンスを取得
@@ -666,30 +649,353 @@ Graphic* Graphic::GetInstance() {
 }
 
 // 初期化
-bool Graphic::Initialize(LPCWCHAR title, uint32_t width, uint32_t height) {
-	m_Instance.reset(new Graphic(TEXT("DX12Game"), title, width, height));
-	m_Instance->CreateWindow();
-	m_Instance->CreateInterface();
-	m_Instance->BeforeRendering();
+bool Graphic::Initialize(BACKEND_TYPE type, const wchar_t* title, uint32_t width, uint32_t height, uint32_t threadNum, uint32_t frameLatency, const VERTEX_FORMAT& vertexFormat, const char* pipelineCachePath) {
+	m_Instance.reset(new Graphic(L"DX12Game", title, width, height, threadNum, frameLatency, vertexFormat, pipelineCachePath));
+	if (!m_Instance->CreateInterface(type)) { return false; }
+	if (!m_Instance->BeforeRendering()) { return false; }
 	return true;
 }
 
 // 終了処理
 void Graphic::Terminate() {
-	m_Instance->DeleteInterface();
-	m_Instance->DeleteWindow();
+	if (m_Instance == nullptr) { return; }
+	if (m_Instance->m_Backend != nullptr) { m_Instance->DeleteInterface(); }
 	m_Instance = nullptr;
 }
 
 // 更新処理
 bool Graphic::Update() {
-	MSG msg = {};
-	if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
-		TranslateMessage(&msg);
-		DispatchMessage(&msg);
+	PROFILE_ZONE("Graphic::Update");
+
+	// 溜まったメッセージをすべて処理してから描画する (メッセージが続いても描画が止まらないようにする)
+	bool quit = false;
+	while (!quit && m_Backend->ProcessMessage(&quit)) {}
+	if (!quit) { Render(); }
+	return !quit;
+}
+
+// 決まったフレーム数だけ描画して CPU 側のフレーム時間を出力する
+void Graphic::RunBenchmark(uint32_t frameNum) {
+
+	if (frameNum == 0) { return; }
+
+	vector<double> frameTimes;
+	frameTimes.reserve(frameNum);
+
+	for (unique_ptr<StateFilterCommandList>& list : m_DrawCommandLists) { list->ResetStatistics(); }
+
+	for (uint32_t i = 0; i < frameNum; ++i) {
+		auto begin = chrono::steady_clock::now();
+		Render();
+		auto end = chrono::steady_clock::now();
+		frameTimes.push_back(chrono::duration<double, milli>(end - begin).count());
+	}
+
+	double total = 0.0;
+	for (double time : frameTimes) { total += time; }
+	sort(frameTimes.begin(), frameTimes.end());
+
+	// 最も近い順位の値を百分位とする
+	auto percentile = [&frameTimes](double p) {
+		size_t index = static_cast<size_t>(p * (frameTimes.size() - 1) + 0.5);
+		return frameTimes[index];
+	};
+
+	cout << "frames : " << frameNum << endl;
+	cout << "threads : " << m_JobSystem->GetThreadNum() << endl;
+	cout << "avg : " << total / frameNum << " ms" << endl;
+	cout << "p50 : " << percentile(0.50) << " ms" << endl;
+	cout << "p90 : " << percentile(0.90) << " ms" << endl;
+	cout << "p99 : " << percentile(0.99) << " ms" << endl;
+	cout << "max : " << frameTimes.back() << " ms" << endl;
+
+	// CPU が GPU を待った時間と、フレームを始めてから GPU が終えるまでの遅延
+	FRAME_STATISTICS frame = m_FrameScheduler->GetStatistics();
+	cout << "frame latency : " << m_FrameScheduler->GetFrameLatency() << endl;
+	cout << "cpu waits : " << frame.WaitCount << endl;
+	cout << "cpu wait avg : " << frame.TotalWaitTime / frame.FrameNum << " ms" << endl;
+	cout << "cpu wait max : " << frame.MaxWaitTime << " ms" << endl;
+	if (frame.CompletedNum > 0) {
+		cout << "latency avg : " << frame.TotalLatency / frame.CompletedNum << " ms" << endl;
+		cout << "latency max : " << frame.MaxLatency << " ms" << endl;
+	}
+
+	// 共有メッシュの大きさ (VERTEX と 32 ビットのインデックスのままだった場合との比較)
+	MESH_REGISTRY_STATISTICS mesh = m_MeshRegistry->GetStatistics();
+	uint64_t meshBytes = mesh.VertexBytesUsed + mesh.IndexBytesUsed;
+	cout << "vertex stride : " << mesh.VertexStride << " bytes (" << sizeof(VERTEX) << " raw)" << endl;
+	cout << "32-bit index meshes : " << mesh.WideIndexMeshCount << " / " << mesh.MeshCount << endl;
+	cout << "mesh buffer : " << mesh.BytesResident << " bytes resident, " << mesh.GrowCount << " grows, " << mesh.CompactionCount << " compactions" << endl;
+	cout << "mesh bytes : " << meshBytes << " (" << mesh.RawBytesUsed << " raw, " << (mesh.RawBytesUsed > 0 ? 100.0 * (mesh.RawBytesUsed - meshBytes) / mesh.RawBytesUsed : 0.0) << " % saved)" << endl;
+	if (mesh.MeshCount > 0) {
+		cout << "upload bytes / mesh : " << mesh.UploadBytes / mesh.MeshCount << endl;
+	}
+	for (const MESH_OPTIMIZATION_STATISTICS& optimization : m_MeshOptimizations) {
+		cout << "mesh optimization : " << optimization.TriangleNum << " triangles, acmr " << optimization.ACMRBefore << " -> " << optimization.ACMRAfter;
+		cout << ", atvr " << optimization.ATVRBefore << " -> " << optimization.ATVRAfter << endl;
+	}
+
+	// 後から読み込んだメッシュ (レンダースレッドで登録にかかった時間と量)
+	STREAMING_STATISTICS streaming = m_AssetStreamer->GetStatistics();
+	if (streaming.ResidentNum + streaming.FailedNum + streaming.QueueDepth > 0) {
+		cout << "streamed meshes : " << streaming.ResidentNum << " resident, " << streaming.FailedNum << " failed, " << streaming.QueueDepth << " queued (" << streaming.BytesInFlight << " bytes in flight)" << endl;
+		cout << "stream upload / frame : " << streaming.TotalUploadBytes / max(streaming.FrameNum, 1u) << " bytes avg (budget " << streaming.UploadBudget << "), ";
+		cout << streaming.TotalUploadTime / max(streaming.FrameNum, 1u) << " ms avg, " << streaming.MaxUploadTime << " ms max" << endl;
+	}
+
+	// 直前のフレームの視錐台カリング (シーンのオブジェクト)
+	CULLING_STATISTICS culling = m_Scene->GetCullingStatistics();
+	cout << "culling : " << culling.Tested << " tested, " << culling.Visible << " visible, " << culling.Culled << " culled" << endl;
+
+	// 直前のフレームに書き込んだ定数 (フレームごと、定数バッファで渡すオブジェクト、インスタンスのストリーム)
+	const CONSTANT_STATISTICS& constant = m_ConstantStatistics;
+	cout << "constant bytes / frame : " << constant.FrameBytes + constant.ObjectBytes + constant.InstanceBytes << " (frame " << constant.FrameBytes;
+	cout << ", " << constant.ObjectNum << " objects " << constant.ObjectBytes << ", " << constant.InstanceNum << " instances " << constant.InstanceBytes << ")" << endl;
+
+	// アップロード用リングバッファの使用量 (待ちは GPU で使用中の範囲に追いついた回数)
+	UPLOAD_STATISTICS upload = m_UploadAllocator->GetStatistics();
+	cout << "upload bytes / frame : " << upload.LastFrameBytes << " (" << upload.BytesInFlight << " / " << m_UploadAllocator->GetCapacity() << " in flight, ";
+	cout << upload.TotalBytes << " total), " << upload.WrapCount << " wraps, " << upload.StallCount << " stalls, " << upload.FailedCount << " failed" << endl;
+
+	// ドローの並べ替え (直前のフレーム、投入された順のままだった場合との比較)
+	RENDER_QUEUE_STATISTICS queue = m_RenderQueue->GetStatistics();
+	cout << "draw sort : " << queue.DrawNum << " draws, " << queue.SortTime << " ms, " << queue.SortPasses << " passes" << endl;
+	cout << "pipeline changes : " << queue.PipelineChanges << " (" << queue.UnsortedPipelineChanges << " unsorted), mesh changes : " << queue.MeshChanges << " (" << queue.UnsortedMeshChanges << " unsorted)" << endl;
+
+	// 省いた状態の設定 (1 フレームあたり)
+	STATE_FILTER_STATISTICS filter = GetStateFilterStatistics();
+	uint64_t issued = 0, elided = 0;
+	for (size_t i = 0; i < static_cast<size_t>(STATE_CALL::NUM); ++i) {
+		issued += filter.Issued[i];
+		elided += filter.Elided[i];
+	}
+	cout << "state filter : " << issued / frameNum << " issued, " << elided / frameNum << " elided / frame";
+	cout << " (" << (issued + elided > 0 ? 100.0 * elided / (issued + elided) : 0.0) << " %" << (m_StateFilterEnabled ? "" : ", disabled") << ")" << endl;
+	for (size_t i = 0; i < static_cast<size_t>(STATE_CALL::NUM); ++i) {
+		if (filter.Elided[i] == 0) { continue; }
+		cout << "  " << StateFilterCommandList::GetCallName(static_cast<STATE_CALL>(i)) << " : " << filter.Issued[i] / frameNum << " issued, " << filter.Elided[i] / frameNum << " elided" << endl;
+	}
+
+	// LOD で減らした三角形 (すべて最も細かい段階で描いた場合との比較)
+	LOD_STATISTICS lod = m_LodSelector->GetStatistics();
+	if (lod.ObjectNum > 0) {
+		cout << "lod triangles / frame : " << lod.SubmittedTriangles / max(lod.FrameNum, 1u) << " (" << lod.FullTriangles / max(lod.FrameNum, 1u) << " without lod, ";
+		cout << 100.0 * (lod.FullTriangles - lod.SubmittedTriangles) / lod.FullTriangles << " % saved, threshold " << m_LodSelector->GetThreshold() << " px";
+		cout << (m_LodSelector->IsEnabled() ? "" : ", disabled") << ")" << endl;
+	}
+
+	// パイプラインの作成時間 (すべてキャッシュに当たれば warm、ひとつも当たらなければ cold)
+	cout << "pipeline startup : " << m_PipelineStartupTime << " ms";
+	if (m_PipelineCache != nullptr) {
+		PIPELINE_CACHE_STATISTICS pipeline = m_PipelineCache->GetStatistics();
+		const char* state = pipeline.MissCount == 0 ? (pipeline.HitCount > 0 ? "warm" : "unused") : (pipeline.HitCount > 0 ? "partial" : "cold");
+		cout << " (" << state << ")" << endl;
+		cout << "pipeline cache : " << pipeline.HitCount << " hits, " << pipeline.MissCount << " misses, " << pipeline.RejectedNum << " rejected, " << pipeline.EntryNum << " entries" << endl;
+		cout << "pipeline cache open : " << pipeline.OpenTime << " ms, save : " << pipeline.SaveTime << " ms, " << pipeline.FileBytes << " bytes" << endl;
 	}
 	else {
-		Render();
+		cout << " (no cache)" << endl;
+	}
+
+	// 記録用バックエンドなら呼び出し回数も出す
+	NullBackend* nullBackend = dynamic_cast<NullBackend*>(m_Backend.get());
+	if (nullBackend != nullptr) {
+		NULL_BACKEND_STATISTICS statistics = nullBackend->GetFrameStatistics();
+		cout << "draws / frame : " << statistics.DrawCount << endl;
+		cout << "instances / frame : " << statistics.InstanceCount << endl;
+		cout << "state calls / frame : " << statistics.StateCallCount << endl;
+		cout << "barriers / frame : " << statistics.BarrierCount << endl;
+		cout << "invalid barriers : " << nullBackend->GetStatistics().InvalidBarrierCount << endl;
+	}
+
+	// ソフトウェア描画なら塗った量も出す
+	SoftwareBackend* softwareBackend = dynamic_cast<SoftwareBackend*>(m_Backend.get());
+	if (softwareBackend != nullptr) {
+		RASTERIZER_STATISTICS statistics = softwareBackend->GetRasterizerStatistics();
+		cout << "triangles / frame : " << statistics.TriangleNum / frameNum << endl;
+		cout << "pixels / frame : " << statistics.PixelNum / frameNum << endl;
+		cout << "pixels / sec : " << statistics.PixelNum / (total / 1000.0) << endl;
+	}
+}
+
+// 直前のフレームを画像に書き出す (ソフトウェア描画のときのみ)
+bool Graphic::SaveImage(const char* path) const {
+	SoftwareBackend* softwareBackend = dynamic_cast<SoftwareBackend*>(m_Backend.get());
+	return softwareBackend != nullptr && softwareBackend->SaveImage(path);
+}
+
+// 直前のフレームを参照画像と比べる (ソフトウェア描画のときのみ)
+bool Graphic::CompareImage(const char* path, float tolerance, IMAGE_COMPARISON* result) const {
+	SoftwareBackend* softwareBackend = dynamic_cast<SoftwareBackend*>(m_Backend.get());
+	if (softwareBackend == nullptr) {
+		*result = {};
+		return false;
+	}
+	return softwareBackend->CompareImage(path, tolerance, result);
+}
+
+// メッシュを登録
+MESH_HANDLE Graphic::RegisterMesh(const RenderObject& object) {
+	return m_MeshRegistry->Register(object);
+}
+
+// メッシュファイルを登録 (マップしたファイルから共有バッファへ直接コピーする)
+MESH_HANDLE Graphic::RegisterMesh(const MeshFile& file) {
+	const MESH_FILE_HEADER& header = file.GetHeader();
+	return m_MeshRegistry->Register(file.GetVertexFormat(), file.GetVertexData(), header.VertexNum, file.GetIndexFormat(), file.GetIndexData(), header.IndexNum);
+}
+
+// インスタンスを描画キューに積む
+void Graphic::DrawInstance(MESH_HANDLE mesh, FXMMATRIX world) {
+	m_InstanceBatcher->Submit(mesh, world);
+}
+
+// 1 回のドローで描く (インスタンスにまとめない)
+void Graphic::DrawObject(MESH_HANDLE mesh, FXMMATRIX world, RENDER_PASS pass) {
+	if (mesh == INVALID_MESH_HANDLE) { return; }
+	INSTANCE_DATA data;
+	XMStoreFloat4x4(&data.World, world);
+	m_ObjectMeshes.push_back(mesh);
+	m_ObjectWorlds.push_back(data);
+	m_ObjectPasses.push_back(pass);
+}
+
+// フレームの始めに描くものを積むコールバックを設定
+void Graphic::SetFrameCallback(const function<void()>& callback) {
+	m_FrameCallback = callback;
+}
+
+// メッシュファイルの読み込みを要求する (読み終えたものから後のフレームで登録される)
+STREAM_REQUEST Graphic::StreamMesh(const char* path) {
+	return m_AssetStreamer->Request(path);
+}
+
+// メッシュを作る処理を要求する (ワーカースレッドで呼ばれる)
+STREAM_REQUEST Graphic::StreamMesh(const MESH_GENERATOR& generator) {
+	return m_AssetStreamer->Request(generator);
+}
+
+// 読み込んだメッシュを取得 (まだ登録されていなければ INVALID_MESH_HANDLE)
+MESH_HANDLE Graphic::GetStreamedMesh(STREAM_REQUEST request) const {
+	return m_AssetStreamer->GetMesh(request);
+}
+
+// 1 フレームに登録するバイト数の上限を設定
+void Graphic::SetStreamingBudget(uint64_t bytesPerFrame) {
+	m_AssetStreamer->SetUploadBudget(bytesPerFrame);
+}
+
+// このフレームのビューで LOD の段階を選ぶ (フレームのコールバックの中で呼ぶ)
+uint32_t Graphic::SelectLod(const LodChain& chain, FXMMATRIX world) {
+	return m_LodSelector->Select(chain, world);
+}
+
+// 変換の階層にノードを追加 (parent は追加済みのノードか INVALID_TRANSFORM_NODE)
+TRANSFORM_NODE Graphic::AddTransformNode(TRANSFORM_NODE parent, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale) {
+	return m_TransformHierarchy->AddNode(parent, position, rotation, scale);
+}
+
+// ノードのワールド行列を取得 (フレームのコールバックの中ではこのフレームの値になる)
+XMMATRIX Graphic::GetWorldMatrix(TRANSFORM_NODE node) const {
+	return m_TransformHierarchy->GetWorldMatrix(node);
+}
+
+// LOD の選択の有効・無効を設定 (無効なら常に最も細かい段階で描く)
+void Graphic::SetLodEnabled(bool enabled) {
+	m_LodSelector->SetEnabled(enabled);
+}
+
+// LOD の選択の閾値を設定 (ピクセル)
+void Graphic::SetLodThreshold(float pixels) {
+	m_LodSelector->SetThreshold(pixels);
+}
+
+// 仮想的な GPU の処理時間を設定 (記録用バックエンドのときのみ)
+void Graphic::SetSimulatedGPUTime(double milliseconds) {
+	NullBackend* nullBackend = dynamic_cast<NullBackend*>(m_Backend.get());
+	if (nullBackend != nullptr) { nullBackend->SetGPUFrameTime(milliseconds); }
+}
+
+// 冗長な状態の設定を省くかどうかを設定
+void Graphic::SetStateFilterEnabled(bool enabled) {
+	m_StateFilterEnabled = enabled;
+	for (unique_ptr<StateFilterCommandList>& list : m_DrawCommandLists) { list->SetEnabled(enabled); }
+}
+
+// 記録に使うスレッド数を取得
+uint32_t Graphic::GetThreadNum() const {
+	return m_JobSystem->GetThreadNum();
+}
+
+// 今のビューの視錐台を取得
+FRUSTUM Graphic::GetFrustum() const {
+	return FrustumCuller::ExtractFrustum(m_FrameConstants.m_ViewProject);
+}
+
+// フレームの統計情報を取得
+FRAME_STATISTICS Graphic::GetFrameStatistics() const {
+	return m_FrameScheduler != nullptr ? m_FrameScheduler->GetStatistics() : FRAME_STATISTICS{ 0 };
+}
+
+// アップロードの統計情報を取得
+UPLOAD_STATISTICS Graphic::GetUploadStatistics() const {
+	return m_UploadAllocator != nullptr ? m_UploadAllocator->GetStatistics() : UPLOAD_STATISTICS{ 0 };
+}
+
+// 1 フレームに書き込んだ定数の量を取得
+CONSTANT_STATISTICS Graphic::GetConstantStatistics() const {
+	return m_ConstantStatistics;
+}
+
+// 共有メッシュの統計情報を取得
+MESH_REGISTRY_STATISTICS Graphic::GetMeshStatistics() const {
+	return m_MeshRegistry->GetStatistics();
+}
+
+// カリングの統計情報を取得
+CULLING_STATISTICS Graphic::GetCullingStatistics() const {
+	return m_Scene->GetCullingStatistics();
+}
+
+// 変換の階層の統計情報を取得
+TRANSFORM_HIERARCHY_STATISTICS Graphic::GetTransformStatistics() const {
+	return m_TransformHierarchy->GetStatistics();
+}
+
+// 描画キューの統計情報を取得
+RENDER_QUEUE_STATISTICS Graphic::GetRenderQueueStatistics() const {
+	return m_RenderQueue->GetStatistics();
+}
+
+// 状態の設定の統計情報を取得 (全スレッドのコマンドリストの合計)
+STATE_FILTER_STATISTICS Graphic::GetStateFilterStatistics() const {
+	STATE_FILTER_STATISTICS total = {};
+	for (const unique_ptr<StateFilterCommandList>& list : m_DrawCommandLists) {
+		STATE_FILTER_STATISTICS statistics = list->GetStatistics();
+		for (size_t i = 0; i < static_cast<size_t>(STATE_CALL::NUM); ++i) {
+			total.Issued[i] += statistics.Issued[i];
+			total.Elided[i] += statistics.Elided[i];
+		}
 	}
-	return msg.message != WM_QUIT;
+	return total;
+}
+
+// ストリーミングの統計情報を取得
+STREAMING_STATISTICS Graphic::GetStreamingStatistics() const {
+	return m_AssetStreamer->GetStatistics();
+}
+
+// LOD の統計情報を取得
+LOD_STATISTICS Graphic::GetLodStatistics() const {
+	return m_LodSelector->GetStatistics();
+}
+
+// パイプラインキャッシュの統計情報を取得
+PIPELINE_CACHE_STATISTICS Graphic::GetPipelineCacheStatistics() const {
+	return m_PipelineCache != nullptr ? m_PipelineCache->GetStatistics() : PIPELINE_CACHE_STATISTICS{ 0 };
+}
+
+// ルートシグニチャとパイプラインを作るのにかかった時間を取得
+double Graphic::GetPipelineStartupTime() const {
+	return m_PipelineStartupTime;
 }
@@ -2,139 +2,216 @@
 
 #include <cassert>
 #include <cstdint>
-#include <exception>
+#include <functional>
 #include <iostream>
 #include <memory>
-#include <sstream>
-#include <system_error>
-#include <Windows.h>
+#include <vector>
 #include <DirectXMath.h>
-#include <d3d12.h>
-#include <d3dcompiler.h>
-#include <dxgi1_4.h>
 
-#if defined(DEBUG) || defined(_DEBUG)
+#if defined(_WIN32) && (defined(DEBUG) || defined(_DEBUG))
 #define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
 
+#include "AssetStreamer.h"
+#include "FrameScheduler.h"
+#include "FrustumCuller.h"
+#include "InstanceBatcher.h"
+#include "JobSystem.h"
+#include "LodChain.h"
+#include "MatrixBatch.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "MeshRegistry.h"
+#include "PipelineCache.h"
+#include "RenderBackend.h"
 #include "RenderObject.h"
-
-#pragma comment(lib, "d3d12.lib")
-#pragma comment(lib, "d3dcompiler.lib")
-#pragma comment(lib, "dxgi.lib")
-#pragma commend(lib, "dxguid.lib")
-
-#undef CreateWindow
+#include "RenderQueue.h"
+#include "Scene.h"
+#include "StateFilterCommandList.h"
+#include "TransformHierarchy.h"
+#include "UploadRingAllocator.h"
+#include "VertexFormat.h"
 
 using namespace std;
 using namespace DirectX;
 
-// COMデリータ
-class UComDeleter {
-public:
-	void operator()(IUnknown* ptr) const {
-		if (ptr) { ptr->Release(); }
-	}
-};
-
-// ユニークなCOMポインタ
-template <typename T>
-using unique_com_ptr = unique_ptr<T, UComDeleter>;
+struct IMAGE_COMPARISON;
 
-// 変換行列
-struct alignas(256) TRANSFORM {
-	XMMATRIX m_World;
+// フレームごとの定数 (全オブジェクトで共通、SimpleVS と InstancedVS の b0)
+struct alignas(256) FRAME_CONSTANTS {
 	XMMATRIX m_View;
 	XMMATRIX m_Project;
+	XMMATRIX m_ViewProject;   // m_View と m_Project を掛けたもの
+	XMFLOAT4 m_PositionScale; // 量子化した頂点の位置に掛ける値
+};
+
+// オブジェクトごとの定数 (SimpleVS の b1、1 つの領域に並べて書き込みオフセットで指す)
+struct OBJECT_CONSTANTS {
+	XMFLOAT4X4 m_WorldViewProject;
+};
+
+// 1 フレームに書き込んだ定数の量 (バイト)
+struct CONSTANT_STATISTICS {
+	uint64_t FrameBytes;
+	uint64_t ObjectBytes;   // 定数バッファで渡すオブジェクトの分 (256 バイト境界で並べる)
+	uint64_t InstanceBytes; // インスタンスのストリームで渡すオブジェクトの分 (詰めて並べる)
+	uint32_t ObjectNum;
+	uint32_t InstanceNum;
 };
 
 // 定数バッファービュー
 template <typename T>
-struct D3D12_CONSTANT_BUFFER_VIEW {
-	D3D12_CONSTANT_BUFFER_VIEW_DESC Desc;
-	D3D12_CPU_DESCRIPTOR_HANDLE CPUHandle;
-	D3D12_GPU_DESCRIPTOR_HANDLE GPUHandle;
+struct CONSTANT_BUFFER_VIEW {
+	GPU_ADDRESS BufferLocation;
 	T* Buffer;
 };
 
+// 記録するドロー 1 回分
+struct DRAW_ITEM {
+	PIPELINE_HANDLE Pipeline;
+	uint32_t IndexNum;
+	uint32_t StartIndex;
+	INDEX_FORMAT IndexFormat;
+	int32_t BaseVertex;
+	uint32_t InstanceNum;
+	uint32_t FirstInstance;      // InstanceChunk 番目のストリームの中での位置
+	GPU_ADDRESS ObjectConstants; // オブジェクトごとの定数 (0 ならインスタンスのストリームから読む)
+	uint32_t InstanceChunk;      // インスタンスのストリームの番号
+};
+
+// 作り直して使わなくなったバッファ (最後に使ったフレームのフェンス値を GPU が越えたら解放する)
+struct RETIRED_BUFFER {
+	RESOURCE_HANDLE Buffer;
+	uint64_t FenceValue; // 0 ならまだフレームを終えていない
+};
+
 // 描画インタフェース
 class Graphic {
 
 // メンバ変数
 private:
-	static const uint32_t m_FrameCount = 2;
+	static const uint64_t m_UploadBufferSize = 4 * 1024 * 1024;
+	static const uint32_t m_VertexCapacity = 64 * 1024;       // 共有バッファの最初の容量 (足りなければメッシュレジストリが広げる)
+	static const uint32_t m_IndexCapacity = 512 * 1024;       // バイト数
+	static const uint32_t m_InstanceChunkNum = static_cast<uint32_t>(m_UploadBufferSize / 4 / sizeof(INSTANCE_DATA)); // インスタンスのストリームを分割する個数 (リングを占有しないようにする)
 	static unique_ptr<Graphic> m_Instance;
 
 	// 実験用プリミティブ
 	unique_ptr<Hexahedron> m_Hexahedron;
 	unique_ptr<Octahedron> m_Octahedron;
 
+	// 共有メッシュ
+	unique_ptr<MeshRegistry> m_MeshRegistry;
+	MESH_HANDLE m_HexahedronMesh;
+	MESH_HANDLE m_OctahedronMesh;
+	vector<MESH_OPTIMIZATION_STATISTICS> m_MeshOptimizations;
+
+	// 後から読み込むメッシュ (ワーカースレッドで読み、予算の範囲で共有バッファへ登録する)
+	unique_ptr<AssetStreamer> m_AssetStreamer;
+
+	// LOD (フレームの始めにビュー・射影行列を渡し、描く側が画面上の誤差で段階を選ぶ)
+	unique_ptr<LodSelector> m_LodSelector;
+
+	// インスタンス描画
+	unique_ptr<InstanceBatcher> m_InstanceBatcher;
+
+	// 変換の階層 (描画の前に、動かしたノードのワールド行列だけを計算し直す)
+	unique_ptr<TransformHierarchy> m_TransformHierarchy;
+
+	// シーン (個別に描くプリミティブを空間で引き、視錐台に入るものだけを描く)
+	unique_ptr<Scene> m_Scene;
+	vector<SCENE_OBJECT> m_VisibleObjects;
+
+	// 個別に描くオブジェクト (インスタンスにまとめない)
+	vector<MESH_HANDLE> m_ObjectMeshes;
+	vector<INSTANCE_DATA> m_ObjectWorlds;
+	vector<RENDER_PASS> m_ObjectPasses;
+
+	// フレームの始めに描くものを積むコールバック (アプリケーションや負荷計測用のシーンが設定する)
+	function<void()> m_FrameCallback;
+
+	// 並列記録 (ドローを分割してスレッドごとのコマンドリストに記録する)
+	unique_ptr<JobSystem> m_JobSystem;
+	vector<DRAW_ITEM> m_DrawItems;
+
+	// ドローの並べ替え (ソートキーの順に並べ替えてから記録する)
+	unique_ptr<RenderQueue> m_RenderQueue;
+	vector<DRAW_ITEM> m_SortedDrawItems;
+
+	// フレームの進行 (同時に処理中にできるフレーム数)
+	uint32_t m_FrameLatency;
+	unique_ptr<FrameScheduler> m_FrameScheduler;
+
 	// ウィンドウ関連
-	HINSTANCE m_InstanceHandle;
-	HWND m_WindowHandle;
-	LPCWCHAR m_ClassName;
-	LPCWCHAR m_WindowName;
+	const wchar_t* m_ClassName;
+	const wchar_t* m_WindowName;
 	uint32_t m_WindowWidth;
 	uint32_t m_WindowHeight;
 
-	// デバッグレイヤー
-#if defined(DEBUG) || defined(_DEBUG)
-	unique_com_ptr<ID3D12Debug> m_Debug;
-#endif
+	// 描画バックエンド
+	unique_ptr<RenderBackend> m_Backend;
+	unique_ptr<CommandList> m_CommandList;
+	vector<unique_ptr<StateFilterCommandList>> m_DrawCommandLists; // 冗長な状態の設定を省いてから記録する
+	bool m_StateFilterEnabled;
+	unique_ptr<CommandList> m_PresentCommandList;
+	ROOT_SIGNATURE_HANDLE m_RootSignature;
+	PIPELINE_HANDLE m_PipelineState;
+	PIPELINE_HANDLE m_InstancedPipelineState;
 
-	// 描画デバイス
-	unique_com_ptr<ID3D12Device> m_Device;
-	unique_com_ptr<ID3D12CommandQueue> m_Queue;
-	unique_com_ptr<IDXGISwapChain3> m_SwapChain;
-	unique_com_ptr<ID3D12CommandAllocator> m_CommandAllocator[m_FrameCount];
-	unique_com_ptr<ID3D12GraphicsCommandList> m_CommandList;
-	unique_com_ptr<ID3D12RootSignature> m_RootSignature;
-	unique_com_ptr<ID3D12PipelineState> m_PipelineState;
+	// パイプラインキャッシュ (パスが nullptr なら使わない)
+	const char* m_PipelineCachePath;
+	unique_ptr<PipelineCache> m_PipelineCache;
+	double m_PipelineStartupTime; // ルートシグニチャとパイプラインを作るのにかかった時間 (ミリ秒)
 
 	// 描画範囲
-	D3D12_VIEWPORT m_Viewport;
-	D3D12_RECT m_Scissor;
+	VIEWPORT m_Viewport;
+	SCISSOR_RECT m_Scissor;
 
 	// バッファ
-	unique_com_ptr<ID3D12Resource> m_RenderTarget[m_FrameCount];
-	unique_com_ptr<ID3D12Resource> m_VertexBuffer;
-	unique_com_ptr<ID3D12Resource> m_IndexBuffer;
-	unique_com_ptr<ID3D12Resource> m_ConstantBuffer[m_FrameCount];
+	RESOURCE_HANDLE m_UploadBuffer;
+	vector<RETIRED_BUFFER> m_RetiredBuffers; // 大きくする前のバッファ (記録済みのコマンドが参照するので GPU が終えるまで残す)
+	RESOURCE_HANDLE m_VertexBuffer;
+	RESOURCE_HANDLE m_IndexBuffer;
+	bool m_MeshBufferInitialized;
 
-	// バッファビュー
-	D3D12_VERTEX_BUFFER_VIEW m_VertexBufferView;
-	D3D12_INDEX_BUFFER_VIEW m_IndexBufferView;
-	D3D12_CONSTANT_BUFFER_VIEW<TRANSFORM> m_ConstantBufferView[m_FrameCount];
-
-	// ディスクリプタヒープ
-	unique_com_ptr<ID3D12DescriptorHeap> m_HeapRTV;
-	unique_com_ptr<ID3D12DescriptorHeap> m_HeapCBV;
+	// アップロードバッファの割り当て
+	unique_ptr<UploadRingAllocator> m_UploadAllocator;
 
-	// ディスクリプタハンドル
-	D3D12_CPU_DESCRIPTOR_HANDLE m_HandleRTV[m_FrameCount];
+	// 定数 (フレームごとの分とオブジェクトごとの分に分けて書き込む)
+	FRAME_CONSTANTS m_FrameConstants;
+	CONSTANT_STATISTICS m_ConstantStatistics;
 
-	// フェンス
-	unique_com_ptr<ID3D12Fence> m_Fence;
-	HANDLE m_FenceEvent;
-	uint64_t m_FenceCounter[m_FrameCount];
+	// バッファビュー
+	VERTEX_BUFFER_VIEW m_VertexBufferView;
+	INDEX_BUFFER_VIEW m_IndexBufferViews[2]; // 同じ共有バッファを R16_UINT と R32_UINT で見る (INDEX_FORMAT が添え字)
+	vector<VERTEX_BUFFER_VIEW> m_InstanceBufferViews; // インスタンスのストリーム (m_InstanceChunkNum 個ずつに分けてアップロードする)
+	vector<CONSTANT_BUFFER_VIEW<FRAME_CONSTANTS>> m_ConstantBufferView;
 
-	// フレーム番号
+	// フレーム番号 (フレームごとのリソースの添え字) とバックバッファの番号
 	uint32_t m_FrameIndex;
+	uint32_t m_BackBufferIndex;
 
 // メソッド
 private:
-	Graphic(LPCWCHAR className, LPCWCHAR windowName, uint32_t windowwidth, uint32_t windowheight);
-	bool CreateWindow();
-	bool CreateInterface();
+	Graphic(const wchar_t* className, const wchar_t* windowName, uint32_t windowwidth, uint32_t windowheight, uint32_t threadNum, uint32_t frameLatency, const VERTEX_FORMAT& vertexFormat, const char* pipelineCachePath);
+	bool CreateInterface(BACKEND_TYPE type);
 	bool BeforeRendering(); // HACK : 後で削除する
+	GPU_ADDRESS Upload(const void* data, uint64_t size, uint64_t alignment, void** cpuAddress = nullptr);
+	void GrowUploadBuffer(uint64_t size);
+	void RetireBuffer(RESOURCE_HANDLE buffer);
+	void ReleaseRetiredBuffers(uint64_t completedValue);
+	void CopyToBuffer(RESOURCE_HANDLE dest, uint64_t destOffset, const void* data, uint64_t size);
+	void CreateMeshBuffers();
+	void UploadMeshes();
+	void BuildDrawItems();
+	void RecordDraws(CommandList* commandList, uint32_t begin, uint32_t end);
 	void Render();
-	void DeleteWindow();
 	void DeleteInterface();
 
 public:
 	static Graphic* GetInstance();
-	static bool Initialize(LPCWCHAR title, uint32_t width, uint32_t height);
+	static bool Initialize(BACKEND_TYPE type, const wchar_t* title, uint32_t width, uint32_t height, uint32_t threadNum = 0, uint32_t frameLatency = 2, const VERTEX_FORMAT& vertexFormat = VertexFormat::Compact(), const char* pipelineCachePath = "PipelineCache.bin");
 	static void Terminate();
 
 	~Graphic() = default;
@@ -142,5 +219,38 @@ public:
 	Graphic& operator=(const Graphic&) = delete;
 
 	bool Update();
+	void RunBenchmark(uint32_t frameNum);
+	bool SaveImage(const char* path) const;
+	bool CompareImage(const char* path, float tolerance, IMAGE_COMPARISON* result) const;
+	MESH_HANDLE RegisterMesh(const RenderObject& object);
+	MESH_HANDLE RegisterMesh(const MeshFile& file);
+	void DrawInstance(MESH_HANDLE mesh, FXMMATRIX world);
+	void DrawObject(MESH_HANDLE mesh, FXMMATRIX world, RENDER_PASS pass = RENDER_PASS::STATE_SORTED);
+	void SetFrameCallback(const function<void()>& callback);
+	STREAM_REQUEST StreamMesh(const char* path);
+	STREAM_REQUEST StreamMesh(const MESH_GENERATOR& generator);
+	MESH_HANDLE GetStreamedMesh(STREAM_REQUEST request) const;
+	void SetStreamingBudget(uint64_t bytesPerFrame);
+	uint32_t SelectLod(const LodChain& chain, FXMMATRIX world);
+	TRANSFORM_NODE AddTransformNode(TRANSFORM_NODE parent, const XMFLOAT3& position = XMFLOAT3(0.0f, 0.0f, 0.0f), const XMFLOAT4& rotation = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), const XMFLOAT3& scale = XMFLOAT3(1.0f, 1.0f, 1.0f));
+	XMMATRIX GetWorldMatrix(TRANSFORM_NODE node) const;
+	void SetLodEnabled(bool enabled);
+	void SetLodThreshold(float pixels);
+	void SetSimulatedGPUTime(double milliseconds);
+	void SetStateFilterEnabled(bool enabled);
+	uint32_t GetThreadNum() const;
+	FRUSTUM GetFrustum() const;
+	FRAME_STATISTICS GetFrameStatistics() const;
+	UPLOAD_STATISTICS GetUploadStatistics() const;
+	CONSTANT_STATISTICS GetConstantStatistics() const;
+	MESH_REGISTRY_STATISTICS GetMeshStatistics() const;
+	CULLING_STATISTICS GetCullingStatistics() const;
+	TRANSFORM_HIERARCHY_STATISTICS GetTransformStatistics() const;
+	RENDER_QUEUE_STATISTICS GetRenderQueueStatistics() const;
+	STATE_FILTER_STATISTICS GetStateFilterStatistics() const;
+	STREAMING_STATISTICS GetStreamingStatistics() const;
+	LOD_STATISTICS GetLodStatistics() const;
+	PIPELINE_CACHE_STATISTICS GetPipelineCacheStatistics() const;
+	double GetPipelineStartupTime() const;
 };
 
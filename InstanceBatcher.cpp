@@ -0,0 +1,139 @@
+﻿#include "InstanceBatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+// インスタンスを投入
+void InstanceBatcher::Submit(MESH_HANDLE mesh, FXMMATRIX world) {
+	XMFLOAT4X4 matrix;
+	XMStoreFloat4x4(&matrix, world);
+	Submit(mesh, matrix);
+}
+
+// インスタンスを投入
+void InstanceBatcher::Submit(MESH_HANDLE mesh, const XMFLOAT4X4& world) {
+	if (mesh == INVALID_MESH_HANDLE) { return; }
+	m_SubmittedMeshes.push_back(mesh);
+	m_SubmittedWorlds.push_back(world);
+}
+
+// メッシュごとにまとめる
+void InstanceBatcher::Build() {
+
+	m_Groups.clear();
+	m_Instances.resize(m_SubmittedMeshes.size());
+	if (m_SubmittedMeshes.empty()) { return; }
+
+	// メッシュハンドルの添え字は小さな連番なので計数ソートで並べる
+	uint32_t maxIndex = 0;
+	for (MESH_HANDLE mesh : m_SubmittedMeshes) {
+		maxIndex = max(maxIndex, MeshRegistry::GetHandleIndex(mesh));
+	}
+
+	m_Offsets.assign(static_cast<size_t>(maxIndex) + 1, 0);
+	for (MESH_HANDLE mesh : m_SubmittedMeshes) { ++m_Offsets[MeshRegistry::GetHandleIndex(mesh)]; }
+
+	uint32_t first = 0;
+	for (uint32_t index = 0; index <= maxIndex; ++index) {
+		uint32_t count = m_Offsets[index];
+		m_Offsets[index] = first;
+		first += count;
+	}
+
+	m_SortedMeshes.resize(m_SubmittedMeshes.size());
+	for (size_t i = 0; i < m_SubmittedMeshes.size(); ++i) {
+		uint32_t slot = m_Offsets[MeshRegistry::GetHandleIndex(m_SubmittedMeshes[i])]++;
+		m_Instances[slot].World = m_SubmittedWorlds[i];
+		m_SortedMeshes[slot] = m_SubmittedMeshes[i];
+	}
+
+	// 同じハンドルが続く範囲を 1 つのグループにする (削除済みの古いハンドルが混ざっていれば同じ添え字でも分ける)
+	for (uint32_t i = 0; i < m_SortedMeshes.size();) {
+		uint32_t end = i + 1;
+		while (end < m_SortedMeshes.size() && m_SortedMeshes[end] == m_SortedMeshes[i]) { ++end; }
+		m_Groups.push_back({ m_SortedMeshes[i], i, end - i });
+		i = end;
+	}
+}
+
+// 投入されたインスタンスを破棄
+void InstanceBatcher::Clear() {
+	m_SubmittedMeshes.clear();
+	m_SubmittedWorlds.clear();
+	m_SortedMeshes.clear();
+	m_Instances.clear();
+	m_Groups.clear();
+}
+
+// 並べ替えたインスタンスを取得
+const INSTANCE_DATA* InstanceBatcher::GetInstances() const { return m_Instances.data(); }
+
+// インスタンスの数を取得
+uint32_t InstanceBatcher::GetInstanceNum() const { return static_cast<uint32_t>(m_Instances.size()); }
+
+// まとめたグループを取得
+const INSTANCE_GROUP* InstanceBatcher::GetGroups() const { return m_Groups.data(); }
+
+// グループの数を取得
+uint32_t InstanceBatcher::GetGroupNum() const { return static_cast<uint32_t>(m_Groups.size()); }
+
+// 投入とまとめる時間を計測して出力する
+void InstanceBatcher::RunBenchmark(uint32_t instanceNum) {
+
+	const uint32_t meshNum = 16;
+	const uint32_t repeatNum = 20;
+	instanceNum = max(instanceNum, 1u);
+
+	// ランダムなメッシュと、番号が分かるように平行移動にインスタンスの番号を入れたワールド行列
+	mt19937 random(1);
+	uniform_int_distribution<uint32_t> meshes(0, meshNum - 1);
+	vector<MESH_HANDLE> submittedMeshes(instanceNum);
+	vector<XMFLOAT4X4> submittedWorlds(instanceNum);
+	for (uint32_t i = 0; i < instanceNum; ++i) {
+		submittedMeshes[i] = meshes(random);
+		XMStoreFloat4x4(&submittedWorlds[i], XMMatrixTranslation(static_cast<float>(i), 0.0f, 0.0f));
+	}
+
+	// 投入とまとめる処理を繰り返し、最も速かった回を取る (投入の分の確保は最初の回で済ませる)
+	InstanceBatcher batcher;
+	double submitTime = 0.0, buildTime = 0.0;
+	for (uint32_t repeat = 0; repeat < repeatNum; ++repeat) {
+		batcher.Clear();
+		auto begin = chrono::steady_clock::now();
+		for (uint32_t i = 0; i < instanceNum; ++i) { batcher.Submit(submittedMeshes[i], submittedWorlds[i]); }
+		auto submitted = chrono::steady_clock::now();
+		batcher.Build();
+		auto built = chrono::steady_clock::now();
+
+		double submit = chrono::duration<double, milli>(submitted - begin).count();
+		double build = chrono::duration<double, milli>(built - submitted).count();
+		submitTime = repeat == 0 ? submit : min(submitTime, submit);
+		buildTime = repeat == 0 ? build : min(buildTime, build);
+	}
+
+	// メッシュで安定ソートした番号の並びと一致し、グループが重ならずに並んでいることを確かめる
+	vector<uint32_t> expected(instanceNum);
+	iota(expected.begin(), expected.end(), 0u);
+	stable_sort(expected.begin(), expected.end(), [&submittedMeshes](uint32_t a, uint32_t b) { return submittedMeshes[a] < submittedMeshes[b]; });
+
+	bool matched = batcher.GetInstanceNum() == instanceNum;
+	for (uint32_t i = 0; i < instanceNum && matched; ++i) {
+		matched = batcher.GetInstances()[i].World._41 == static_cast<float>(expected[i]);
+	}
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < batcher.GetGroupNum() && matched; ++i) {
+		const INSTANCE_GROUP& group = batcher.GetGroups()[i];
+		matched = group.FirstInstance == next && submittedMeshes[expected[group.FirstInstance]] == group.Mesh;
+		next += group.InstanceNum;
+	}
+	matched = matched && next == instanceNum;
+
+	cout << "instances : " << instanceNum << ", meshes : " << meshNum << endl;
+	cout << "submit : " << submitTime << " ms (" << instanceNum / submitTime / 1000.0 << " M instances / s)" << endl;
+	cout << "build : " << buildTime << " ms (" << instanceNum / buildTime / 1000.0 << " M instances / s)" << endl;
+	cout << "groups : " << batcher.GetGroupNum() << endl;
+	cout << "result : " << (matched ? "matched" : "MISMATCH") << endl;
+}
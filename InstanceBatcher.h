@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "MeshRegistry.h"
+
+using namespace std;
+using namespace DirectX;
+
+// インスタンスごとのデータ (ビュー・射影行列を掛けてから 2 番目の入力スロットに流す)
+struct INSTANCE_DATA {
+	XMFLOAT4X4 World;
+};
+
+// 1 回のドローにまとめるインスタンス
+struct INSTANCE_GROUP {
+	MESH_HANDLE Mesh;
+	uint32_t FirstInstance;
+	uint32_t InstanceNum;
+};
+
+// インスタンスの振り分け
+// (メッシュ, ワールド行列) の組を受け取り、メッシュごとに連続したインスタンスストリームへ詰める
+class InstanceBatcher {
+
+private:
+	// 投入された順のインスタンス
+	vector<MESH_HANDLE> m_SubmittedMeshes;
+	vector<XMFLOAT4X4> m_SubmittedWorlds;
+
+	// メッシュごとに並べ替えたインスタンス
+	vector<INSTANCE_DATA> m_Instances;
+	vector<INSTANCE_GROUP> m_Groups;
+
+	// メッシュの添え字ごとの個数と書き込み位置、並べ替えた後のインスタンスのメッシュ
+	vector<uint32_t> m_Offsets;
+	vector<MESH_HANDLE> m_SortedMeshes;
+
+public:
+	InstanceBatcher() = default;
+	~InstanceBatcher() = default;
+
+	// インスタンスを投入
+	void Submit(MESH_HANDLE mesh, FXMMATRIX world);
+	void Submit(MESH_HANDLE mesh, const XMFLOAT4X4& world);
+
+	// メッシュごとにまとめる (投入順は各メッシュの中で保たれる)
+	void Build();
+
+	// 投入されたインスタンスを破棄
+	void Clear();
+
+	const INSTANCE_DATA* GetInstances() const;
+	uint32_t GetInstanceNum() const;
+
+	const INSTANCE_GROUP* GetGroups() const;
+	uint32_t GetGroupNum() const;
+
+	// instanceNum 個のインスタンスを投入してまとめる時間を計測して出力する (投入順を保って並べ替えた結果と比べる)
+	static void RunBenchmark(uint32_t instanceNum);
+};
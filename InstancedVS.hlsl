@@ -0,0 +1,43 @@
+// ̓f[^
+struct VSInput
+{
+    float3 Position : POSITION;
+    float4 Color : COLOR;
+    float4 WorldViewProject0 : WVP0;
+    float4 WorldViewProject1 : WVP1;
+    float4 WorldViewProject2 : WVP2;
+    float4 WorldViewProject3 : WVP3;
+};
+
+// o̓f[^
+struct VSOutput
+{
+    float4 Position : SV_POSITION;
+    float4 Color : COLOR;
+};
+
+// t[Ƃ̒萔obt@ ([hEr[Eˉes̓CX^X̃Xg[ǂ)
+cbuffer FrameConstants : register(b0)
+{
+    float4x4 View : packoffset(c0);
+    float4x4 Project : packoffset(c4);
+    float4x4 ViewProject : packoffset(c8); // View  Project |
+    float4 PositionScale : packoffset(c12); // ʎqʒu͈̔͂ɖ߂l
+};
+
+// Gg[|Cg
+VSOutput main(VSInput input)
+{
+    VSOutput output = (VSOutput) 0;
+    
+    // CX^XƂ̃[hEr[Eˉes (CPU ł܂Ƃ߂Ċ|́AsƂɊi[Ă)
+    float4x4 instanceWorldViewProject = float4x4(input.WorldViewProject0, input.WorldViewProject1, input.WorldViewProject2, input.WorldViewProject3);
+    
+    float4 localPos = float4(input.Position * PositionScale.xyz, 1.0f);
+    float4 projectPos = mul(localPos, instanceWorldViewProject);
+    
+    output.Position = projectPos;
+    output.Color = input.Color;
+    
+    return output;
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+﻿#include "JobSystem.h"
+
+#include <algorithm>
+
+// コンストラクタ
+JobSystem::JobSystem(uint32_t threadNum):
+	m_Workers(),
+	m_Mutex(),
+	m_StartCondition(),
+	m_DoneCondition(),
+	m_Generation(0),
+	m_Running(0),
+	m_Exit(false),
+	m_Function(nullptr),
+	m_JobNum(0),
+	m_NextJob(0) {
+
+	// 呼び出し元のスレッドも実行するので、ワーカーは 1 つ少なくてよい
+	if (threadNum == 0) { threadNum = max(thread::hardware_concurrency(), 1u); }
+	for (uint32_t i = 1; i < threadNum; ++i) {
+		m_Workers.emplace_back(&JobSystem::WorkerMain, this, i);
+	}
+}
+
+// デストラクタ
+JobSystem::~JobSystem() {
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_Exit = true;
+	}
+	m_StartCondition.notify_all();
+	for (thread& worker : m_Workers) { worker.join(); }
+}
+
+// ワーカースレッド
+void JobSystem::WorkerMain(uint32_t thread) {
+	uint64_t generation = 0;
+	while (true) {
+		{
+			unique_lock<mutex> lock(m_Mutex);
+			m_StartCondition.wait(lock, [this, generation] { return m_Exit || m_Generation != generation; });
+			if (m_Exit) { return; }
+			generation = m_Generation;
+		}
+
+		RunJobs(thread);
+
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			if (--m_Running == 0) { m_DoneCondition.notify_one(); }
+		}
+	}
+}
+
+// 残っているジョブを順に取って実行する
+void JobSystem::RunJobs(uint32_t thread) {
+	for (uint32_t job = m_NextJob++; job < m_JobNum; job = m_NextJob++) {
+		(*m_Function)(job, thread);
+	}
+}
+
+// ジョブを実行して終わるまで待つ
+void JobSystem::Run(uint32_t jobNum, const JOB_FUNCTION& function) {
+
+	if (jobNum == 0) { return; }
+
+	// ジョブが 1 つかワーカーがいなければその場で実行する
+	if (jobNum == 1 || m_Workers.empty()) {
+		for (uint32_t job = 0; job < jobNum; ++job) { function(job, 0); }
+		return;
+	}
+
+	m_Function = &function;
+	m_JobNum = jobNum;
+	m_NextJob = 0;
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_Running = static_cast<uint32_t>(m_Workers.size());
+		++m_Generation;
+	}
+	m_StartCondition.notify_all();
+
+	RunJobs(0);
+
+	{
+		unique_lock<mutex> lock(m_Mutex);
+		m_DoneCondition.wait(lock, [this] { return m_Running == 0; });
+	}
+	m_Function = nullptr;
+}
+
+// 範囲を分割して実行する
+void JobSystem::ParallelFor(uint32_t count, uint32_t minBatchSize, const function<void(uint32_t begin, uint32_t end, uint32_t thread)>& function) {
+
+	if (count == 0) { return; }
+
+	uint32_t batchNum = min(GetThreadNum(), (count + max(minBatchSize, 1u) - 1) / max(minBatchSize, 1u));
+	uint32_t batchSize = (count + batchNum - 1) / batchNum;
+
+	Run(batchNum, [&](uint32_t job, uint32_t thread) {
+		uint32_t begin = job * batchSize;
+		uint32_t end = min(begin + batchSize, count);
+		if (begin < end) { function(begin, end, thread); }
+	});
+}
+
+// スレッド数を取得
+uint32_t JobSystem::GetThreadNum() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
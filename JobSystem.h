@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// ジョブの処理 (ジョブ番号, 実行しているスレッドの番号)
+typedef function<void(uint32_t job, uint32_t thread)> JOB_FUNCTION;
+
+// ジョブシステム
+// ワーカースレッドを常駐させておき、Run で渡したジョブを呼び出し元のスレッドと一緒に取り合って実行する
+// Run はすべてのジョブが終わるまで戻らない (スレッド番号 0 は呼び出し元)
+class JobSystem {
+
+private:
+	vector<thread> m_Workers;
+	mutex m_Mutex;
+	condition_variable m_StartCondition;
+	condition_variable m_DoneCondition;
+	uint64_t m_Generation;
+	uint32_t m_Running;
+	bool m_Exit;
+
+	// 実行中のジョブ
+	const JOB_FUNCTION* m_Function;
+	uint32_t m_JobNum;
+	atomic<uint32_t> m_NextJob;
+
+	void WorkerMain(uint32_t thread);
+	void RunJobs(uint32_t thread);
+
+public:
+	// threadNum が 0 なら論理コア数だけ使う
+	JobSystem(uint32_t threadNum = 0);
+	~JobSystem();
+
+	// jobNum 個のジョブを実行して終わるまで待つ
+	void Run(uint32_t jobNum, const JOB_FUNCTION& function);
+
+	// [0, count) をスレッド数に合わせて分割して実行する (begin, end, スレッドの番号)
+	void ParallelFor(uint32_t count, uint32_t minBatchSize, const function<void(uint32_t begin, uint32_t end, uint32_t thread)>& function);
+
+	uint32_t GetThreadNum() const;
+};
@@ -0,0 +1,97 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+using namespace std;
+
+// 容量固定のロックフリーキュー (複数の生産者と複数の消費者)
+// セルごとに通し番号を持たせ、書き込みと読み出しの位置を CAS で進める (D. Vyukov の bounded MPMC queue)
+// 満杯や空のときは待たずに false を返すので、待ち方は呼び出し側が決める
+template <typename T>
+class LockFreeQueue {
+
+private:
+	struct CELL {
+		atomic<size_t> Sequence;
+		T Data;
+	};
+
+	unique_ptr<CELL[]> m_Cells;
+	size_t m_Mask;
+
+	// 書き込みと読み出しの位置 (別々のスレッドが触るのでキャッシュラインを分ける)
+	alignas(64) atomic<size_t> m_EnqueuePosition;
+	alignas(64) atomic<size_t> m_DequeuePosition;
+
+public:
+	// 容量は 2 のべき乗に切り上げる
+	LockFreeQueue(size_t capacity):
+		m_Cells(nullptr),
+		m_Mask(0),
+		m_EnqueuePosition(0),
+		m_DequeuePosition(0) {
+
+		size_t size = 2;
+		while (size < capacity) { size <<= 1; }
+
+		m_Cells.reset(new CELL[size]);
+		m_Mask = size - 1;
+		for (size_t i = 0; i < size; ++i) { m_Cells[i].Sequence.store(i, memory_order_relaxed); }
+	}
+
+	~LockFreeQueue() = default;
+	LockFreeQueue(const LockFreeQueue&) = delete;
+	LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+	// 積む (満杯なら value に触れずに false)
+	bool TryPush(T& value) {
+		size_t position = m_EnqueuePosition.load(memory_order_relaxed);
+		while (true) {
+			CELL& cell = m_Cells[position & m_Mask];
+			size_t sequence = cell.Sequence.load(memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+			if (difference == 0) {
+				if (m_EnqueuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+					cell.Data = move(value);
+					cell.Sequence.store(position + 1, memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) {
+				return false;
+			}
+			else {
+				position = m_EnqueuePosition.load(memory_order_relaxed);
+			}
+		}
+	}
+
+	// 取り出す (空なら false)
+	bool TryPop(T* value) {
+		size_t position = m_DequeuePosition.load(memory_order_relaxed);
+		while (true) {
+			CELL& cell = m_Cells[position & m_Mask];
+			size_t sequence = cell.Sequence.load(memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+			if (difference == 0) {
+				if (m_DequeuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+					*value = move(cell.Data);
+					cell.Sequence.store(position + m_Mask + 1, memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) {
+				return false;
+			}
+			else {
+				position = m_DequeuePosition.load(memory_order_relaxed);
+			}
+		}
+	}
+
+	size_t GetCapacity() const { return m_Mask + 1; }
+};
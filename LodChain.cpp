@@ -0,0 +1,266 @@
+﻿#include "LodChain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "MeshOptimizer.h"
+
+// 三角形の平面と点の距離のうち最も近いもの (球に沿わせたメッシュの誤差に使う)
+static float MinPlaneDistance(const vector<VERTEX>& vertices, const vector<uint32_t>& indices, FXMVECTOR center) {
+	float distance = numeric_limits<float>::infinity();
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		XMVECTOR v0 = XMLoadFloat3(&vertices[indices[i + 0]].Position);
+		XMVECTOR v1 = XMLoadFloat3(&vertices[indices[i + 1]].Position);
+		XMVECTOR v2 = XMLoadFloat3(&vertices[indices[i + 2]].Position);
+		XMVECTOR normal = XMVector3Normalize(XMVector3Cross(XMVectorSubtract(v1, v0), XMVectorSubtract(v2, v0)));
+		distance = min(distance, fabsf(XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(v0, center)))));
+	}
+	return distance;
+}
+
+// 段階を追加 (頂点を並べ替えてから格納し、誤差は前の段階より小さくならないようにする)
+// 深度テストなしで描かれるので、描く順が変わらないように三角形の順は保つ
+void LodChain::AddLevel(unique_ptr<RenderObject> object, float error) {
+	MeshOptimizer::OptimizeKeepingOrder(*object);
+	if (!m_Levels.empty()) { error = max(error, m_Levels.back().Error); }
+	m_Levels.push_back({ move(object), error });
+}
+
+// 球の LOD チェインを作る
+unique_ptr<LodChain> LodChain::CreateSphere(const RenderObject& seed, uint32_t levelNum) {
+
+	if (seed.GetVertexNum() == 0 || seed.GetIndexNum() < 3) { throw runtime_error("LOD の元になるメッシュが空です。"); }
+	levelNum = max(levelNum, 1u);
+
+	const BOUNDS& bounds = seed.GetBounds();
+	const XMVECTOR center = XMLoadFloat3(&bounds.Center);
+	const float radius = bounds.Radius;
+
+	vector<VERTEX> vertices(seed.GetVertices(), seed.GetVertices() + seed.GetVertexNum());
+	vector<uint32_t> indices(seed.GetIndices(), seed.GetIndices() + seed.GetIndexNum());
+
+	// 粗い順に作り、最後に細かい順へ並べ直す
+	vector<unique_ptr<RenderObject>> objects;
+	vector<float> errors;
+	for (uint32_t level = 0; level < levelNum; ++level) {
+		if (level > 0) {
+			// 辺の中点を共有しながら三角形を 4 分割し、中点を境界球の表面へ押し出す
+			unordered_map<uint64_t, uint32_t> midpoints;
+			auto midpoint = [&](uint32_t a, uint32_t b) {
+				uint64_t key = (static_cast<uint64_t>(min(a, b)) << 32) | max(a, b);
+				auto it = midpoints.find(key);
+				if (it != midpoints.end()) { return it->second; }
+
+				XMVECTOR position = XMVectorScale(XMVectorAdd(XMLoadFloat3(&vertices[a].Position), XMLoadFloat3(&vertices[b].Position)), 0.5f);
+				position = XMVectorAdd(center, XMVectorScale(XMVector3Normalize(XMVectorSubtract(position, center)), radius));
+				XMVECTOR color = XMVectorScale(XMVectorAdd(XMLoadFloat4(&vertices[a].Color), XMLoadFloat4(&vertices[b].Color)), 0.5f);
+
+				VERTEX vertex;
+				XMStoreFloat3(&vertex.Position, position);
+				XMStoreFloat4(&vertex.Color, color);
+				vertices.push_back(vertex);
+
+				uint32_t index = static_cast<uint32_t>(vertices.size() - 1);
+				midpoints.emplace(key, index);
+				return index;
+			};
+
+			vector<uint32_t> subdivided;
+			subdivided.reserve(indices.size() * 4);
+			for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+				uint32_t a = indices[i + 0], b = indices[i + 1], c = indices[i + 2];
+				uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+				subdivided.insert(subdivided.end(), { a, ab, ca, ab, b, bc, ca, bc, c, ab, bc, ca });
+			}
+			indices.swap(subdivided);
+		}
+
+		// 誤差は境界球と三角形の平面の最大の隔たり
+		errors.push_back(max(radius - MinPlaneDistance(vertices, indices, center), 0.0f));
+		objects.push_back(make_unique<GeneratedMesh>(vertices.data(), vertices.size(), indices.data(), indices.size()));
+	}
+
+	unique_ptr<LodChain> chain = make_unique<LodChain>();
+	for (uint32_t level = levelNum; level-- > 0;) {
+		chain->AddLevel(move(objects[level]), errors[level]);
+	}
+	return chain;
+}
+
+// メッシュを間引いた LOD チェインを作る
+unique_ptr<LodChain> LodChain::CreateDecimated(const RenderObject& object, uint32_t levelNum) {
+
+	if (object.GetVertexNum() == 0 || object.GetIndexNum() < 3) { throw runtime_error("LOD の元になるメッシュが空です。"); }
+	levelNum = max(levelNum, 1u);
+
+	const VERTEX* source = object.GetVertices();
+	const uint32_t* sourceIndices = object.GetIndices();
+	const size_t vertexNum = object.GetVertexNum();
+	const size_t indexNum = object.GetIndexNum();
+	const BOUNDS& bounds = object.GetBounds();
+
+	unique_ptr<LodChain> chain = make_unique<LodChain>();
+	chain->AddLevel(make_unique<GeneratedMesh>(source, vertexNum, sourceIndices, indexNum), 0.0f);
+
+	// 格子は一辺を頂点数の平方根で分ける細かさから始め、段階ごとにセルを倍の大きさにする
+	const float extent = max({ bounds.Max.x - bounds.Min.x, bounds.Max.y - bounds.Min.y, bounds.Max.z - bounds.Min.z, 1e-6f });
+	uint32_t cellNum = max(static_cast<uint32_t>(sqrtf(static_cast<float>(vertexNum))), 1u);
+	uint32_t previousTriangleNum = static_cast<uint32_t>(indexNum / 3);
+
+	vector<uint32_t> clusterOf(vertexNum);
+	for (; chain->GetLevelNum() < levelNum && cellNum >= 1; cellNum /= 2) {
+
+		// 頂点をセルに振り分け、セルごとに位置と色を平均する
+		const float cellSize = extent / cellNum;
+		unordered_map<uint64_t, uint32_t> cells;
+		vector<XMFLOAT4> positionSums, colorSums;
+		for (size_t i = 0; i < vertexNum; ++i) {
+			uint64_t x = min(static_cast<uint32_t>((source[i].Position.x - bounds.Min.x) / cellSize), cellNum - 1);
+			uint64_t y = min(static_cast<uint32_t>((source[i].Position.y - bounds.Min.y) / cellSize), cellNum - 1);
+			uint64_t z = min(static_cast<uint32_t>((source[i].Position.z - bounds.Min.z) / cellSize), cellNum - 1);
+			uint64_t key = (x << 42) | (y << 21) | z;
+
+			auto it = cells.find(key);
+			if (it == cells.end()) {
+				it = cells.emplace(key, static_cast<uint32_t>(positionSums.size())).first;
+				positionSums.push_back(XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+				colorSums.push_back(XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+			}
+
+			uint32_t cluster = it->second;
+			clusterOf[i] = cluster;
+			positionSums[cluster].x += source[i].Position.x;
+			positionSums[cluster].y += source[i].Position.y;
+			positionSums[cluster].z += source[i].Position.z;
+			positionSums[cluster].w += 1.0f;
+			colorSums[cluster].x += source[i].Color.x;
+			colorSums[cluster].y += source[i].Color.y;
+			colorSums[cluster].z += source[i].Color.z;
+			colorSums[cluster].w += source[i].Color.w;
+		}
+
+		vector<VERTEX> vertices(positionSums.size());
+		for (size_t i = 0; i < vertices.size(); ++i) {
+			float scale = 1.0f / positionSums[i].w;
+			vertices[i].Position = XMFLOAT3(positionSums[i].x * scale, positionSums[i].y * scale, positionSums[i].z * scale);
+			vertices[i].Color = XMFLOAT4(colorSums[i].x * scale, colorSums[i].y * scale, colorSums[i].z * scale, colorSums[i].w * scale);
+		}
+
+		// 潰れた三角形と重複した三角形を除く (向きは元の三角形のまま)
+		vector<uint32_t> indices;
+		unordered_set<uint64_t> triangles;
+		for (size_t i = 0; i + 2 < indexNum; i += 3) {
+			uint32_t a = clusterOf[sourceIndices[i + 0]], b = clusterOf[sourceIndices[i + 1]], c = clusterOf[sourceIndices[i + 2]];
+			if (a == b || b == c || c == a) { continue; }
+
+			uint64_t low = min({ a, b, c }), high = max({ a, b, c }), middle = static_cast<uint64_t>(a) + b + c - low - high;
+			if (!triangles.insert((low << 42) | (middle << 21) | high).second) { continue; }
+			indices.insert(indices.end(), { a, b, c });
+		}
+
+		// 三角形が減らなければ格子を粗くしてやり直し、なくなったら打ち切る
+		uint32_t triangleNum = static_cast<uint32_t>(indices.size() / 3);
+		if (triangleNum == 0) { break; }
+		if (triangleNum >= previousTriangleNum) { continue; }
+		previousTriangleNum = triangleNum;
+
+		// 誤差は元の頂点とまとめた頂点の最大の距離
+		float error = 0.0f;
+		for (size_t i = 0; i < vertexNum; ++i) {
+			XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&source[i].Position), XMLoadFloat3(&vertices[clusterOf[i]].Position));
+			error = max(error, XMVectorGetX(XMVector3Length(offset)));
+		}
+
+		chain->AddLevel(make_unique<GeneratedMesh>(vertices.data(), vertices.size(), indices.data(), indices.size()), error);
+	}
+	return chain;
+}
+
+// 段階の数を取得
+uint32_t LodChain::GetLevelNum() const { return static_cast<uint32_t>(m_Levels.size()); }
+
+// 段階のメッシュを取得
+const RenderObject& LodChain::GetLevel(uint32_t level) const { return *m_Levels[level].Object; }
+
+// 段階の誤差を取得
+float LodChain::GetError(uint32_t level) const { return m_Levels[level].Error; }
+
+// 段階の三角形数を取得
+uint32_t LodChain::GetTriangleNum(uint32_t level) const { return static_cast<uint32_t>(m_Levels[level].Object->GetIndexNum() / 3); }
+
+// 最も細かい段階の境界ボリュームを取得
+const BOUNDS& LodChain::GetBounds() const { return m_Levels.front().Object->GetBounds(); }
+
+// コンストラクタ
+LodSelector::LodSelector(float threshold):
+	m_View(),
+	m_ProjectScale(0.0f),
+	m_Threshold(threshold),
+	m_Enabled(true),
+	m_Statistics({ 0 }) {
+
+	XMStoreFloat4x4(&m_View, XMMatrixIdentity());
+}
+
+// フレームの始めにビューと射影を設定
+void LodSelector::BeginFrame(FXMMATRIX view, CXMMATRIX project, float viewportHeight) {
+	XMFLOAT4X4 projectMatrix;
+	XMStoreFloat4x4(&projectMatrix, project);
+	XMStoreFloat4x4(&m_View, view);
+	m_ProjectScale = fabsf(projectMatrix.m[1][1]) * viewportHeight * 0.5f;
+	++m_Statistics.FrameNum;
+}
+
+// 段階を選ぶ
+uint32_t LodSelector::Select(const LodChain& chain, FXMMATRIX world) {
+
+	// 粗い方から見て、最初に閾値に収まった段階を選ぶ
+	uint32_t selected = 0;
+	if (m_Enabled) {
+		const BOUNDS& bounds = chain.GetBounds();
+		for (uint32_t level = chain.GetLevelNum(); level-- > 1;) {
+			if (ComputePixelError(chain.GetError(level), bounds, world) <= m_Threshold) {
+				selected = level;
+				break;
+			}
+		}
+	}
+
+	++m_Statistics.ObjectNum;
+	m_Statistics.SubmittedTriangles += chain.GetTriangleNum(selected);
+	m_Statistics.FullTriangles += chain.GetTriangleNum(0);
+	return selected;
+}
+
+// 誤差をピクセルに投影する
+float LodSelector::ComputePixelError(float error, const BOUNDS& bounds, FXMMATRIX world) const {
+
+	// ワールド行列の拡大率 (行ベクトルなので各行の長さの最大)
+	float scale = max({ XMVectorGetX(XMVector3Length(world.r[0])), XMVectorGetX(XMVector3Length(world.r[1])), XMVectorGetX(XMVector3Length(world.r[2])) });
+
+	// 右手系なのでカメラの前方は -Z
+	XMVECTOR center = XMVector3Transform(XMLoadFloat3(&bounds.Center), XMMatrixMultiply(world, XMLoadFloat4x4(&m_View)));
+	float depth = -XMVectorGetZ(center) - bounds.Radius * scale;
+	if (depth <= 0.0f) { return numeric_limits<float>::infinity(); }
+
+	return error * scale * m_ProjectScale / depth;
+}
+
+// 閾値を設定 (ピクセル)
+void LodSelector::SetThreshold(float pixels) { m_Threshold = pixels; }
+
+// 有効・無効を設定
+void LodSelector::SetEnabled(bool enabled) { m_Enabled = enabled; }
+
+// 閾値を取得
+float LodSelector::GetThreshold() const { return m_Threshold; }
+
+// 有効かどうか
+bool LodSelector::IsEnabled() const { return m_Enabled; }
+
+// 統計情報を取得
+LOD_STATISTICS LodSelector::GetStatistics() const { return m_Statistics; }
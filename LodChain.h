@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "RenderObject.h"
+
+using namespace std;
+using namespace DirectX;
+
+// LOD の段階 (Error は最も細かい形からの最大のずれ、オブジェクト空間の長さ)
+struct LOD_LEVEL {
+	unique_ptr<RenderObject> Object;
+	float Error;
+};
+
+// LOD の選択の統計情報 (フレームをまたいだ累計)
+struct LOD_STATISTICS {
+	uint32_t FrameNum;
+	uint64_t ObjectNum;
+	uint64_t SubmittedTriangles; // 選んだ段階の三角形数
+	uint64_t FullTriangles;      // すべて最も細かい段階で描いた場合の三角形数
+};
+
+// LOD チェイン
+// 段階 0 が最も細かく、番号が大きいほど粗い (誤差は段階を追って増える)
+// どの段階も MeshOptimizer で頂点を並べ替えてあるので、そのまま共有バッファに登録できる
+class LodChain {
+
+private:
+	vector<LOD_LEVEL> m_Levels;
+
+	void AddLevel(unique_ptr<RenderObject> object, float error);
+
+public:
+	LodChain() = default;
+	~LodChain() = default;
+	LodChain(const LodChain&) = delete;
+	LodChain& operator=(const LodChain&) = delete;
+
+	// 球 (seed の三角形を 4 分割しては境界球に沿わせることを繰り返す、levelNum 段階)
+	// 正八面体を渡せば、細かい段階ほど球に近づく
+	static unique_ptr<LodChain> CreateSphere(const RenderObject& seed, uint32_t levelNum);
+
+	// 任意のメッシュを頂点クラスタリングで間引く (元のメッシュを段階 0 として最大 levelNum 段階)
+	// 格子の大きさを段階ごとに倍にし、同じセルの頂点を平均した 1 つにまとめる
+	static unique_ptr<LodChain> CreateDecimated(const RenderObject& object, uint32_t levelNum);
+
+	uint32_t GetLevelNum() const;
+	const RenderObject& GetLevel(uint32_t level) const;
+	float GetError(uint32_t level) const;
+	uint32_t GetTriangleNum(uint32_t level) const;
+	const BOUNDS& GetBounds() const;
+};
+
+// LOD の選択
+// 誤差を画面に投影し、閾値 (ピクセル) 以下に収まる最も粗い段階を選ぶ
+// 投影した誤差 = 誤差 × ワールド行列の拡大率 × (射影行列の _22 × ビューポートの高さ / 2) / 境界球の最も近い点までの奥行き
+class LodSelector {
+
+private:
+	XMFLOAT4X4 m_View;
+	float m_ProjectScale; // 奥行き 1 の位置での長さ 1 のピクセル数
+	float m_Threshold;
+	bool m_Enabled;
+
+	LOD_STATISTICS m_Statistics;
+
+public:
+	LodSelector(float threshold = 1.0f);
+	~LodSelector() = default;
+
+	// フレームの始めにビュー・射影行列とビューポートの高さを渡す
+	void BeginFrame(FXMMATRIX view, CXMMATRIX project, float viewportHeight);
+
+	// 段階を選ぶ (無効なら常に段階 0)
+	uint32_t Select(const LodChain& chain, FXMMATRIX world);
+
+	// 誤差をピクセルに投影する (カメラが境界球の中にあれば無限大)
+	float ComputePixelError(float error, const BOUNDS& bounds, FXMMATRIX world) const;
+
+	void SetThreshold(float pixels);
+	void SetEnabled(bool enabled);
+	float GetThreshold() const;
+	bool IsEnabled() const;
+	LOD_STATISTICS GetStatistics() const;
+};
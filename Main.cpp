@@ -1,18 +1,316 @@
-﻿#include "Graphic.h"
+﻿#include <cstdlib>
+#include <cstring>
+#include <string>
 
-int main() {
+#include "DescriptorAllocator.h"
+#include "FrustumCuller.h"
+#include "Graphic.h"
+#include "InstanceBatcher.h"
+#include "MatrixBatch.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "Profiler.h"
+#include "RenderQueue.h"
+#include "Scene.h"
+#include "Simulation.h"
+#include "SoftwareBackend.h"
+#include "TestScene.h"
+#include "TransformEngine.h"
+#include "TransformHierarchy.h"
+#include "TriangleBvh.h"
+#include "UploadRingAllocator.h"
+
+// コード中のメッシュをメッシュファイルに書き出す (負荷計測用の大きな格子も一緒に書き出す)
+static bool ConvertMeshes(const char* directory) {
+	string base = string(directory) + "/";
+	bool result = true;
+	result &= MeshFile::Write((base + "hexahedron.mesh").c_str(), Hexahedron());
+	result &= MeshFile::Write((base + "octahedron.mesh").c_str(), Octahedron());
+	result &= MeshFile::Write((base + "grid.mesh").c_str(), Grid(1024));
+	return result;
+}
+
+int main(int argc, char* argv[]) {
 
 	// デバッグレイヤーを追加
-#if defined(DEBUG) || defined(_DEBUG)
+#if defined(_WIN32) && (defined(DEBUG) || defined(_DEBUG))
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	// コマンドライン引数
+	// -headless    : ウィンドウと GPU を使わない記録用バックエンドで動かす
+	// -software    : CPU で実際に描画するソフトウェアバックエンドで動かす
+	// -benchmark N : N フレームだけ描画してフレーム時間を出力する
+	// -capture P   : 終了時に直前のフレームを P に書き出す (-software のみ)
+	// -compare P [T] : 終了時に直前のフレームを参照画像 P と比べ、違う画素が T % (既定は 0) を超えたら 1 を返す (-software のみ)
+	// -threads N   : N スレッドでコマンドを記録する (0 なら論理コア数)
+	// -objects N   : 1 つずつドローするオブジェクトを N 個追加する
+	// -demo        : 負荷計測でもデモ用のインスタンスを描く (計測しないときは常に描く)
+	// -latency N   : 同時に処理中にできるフレーム数 (1 〜 4)
+	// -gputime MS  : 1 フレームの GPU の処理時間を MS ミリ秒とみなす (-headless のみ)
+	// -convert D   : コード中のメッシュを D にメッシュファイルとして書き出して終了する
+	// -loadbench P : メッシュファイル P の読み込み時間を計測して終了する
+	// -transformbench N : N 個の頂点の座標変換の速さをスカラー・SSE・AVX2 で計測して終了する
+	// -optbench N  : 約 N 個の三角形のメッシュを最適化する時間と ACMR / ATVR を計測して終了する
+	// -cullbench N : N 個の境界ボリュームの視錐台カリングの時間をスカラー版と SIMD 版で計測して終了する
+	// -hierarchybench N : N ノードの変換の階層の更新時間を計測して終了する
+	// -hierarchychange R : 計測で 1 フレームに動かすノードの割合 (既定は 0.02)
+	// -profile P   : 区間ごとの時間を計測し、終了時に集計を出力して Chrome のトレースとして P に書き出す
+	// -profilebench N : 区間の計測の負荷を N 回の繰り返しで計測して終了する
+	// -sortbench N : N 個のドローを並べ替える時間を計測して終了する
+	// -instancebench N : N 個のインスタンスをメッシュごとにまとめる時間を計測して終了する
+	// -descriptorbench N : N 個のビューを持つディスクリプタの割り当てと解放の時間を計測して終了する
+	// -uploadbench N : N フレーム分のアップロード用リングバッファの割り当てと回収を偽のフェンスで計測して終了する
+	// -matrixbench N : N 個のワールド行列にビュー・射影行列を掛ける時間を計測して終了する
+	// -bvhbench N  : 約 N 個の三角形の BVH を作る時間と光線の判定の速さを計測して終了する
+	// -scenebench N : N 個のオブジェクトのシーンの更新時間と問い合わせの速さを計測して終了する
+	// -scenemove R : 計測で 1 フレームに動かすオブジェクトの割合 (既定は 0.05)
+	// -simbench N  : N 個のオブジェクトのシミュレーションのステップ時間とスナップショットの受け渡しを計測して終了する
+	// -simulate N  : N 個のオブジェクトを別のスレッドで動かして描く
+	// -simrate HZ  : シミュレーションの 1 秒あたりのステップ数 (既定は 60)
+	// -pipelinecache P : パイプラインキャッシュのファイル (none なら使わない)
+	// -stream N    : 格子のメッシュを N 個ワーカースレッドで作り、後から読み込む
+	// -streamfile P : メッシュファイル P をワーカースレッドで読み、後から登録する
+	// -streambudget K : 後から読み込むメッシュを 1 フレームに K KB まで登録する
+	// -streamwait  : 後から読み込むメッシュがすべて登録されるか失敗するまで描いてから計測する
+	// -lod N       : LOD を選んで描く球を N 個追加する
+	// -nolod       : LOD を選ばず常に最も細かい段階で描く
+	// -lodthreshold PX : LOD の画面上の誤差の閾値 (ピクセル)
+	// -nostatefilter : 冗長な状態の設定を省かずにすべて記録する
+	// -vertex F    : 頂点形式 (full : VERTEX のまま、compact : half と RGBA8、snorm : 16 ビットに量子化と RGBA8)
+	// -vertexextent E : snorm で量子化する位置の範囲 (各成分の絶対値の上限、既定は 4、超えるメッシュは登録しない)
+	BACKEND_TYPE backend = BACKEND_TYPE::D3D12;
+	uint32_t benchmarkFrames = 0;
+	const char* capturePath = nullptr;
+	const char* comparePath = nullptr;
+	float compareTolerance = 0.0f;
+	uint32_t threadNum = 0;
+	uint32_t objectNum = 0;
+	bool demo = false;
+	uint32_t streamNum = 0;
+	const char* streamPath = nullptr;
+	bool streamWait = false;
+	uint64_t streamBudget = 1024 * 1024;
+	uint32_t lodNum = 0;
+	bool lodEnabled = true;
+	bool stateFilterEnabled = true;
+	float lodThreshold = 1.0f;
+	uint32_t frameLatency = 2;
+	double gpuTime = 0.0;
+	VERTEX_FORMAT vertexFormat = VertexFormat::Compact();
+	float positionExtent = DEFAULT_POSITION_EXTENT;
+	const char* convertDirectory = nullptr;
+	const char* loadBenchmarkPath = nullptr;
+	uint32_t transformBenchmarkNum = 0;
+	uint32_t optimizeBenchmarkNum = 0;
+	uint32_t cullBenchmarkNum = 0;
+	uint32_t hierarchyBenchmarkNum = 0;
+	float hierarchyChangeRate = 0.02f;
+	const char* profilePath = nullptr;
+	uint32_t profileBenchmarkNum = 0;
+	uint32_t sortBenchmarkNum = 0;
+	uint32_t instanceBenchmarkNum = 0;
+	uint32_t descriptorBenchmarkNum = 0;
+	uint32_t uploadBenchmarkNum = 0;
+	uint32_t matrixBenchmarkNum = 0;
+	uint32_t bvhBenchmarkNum = 0;
+	uint32_t sceneBenchmarkNum = 0;
+	float sceneMoveRate = 0.05f;
+	uint32_t simulationBenchmarkNum = 0;
+	uint32_t simulationNum = 0;
+	double simulationRate = 60.0;
+	const char* pipelineCachePath = "PipelineCache.bin";
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-headless") == 0) { backend = BACKEND_TYPE::NULL_DEVICE; }
+		else if (strcmp(argv[i], "-software") == 0) { backend = BACKEND_TYPE::SOFTWARE; }
+		else if (strcmp(argv[i], "-capture") == 0 && i + 1 < argc) { capturePath = argv[++i]; }
+		else if (strcmp(argv[i], "-compare") == 0 && i + 1 < argc) {
+			comparePath = argv[++i];
+			if (i + 1 < argc && argv[i + 1][0] != '-') { compareTolerance = strtof(argv[++i], nullptr); }
+		}
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) { threadNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-objects") == 0 && i + 1 < argc) { objectNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-demo") == 0) { demo = true; }
+		else if (strcmp(argv[i], "-stream") == 0 && i + 1 < argc) { streamNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-streamfile") == 0 && i + 1 < argc) { streamPath = argv[++i]; }
+		else if (strcmp(argv[i], "-streamwait") == 0) { streamWait = true; }
+		else if (strcmp(argv[i], "-streambudget") == 0 && i + 1 < argc) { streamBudget = strtoull(argv[++i], nullptr, 10) * 1024; }
+		else if (strcmp(argv[i], "-lod") == 0 && i + 1 < argc) { lodNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-nolod") == 0) { lodEnabled = false; }
+		else if (strcmp(argv[i], "-nostatefilter") == 0) { stateFilterEnabled = false; }
+		else if (strcmp(argv[i], "-lodthreshold") == 0 && i + 1 < argc) { lodThreshold = strtof(argv[++i], nullptr); }
+		else if (strcmp(argv[i], "-latency") == 0 && i + 1 < argc) { frameLatency = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-gputime") == 0 && i + 1 < argc) { gpuTime = strtod(argv[++i], nullptr); }
+		else if (strcmp(argv[i], "-convert") == 0 && i + 1 < argc) { convertDirectory = argv[++i]; }
+		else if (strcmp(argv[i], "-loadbench") == 0 && i + 1 < argc) { loadBenchmarkPath = argv[++i]; }
+		else if (strcmp(argv[i], "-transformbench") == 0 && i + 1 < argc) { transformBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-optbench") == 0 && i + 1 < argc) { optimizeBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-cullbench") == 0 && i + 1 < argc) { cullBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-hierarchybench") == 0 && i + 1 < argc) { hierarchyBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-hierarchychange") == 0 && i + 1 < argc) { hierarchyChangeRate = strtof(argv[++i], nullptr); }
+		else if (strcmp(argv[i], "-profile") == 0 && i + 1 < argc) { profilePath = argv[++i]; }
+		else if (strcmp(argv[i], "-profilebench") == 0 && i + 1 < argc) { profileBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-sortbench") == 0 && i + 1 < argc) { sortBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-instancebench") == 0 && i + 1 < argc) { instanceBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-descriptorbench") == 0 && i + 1 < argc) { descriptorBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-uploadbench") == 0 && i + 1 < argc) { uploadBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-matrixbench") == 0 && i + 1 < argc) { matrixBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-bvhbench") == 0 && i + 1 < argc) { bvhBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-scenebench") == 0 && i + 1 < argc) { sceneBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-scenemove") == 0 && i + 1 < argc) { sceneMoveRate = strtof(argv[++i], nullptr); }
+		else if (strcmp(argv[i], "-simbench") == 0 && i + 1 < argc) { simulationBenchmarkNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-simulate") == 0 && i + 1 < argc) { simulationNum = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+		else if (strcmp(argv[i], "-simrate") == 0 && i + 1 < argc) { simulationRate = strtod(argv[++i], nullptr); }
+		else if (strcmp(argv[i], "-pipelinecache") == 0 && i + 1 < argc) {
+			pipelineCachePath = argv[++i];
+			if (strcmp(pipelineCachePath, "none") == 0) { pipelineCachePath = nullptr; }
+		}
+		else if (strcmp(argv[i], "-vertex") == 0 && i + 1 < argc) {
+			const char* name = argv[++i];
+			if (strcmp(name, "full") == 0) { vertexFormat = VertexFormat::Full(); }
+			else if (strcmp(name, "snorm") == 0) { vertexFormat = VertexFormat::Quantized(); }
+			else { vertexFormat = VertexFormat::Compact(); }
+		}
+		else if (strcmp(argv[i], "-vertexextent") == 0 && i + 1 < argc) { positionExtent = strtof(argv[++i], nullptr); }
+		else if (strcmp(argv[i], "-benchmark") == 0 && i + 1 < argc) { benchmarkFrames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)); }
+	}
+
+	// 量子化する範囲は -vertex と -vertexextent のどちらが先でも効くように最後に決める (正でなければ既定のまま)
+	if (vertexFormat.Position == POSITION_FORMAT::SNORM16X4 && positionExtent > 0.0f) { vertexFormat.PositionExtent = positionExtent; }
+
+	// メッシュファイルの変換と計測 (描画はしない)
+	if (convertDirectory != nullptr) {
+		if (!ConvertMeshes(convertDirectory)) {
+			cerr << "メッシュファイルを書き出せませんでした。" << endl;
+			return 1;
+		}
+		return 0;
+	}
+	if (loadBenchmarkPath != nullptr) {
+		MeshFile::RunLoadBenchmark(loadBenchmarkPath);
+		return 0;
+	}
+	if (transformBenchmarkNum > 0) {
+		TransformEngine::RunBenchmark(transformBenchmarkNum, threadNum);
+		return 0;
+	}
+	if (optimizeBenchmarkNum > 0) {
+		MeshOptimizer::RunBenchmark(optimizeBenchmarkNum);
+		return 0;
+	}
+	if (cullBenchmarkNum > 0) {
+		FrustumCuller::RunBenchmark(cullBenchmarkNum);
+		return 0;
+	}
+	if (hierarchyBenchmarkNum > 0) {
+		TransformHierarchy::RunBenchmark(hierarchyBenchmarkNum, hierarchyChangeRate, threadNum);
+		return 0;
+	}
+	if (profileBenchmarkNum > 0) {
+		Profiler::RunOverheadBenchmark(profileBenchmarkNum);
+		return 0;
+	}
+	if (sortBenchmarkNum > 0) {
+		RenderQueue::RunBenchmark(sortBenchmarkNum, threadNum);
+		return 0;
+	}
+	if (instanceBenchmarkNum > 0) {
+		InstanceBatcher::RunBenchmark(instanceBenchmarkNum);
+		return 0;
+	}
+	if (descriptorBenchmarkNum > 0) {
+		DescriptorAllocator::RunBenchmark(descriptorBenchmarkNum);
+		return 0;
+	}
+	if (uploadBenchmarkNum > 0) {
+		UploadRingAllocator::RunBenchmark(uploadBenchmarkNum);
+		return 0;
+	}
+	if (matrixBenchmarkNum > 0) {
+		MatrixBatch::RunBenchmark(matrixBenchmarkNum, threadNum);
+		return 0;
+	}
+	if (bvhBenchmarkNum > 0) {
+		TriangleBvh::RunBenchmark(bvhBenchmarkNum, threadNum);
+		return 0;
+	}
+	if (sceneBenchmarkNum > 0) {
+		Scene::RunBenchmark(sceneBenchmarkNum, sceneMoveRate);
+		return 0;
+	}
+	if (simulationBenchmarkNum > 0) {
+		Simulation::RunBenchmark(simulationBenchmarkNum, 600);
+		return 0;
+	}
+
+	// 参照画像と比べるときは決まったフレーム数だけ描く
+	if (comparePath != nullptr && benchmarkFrames == 0) { benchmarkFrames = 1; }
+	int exitCode = 0;
+
+	// 初期化から計測する
+	Profiler::SetEnabled(profilePath != nullptr);
+
 	// 描画処理
-	if (Graphic::Initialize(TEXT("SAMPLE WINDOW"), 960, 540)) {
+	if (Graphic::Initialize(backend, L"SAMPLE WINDOW", 960, 540, threadNum, frameLatency, vertexFormat, pipelineCachePath)) {
 		Graphic* graphic = Graphic::GetInstance();
-		while (graphic->Update()) {
-			/* 何かしらロジック的な処理 */
+		graphic->SetSimulatedGPUTime(gpuTime);
+		graphic->SetStreamingBudget(streamBudget);
+		graphic->SetLodEnabled(lodEnabled);
+		graphic->SetLodThreshold(lodThreshold);
+		graphic->SetStateFilterEnabled(stateFilterEnabled);
+
+		// 負荷計測用のシーン (描画インタフェースの公開の関数で毎フレーム描くものを積む)
+		TestScene testScene(graphic);
+		if (demo || benchmarkFrames == 0) { testScene.CreateDemo(); }
+		testScene.SetObjectNum(objectNum);
+		testScene.RequestStreams(streamNum);
+		if (streamPath != nullptr) { testScene.RequestStream(streamPath); }
+		testScene.SetSphereNum(lodNum);
+		graphic->SetFrameCallback([&testScene] { testScene.Submit(); });
+
+		// ゲームの処理 (オブジェクトを動かしてシーンを更新し、見えるものを集める) はシミュレーションのスレッドで進める
+		// 描画側は毎フレーム視錐台を渡し、公開された最新の結果を描くだけにする
+		unique_ptr<Simulation> simulation = nullptr;
+		if (simulationNum > 0) {
+			simulation = make_unique<Simulation>(simulationNum, graphic->GetFrustum(), simulationRate);
+			simulation->Start();
+			testScene.SetSimulation(simulation.get());
+		}
+
+		if (benchmarkFrames > 0) {
+			if (streamWait) {
+				while (graphic->GetStreamingStatistics().QueueDepth > 0 && graphic->Update()) {}
+			}
+			graphic->RunBenchmark(benchmarkFrames);
+		}
+		else {
+			// ゲームの処理はシミュレーションのスレッドで進むので、ここではメッセージの処理と描画だけを行う
+			while (graphic->Update()) {}
+		}
+		if (capturePath != nullptr && !graphic->SaveImage(capturePath)) {
+			cerr << "画像を書き出せませんでした。" << endl;
 		}
+		if (comparePath != nullptr) {
+			IMAGE_COMPARISON comparison = {};
+			graphic->CompareImage(comparePath, compareTolerance, &comparison);
+			if (!comparison.Loaded) { cerr << "参照画像を読めませんでした (-software のみ比べられます)。" << endl; }
+			else {
+				cout << "image diff : " << comparison.DifferentNum << " / " << comparison.PixelNum << " pixels (" << comparison.DifferentRate << " %, tolerance " << compareTolerance << " %), max channel diff " << comparison.MaxDifference << endl;
+			}
+			cout << "result : " << (comparison.Matched ? "matched" : "MISMATCH") << endl;
+			if (!comparison.Matched) { exitCode = 1; }
+		}
+		graphic->SetFrameCallback(nullptr);
+		if (simulation != nullptr) { simulation->Stop(); }
 	}
 	Graphic::Terminate();
+
+	// 計測した区間の集計とトレース
+	if (profilePath != nullptr) {
+		Profiler::Collect();
+		Profiler::PrintSummary();
+		if (!Profiler::ExportChromeTrace(profilePath)) { cerr << "トレースを書き出せませんでした。" << endl; }
+	}
+
+	return exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+﻿#include "MappedFile.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// コンストラクタ
+MappedFile::MappedFile():
+#if defined(_WIN32)
+	m_FileHandle(INVALID_HANDLE_VALUE),
+	m_MappingHandle(nullptr),
+#endif
+	m_Data(nullptr),
+	m_Size(0) {}
+
+// デストラクタ
+MappedFile::~MappedFile() { Close(); }
+
+#if defined(_WIN32)
+
+// ファイルをマップする
+bool MappedFile::Open(const char* path) {
+
+	Close();
+
+	m_FileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_FileHandle == INVALID_HANDLE_VALUE) { return false; }
+
+	LARGE_INTEGER size = {};
+	if (!GetFileSizeEx(m_FileHandle, &size) || size.QuadPart == 0) {
+		Close();
+		return false;
+	}
+
+	m_MappingHandle = CreateFileMappingA(m_FileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (m_MappingHandle == nullptr) {
+		Close();
+		return false;
+	}
+
+	m_Data = static_cast<uint8_t*>(MapViewOfFile(m_MappingHandle, FILE_MAP_COPY, 0, 0, 0));
+	if (m_Data == nullptr) {
+		Close();
+		return false;
+	}
+
+	m_Size = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+// マップを解除する
+void MappedFile::Close() {
+	if (m_Data != nullptr) { UnmapViewOfFile(m_Data); }
+	if (m_MappingHandle != nullptr) { CloseHandle(m_MappingHandle); }
+	if (m_FileHandle != INVALID_HANDLE_VALUE) { CloseHandle(m_FileHandle); }
+	m_Data = nullptr;
+	m_Size = 0;
+	m_MappingHandle = nullptr;
+	m_FileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+// ファイルをマップする
+bool MappedFile::Open(const char* path) {
+
+	Close();
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) { return false; }
+
+	struct stat status = {};
+	if (fstat(fd, &status) != 0 || status.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	// マップした後はファイル記述子は要らない
+	void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) { return false; }
+
+	m_Data = static_cast<uint8_t*>(data);
+	m_Size = static_cast<size_t>(status.st_size);
+	return true;
+}
+
+// マップを解除する
+void MappedFile::Close() {
+	if (m_Data != nullptr) { munmap(m_Data, m_Size); }
+	m_Data = nullptr;
+	m_Size = 0;
+}
+
+#endif
+
+// 先頭のアドレスを取得
+uint8_t* MappedFile::GetData() const { return m_Data; }
+
+// 大きさを取得
+size_t MappedFile::GetSize() const { return m_Size; }
+
+// マップしているか
+bool MappedFile::IsOpen() const { return m_Data != nullptr; }
@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// メモリマップしたファイル (読み込み専用、書き込みはコピーオンライト)
+// 書き換えたページだけがプロセス専用に複製され、ファイルには反映されない
+class MappedFile {
+
+private:
+#if defined(_WIN32)
+	void* m_FileHandle;
+	void* m_MappingHandle;
+#endif
+	uint8_t* m_Data;
+	size_t m_Size;
+
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// ファイルをマップする (失敗したら false)
+	bool Open(const char* path);
+	void Close();
+
+	uint8_t* GetData() const;
+	size_t GetSize() const;
+	bool IsOpen() const;
+};
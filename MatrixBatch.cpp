@@ -0,0 +1,345 @@
+﻿#include "MatrixBatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include "Profiler.h"
+#include "Simd.h"
+
+// 1 つのジョブで計算する最小の行列数 (これより少なければ分けない)
+static const uint32_t MATRIX_BATCH_SIZE = 4096;
+
+// 行ごとに並んだ行列を SoA に並べ替えるときの塊の大きさ
+static const size_t MATRIX_CHUNK_SIZE = 64;
+
+// 左上 3x3 の余因子 (要素の番号 a, b, c, d について a * b - c * d、行優先で 9 個)
+static const int COFACTORS[9][4] = {
+	{ 5, 10, 6, 9 }, { 6, 8, 4, 10 }, { 4, 9, 5, 8 },
+	{ 2, 9, 1, 10 }, { 0, 10, 2, 8 }, { 1, 8, 0, 9 },
+	{ 1, 6, 2, 5 }, { 2, 4, 0, 6 }, { 0, 5, 1, 4 },
+};
+
+// SoA の行列の並び (要素 e の i 番目の値は Base[e * Stride + i]、Normal は nullptr なら作らない)
+struct MATRIX_SOA {
+	const float* In;
+	size_t InStride;
+	float* Out;
+	size_t OutStride;
+	float* Normal;
+	size_t NormalStride;
+};
+
+// スカラー版
+static void MultiplyScalar(const MATRIX_SOA& soa, const XMFLOAT4X4& vp, size_t begin, size_t end) {
+	for (size_t i = begin; i < end; ++i) {
+		float w[16];
+		for (int e = 0; e < 16; ++e) { w[e] = soa.In[e * soa.InStride + i]; }
+
+		for (int row = 0; row < 4; ++row) {
+			for (int col = 0; col < 4; ++col) {
+				float r = w[row * 4 + 0] * vp.m[0][col] + w[row * 4 + 1] * vp.m[1][col] + w[row * 4 + 2] * vp.m[2][col] + w[row * 4 + 3] * vp.m[3][col];
+				soa.Out[(row * 4 + col) * soa.OutStride + i] = r;
+			}
+		}
+
+		if (soa.Normal == nullptr) { continue; }
+
+		// 左上 3x3 の余因子を行列式で割ると逆行列の転置になる
+		float c[9];
+		for (int k = 0; k < 9; ++k) { c[k] = w[COFACTORS[k][0]] * w[COFACTORS[k][1]] - w[COFACTORS[k][2]] * w[COFACTORS[k][3]]; }
+		float inv = 1.0f / (w[0] * c[0] + w[1] * c[1] + w[2] * c[2]);
+		for (int e = 0; e < 16; ++e) {
+			int row = e / 4, col = e % 4;
+			float n = row < 3 && col < 3 ? c[row * 3 + col] * inv : (e == 15 ? 1.0f : 0.0f);
+			soa.Normal[e * soa.NormalStride + i] = n;
+		}
+	}
+}
+
+#if defined(SIMD_X86)
+
+// SSE 版 (4 行列ずつ)
+static size_t MultiplySSE(const MATRIX_SOA& soa, const XMFLOAT4X4& vp, size_t begin, size_t end) {
+
+	__m128 v[16];
+	for (int e = 0; e < 16; ++e) { v[e] = _mm_set1_ps(vp.m[e / 4][e % 4]); }
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 w[16];
+		for (int e = 0; e < 16; ++e) { w[e] = _mm_loadu_ps(soa.In + e * soa.InStride + i); }
+
+		for (int row = 0; row < 4; ++row) {
+			for (int col = 0; col < 4; ++col) {
+				__m128 r0 = _mm_add_ps(_mm_mul_ps(w[row * 4 + 0], v[col]), _mm_mul_ps(w[row * 4 + 1], v[4 + col]));
+				__m128 r1 = _mm_add_ps(_mm_mul_ps(w[row * 4 + 2], v[8 + col]), _mm_mul_ps(w[row * 4 + 3], v[12 + col]));
+				_mm_storeu_ps(soa.Out + (row * 4 + col) * soa.OutStride + i, _mm_add_ps(r0, r1));
+			}
+		}
+
+		if (soa.Normal == nullptr) { continue; }
+
+		__m128 c[9];
+		for (int k = 0; k < 9; ++k) { c[k] = _mm_sub_ps(_mm_mul_ps(w[COFACTORS[k][0]], w[COFACTORS[k][1]]), _mm_mul_ps(w[COFACTORS[k][2]], w[COFACTORS[k][3]])); }
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[0], c[0]), _mm_mul_ps(w[1], c[1])), _mm_mul_ps(w[2], c[2]));
+		__m128 inv = _mm_div_ps(one, det);
+		for (int e = 0; e < 16; ++e) {
+			int row = e / 4, col = e % 4;
+			__m128 n = row < 3 && col < 3 ? _mm_mul_ps(c[row * 3 + col], inv) : (e == 15 ? one : zero);
+			_mm_storeu_ps(soa.Normal + e * soa.NormalStride + i, n);
+		}
+	}
+	return i;
+}
+
+// AVX2 版 (8 行列ずつ)
+SIMD_TARGET_AVX2 static size_t MultiplyAVX2(const MATRIX_SOA& soa, const XMFLOAT4X4& vp, size_t begin, size_t end) {
+
+	__m256 v[16];
+	for (int e = 0; e < 16; ++e) { v[e] = _mm256_set1_ps(vp.m[e / 4][e % 4]); }
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 w[16];
+		for (int e = 0; e < 16; ++e) { w[e] = _mm256_loadu_ps(soa.In + e * soa.InStride + i); }
+
+		for (int row = 0; row < 4; ++row) {
+			for (int col = 0; col < 4; ++col) {
+				__m256 r = _mm256_mul_ps(w[row * 4 + 3], v[12 + col]);
+				r = _mm256_fmadd_ps(w[row * 4 + 2], v[8 + col], r);
+				r = _mm256_fmadd_ps(w[row * 4 + 1], v[4 + col], r);
+				r = _mm256_fmadd_ps(w[row * 4 + 0], v[col], r);
+				_mm256_storeu_ps(soa.Out + (row * 4 + col) * soa.OutStride + i, r);
+			}
+		}
+
+		if (soa.Normal == nullptr) { continue; }
+
+		__m256 c[9];
+		for (int k = 0; k < 9; ++k) { c[k] = _mm256_fmsub_ps(w[COFACTORS[k][0]], w[COFACTORS[k][1]], _mm256_mul_ps(w[COFACTORS[k][2]], w[COFACTORS[k][3]])); }
+		__m256 det = _mm256_fmadd_ps(w[0], c[0], _mm256_fmadd_ps(w[1], c[1], _mm256_mul_ps(w[2], c[2])));
+		__m256 inv = _mm256_div_ps(one, det);
+		for (int e = 0; e < 16; ++e) {
+			int row = e / 4, col = e % 4;
+			__m256 n = row < 3 && col < 3 ? _mm256_mul_ps(c[row * 3 + col], inv) : (e == 15 ? one : zero);
+			_mm256_storeu_ps(soa.Normal + e * soa.NormalStride + i, n);
+		}
+	}
+	return i;
+}
+
+#endif
+
+// [begin, end) の行列を掛ける
+static void MultiplyRange(const MATRIX_SOA& soa, const XMFLOAT4X4& vp, size_t begin, size_t end) {
+
+	size_t done = begin;
+
+#if defined(SIMD_X86)
+	if (IsAVX2Supported()) { done = MultiplyAVX2(soa, vp, begin, end); }
+	else { done = MultiplySSE(soa, vp, begin, end); }
+#endif
+
+	MultiplyScalar(soa, vp, done, end);
+}
+
+// 行ごとに並んだ [begin, end) の行列を塊ごとに SoA に並べ替えて掛ける
+static void MultiplyRows(const XMFLOAT4X4* worlds, XMFLOAT4X4* results, XMFLOAT4X4* normals, const XMFLOAT4X4& vp, size_t begin, size_t end) {
+
+	alignas(32) float in[16 * MATRIX_CHUNK_SIZE];
+	alignas(32) float out[16 * MATRIX_CHUNK_SIZE];
+	alignas(32) float normal[16 * MATRIX_CHUNK_SIZE];
+	MATRIX_SOA soa = { in, MATRIX_CHUNK_SIZE, out, MATRIX_CHUNK_SIZE, normals != nullptr ? normal : nullptr, MATRIX_CHUNK_SIZE };
+
+	for (size_t base = begin; base < end; base += MATRIX_CHUNK_SIZE) {
+		size_t num = min(MATRIX_CHUNK_SIZE, end - base);
+		for (size_t i = 0; i < num; ++i) {
+			const float* world = reinterpret_cast<const float*>(&worlds[base + i]);
+			for (int e = 0; e < 16; ++e) { in[e * MATRIX_CHUNK_SIZE + i] = world[e]; }
+		}
+
+		MultiplyRange(soa, vp, 0, num);
+
+		for (size_t i = 0; i < num; ++i) {
+			float* result = reinterpret_cast<float*>(&results[base + i]);
+			for (int e = 0; e < 16; ++e) { result[e] = out[e * MATRIX_CHUNK_SIZE + i]; }
+		}
+		if (normals == nullptr) { continue; }
+		for (size_t i = 0; i < num; ++i) {
+			float* result = reinterpret_cast<float*>(&normals[base + i]);
+			for (int e = 0; e < 16; ++e) { result[e] = normal[e * MATRIX_CHUNK_SIZE + i]; }
+		}
+	}
+}
+
+// コンストラクタ
+MatrixStream::MatrixStream():
+	m_Elements(),
+	m_Num(0),
+	m_Stride(0) {}
+
+// 行列の数を変える (要素ごとの配列は 8 の倍数に揃え、値は保たない)
+void MatrixStream::Resize(size_t num) {
+	m_Num = num;
+	m_Stride = (num + 7) & ~static_cast<size_t>(7);
+	m_Elements.resize(16 * m_Stride);
+}
+
+// 行列の数を取得
+size_t MatrixStream::GetNum() const { return m_Num; }
+
+// 要素ごとの配列の間隔を取得
+size_t MatrixStream::GetStride() const { return m_Stride; }
+
+// 行列を設定
+void MatrixStream::Set(size_t index, FXMMATRIX matrix) {
+	XMFLOAT4X4 value;
+	XMStoreFloat4x4(&value, matrix);
+	Set(index, value);
+}
+
+// 行列を設定
+void MatrixStream::Set(size_t index, const XMFLOAT4X4& matrix) {
+	for (int e = 0; e < 16; ++e) { m_Elements[e * m_Stride + index] = matrix.m[e / 4][e % 4]; }
+}
+
+// 行列を取得
+XMFLOAT4X4 MatrixStream::Get(size_t index) const {
+	XMFLOAT4X4 matrix;
+	for (int e = 0; e < 16; ++e) { matrix.m[e / 4][e % 4] = m_Elements[e * m_Stride + index]; }
+	return matrix;
+}
+
+// 要素ごとの配列の先頭を取得
+const float* MatrixStream::GetElement(uint32_t element) const { return m_Elements.data() + element * m_Stride; }
+float* MatrixStream::GetElement(uint32_t element) { return m_Elements.data() + element * m_Stride; }
+
+// SoA の行列を掛ける
+void MatrixBatch::Multiply(const MatrixStream& worlds, FXMMATRIX viewProject, MatrixStream* results, MatrixStream* normals, JobSystem* jobSystem) {
+	PROFILE_ZONE("MatrixBatch::Multiply");
+
+	size_t count = worlds.GetNum();
+	results->Resize(count);
+	if (normals != nullptr) { normals->Resize(count); }
+
+	XMFLOAT4X4 vp;
+	XMStoreFloat4x4(&vp, viewProject);
+
+	MATRIX_SOA soa = {
+		worlds.GetElement(0), worlds.GetStride(),
+		results->GetElement(0), results->GetStride(),
+		normals != nullptr ? normals->GetElement(0) : nullptr, normals != nullptr ? normals->GetStride() : 0,
+	};
+
+	if (jobSystem == nullptr || count <= MATRIX_BATCH_SIZE) {
+		MultiplyRange(soa, vp, 0, count);
+		return;
+	}
+	jobSystem->ParallelFor(static_cast<uint32_t>(count), MATRIX_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+		MultiplyRange(soa, vp, begin, end);
+	});
+}
+
+// 行ごとに並んだ行列を掛ける
+void MatrixBatch::Multiply(const XMFLOAT4X4* worlds, size_t count, FXMMATRIX viewProject, XMFLOAT4X4* results, XMFLOAT4X4* normals, JobSystem* jobSystem) {
+	PROFILE_ZONE("MatrixBatch::Multiply");
+
+	XMFLOAT4X4 vp;
+	XMStoreFloat4x4(&vp, viewProject);
+
+	if (jobSystem == nullptr || count <= MATRIX_BATCH_SIZE) {
+		MultiplyRows(worlds, results, normals, vp, 0, count);
+		return;
+	}
+	jobSystem->ParallelFor(static_cast<uint32_t>(count), MATRIX_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+		MultiplyRows(worlds, results, normals, vp, begin, end);
+	});
+}
+
+// matrixNum 個の行列を掛ける時間を計測して出力する
+void MatrixBatch::RunBenchmark(uint32_t matrixNum, uint32_t threadNum) {
+
+	const uint32_t frameNum = 20;
+	matrixNum = max(matrixNum, 1u);
+
+	// 拡大・回転・平行移動を組み合わせたワールド行列
+	mt19937 random(1);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	uniform_real_distribution<float> scale(0.5f, 2.0f);
+	vector<XMFLOAT4X4> worlds(matrixNum);
+	MatrixStream worldStream;
+	worldStream.Resize(matrixNum);
+	for (uint32_t i = 0; i < matrixNum; ++i) {
+		XMVECTOR axis = XMVector3Normalize(XMVectorSet(unit(random), unit(random), unit(random) + 2.0f, 0.0f));
+		XMMATRIX world = XMMatrixAffineTransformation(
+			XMVectorSet(scale(random), scale(random), scale(random), 0.0f), XMVectorZero(),
+			XMQuaternionRotationAxis(axis, unit(random) * XM_PI), XMVectorSet(unit(random) * 100.0f, unit(random) * 100.0f, unit(random) * 100.0f, 0.0f));
+		XMStoreFloat4x4(&worlds[i], world);
+		worldStream.Set(i, worlds[i]);
+	}
+	XMMATRIX view = XMMatrixLookAtRH(XMVectorSet(0.0f, 50.0f, 200.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX viewProject = XMMatrixMultiply(view, XMMatrixPerspectiveFovRH(XMConvertToRadians(37.5f), 16.0f / 9.0f, 1.0f, 1000.0f));
+
+	// 1 回分の時間 (ミリ秒) の平均
+	auto measure = [frameNum](const function<void()>& function) {
+		auto begin = chrono::steady_clock::now();
+		for (uint32_t frame = 0; frame < frameNum; ++frame) { function(); }
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count() / frameNum;
+	};
+
+	// 比較のために 1 つずつ XMMatrixMultiply で掛ける
+	vector<XMFLOAT4X4> expected(matrixNum);
+	double scalarTime = measure([&] {
+		for (uint32_t i = 0; i < matrixNum; ++i) { XMStoreFloat4x4(&expected[i], XMMatrixMultiply(XMLoadFloat4x4(&worlds[i]), viewProject)); }
+	});
+
+	JobSystem jobSystem(threadNum);
+	MatrixStream results, normals;
+	vector<XMFLOAT4X4> rowResults(matrixNum);
+	double soaTime = measure([&] { MatrixBatch::Multiply(worldStream, viewProject, &results); });
+	double normalTime = measure([&] { MatrixBatch::Multiply(worldStream, viewProject, &results, &normals); });
+	double rowTime = measure([&] { MatrixBatch::Multiply(worlds.data(), matrixNum, viewProject, rowResults.data()); });
+	double threadTime = measure([&] { MatrixBatch::Multiply(worldStream, viewProject, &results, &normals, &jobSystem); });
+
+	// XMMatrixMultiply との差と、ワールド行列と法線行列の転置の積が単位行列になっているか
+	float maxError = 0.0f, maxNormalError = 0.0f;
+	for (uint32_t i = 0; i < matrixNum; ++i) {
+		XMFLOAT4X4 result = results.Get(i), row = rowResults[i];
+		for (int e = 0; e < 16; ++e) {
+			float tolerance = 1e-5f * max(1.0f, fabs(expected[i].m[e / 4][e % 4]));
+			maxError = max(maxError, max(fabs(result.m[e / 4][e % 4] - expected[i].m[e / 4][e % 4]), fabs(row.m[e / 4][e % 4] - expected[i].m[e / 4][e % 4])) / tolerance);
+		}
+		XMFLOAT4X4 normal = normals.Get(i), identity;
+		XMStoreFloat4x4(&identity, XMMatrixMultiply(XMLoadFloat4x4(&worlds[i]), XMMatrixTranspose(XMLoadFloat4x4(&normal))));
+		for (int row = 0; row < 3; ++row) {
+			for (int col = 0; col < 3; ++col) { maxNormalError = max(maxNormalError, fabs(identity.m[row][col] - (row == col ? 1.0f : 0.0f))); }
+		}
+	}
+	bool matched = maxError <= 1.0f && maxNormalError <= 1e-4f;
+
+	// 1 秒あたりの行列数 (百万)
+	auto rate = [matrixNum](double milliseconds) { return matrixNum / (milliseconds * 1000.0); };
+
+#if defined(SIMD_X86)
+	const char* kernel = IsAVX2Supported() ? "avx2" : "sse";
+#else
+	const char* kernel = "scalar";
+#endif
+
+	cout << "matrices : " << matrixNum << endl;
+	cout << "threads : " << jobSystem.GetThreadNum() << endl;
+	cout << "kernel : " << kernel << endl;
+	cout << "XMMatrixMultiply : " << scalarTime << " ms (" << rate(scalarTime) << " M matrices/s)" << endl;
+	cout << "batch soa : " << soaTime << " ms (" << rate(soaTime) << " M matrices/s)" << endl;
+	cout << "batch soa + normal : " << normalTime << " ms (" << rate(normalTime) << " M matrices/s)" << endl;
+	cout << "batch rows : " << rowTime << " ms (" << rate(rowTime) << " M matrices/s)" << endl;
+	cout << "batch soa + normal, threaded : " << threadTime << " ms (" << rate(threadTime) << " M matrices/s)" << endl;
+	cout << "result : " << (matched ? "matched" : "MISMATCH") << endl;
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "JobSystem.h"
+
+using namespace std;
+using namespace DirectX;
+
+// 行列の SoA 配列
+// 16 個の要素 (_11, _12, ..., _44) ごとに全行列の値を並べ、8 個 (AVX2) / 4 個 (SSE) の行列を 1 度に読めるようにする
+class MatrixStream {
+
+private:
+	vector<float> m_Elements; // 要素 e の i 番目の行列の値は m_Elements[e * m_Stride + i]
+	size_t m_Num;
+	size_t m_Stride;
+
+public:
+	MatrixStream();
+	~MatrixStream() = default;
+
+	void Resize(size_t num);
+	size_t GetNum() const;
+	size_t GetStride() const;
+
+	void Set(size_t index, FXMMATRIX matrix);
+	void Set(size_t index, const XMFLOAT4X4& matrix);
+	XMFLOAT4X4 Get(size_t index) const;
+
+	// 要素ごとの配列の先頭
+	const float* GetElement(uint32_t element) const;
+	float* GetElement(uint32_t element);
+};
+
+// 行列の一括乗算
+// ワールド行列の配列に 1 つのビュー・射影行列を掛け、ワールド・ビュー・射影行列と法線行列 (ワールド行列の逆転置) をまとめて作る
+// SoA の行列を 8 個 (AVX2) / 4 個 (SSE) 単位で計算し、端数はスカラーで処理する
+// 行列の数が多ければ JobSystem で分割して計算する (jobSystem が nullptr なら呼び出し元のスレッドだけで計算する)
+class MatrixBatch {
+public:
+	// SoA の行列を掛ける (results と normals は worlds と同じ数に広げる、normals は nullptr なら作らない)
+	static void Multiply(const MatrixStream& worlds, FXMMATRIX viewProject, MatrixStream* results, MatrixStream* normals = nullptr, JobSystem* jobSystem = nullptr);
+
+	// 行ごとに並んだ行列を掛ける (小さな塊ごとに SoA に並べ替えてから計算する)
+	static void Multiply(const XMFLOAT4X4* worlds, size_t count, FXMMATRIX viewProject, XMFLOAT4X4* results, XMFLOAT4X4* normals = nullptr, JobSystem* jobSystem = nullptr);
+
+	// matrixNum 個の行列を掛ける時間を計測して出力する
+	static void RunBenchmark(uint32_t matrixNum, uint32_t threadNum);
+};
@@ -0,0 +1,233 @@
+﻿#include "MeshFile.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+static_assert(sizeof(MESH_FILE_HEADER) == 112, "MESH_FILE_HEADER の大きさが変わっています。");
+
+// 境界に切り上げる
+static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// コンストラクタ
+MeshFile::MeshFile():
+	m_File(nullptr),
+	m_Header(nullptr) {}
+
+// レンダリングオブジェクトを書き出す
+bool MeshFile::Write(const char* path, const RenderObject& object, const VERTEX_FORMAT& format, INDEX_FORMAT indexFormat) {
+
+	const uint32_t vertexNum = static_cast<uint32_t>(object.GetVertexNum());
+	const uint32_t indexNum = static_cast<uint32_t>(object.GetIndexNum());
+	if (indexFormat == INDEX_FORMAT::R16_UINT && VertexFormat::SelectIndexFormat(vertexNum) != INDEX_FORMAT::R16_UINT) { return false; }
+
+	VertexFormat vertexFormat(format);
+	const uint32_t indexSize = VertexFormat::GetIndexSize(indexFormat);
+
+	MESH_FILE_HEADER header = {};
+	header.Magic = MESH_FILE_MAGIC;
+	header.Version = MESH_FILE_VERSION;
+	header.HeaderSize = sizeof(MESH_FILE_HEADER);
+	header.PositionFormat = static_cast<uint32_t>(format.Position);
+	header.ColorFormat = static_cast<uint32_t>(format.Color);
+	header.PositionExtent = format.PositionExtent;
+	header.VertexStride = vertexFormat.GetStride();
+	header.IndexFormat = static_cast<uint32_t>(indexFormat);
+	header.VertexNum = vertexNum;
+	header.IndexNum = indexNum;
+	header.VertexOffset = AlignUp(sizeof(MESH_FILE_HEADER), MESH_FILE_ALIGNMENT);
+	header.VertexSize = static_cast<uint64_t>(vertexNum) * header.VertexStride;
+	header.IndexOffset = AlignUp(header.VertexOffset + header.VertexSize, MESH_FILE_ALIGNMENT);
+	header.IndexSize = static_cast<uint64_t>(indexNum) * indexSize;
+	header.Bounds = object.GetBounds();
+
+	// 頂点とインデックスを書き出す形式に詰める
+	vector<uint8_t> vertices(static_cast<size_t>(header.VertexSize));
+	vertexFormat.Encode(object.GetVertices(), vertexNum, vertices.data());
+
+	vector<uint8_t> indices(static_cast<size_t>(header.IndexSize));
+	if (indexFormat == INDEX_FORMAT::R16_UINT) {
+		uint16_t* dest = reinterpret_cast<uint16_t*>(indices.data());
+		for (uint32_t i = 0; i < indexNum; ++i) { dest[i] = static_cast<uint16_t>(object.GetIndices()[i]); }
+	}
+	else if (indexNum > 0) {
+		memcpy(indices.data(), object.GetIndices(), static_cast<size_t>(header.IndexSize));
+	}
+
+	ofstream file(path, ios::binary);
+	if (!file) { return false; }
+
+	const char padding[MESH_FILE_ALIGNMENT] = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(padding, static_cast<streamsize>(header.VertexOffset - sizeof(header)));
+	file.write(reinterpret_cast<const char*>(vertices.data()), static_cast<streamsize>(vertices.size()));
+	file.write(padding, static_cast<streamsize>(header.IndexOffset - header.VertexOffset - header.VertexSize));
+	file.write(reinterpret_cast<const char*>(indices.data()), static_cast<streamsize>(indices.size()));
+	return static_cast<bool>(file);
+}
+
+// ファイルを開いて中身を確かめる
+bool MeshFile::Open(const char* path) {
+
+	Close();
+
+	shared_ptr<MappedFile> file = make_shared<MappedFile>();
+	if (!file->Open(path) || file->GetSize() < sizeof(MESH_FILE_HEADER)) { return false; }
+
+	const MESH_FILE_HEADER* header = reinterpret_cast<const MESH_FILE_HEADER*>(file->GetData());
+	if (header->Magic != MESH_FILE_MAGIC || header->Version != MESH_FILE_VERSION || header->HeaderSize != sizeof(MESH_FILE_HEADER)) { return false; }
+
+	// 形式
+	if (header->PositionFormat > static_cast<uint32_t>(POSITION_FORMAT::SNORM16X4)) { return false; }
+	if (header->ColorFormat > static_cast<uint32_t>(COLOR_FORMAT::RGBA8_UNORM)) { return false; }
+	if (header->IndexFormat > static_cast<uint32_t>(INDEX_FORMAT::R32_UINT)) { return false; }
+	if (header->PositionFormat == static_cast<uint32_t>(POSITION_FORMAT::SNORM16X4) && !(header->PositionExtent > 0.0f)) { return false; }
+
+	VERTEX_FORMAT format = { static_cast<POSITION_FORMAT>(header->PositionFormat), static_cast<COLOR_FORMAT>(header->ColorFormat), header->PositionExtent };
+	uint32_t indexSize = VertexFormat::GetIndexSize(static_cast<INDEX_FORMAT>(header->IndexFormat));
+	if (header->VertexStride != VertexFormat(format).GetStride()) { return false; }
+
+	// 配置 (境界に揃っていて、ファイルの中に収まっていること)
+	const uint64_t fileSize = file->GetSize();
+	if (header->VertexOffset % MESH_FILE_ALIGNMENT != 0 || header->IndexOffset % MESH_FILE_ALIGNMENT != 0) { return false; }
+	if (header->VertexSize != static_cast<uint64_t>(header->VertexNum) * header->VertexStride) { return false; }
+	if (header->IndexSize != static_cast<uint64_t>(header->IndexNum) * indexSize) { return false; }
+	if (header->VertexOffset < sizeof(MESH_FILE_HEADER) || header->VertexOffset > fileSize || header->VertexSize > fileSize - header->VertexOffset) { return false; }
+	if (header->IndexOffset < sizeof(MESH_FILE_HEADER) || header->IndexOffset > fileSize || header->IndexSize > fileSize - header->IndexOffset) { return false; }
+
+	m_File = file;
+	m_Header = header;
+	return true;
+}
+
+// ファイルを閉じる (MappedMesh が参照していればマップはそちらに残る)
+void MeshFile::Close() {
+	m_File = nullptr;
+	m_Header = nullptr;
+}
+
+// ヘッダを取得
+const MESH_FILE_HEADER& MeshFile::GetHeader() const {
+	if (m_Header == nullptr) { throw runtime_error("メッシュファイルが開かれていません。"); }
+	return *m_Header;
+}
+
+// 頂点形式を取得
+VERTEX_FORMAT MeshFile::GetVertexFormat() const {
+	const MESH_FILE_HEADER& header = GetHeader();
+	return { static_cast<POSITION_FORMAT>(header.PositionFormat), static_cast<COLOR_FORMAT>(header.ColorFormat), header.PositionExtent };
+}
+
+// インデックスの形式を取得
+INDEX_FORMAT MeshFile::GetIndexFormat() const {
+	return static_cast<INDEX_FORMAT>(GetHeader().IndexFormat);
+}
+
+// 頂点を取得
+void* MeshFile::GetVertexData() const {
+	return m_File->GetData() + GetHeader().VertexOffset;
+}
+
+// インデックスを取得
+void* MeshFile::GetIndexData() const {
+	return m_File->GetData() + GetHeader().IndexOffset;
+}
+
+// RenderObject がそのまま参照できるか
+bool MeshFile::IsRenderObjectLayout() const {
+	const MESH_FILE_HEADER& header = GetHeader();
+	return header.PositionFormat == static_cast<uint32_t>(POSITION_FORMAT::FLOAT3)
+		&& header.ColorFormat == static_cast<uint32_t>(COLOR_FORMAT::FLOAT4)
+		&& header.IndexFormat == static_cast<uint32_t>(INDEX_FORMAT::R32_UINT)
+		&& header.VertexStride == sizeof(VERTEX);
+}
+
+// マップを共有する
+shared_ptr<MappedFile> MeshFile::GetMappedFile() const { return m_File; }
+
+// 読み込み時間を計測して出力する
+void MeshFile::RunLoadBenchmark(const char* path) {
+
+	auto elapsed = [](chrono::steady_clock::time_point begin) {
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+	};
+
+	// メモリマップして中身を確かめる
+	auto begin = chrono::steady_clock::now();
+	MeshFile file;
+	if (!file.Open(path)) {
+		cerr << "メッシュファイルを開けませんでした : " << path << endl;
+		return;
+	}
+	double openTime = elapsed(begin);
+	const MESH_FILE_HEADER& header = file.GetHeader();
+	const uint64_t dataSize = header.VertexSize + header.IndexSize;
+
+	// RenderObject として参照する (コピーしない)
+	double viewTime = 0.0;
+	if (file.IsRenderObjectLayout()) {
+		begin = chrono::steady_clock::now();
+		MappedMesh mesh(file);
+		viewTime = elapsed(begin);
+	}
+
+	// マップから直接コピーする (初めて触るページはここで読み込まれる)
+	vector<uint8_t> copy(static_cast<size_t>(dataSize));
+	begin = chrono::steady_clock::now();
+	memcpy(copy.data(), file.GetVertexData(), static_cast<size_t>(header.VertexSize));
+	memcpy(copy.data() + header.VertexSize, file.GetIndexData(), static_cast<size_t>(header.IndexSize));
+	double firstCopyTime = elapsed(begin);
+
+	begin = chrono::steady_clock::now();
+	memcpy(copy.data(), file.GetVertexData(), static_cast<size_t>(header.VertexSize));
+	memcpy(copy.data() + header.VertexSize, file.GetIndexData(), static_cast<size_t>(header.IndexSize));
+	double copyTime = elapsed(begin);
+
+	// 比較のためにストリームで読み込む
+	begin = chrono::steady_clock::now();
+	{
+		ifstream stream(path, ios::binary);
+		MESH_FILE_HEADER streamHeader = {};
+		stream.read(reinterpret_cast<char*>(&streamHeader), sizeof(streamHeader));
+		stream.seekg(static_cast<streamoff>(streamHeader.VertexOffset));
+		stream.read(reinterpret_cast<char*>(copy.data()), static_cast<streamsize>(streamHeader.VertexSize));
+		stream.seekg(static_cast<streamoff>(streamHeader.IndexOffset));
+		stream.read(reinterpret_cast<char*>(copy.data() + streamHeader.VertexSize), static_cast<streamsize>(streamHeader.IndexSize));
+	}
+	double streamTime = elapsed(begin);
+
+	auto bandwidth = [dataSize](double milliseconds) {
+		return milliseconds > 0.0 ? dataSize / (milliseconds * 1.0e6) : 0.0;
+	};
+
+	cout << "file : " << path << endl;
+	cout << "vertices : " << header.VertexNum << " (" << header.VertexStride << " bytes)" << endl;
+	cout << "indices : " << header.IndexNum << " (" << VertexFormat::GetIndexSize(static_cast<INDEX_FORMAT>(header.IndexFormat)) << " bytes)" << endl;
+	cout << "data bytes : " << dataSize << endl;
+	cout << "map + validate : " << openTime << " ms" << endl;
+	cout << "view as RenderObject : " << viewTime << " ms" << endl;
+	cout << "copy from mapping (first touch) : " << firstCopyTime << " ms, " << bandwidth(firstCopyTime) << " GB/s" << endl;
+	cout << "copy from mapping : " << copyTime << " ms, " << bandwidth(copyTime) << " GB/s" << endl;
+	cout << "stream read : " << streamTime << " ms, " << bandwidth(streamTime) << " GB/s" << endl;
+}
+
+// コンストラクタ
+MappedMesh::MappedMesh(const MeshFile& file):
+	m_File(file.GetMappedFile()) {
+
+	if (m_File == nullptr || !file.IsRenderObjectLayout()) { throw runtime_error("RenderObject が参照できない形式のメッシュファイルです。"); }
+
+	// 外部のメモリを指すだけなので、デストラクタで解放しない
+	const MESH_FILE_HEADER& header = file.GetHeader();
+	m_OwnsData = false;
+	m_Vertices = static_cast<VERTEX*>(file.GetVertexData());
+	m_VertexNum = header.VertexNum;
+	m_Indices = static_cast<uint32_t*>(file.GetIndexData());
+	m_IndexNum = header.IndexNum;
+	m_Bounds = header.Bounds;
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "MappedFile.h"
+#include "RenderObject.h"
+#include "VertexFormat.h"
+
+using namespace std;
+
+// メッシュファイルの識別子と版
+static const uint32_t MESH_FILE_MAGIC = 0x4853454D; // "MESH"
+static const uint32_t MESH_FILE_VERSION = 1;
+
+// 頂点とインデックスの配置の境界 (キャッシュラインに合わせる)
+static const uint64_t MESH_FILE_ALIGNMENT = 64;
+
+// メッシュファイルのヘッダ (リトルエンディアン)
+// ヘッダの後ろに頂点とインデックスを MESH_FILE_ALIGNMENT 境界で並べる
+struct MESH_FILE_HEADER {
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t HeaderSize;
+
+	// 頂点形式 (POSITION_FORMAT, COLOR_FORMAT, 量子化の範囲, 頂点 1 つの大きさ)
+	uint32_t PositionFormat;
+	uint32_t ColorFormat;
+	float PositionExtent;
+	uint32_t VertexStride;
+
+	// インデックスの形式 (INDEX_FORMAT)
+	uint32_t IndexFormat;
+
+	uint32_t VertexNum;
+	uint32_t IndexNum;
+	uint64_t VertexOffset;
+	uint64_t VertexSize;
+	uint64_t IndexOffset;
+	uint64_t IndexSize;
+
+	BOUNDS Bounds;
+};
+
+// メッシュファイル
+// ファイルをメモリマップし、頂点とインデックスをコピーせずにそのまま参照させる
+class MeshFile {
+
+private:
+	shared_ptr<MappedFile> m_File;
+	const MESH_FILE_HEADER* m_Header;
+
+public:
+	MeshFile();
+	~MeshFile() = default;
+
+	// レンダリングオブジェクトを書き出す (頂点は format に詰め、インデックスは indexFormat で書く)
+	static bool Write(const char* path, const RenderObject& object, const VERTEX_FORMAT& format = VertexFormat::Full(), INDEX_FORMAT indexFormat = INDEX_FORMAT::R32_UINT);
+
+	// ファイルを開いて中身を確かめる (壊れていれば false)
+	bool Open(const char* path);
+	void Close();
+
+	const MESH_FILE_HEADER& GetHeader() const;
+	VERTEX_FORMAT GetVertexFormat() const;
+	INDEX_FORMAT GetIndexFormat() const;
+	void* GetVertexData() const;
+	void* GetIndexData() const;
+
+	// VERTEX と 32 ビットのインデックスのままで、RenderObject がそのまま参照できるか
+	bool IsRenderObjectLayout() const;
+
+	// マップを共有する (参照している間はマップが解除されない)
+	shared_ptr<MappedFile> GetMappedFile() const;
+
+	// 読み込み時間を計測して出力する (メモリマップとストリームでの読み込みを比べる)
+	static void RunLoadBenchmark(const char* path);
+};
+
+// メッシュファイルを参照するレンダリングオブジェクト
+// 頂点とインデックスはマップしたファイルをそのまま指す (書き換えたページだけが複製される)
+class MappedMesh : public RenderObject {
+
+private:
+	shared_ptr<MappedFile> m_File;
+
+public:
+	// VERTEX と 32 ビットのインデックスで書かれたファイルでなければ例外を投げる
+	MappedMesh(const MeshFile& file);
+};
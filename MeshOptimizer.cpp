@@ -0,0 +1,413 @@
+﻿#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+// Forsyth のアルゴリズムで頂点の点数を付けるときの LRU キャッシュの大きさ
+static const uint32_t ForsythCacheSize = 32;
+static const uint32_t ForsythMaxValence = 32;
+
+// 頂点の点数の表 (キャッシュ内の位置と、残っている三角形の数ごと)
+struct FORSYTH_TABLE {
+	float Cache[ForsythCacheSize];
+	float Valence[ForsythMaxValence + 1];
+
+	FORSYTH_TABLE() {
+		for (uint32_t i = 0; i < ForsythCacheSize; ++i) {
+			// 直前の三角形の頂点は少し下げ、それより古いものは位置に応じて下げる
+			if (i < 3) { Cache[i] = 0.75f; }
+			else { Cache[i] = powf(1.0f - static_cast<float>(i - 3) / (ForsythCacheSize - 3), 1.5f); }
+		}
+		// 残りの三角形が少ない頂点を早く片付ける
+		Valence[0] = 0.0f;
+		for (uint32_t i = 1; i <= ForsythMaxValence; ++i) { Valence[i] = 2.0f * powf(static_cast<float>(i), -0.5f); }
+	}
+};
+
+static const FORSYTH_TABLE& GetForsythTable() {
+	static const FORSYTH_TABLE table;
+	return table;
+}
+
+// インデックスが頂点数に収まっているか確かめる
+static void Validate(const uint32_t* indices, size_t indexNum, size_t vertexNum) {
+	if (indexNum % 3 != 0) { throw runtime_error("インデックスの数が 3 の倍数ではありません。"); }
+	for (size_t i = 0; i < indexNum; ++i) {
+		if (indices[i] >= vertexNum) { throw runtime_error("頂点数を超えるインデックスがあります。"); }
+	}
+}
+
+// FIFO キャッシュで頂点変換の回数を数える (参照された頂点の数も返す)
+static size_t CountTransforms(const uint32_t* indices, size_t indexNum, size_t vertexNum, uint32_t cacheSize, size_t* referencedNum) {
+
+	// 頂点が最後に読み込まれたときの変換回数で、キャッシュに残っているかを判定する
+	vector<size_t> timestamps(vertexNum, 0);
+	size_t transforms = cacheSize + 1;
+	size_t referenced = 0;
+
+	for (size_t i = 0; i < indexNum; ++i) {
+		uint32_t index = indices[i];
+		if (timestamps[index] == 0) { ++referenced; }
+		if (transforms - timestamps[index] > cacheSize) { timestamps[index] = transforms++; }
+	}
+
+	if (referencedNum != nullptr) { *referencedNum = referenced; }
+	return transforms - (cacheSize + 1);
+}
+
+// 頂点キャッシュに合わせて三角形を並べ替える
+void MeshOptimizer::OptimizeVertexCache(uint32_t* indices, size_t indexNum, size_t vertexNum) {
+
+	Validate(indices, indexNum, vertexNum);
+	const size_t triangleNum = indexNum / 3;
+	if (triangleNum == 0) { return; }
+
+	const FORSYTH_TABLE& table = GetForsythTable();
+
+	// 頂点ごとの三角形の一覧 (残っている三角形を先頭に詰めておく)
+	vector<uint32_t> offsets(vertexNum + 1, 0);
+	vector<uint32_t> liveNum(vertexNum, 0);
+	for (size_t i = 0; i < indexNum; ++i) { ++liveNum[indices[i]]; }
+	for (size_t i = 0; i < vertexNum; ++i) { offsets[i + 1] = offsets[i] + liveNum[i]; }
+
+	vector<uint32_t> adjacency(indexNum);
+	{
+		vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indexNum; ++i) { adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3); }
+	}
+
+	// 頂点と三角形の点数
+	vector<int32_t> cachePositions(vertexNum, -1);
+	vector<float> vertexScores(vertexNum);
+	auto scoreVertex = [&](uint32_t vertex) {
+		int32_t position = cachePositions[vertex];
+		float score = position >= 0 ? table.Cache[position] : 0.0f;
+		return score + table.Valence[min(liveNum[vertex], ForsythMaxValence)];
+	};
+	for (uint32_t i = 0; i < vertexNum; ++i) { vertexScores[i] = scoreVertex(i); }
+
+	vector<float> triangleScores(triangleNum);
+	vector<uint8_t> emitted(triangleNum, 0);
+	for (size_t i = 0; i < triangleNum; ++i) {
+		triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] + vertexScores[indices[i * 3 + 2]];
+	}
+
+	// 最初は点数が最も高い三角形から始める
+	uint32_t best = 0;
+	for (uint32_t i = 1; i < triangleNum; ++i) {
+		if (triangleScores[i] > triangleScores[best]) { best = i; }
+	}
+
+	vector<uint32_t> result(indexNum);
+	uint32_t cache[ForsythCacheSize + 3];
+	uint32_t newCache[ForsythCacheSize + 3];
+	uint32_t cacheNum = 0;
+	uint32_t cursor = 0;
+
+	for (size_t output = 0; output < triangleNum; ++output) {
+
+		// キャッシュから候補が見つからなければ、まだ出していない三角形を先頭から探す
+		if (best == UINT32_MAX) {
+			while (emitted[cursor]) { ++cursor; }
+			best = cursor;
+		}
+
+		const uint32_t* triangle = &indices[static_cast<size_t>(best) * 3];
+		result[output * 3] = triangle[0];
+		result[output * 3 + 1] = triangle[1];
+		result[output * 3 + 2] = triangle[2];
+		emitted[best] = 1;
+
+		// 三角形を頂点ごとの一覧から外す
+		for (int i = 0; i < 3; ++i) {
+			uint32_t vertex = triangle[i];
+			uint32_t* begin = &adjacency[offsets[vertex]];
+			uint32_t* end = begin + liveNum[vertex];
+			uint32_t* it = find(begin, end, best);
+			if (it != end) {
+				*it = *(end - 1);
+				--liveNum[vertex];
+			}
+		}
+
+		// 三角形の頂点をキャッシュの先頭に入れ、残りを後ろにずらす
+		uint32_t newCacheNum = 0;
+		for (int i = 0; i < 3; ++i) {
+			if (find(newCache, newCache + newCacheNum, triangle[i]) == newCache + newCacheNum) { newCache[newCacheNum++] = triangle[i]; }
+		}
+		for (uint32_t i = 0; i < cacheNum; ++i) {
+			uint32_t vertex = cache[i];
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) { newCache[newCacheNum++] = vertex; }
+		}
+
+		// あふれた頂点はキャッシュから外す
+		for (uint32_t i = ForsythCacheSize; i < newCacheNum; ++i) {
+			cachePositions[newCache[i]] = -1;
+			vertexScores[newCache[i]] = scoreVertex(newCache[i]);
+		}
+		cacheNum = min(newCacheNum, ForsythCacheSize);
+		for (uint32_t i = 0; i < cacheNum; ++i) {
+			cache[i] = newCache[i];
+			cachePositions[cache[i]] = static_cast<int32_t>(i);
+			vertexScores[cache[i]] = scoreVertex(cache[i]);
+		}
+
+		// キャッシュ内の頂点を使う三角形の点数を付け直し、最も高いものを次に出す
+		best = UINT32_MAX;
+		float bestScore = -1.0f;
+		for (uint32_t i = 0; i < cacheNum; ++i) {
+			uint32_t vertex = cache[i];
+			for (uint32_t j = 0; j < liveNum[vertex]; ++j) {
+				uint32_t candidate = adjacency[offsets[vertex] + j];
+				const uint32_t* t = &indices[static_cast<size_t>(candidate) * 3];
+				float score = vertexScores[t[0]] + vertexScores[t[1]] + vertexScores[t[2]];
+				triangleScores[candidate] = score;
+				if (score > bestScore || (score == bestScore && candidate < best)) {
+					best = candidate;
+					bestScore = score;
+				}
+			}
+		}
+	}
+
+	copy(result.begin(), result.end(), indices);
+}
+
+// オーバードローを減らすように三角形のかたまりを並べ替える
+void MeshOptimizer::OptimizeOverdraw(uint32_t* indices, size_t indexNum, const VERTEX* vertices, size_t vertexNum, float threshold) {
+
+	Validate(indices, indexNum, vertexNum);
+	const size_t triangleNum = indexNum / 3;
+	if (triangleNum == 0) { return; }
+
+	// 3 頂点とも読み込み直しになる三角形でかたまりを区切る (キャッシュが切り替わる位置)
+	vector<uint32_t> clusters;
+	{
+		vector<size_t> timestamps(vertexNum, 0);
+		size_t transforms = m_CacheSize + 1;
+		for (size_t i = 0; i < triangleNum; ++i) {
+			uint32_t misses = 0;
+			for (int j = 0; j < 3; ++j) {
+				uint32_t index = indices[i * 3 + j];
+				if (transforms - timestamps[index] > m_CacheSize) {
+					timestamps[index] = transforms++;
+					++misses;
+				}
+			}
+			if (i == 0 || misses == 3) { clusters.push_back(static_cast<uint32_t>(i)); }
+		}
+	}
+	if (clusters.size() < 2) { return; }
+
+	// かたまりごとの重心と向き (面積で重み付け)
+	const size_t clusterNum = clusters.size();
+	vector<XMFLOAT3> centroids(clusterNum), normals(clusterNum);
+	XMVECTOR meshCentroid = XMVectorZero();
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < clusterNum; ++c) {
+		size_t begin = clusters[c];
+		size_t end = c + 1 < clusterNum ? clusters[c + 1] : triangleNum;
+
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+		for (size_t i = begin; i < end; ++i) {
+			XMVECTOR p0 = XMLoadFloat3(&vertices[indices[i * 3]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[indices[i * 3 + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[indices[i * 3 + 2]].Position);
+			XMVECTOR cross = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+			float weight = XMVectorGetX(XMVector3Length(cross)) * 0.5f;
+
+			centroid = XMVectorAdd(centroid, XMVectorScale(XMVectorAdd(XMVectorAdd(p0, p1), p2), weight / 3.0f));
+			normal = XMVectorAdd(normal, cross);
+			area += weight;
+		}
+
+		meshCentroid = XMVectorAdd(meshCentroid, centroid);
+		meshArea += area;
+		XMStoreFloat3(&centroids[c], area > 0.0f ? XMVectorScale(centroid, 1.0f / area) : XMVectorZero());
+		XMStoreFloat3(&normals[c], normal);
+	}
+	if (meshArea > 0.0f) { meshCentroid = XMVectorScale(meshCentroid, 1.0f / meshArea); }
+
+	// メッシュの中心から見て外を向いているかたまりほど先に描く
+	vector<float> keys(clusterNum);
+	for (size_t c = 0; c < clusterNum; ++c) {
+		XMVECTOR normal = XMLoadFloat3(&normals[c]);
+		float length = XMVectorGetX(XMVector3Length(normal));
+		XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&centroids[c]), meshCentroid);
+		keys[c] = length > 0.0f ? XMVectorGetX(XMVector3Dot(offset, normal)) / length : 0.0f;
+	}
+
+	vector<uint32_t> order(clusterNum);
+	for (uint32_t i = 0; i < clusterNum; ++i) { order[i] = i; }
+	stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	vector<uint32_t> result;
+	result.reserve(indexNum);
+	for (uint32_t c : order) {
+		size_t begin = clusters[c];
+		size_t end = c + 1 < clusterNum ? clusters[c + 1] : triangleNum;
+		result.insert(result.end(), indices + begin * 3, indices + end * 3);
+	}
+
+	// 頂点キャッシュの効率が落ちすぎるなら元の順番のままにする
+	float before = CalculateACMR(indices, indexNum, vertexNum);
+	float after = CalculateACMR(result.data(), indexNum, vertexNum);
+	if (after <= before * threshold) { copy(result.begin(), result.end(), indices); }
+}
+
+// 頂点を参照順に並べ替える
+size_t MeshOptimizer::OptimizeVertexFetch(VERTEX* vertices, uint32_t* indices, size_t indexNum, size_t vertexNum) {
+
+	Validate(indices, indexNum, vertexNum);
+
+	vector<uint32_t> remap(vertexNum, UINT32_MAX);
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexNum; ++i) {
+		uint32_t& index = indices[i];
+		if (remap[index] == UINT32_MAX) { remap[index] = next++; }
+		index = remap[index];
+	}
+	const size_t referencedNum = next;
+
+	// 使われない頂点は元の順番のまま後ろに回す
+	for (size_t i = 0; i < vertexNum; ++i) {
+		if (remap[i] == UINT32_MAX) { remap[i] = next++; }
+	}
+
+	vector<VERTEX> reordered(vertexNum);
+	for (size_t i = 0; i < vertexNum; ++i) { reordered[remap[i]] = vertices[i]; }
+	copy(reordered.begin(), reordered.end(), vertices);
+
+	return referencedNum;
+}
+
+// レンダリングオブジェクトにすべて施す
+MESH_OPTIMIZATION_STATISTICS MeshOptimizer::Optimize(RenderObject& object, bool overdraw, float threshold) {
+
+	VERTEX* vertices = object.GetVertices();
+	uint32_t* indices = object.GetIndices();
+	const size_t vertexNum = object.GetVertexNum();
+	const size_t indexNum = object.GetIndexNum();
+
+	MESH_OPTIMIZATION_STATISTICS statistics = {};
+	statistics.TriangleNum = static_cast<uint32_t>(indexNum / 3);
+	statistics.VertexNum = static_cast<uint32_t>(vertexNum);
+	statistics.ACMRBefore = CalculateACMR(indices, indexNum, vertexNum);
+	statistics.ATVRBefore = CalculateATVR(indices, indexNum, vertexNum);
+
+	OptimizeVertexCache(indices, indexNum, vertexNum);
+	if (overdraw) { OptimizeOverdraw(indices, indexNum, vertices, vertexNum, threshold); }
+	OptimizeVertexFetch(vertices, indices, indexNum, vertexNum);
+
+	statistics.ACMRAfter = CalculateACMR(indices, indexNum, vertexNum);
+	statistics.ATVRAfter = CalculateATVR(indices, indexNum, vertexNum);
+	return statistics;
+}
+
+// 三角形の順を保ったまま頂点フェッチだけを施す
+MESH_OPTIMIZATION_STATISTICS MeshOptimizer::OptimizeKeepingOrder(RenderObject& object) {
+
+	VERTEX* vertices = object.GetVertices();
+	uint32_t* indices = object.GetIndices();
+	const size_t vertexNum = object.GetVertexNum();
+	const size_t indexNum = object.GetIndexNum();
+
+	// 頂点の番号を付け直すだけなので、インデックスの並びで決まる ACMR と ATVR は変わらない
+	MESH_OPTIMIZATION_STATISTICS statistics = {};
+	statistics.TriangleNum = static_cast<uint32_t>(indexNum / 3);
+	statistics.VertexNum = static_cast<uint32_t>(vertexNum);
+	statistics.ACMRBefore = statistics.ACMRAfter = CalculateACMR(indices, indexNum, vertexNum);
+	statistics.ATVRBefore = statistics.ATVRAfter = CalculateATVR(indices, indexNum, vertexNum);
+
+	OptimizeVertexFetch(vertices, indices, indexNum, vertexNum);
+	return statistics;
+}
+
+// ACMR を見積もる
+float MeshOptimizer::CalculateACMR(const uint32_t* indices, size_t indexNum, size_t vertexNum, uint32_t cacheSize) {
+	if (indexNum < 3) { return 0.0f; }
+	size_t transforms = CountTransforms(indices, indexNum, vertexNum, cacheSize, nullptr);
+	return static_cast<float>(static_cast<double>(transforms) / static_cast<double>(indexNum / 3));
+}
+
+// ATVR を見積もる
+float MeshOptimizer::CalculateATVR(const uint32_t* indices, size_t indexNum, size_t vertexNum, uint32_t cacheSize) {
+	size_t referenced = 0;
+	size_t transforms = CountTransforms(indices, indexNum, vertexNum, cacheSize, &referenced);
+	return referenced > 0 ? static_cast<float>(static_cast<double>(transforms) / static_cast<double>(referenced)) : 0.0f;
+}
+
+// 最適化の速さと結果を計測する
+void MeshOptimizer::RunBenchmark(uint32_t triangleNum) {
+
+	// 起伏のある格子 (格子の 1 マスが 2 つの三角形、オーバードローの並べ替えで向きに差が出るようにする)
+	uint32_t divisions = max(1u, static_cast<uint32_t>(sqrt(triangleNum / 2.0)));
+	Grid grid(divisions);
+	VERTEX* gridVertices = grid.GetVertices();
+	for (size_t i = 0; i < grid.GetVertexNum(); ++i) {
+		XMFLOAT3& p = gridVertices[i].Position;
+		p.z = 0.15f * sinf(p.x * 9.0f) * cosf(p.y * 7.0f) + 0.04f * sinf(p.x * 31.0f + p.y * 17.0f);
+	}
+
+	// 格子の順のままではキャッシュの効率が元から良いので、書き出し順の悪いメッシュに見立てて三角形を乱数の順に並べる
+	const size_t vertexNum = grid.GetVertexNum();
+	const size_t indexNum = grid.GetIndexNum();
+	const size_t gridTriangleNum = indexNum / 3;
+	vector<uint32_t> order(gridTriangleNum);
+	for (uint32_t i = 0; i < gridTriangleNum; ++i) { order[i] = i; }
+	shuffle(order.begin(), order.end(), mt19937(1));
+	vector<uint32_t> shuffled(indexNum);
+	for (size_t i = 0; i < gridTriangleNum; ++i) { copy(grid.GetIndices() + order[i] * 3, grid.GetIndices() + order[i] * 3 + 3, shuffled.begin() + i * 3); }
+
+	auto elapsed = [](chrono::steady_clock::time_point begin) { return chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count(); };
+
+	// 1 回目は段階ごとに時間を計る
+	GeneratedMesh first(gridVertices, vertexNum, shuffled.data(), indexNum);
+	VERTEX* vertices = first.GetVertices();
+	uint32_t* indices = first.GetIndices();
+	float acmrBefore = CalculateACMR(indices, indexNum, vertexNum);
+	float atvrBefore = CalculateATVR(indices, indexNum, vertexNum);
+
+	auto begin = chrono::steady_clock::now();
+	OptimizeVertexCache(indices, indexNum, vertexNum);
+	double cacheTime = elapsed(begin);
+	float acmrCache = CalculateACMR(indices, indexNum, vertexNum);
+
+	begin = chrono::steady_clock::now();
+	OptimizeOverdraw(indices, indexNum, vertices, vertexNum, 1.05f);
+	double overdrawTime = elapsed(begin);
+
+	begin = chrono::steady_clock::now();
+	OptimizeVertexFetch(vertices, indices, indexNum, vertexNum);
+	double fetchTime = elapsed(begin);
+	double totalTime = cacheTime + overdrawTime + fetchTime;
+
+	// 2 回目は Optimize を通し、段階ごとに呼んだ結果とまったく同じになるかを確かめる
+	GeneratedMesh second(gridVertices, vertexNum, shuffled.data(), indexNum);
+	begin = chrono::steady_clock::now();
+	MESH_OPTIMIZATION_STATISTICS statistics = Optimize(second, true);
+	double optimizeTime = elapsed(begin);
+	bool matched = memcmp(first.GetIndices(), second.GetIndices(), sizeof(uint32_t) * indexNum) == 0 &&
+		memcmp(first.GetVertices(), second.GetVertices(), sizeof(VERTEX) * vertexNum) == 0;
+
+	// 1 秒あたりの三角形の数 (百万)
+	auto rate = [gridTriangleNum](double milliseconds) { return gridTriangleNum / (milliseconds * 1000.0); };
+
+	cout << "triangles : " << gridTriangleNum << ", vertices : " << vertexNum << endl;
+	cout << "acmr : " << acmrBefore << " -> " << statistics.ACMRAfter << " (" << acmrCache << " after vertex cache)" << endl;
+	cout << "atvr : " << atvrBefore << " -> " << statistics.ATVRAfter << endl;
+	cout << "vertex cache : " << cacheTime << " ms (" << rate(cacheTime) << " M triangles/s)" << endl;
+	cout << "overdraw : " << overdrawTime << " ms" << endl;
+	cout << "vertex fetch : " << fetchTime << " ms" << endl;
+	cout << "total : " << totalTime << " ms (" << rate(totalTime) << " M triangles/s)" << endl;
+	cout << "Optimize : " << optimizeTime << " ms" << endl;
+	cout << "result : " << (matched ? "matched" : "MISMATCH") << endl;
+}
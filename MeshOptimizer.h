@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "RenderObject.h"
+
+using namespace std;
+
+// メッシュ最適化の統計情報
+// ACMR : 三角形 1 つあたりの頂点変換回数 (0.5 〜 3.0、小さいほど良い)
+// ATVR : 頂点 1 つあたりの頂点変換回数 (1.0 が最良)
+struct MESH_OPTIMIZATION_STATISTICS {
+	uint32_t TriangleNum;
+	uint32_t VertexNum;
+	float ACMRBefore;
+	float ACMRAfter;
+	float ATVRBefore;
+	float ATVRAfter;
+};
+
+// メッシュの最適化
+// 1. 頂点キャッシュ : 変換済み頂点を使い回せるように三角形を並べ替える (Forsyth の線形時間のアルゴリズム)
+// 2. オーバードロー : キャッシュの効率を閾値以上に落とさない範囲で、外を向いた面のかたまりを先に描く
+// 3. 頂点フェッチ   : 頂点を初めて参照される順に並べ替え、インデックスを付け直す
+// どれも乱数や並列処理を使わないので、同じ入力からは常に同じ結果になる
+class MeshOptimizer {
+public:
+	// ACMR と ATVR を見積もる FIFO キャッシュの大きさ
+	static const uint32_t m_CacheSize = 16;
+
+	// 頂点キャッシュに合わせて三角形を並べ替える
+	static void OptimizeVertexCache(uint32_t* indices, size_t indexNum, size_t vertexNum);
+
+	// オーバードローを減らすように三角形のかたまりを並べ替える (ACMR が threshold 倍を超えるなら元のまま)
+	static void OptimizeOverdraw(uint32_t* indices, size_t indexNum, const VERTEX* vertices, size_t vertexNum, float threshold);
+
+	// 頂点を参照順に並べ替える (使われる頂点の数を返し、使われない頂点は後ろに回す)
+	static size_t OptimizeVertexFetch(VERTEX* vertices, uint32_t* indices, size_t indexNum, size_t vertexNum);
+
+	// レンダリングオブジェクトにすべて施す
+	static MESH_OPTIMIZATION_STATISTICS Optimize(RenderObject& object, bool overdraw = false, float threshold = 1.05f);
+
+	// 三角形の順を保ったまま頂点フェッチだけを施す
+	// 深度テストなしで描くメッシュは、重なった三角形を描く順がそのまま描画結果になるので三角形を並べ替えられない
+	static MESH_OPTIMIZATION_STATISTICS OptimizeKeepingOrder(RenderObject& object);
+
+	// 指定した大きさの FIFO キャッシュで ACMR と ATVR を見積もる
+	static float CalculateACMR(const uint32_t* indices, size_t indexNum, size_t vertexNum, uint32_t cacheSize = m_CacheSize);
+	static float CalculateATVR(const uint32_t* indices, size_t indexNum, size_t vertexNum, uint32_t cacheSize = m_CacheSize);
+
+	// 約 triangleNum 個の三角形を乱数の順に並べた起伏のある格子を最適化し、ACMR と ATVR、時間、2 回の結果が一致するかを出力する
+	static void RunBenchmark(uint32_t triangleNum);
+};
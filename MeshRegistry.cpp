@@ -0,0 +1,370 @@
+﻿#include "MeshRegistry.h"
+
+#include <algorithm>
+#include <cstring>
+
+// 空の範囲
+static const MESH_DIRTY_RANGE EmptyRange = { UINT32_MAX, 0 };
+
+// コンストラクタ
+MeshRegistry::MeshRegistry(uint32_t vertexCapacity, uint32_t indexCapacity, const VERTEX_FORMAT& format):
+	m_VertexFormat(format),
+	m_VertexStride(m_VertexFormat.GetStride()),
+	m_VertexCapacity(vertexCapacity),
+	m_IndexCapacity(indexCapacity & ~3u),
+	m_VertexData(static_cast<size_t>(m_VertexCapacity) * m_VertexStride),
+	m_IndexData(m_IndexCapacity),
+	m_VertexEnd(0),
+	m_IndexEnd(0),
+	m_FreeVertexNum(0),
+	m_FreeIndexBytes(0),
+	m_Meshes(),
+	m_FreeIndices(),
+	m_RetiredIndexNum(0),
+	m_DirtyVertices(EmptyRange),
+	m_DirtyIndices(EmptyRange),
+	m_CompactionCount(0),
+	m_GrowCount(0),
+	m_UploadBytes(0) {}
+
+// インデックスの位置 (バイト数)
+uint32_t MeshRegistry::GetIndexOffset(const MESH_ENTRY& entry) {
+	return entry.StartIndex * VertexFormat::GetIndexSize(entry.IndexFormat);
+}
+
+// インデックスの大きさ (次のメッシュが 4 バイト境界から始まるように切り上げる)
+uint32_t MeshRegistry::GetIndexBytes(const MESH_ENTRY& entry) {
+	return (entry.IndexNum * VertexFormat::GetIndexSize(entry.IndexFormat) + 3) & ~3u;
+}
+
+// 更新範囲を広げる
+void MeshRegistry::MarkDirty(MESH_DIRTY_RANGE& range, uint32_t begin, uint32_t end) {
+	range.Begin = min(range.Begin, begin);
+	range.End = max(range.End, end);
+}
+
+// 容量を倍に広げる (足りなければ必要な分まで)
+// バッファビューの大きさは 32 ビットなので、それを超えるなら広げずに false を返す
+bool MeshRegistry::Grow(uint64_t vertexNum, uint64_t indexBytes) {
+
+	const uint64_t maxBytes = UINT32_MAX & ~3u;
+	if (vertexNum * m_VertexStride > maxBytes || indexBytes > maxBytes) { return false; }
+
+	uint64_t vertexCapacity = m_VertexCapacity;
+	if (vertexNum > vertexCapacity) {
+		vertexCapacity = max(vertexCapacity * 2, vertexNum);
+		if (vertexCapacity * m_VertexStride > maxBytes) { vertexCapacity = vertexNum; }
+	}
+
+	uint64_t indexCapacity = m_IndexCapacity;
+	if (indexBytes > indexCapacity) {
+		indexCapacity = min(max(indexCapacity * 2, indexBytes), maxBytes);
+	}
+
+	m_VertexCapacity = static_cast<uint32_t>(vertexCapacity);
+	m_IndexCapacity = static_cast<uint32_t>(indexCapacity);
+	m_VertexData.resize(static_cast<size_t>(m_VertexCapacity) * m_VertexStride);
+	m_IndexData.resize(m_IndexCapacity);
+
+	// GPU 側は新しいバッファに作り直されるので、使っている範囲をすべて送り直す
+	MarkDirty(m_DirtyVertices, 0, m_VertexEnd);
+	MarkDirty(m_DirtyIndices, 0, m_IndexEnd);
+	++m_GrowCount;
+	return true;
+}
+
+// 共有バッファに領域を割り当てる (空きがなければ詰めてから再試行し、それでも入らなければ広げる)
+MESH_HANDLE MeshRegistry::AddEntry(uint32_t vertexNum, uint32_t indexNum, INDEX_FORMAT indexFormat) {
+
+	// 添え字を使い切っていれば登録しない
+	if (m_FreeIndices.empty() && m_Meshes.size() >= MESH_HANDLE_INDEX_MASK) { return INVALID_MESH_HANDLE; }
+
+	MESH_ENTRY entry = {};
+	entry.VertexNum = vertexNum;
+	entry.IndexNum = indexNum;
+	entry.IndexFormat = indexFormat;
+	entry.Alive = true;
+
+	const uint32_t indexBytes = GetIndexBytes(entry);
+	auto fits = [&] {
+		return m_VertexEnd + static_cast<uint64_t>(vertexNum) <= m_VertexCapacity
+			&& m_IndexEnd + static_cast<uint64_t>(indexBytes) <= m_IndexCapacity;
+	};
+
+	if (!fits()) {
+		Compact();
+		if (!fits() && !Grow(m_VertexEnd + static_cast<uint64_t>(vertexNum), m_IndexEnd + static_cast<uint64_t>(indexBytes))) { return INVALID_MESH_HANDLE; }
+	}
+
+	entry.BaseVertex = m_VertexEnd;
+	entry.StartIndex = m_IndexEnd / VertexFormat::GetIndexSize(indexFormat);
+
+	m_VertexEnd += vertexNum;
+	m_IndexEnd += indexBytes;
+	MarkDirty(m_DirtyVertices, entry.BaseVertex, m_VertexEnd);
+	MarkDirty(m_DirtyIndices, GetIndexOffset(entry), m_IndexEnd);
+
+	// 空いている添え字は削除したときに進めた世代のまま使う
+	uint32_t index;
+	if (!m_FreeIndices.empty()) {
+		index = m_FreeIndices.back();
+		m_FreeIndices.pop_back();
+		entry.Generation = m_Meshes[index].Generation;
+		m_Meshes[index] = entry;
+	}
+	else {
+		index = static_cast<uint32_t>(m_Meshes.size());
+		m_Meshes.push_back(entry);
+	}
+	return (entry.Generation << MESH_HANDLE_INDEX_BITS) | index;
+}
+
+// ハンドルの指す生きているエントリを取得 (削除済みか世代が違えば nullptr)
+MESH_ENTRY* MeshRegistry::FindEntry(MESH_HANDLE handle) {
+	uint32_t index = GetHandleIndex(handle);
+	if (handle == INVALID_MESH_HANDLE || index >= m_Meshes.size()) { return nullptr; }
+	MESH_ENTRY& entry = m_Meshes[index];
+	if (!entry.Alive || entry.Generation != handle >> MESH_HANDLE_INDEX_BITS) { return nullptr; }
+	return &entry;
+}
+
+// インデックスをメッシュの形式で書き込む
+// メッシュの頂点数が 65536 以下なら、メッシュ内の番号は必ず 16 ビットに収まる
+void MeshRegistry::WriteIndices(const MESH_ENTRY& entry, const void* indices, INDEX_FORMAT format) {
+
+	uint8_t* dest = &m_IndexData[GetIndexOffset(entry)];
+	if (format == entry.IndexFormat) {
+		memcpy(dest, indices, static_cast<size_t>(entry.IndexNum) * VertexFormat::GetIndexSize(format));
+	}
+	else if (entry.IndexFormat == INDEX_FORMAT::R16_UINT) {
+		const uint32_t* src = static_cast<const uint32_t*>(indices);
+		uint16_t* dest16 = reinterpret_cast<uint16_t*>(dest);
+		for (uint32_t i = 0; i < entry.IndexNum; ++i) { dest16[i] = static_cast<uint16_t>(src[i]); }
+	}
+	else {
+		const uint16_t* src = static_cast<const uint16_t*>(indices);
+		uint32_t* dest32 = reinterpret_cast<uint32_t*>(dest);
+		for (uint32_t i = 0; i < entry.IndexNum; ++i) { dest32[i] = src[i]; }
+	}
+}
+
+// 頂点数を超えるインデックスがないか確かめる
+template <typename T>
+static bool ValidateIndices(const T* indices, uint32_t indexNum, uint32_t vertexNum) {
+	for (uint32_t i = 0; i < indexNum; ++i) {
+		if (indices[i] >= vertexNum) { return false; }
+	}
+	return true;
+}
+
+// メッシュを登録
+MESH_HANDLE MeshRegistry::Register(const VERTEX* vertices, uint32_t vertexNum, const uint32_t* indices, uint32_t indexNum) {
+
+	if (!ValidateIndices(indices, indexNum, vertexNum)) { return INVALID_MESH_HANDLE; }
+	if (!m_VertexFormat.CanEncode(vertices, vertexNum)) { return INVALID_MESH_HANDLE; }
+
+	MESH_HANDLE handle = AddEntry(vertexNum, indexNum, VertexFormat::SelectIndexFormat(vertexNum));
+	if (handle == INVALID_MESH_HANDLE) { return INVALID_MESH_HANDLE; }
+
+	const MESH_ENTRY& entry = *FindEntry(handle);
+	m_VertexFormat.Encode(vertices, vertexNum, &m_VertexData[static_cast<size_t>(entry.BaseVertex) * m_VertexStride]);
+	WriteIndices(entry, indices, INDEX_FORMAT::R32_UINT);
+	return handle;
+}
+
+// 詰めた形式のまま登録
+MESH_HANDLE MeshRegistry::Register(const VERTEX_FORMAT& vertexFormat, const void* vertices, uint32_t vertexNum, INDEX_FORMAT indexFormat, const void* indices, uint32_t indexNum) {
+
+	bool valid = indexFormat == INDEX_FORMAT::R16_UINT
+		? ValidateIndices(static_cast<const uint16_t*>(indices), indexNum, vertexNum)
+		: ValidateIndices(static_cast<const uint32_t*>(indices), indexNum, vertexNum);
+	if (!valid) { return INVALID_MESH_HANDLE; }
+
+	// 形式が違えば先に展開し、量子化の範囲に収まるか確かめてから場所を取る (同じ形式なら範囲も同じなので確かめない)
+	const bool sameFormat = VertexFormat::IsSameFormat(vertexFormat, m_VertexFormat.GetFormat());
+	vector<VERTEX> decoded;
+	if (!sameFormat) {
+		decoded.resize(vertexNum);
+		VertexFormat(vertexFormat).Decode(vertices, vertexNum, decoded.data());
+		if (!m_VertexFormat.CanEncode(decoded.data(), vertexNum)) { return INVALID_MESH_HANDLE; }
+	}
+
+	// 16 ビットで来たものは広げない
+	INDEX_FORMAT format = indexFormat == INDEX_FORMAT::R16_UINT ? INDEX_FORMAT::R16_UINT : VertexFormat::SelectIndexFormat(vertexNum);
+	MESH_HANDLE handle = AddEntry(vertexNum, indexNum, format);
+	if (handle == INVALID_MESH_HANDLE) { return INVALID_MESH_HANDLE; }
+
+	const MESH_ENTRY& entry = *FindEntry(handle);
+	uint8_t* dest = &m_VertexData[static_cast<size_t>(entry.BaseVertex) * m_VertexStride];
+
+	// 形式が同じなら詰め直さずにコピーする
+	if (sameFormat) {
+		memcpy(dest, vertices, static_cast<size_t>(vertexNum) * m_VertexStride);
+	}
+	else {
+		m_VertexFormat.Encode(decoded.data(), vertexNum, dest);
+	}
+
+	WriteIndices(entry, indices, indexFormat);
+	return handle;
+}
+
+// レンダリングオブジェクトを登録
+MESH_HANDLE MeshRegistry::Register(const RenderObject& object) {
+	return Register(object.GetVertices(), static_cast<uint32_t>(object.GetVertexNum()), object.GetIndices(), static_cast<uint32_t>(object.GetIndexNum()));
+}
+
+// 頂点を書き戻す
+bool MeshRegistry::Update(MESH_HANDLE handle, const VERTEX* vertices, uint32_t vertexNum) {
+
+	MESH_ENTRY* found = FindEntry(handle);
+	if (found == nullptr) { return false; }
+
+	MESH_ENTRY& entry = *found;
+	if (entry.VertexNum != vertexNum) { return false; }
+	if (!m_VertexFormat.CanEncode(vertices, vertexNum)) { return false; }
+
+	m_VertexFormat.Encode(vertices, vertexNum, &m_VertexData[static_cast<size_t>(entry.BaseVertex) * m_VertexStride]);
+	MarkDirty(m_DirtyVertices, entry.BaseVertex, entry.BaseVertex + vertexNum);
+	return true;
+}
+
+// レンダリングオブジェクトの頂点を書き戻す
+bool MeshRegistry::Update(MESH_HANDLE handle, const RenderObject& object) {
+	return Update(handle, object.GetVertices(), static_cast<uint32_t>(object.GetVertexNum()));
+}
+
+// メッシュを削除
+void MeshRegistry::Remove(MESH_HANDLE handle) {
+
+	MESH_ENTRY* found = FindEntry(handle);
+	if (found == nullptr) { return; }
+
+	MESH_ENTRY& entry = *found;
+	entry.Alive = false;
+
+	// 末尾のメッシュならそのまま縮め、それ以外は穴として数える
+	if (entry.BaseVertex + entry.VertexNum == m_VertexEnd) { m_VertexEnd = entry.BaseVertex; }
+	else { m_FreeVertexNum += entry.VertexNum; }
+
+	if (GetIndexOffset(entry) + GetIndexBytes(entry) == m_IndexEnd) { m_IndexEnd = GetIndexOffset(entry); }
+	else { m_FreeIndexBytes += GetIndexBytes(entry); }
+
+	// 世代を進めてから空きに戻す (一周したら古いハンドルと区別できないので使わない)
+	entry.Generation = (entry.Generation + 1) & MESH_HANDLE_GENERATION_MASK;
+	if (entry.Generation != 0) { m_FreeIndices.push_back(GetHandleIndex(handle)); }
+	else { ++m_RetiredIndexNum; }
+}
+
+// 削除で空いた穴を詰める
+void MeshRegistry::Compact() {
+
+	if (m_FreeVertexNum == 0 && m_FreeIndexBytes == 0) { return; }
+
+	// 先頭側から順に詰めるので、元の位置でソートしておく
+	vector<uint32_t> order;
+	for (uint32_t i = 0; i < m_Meshes.size(); ++i) {
+		if (m_Meshes[i].Alive) { order.push_back(i); }
+	}
+
+	sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return m_Meshes[a].BaseVertex < m_Meshes[b].BaseVertex; });
+	uint32_t vertexEnd = 0;
+	for (uint32_t index : order) {
+		MESH_ENTRY& entry = m_Meshes[index];
+		if (entry.BaseVertex != vertexEnd) {
+			memmove(&m_VertexData[static_cast<size_t>(vertexEnd) * m_VertexStride], &m_VertexData[static_cast<size_t>(entry.BaseVertex) * m_VertexStride], static_cast<size_t>(entry.VertexNum) * m_VertexStride);
+			entry.BaseVertex = vertexEnd;
+		}
+		vertexEnd += entry.VertexNum;
+	}
+
+	// インデックスはバイト位置で並べ、4 バイト境界のまま詰める
+	sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return GetIndexOffset(m_Meshes[a]) < GetIndexOffset(m_Meshes[b]); });
+	uint32_t indexEnd = 0;
+	for (uint32_t index : order) {
+		MESH_ENTRY& entry = m_Meshes[index];
+		if (GetIndexOffset(entry) != indexEnd) {
+			memmove(&m_IndexData[indexEnd], &m_IndexData[GetIndexOffset(entry)], GetIndexBytes(entry));
+			entry.StartIndex = indexEnd / VertexFormat::GetIndexSize(entry.IndexFormat);
+		}
+		indexEnd += GetIndexBytes(entry);
+	}
+
+	m_VertexEnd = vertexEnd;
+	m_IndexEnd = indexEnd;
+	m_FreeVertexNum = 0;
+	m_FreeIndexBytes = 0;
+	MarkDirty(m_DirtyVertices, 0, m_VertexEnd);
+	MarkDirty(m_DirtyIndices, 0, m_IndexEnd);
+	++m_CompactionCount;
+}
+
+// メッシュを取得
+const MESH_ENTRY* MeshRegistry::GetMesh(MESH_HANDLE handle) const {
+	return const_cast<MeshRegistry*>(this)->FindEntry(handle);
+}
+
+// ハンドルの添え字を取得
+uint32_t MeshRegistry::GetHandleIndex(MESH_HANDLE handle) { return handle & MESH_HANDLE_INDEX_MASK; }
+
+// 共有バッファの内容を取得
+const uint8_t* MeshRegistry::GetVertexData() const { return m_VertexData.data(); }
+const uint8_t* MeshRegistry::GetIndexData() const { return m_IndexData.data(); }
+
+// 共有バッファの容量を取得
+uint32_t MeshRegistry::GetVertexCapacity() const { return m_VertexCapacity; }
+uint32_t MeshRegistry::GetIndexCapacity() const { return m_IndexCapacity; }
+
+// 共有バッファの形式を取得
+const VertexFormat& MeshRegistry::GetVertexFormat() const { return m_VertexFormat; }
+uint32_t MeshRegistry::GetVertexStride() const { return m_VertexStride; }
+
+// GPU に反映されていない頂点の範囲を取得
+bool MeshRegistry::GetDirtyVertices(MESH_DIRTY_RANGE* range) const {
+	*range = m_DirtyVertices;
+	return m_DirtyVertices.Begin < m_DirtyVertices.End;
+}
+
+// GPU に反映されていないインデックスの範囲を取得
+bool MeshRegistry::GetDirtyIndices(MESH_DIRTY_RANGE* range) const {
+	*range = m_DirtyIndices;
+	return m_DirtyIndices.Begin < m_DirtyIndices.End;
+}
+
+// 更新範囲を消去
+void MeshRegistry::ClearDirty() {
+	if (m_DirtyVertices.Begin < m_DirtyVertices.End) { m_UploadBytes += static_cast<uint64_t>(m_DirtyVertices.End - m_DirtyVertices.Begin) * m_VertexStride; }
+	if (m_DirtyIndices.Begin < m_DirtyIndices.End) { m_UploadBytes += m_DirtyIndices.End - m_DirtyIndices.Begin; }
+	m_DirtyVertices = EmptyRange;
+	m_DirtyIndices = EmptyRange;
+}
+
+// 統計情報を取得
+MESH_REGISTRY_STATISTICS MeshRegistry::GetStatistics() const {
+
+	MESH_REGISTRY_STATISTICS statistics = {};
+	statistics.MeshCount = static_cast<uint32_t>(m_Meshes.size() - m_FreeIndices.size() - m_RetiredIndexNum);
+	statistics.VertexStride = m_VertexStride;
+	statistics.VertexBytesUsed = static_cast<uint64_t>(m_VertexEnd - m_FreeVertexNum) * m_VertexStride;
+	statistics.IndexBytesUsed = m_IndexEnd - m_FreeIndexBytes;
+	statistics.VertexBytesFree = static_cast<uint64_t>(m_FreeVertexNum) * m_VertexStride;
+	statistics.IndexBytesFree = m_FreeIndexBytes;
+	statistics.BytesResident = m_VertexData.size() + m_IndexData.size();
+	statistics.UploadBytes = m_UploadBytes;
+	statistics.CompactionCount = m_CompactionCount;
+	statistics.GrowCount = m_GrowCount;
+
+	// インデックスの形式と、VERTEX と 32 ビットのインデックスのままだった場合の大きさはメッシュごとに数える
+	for (const MESH_ENTRY& entry : m_Meshes) {
+		if (!entry.Alive) { continue; }
+		if (entry.IndexFormat == INDEX_FORMAT::R32_UINT) { ++statistics.WideIndexMeshCount; }
+		statistics.RawBytesUsed += static_cast<uint64_t>(entry.VertexNum) * sizeof(VERTEX) + static_cast<uint64_t>(entry.IndexNum) * sizeof(uint32_t);
+	}
+
+	// 割り当て済みの区間に占める穴の割合
+	uint64_t span = static_cast<uint64_t>(m_VertexEnd) * m_VertexStride + m_IndexEnd;
+	uint64_t holes = statistics.VertexBytesFree + statistics.IndexBytesFree;
+	statistics.Fragmentation = span > 0 ? static_cast<float>(static_cast<double>(holes) / static_cast<double>(span)) : 0.0f;
+
+	return statistics;
+}
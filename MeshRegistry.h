@@ -0,0 +1,153 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "RenderObject.h"
+#include "VertexFormat.h"
+
+using namespace std;
+
+// メッシュのハンドル
+// 下位 MESH_HANDLE_INDEX_BITS ビットがメッシュ一覧の添え字、上位が世代
+// 世代は削除するたびに進めるので、削除したメッシュのハンドルが同じ添え字に登録し直したメッシュを指すことはない
+typedef uint32_t MESH_HANDLE;
+static const MESH_HANDLE INVALID_MESH_HANDLE = UINT32_MAX;
+static const uint32_t MESH_HANDLE_INDEX_BITS = 20;
+static const uint32_t MESH_HANDLE_INDEX_MASK = (1u << MESH_HANDLE_INDEX_BITS) - 1;   // INVALID_MESH_HANDLE と重ならないように、この値の添え字は使わない
+static const uint32_t MESH_HANDLE_GENERATION_MASK = (1u << (32 - MESH_HANDLE_INDEX_BITS)) - 1;
+
+// 共有バッファ内のメッシュの位置
+struct MESH_ENTRY {
+	uint32_t BaseVertex;
+	uint32_t VertexNum;
+	uint32_t StartIndex;     // IndexFormat の要素数単位 (バイト位置は 4 の倍数)
+	uint32_t IndexNum;
+	INDEX_FORMAT IndexFormat; // 頂点数が 65536 以下なら R16_UINT
+	uint32_t Generation;      // この添え字の今の世代 (ハンドルの上位ビットと比べる)
+	bool Alive;
+};
+
+// 共有バッファの統計情報
+struct MESH_REGISTRY_STATISTICS {
+	uint32_t MeshCount;
+	uint32_t VertexStride;
+	uint32_t WideIndexMeshCount; // 32 ビットのインデックスで格納したメッシュの数
+	uint64_t VertexBytesUsed;
+	uint64_t IndexBytesUsed;
+	uint64_t VertexBytesFree;
+	uint64_t IndexBytesFree;
+	uint64_t BytesResident;
+	uint64_t RawBytesUsed;   // VERTEX と 32 ビットのインデックスのままだった場合の使用量
+	uint64_t UploadBytes;    // GPU へ送った累計
+	float Fragmentation;
+	uint32_t CompactionCount;
+	uint32_t GrowCount;
+};
+
+// 更新された範囲 (頂点は要素数、インデックスはバイト数単位)
+struct MESH_DIRTY_RANGE {
+	uint32_t Begin;
+	uint32_t End;
+};
+
+// メッシュレジストリ
+// 全メッシュの頂点とインデックスを 1 本ずつの共有バッファに詰め、ベース頂点と開始インデックスで参照する
+// インデックスはメッシュ内のローカル番号のまま格納するので、コンパクションで頂点を詰めても書き換えは要らない
+// 頂点は指定された形式に詰め、インデックスはメッシュごとに頂点数が 65536 以下なら 16 ビットで格納する
+// 16 ビットと 32 ビットのメッシュは同じバッファに 4 バイト境界で並べ、描画時に形式の違うビューで参照する
+// 詰めても入らなければ容量を倍にする (GPU 側はバッファを作り直すので、そのときは全体を送り直す)
+class MeshRegistry {
+
+private:
+	// 共有バッファの形式と容量 (インデックスはバイト数)
+	VertexFormat m_VertexFormat;
+	uint32_t m_VertexStride;
+	uint32_t m_VertexCapacity;
+	uint32_t m_IndexCapacity;
+
+	// 共有バッファの CPU 側の写し (GPU に置く形式のまま)
+	vector<uint8_t> m_VertexData;
+	vector<uint8_t> m_IndexData;
+
+	// 末尾の割り当て位置
+	uint32_t m_VertexEnd;
+	uint32_t m_IndexEnd;
+
+	// 削除されて穴になっている頂点数とインデックスのバイト数
+	uint32_t m_FreeVertexNum;
+	uint32_t m_FreeIndexBytes;
+
+	// メッシュ一覧 (ハンドルの下位ビットが添え字) と、削除されて空いている添え字
+	// 世代が一周した添え字は空きに戻さず、古いハンドルと取り違えないようにする
+	vector<MESH_ENTRY> m_Meshes;
+	vector<uint32_t> m_FreeIndices;
+	uint32_t m_RetiredIndexNum;
+
+	// GPU に反映されていない範囲
+	MESH_DIRTY_RANGE m_DirtyVertices;
+	MESH_DIRTY_RANGE m_DirtyIndices;
+
+	uint32_t m_CompactionCount;
+	uint32_t m_GrowCount;
+	uint64_t m_UploadBytes;
+
+	// インデックスの位置と、4 バイト境界まで詰め物をした大きさ (バイト数)
+	static uint32_t GetIndexOffset(const MESH_ENTRY& entry);
+	static uint32_t GetIndexBytes(const MESH_ENTRY& entry);
+
+	void MarkDirty(MESH_DIRTY_RANGE& range, uint32_t begin, uint32_t end);
+	bool Grow(uint64_t vertexNum, uint64_t indexBytes);
+	MESH_HANDLE AddEntry(uint32_t vertexNum, uint32_t indexNum, INDEX_FORMAT indexFormat);
+	MESH_ENTRY* FindEntry(MESH_HANDLE handle);
+	void WriteIndices(const MESH_ENTRY& entry, const void* indices, INDEX_FORMAT format);
+
+public:
+	// 容量は最初に確保する頂点数とインデックスのバイト数
+	MeshRegistry(uint32_t vertexCapacity, uint32_t indexCapacity, const VERTEX_FORMAT& format = VertexFormat::Full());
+	~MeshRegistry() = default;
+	MeshRegistry(const MeshRegistry&) = delete;
+	MeshRegistry& operator=(const MeshRegistry&) = delete;
+
+	// メッシュを登録 (空きがなければ詰めるか広げてから再試行し、バッファビューの大きさ (32 ビット) を超えるなら INVALID_MESH_HANDLE)
+	// 頂点数を超えるインデックスを含むメッシュと、量子化する形式で範囲を超える位置を含むメッシュも INVALID_MESH_HANDLE
+	MESH_HANDLE Register(const VERTEX* vertices, uint32_t vertexNum, const uint32_t* indices, uint32_t indexNum);
+	MESH_HANDLE Register(const RenderObject& object);
+
+	// 詰めた形式のまま登録 (形式が共有バッファと同じならそのままコピーし、違えば詰め直す)
+	// 16 ビットのインデックスはそのまま 16 ビットで格納する
+	MESH_HANDLE Register(const VERTEX_FORMAT& vertexFormat, const void* vertices, uint32_t vertexNum, INDEX_FORMAT indexFormat, const void* indices, uint32_t indexNum);
+
+	// 頂点を書き戻す (頂点数は登録時と同じであること、量子化の範囲を超える位置を含むなら書き戻さずに false)
+	bool Update(MESH_HANDLE handle, const VERTEX* vertices, uint32_t vertexNum);
+	bool Update(MESH_HANDLE handle, const RenderObject& object);
+
+	// メッシュを削除
+	void Remove(MESH_HANDLE handle);
+
+	// 削除で空いた穴を詰める
+	void Compact();
+
+	// 生きているメッシュを取得 (削除済みか世代が違うハンドルなら nullptr)
+	const MESH_ENTRY* GetMesh(MESH_HANDLE handle) const;
+
+	// ハンドルの添え字 (メッシュごとの表を引くときに使う)
+	static uint32_t GetHandleIndex(MESH_HANDLE handle);
+
+	const uint8_t* GetVertexData() const;
+	const uint8_t* GetIndexData() const;
+	uint32_t GetVertexCapacity() const;
+	uint32_t GetIndexCapacity() const;
+
+	const VertexFormat& GetVertexFormat() const;
+	uint32_t GetVertexStride() const;
+
+	// GPU に反映されていない範囲を取得 (なければ false)
+	bool GetDirtyVertices(MESH_DIRTY_RANGE* range) const;
+	bool GetDirtyIndices(MESH_DIRTY_RANGE* range) const;
+
+	// 反映し終えたら呼ぶ (送った量を数える)
+	void ClearDirty();
+
+	MESH_REGISTRY_STATISTICS GetStatistics() const;
+};
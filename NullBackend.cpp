@@ -0,0 +1,457 @@
+﻿#include "NullBackend.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cwchar>
+#include <stdexcept>
+#include <thread>
+
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "VertexFormat.h"
+
+// パイプラインキャッシュに格納する NULL_PIPELINE の版 (直列化の形を変えたら上げる)
+static const uint32_t NULL_PIPELINE_CACHE_VERSION = 1;
+
+// 統計情報の差分
+static NULL_BACKEND_STATISTICS Subtract(const NULL_BACKEND_STATISTICS& a, const NULL_BACKEND_STATISTICS& b) {
+	NULL_BACKEND_STATISTICS result = {};
+	result.ResourceCount = a.ResourceCount - b.ResourceCount;
+	result.ResourceBytes = a.ResourceBytes - b.ResourceBytes;
+	result.PipelineCount = a.PipelineCount - b.PipelineCount;
+	result.CommandListCount = a.CommandListCount - b.CommandListCount;
+	result.ExecuteCount = a.ExecuteCount - b.ExecuteCount;
+	result.PresentCount = a.PresentCount - b.PresentCount;
+	result.FenceWaitCount = a.FenceWaitCount - b.FenceWaitCount;
+	result.BarrierCount = a.BarrierCount - b.BarrierCount;
+	result.InvalidBarrierCount = a.InvalidBarrierCount - b.InvalidBarrierCount;
+	result.CopyCount = a.CopyCount - b.CopyCount;
+	result.CopyBytes = a.CopyBytes - b.CopyBytes;
+	result.StateCallCount = a.StateCallCount - b.StateCallCount;
+	result.DrawCount = a.DrawCount - b.DrawCount;
+	result.InstanceCount = a.InstanceCount - b.InstanceCount;
+	result.IndexCount = a.IndexCount - b.IndexCount;
+	return result;
+}
+
+// コマンドリストで数えたものを加える
+static void Accumulate(NULL_BACKEND_STATISTICS& total, const NULL_BACKEND_STATISTICS& list) {
+	total.BarrierCount += list.BarrierCount;
+	total.CopyCount += list.CopyCount;
+	total.CopyBytes += list.CopyBytes;
+	total.StateCallCount += list.StateCallCount;
+	total.DrawCount += list.DrawCount;
+	total.InstanceCount += list.InstanceCount;
+	total.IndexCount += list.IndexCount;
+}
+
+// コンストラクタ
+NullCommandList::NullCommandList(NullBackend* backend):
+	m_Backend(backend),
+	m_Recording(false),
+	m_Barriers(),
+	m_Copies(),
+	m_Statistics({ 0 }) {}
+
+// 記録を始める
+void NullCommandList::Reset(uint32_t frameIndex) {
+	if (m_Recording) { throw runtime_error("コマンドリストが閉じられていません。"); }
+	m_Recording = true;
+	m_Barriers.clear();
+	m_Copies.clear();
+	m_Statistics = { 0 };
+}
+
+// 記録を終える
+void NullCommandList::Close() { m_Recording = false; }
+
+// リソースバリア
+void NullCommandList::ResourceBarrier(uint32_t num, const RESOURCE_BARRIER* barriers) {
+	m_Barriers.insert(m_Barriers.end(), barriers, barriers + num);
+	m_Statistics.BarrierCount += num;
+}
+
+// バッファのコピー
+void NullCommandList::CopyBufferRegion(RESOURCE_HANDLE dest, uint64_t destOffset, RESOURCE_HANDLE src, uint64_t srcOffset, uint64_t size) {
+	m_Copies.push_back({ dest, destOffset, src, srcOffset, size });
+	++m_Statistics.CopyCount;
+	m_Statistics.CopyBytes += size;
+}
+
+// 状態の設定は数えるだけ
+void NullCommandList::OMSetRenderTarget(RESOURCE_HANDLE renderTarget) { ++m_Statistics.StateCallCount; }
+void NullCommandList::ClearRenderTargetView(RESOURCE_HANDLE renderTarget, const float color[4]) { ++m_Statistics.StateCallCount; }
+void NullCommandList::SetGraphicsRootSignature(ROOT_SIGNATURE_HANDLE rootSignature) { ++m_Statistics.StateCallCount; }
+void NullCommandList::SetDescriptorHeaps(uint32_t num, const DESCRIPTOR_HEAP_HANDLE* heaps) { ++m_Statistics.StateCallCount; }
+void NullCommandList::SetGraphicsRootConstantBufferView(uint32_t parameterIndex, GPU_ADDRESS address) { ++m_Statistics.StateCallCount; }
+void NullCommandList::SetPipelineState(PIPELINE_HANDLE pipelineState) { ++m_Statistics.StateCallCount; }
+void NullCommandList::IASetPrimitiveTopology(PRIMITIVE_TOPOLOGY topology) { ++m_Statistics.StateCallCount; }
+void NullCommandList::IASetVertexBuffers(uint32_t startSlot, uint32_t num, const VERTEX_BUFFER_VIEW* views) { ++m_Statistics.StateCallCount; }
+void NullCommandList::IASetIndexBuffer(const INDEX_BUFFER_VIEW* view) { ++m_Statistics.StateCallCount; }
+void NullCommandList::RSSetViewports(uint32_t num, const VIEWPORT* viewports) { ++m_Statistics.StateCallCount; }
+void NullCommandList::RSSetScissorRects(uint32_t num, const SCISSOR_RECT* rects) { ++m_Statistics.StateCallCount; }
+
+// 描画
+void NullCommandList::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) {
+	++m_Statistics.DrawCount;
+	m_Statistics.InstanceCount += instanceCount;
+	m_Statistics.IndexCount += static_cast<uint64_t>(indexCount) * instanceCount;
+}
+
+// コンストラクタ
+NullBackend::NullBackend():
+	m_FrameCount(0),
+	m_BackBufferIndex(0),
+	m_Resources(),
+	m_BackBuffers(),
+	m_NextAddress(0x10000),
+	m_RootSignatureCount(0),
+	m_DescriptorHeapCount(0),
+	m_Pipelines(),
+	m_PipelineCache(nullptr),
+	m_PipelineCacheName("NULL"),
+	m_RootSignatureKeys(),
+	m_CompletedValue(0),
+	m_GPUFrameTime(chrono::steady_clock::duration::zero()),
+	m_GPUBusyUntil(),
+	m_PendingFences(),
+	m_Statistics({ 0 }),
+	m_FrameStart({ 0 }),
+	m_LastFrame({ 0 }) {}
+
+// リソースを追加
+RESOURCE_HANDLE NullBackend::AddResource(HEAP_TYPE heapType, uint64_t size, RESOURCE_STATE initialState) {
+
+	NULL_RESOURCE resource;
+	resource.HeapType = heapType;
+	resource.State = initialState;
+	resource.Address = m_NextAddress;
+	resource.Memory.resize(static_cast<size_t>(size));
+
+	// 64KB 境界に並べる
+	m_NextAddress += (size + 0xFFFF) & ~static_cast<uint64_t>(0xFFFF);
+
+	++m_Statistics.ResourceCount;
+	m_Statistics.ResourceBytes += size;
+
+	m_Resources.push_back(move(resource));
+	return static_cast<RESOURCE_HANDLE>(m_Resources.size() - 1);
+}
+
+// 初期化
+void NullBackend::Initialize(const BACKEND_DESC& desc) {
+	m_FrameCount = desc.FrameCount;
+	m_BackBufferIndex = 0;
+	m_PipelineCache = desc.PipelineStateCache;
+
+	// バックバッファは RGBA8 の分だけ確保しておく
+	uint64_t backBufferSize = static_cast<uint64_t>(desc.Width) * desc.Height * 4;
+	for (uint32_t i = 0; i < m_FrameCount; ++i) {
+		m_BackBuffers.push_back(AddResource(HEAP_TYPE::DEFAULT, backBufferSize, RESOURCE_STATE::PRESENT));
+	}
+}
+
+// 終了処理
+void NullBackend::Terminate() {
+	m_Resources.clear();
+	m_BackBuffers.clear();
+}
+
+// ウィンドウがないのでメッセージは来ない
+bool NullBackend::ProcessMessage(bool* quit) {
+	*quit = false;
+	return false;
+}
+
+// バッファを作成
+RESOURCE_HANDLE NullBackend::CreateBuffer(HEAP_TYPE heapType, uint64_t size, RESOURCE_STATE initialState) {
+	return AddResource(heapType, size, initialState);
+}
+
+// バッファをマップ
+void* NullBackend::Map(RESOURCE_HANDLE resource) {
+	return m_Resources.at(resource).Memory.data();
+}
+
+// GPU 上のアドレスを取得
+GPU_ADDRESS NullBackend::GetGPUVirtualAddress(RESOURCE_HANDLE resource) {
+	return m_Resources.at(resource).Address;
+}
+
+// リソースを解放 (アドレスの並びを保つため、要素は残してメモリだけ手放す)
+void NullBackend::ReleaseResource(RESOURCE_HANDLE resource) {
+	vector<uint8_t>().swap(m_Resources.at(resource).Memory);
+}
+
+// ディスクリプタヒープを作成
+DESCRIPTOR_HEAP_HANDLE NullBackend::CreateDescriptorHeap(DESCRIPTOR_HEAP_TYPE type, uint32_t num, bool shaderVisible) {
+	return m_DescriptorHeapCount++;
+}
+
+// 定数バッファビューを作成
+void NullBackend::CreateConstantBufferView(DESCRIPTOR_HEAP_HANDLE heap, uint32_t index, GPU_ADDRESS address, uint32_t size) {}
+
+// ルートシグニチャを作成 (実体はないのでキャッシュのキーだけ覚える)
+ROOT_SIGNATURE_HANDLE NullBackend::CreateRootSignature(const ROOT_SIGNATURE_DESC& desc) {
+	m_RootSignatureKeys.push_back(PipelineCache::ComputeRootSignatureKey(desc, 0));
+	return m_RootSignatureCount++;
+}
+
+// 直列化した値を書き足す
+template <typename T>
+static void WriteValue(vector<uint8_t>* data, T value) {
+	size_t position = data->size();
+	data->resize(position + sizeof(T));
+	memcpy(data->data() + position, &value, sizeof(T));
+}
+
+// 直列化した値を読む (足りなければ false)
+template <typename T>
+static bool ReadValue(const uint8_t** data, const uint8_t* end, T* value) {
+	if (static_cast<size_t>(end - *data) < sizeof(T)) { return false; }
+	memcpy(value, *data, sizeof(T));
+	*data += sizeof(T);
+	return true;
+}
+
+// 文字列を長さと一緒に書き足す (wchar_t の大きさは環境で違うので 16 ビットに揃える)
+static void WriteString(vector<uint8_t>* data, const string& text) {
+	WriteValue(data, static_cast<uint32_t>(text.size()));
+	data->insert(data->end(), text.begin(), text.end());
+}
+static void WriteString(vector<uint8_t>* data, const wstring& text) {
+	WriteValue(data, static_cast<uint32_t>(text.size()));
+	for (wchar_t c : text) { WriteValue(data, static_cast<uint16_t>(c)); }
+}
+
+// 長さと一緒に書いた文字列を読む
+static bool ReadString(const uint8_t** data, const uint8_t* end, string* text) {
+	uint32_t length = 0;
+	if (!ReadValue(data, end, &length) || static_cast<size_t>(end - *data) < length) { return false; }
+	text->assign(reinterpret_cast<const char*>(*data), length);
+	*data += length;
+	return true;
+}
+static bool ReadString(const uint8_t** data, const uint8_t* end, wstring* text) {
+	uint32_t length = 0;
+	if (!ReadValue(data, end, &length) || static_cast<size_t>(end - *data) / sizeof(uint16_t) < length) { return false; }
+	text->resize(length);
+	for (uint32_t i = 0; i < length; ++i) {
+		uint16_t c = 0;
+		ReadValue(data, end, &c);
+		(*text)[i] = static_cast<wchar_t>(c);
+	}
+	return true;
+}
+
+// 入力レイアウトを解決する (要素はスロットごとに詰めて並んでいるものとして位置を求める)
+NULL_PIPELINE NullBackend::BuildPipeline(const PIPELINE_DESC& desc) {
+
+	NULL_PIPELINE pipeline;
+	pipeline.VertexShader = desc.VertexShader;
+	pipeline.PixelShader = desc.PixelShader;
+	pipeline.InputElements.resize(desc.InputElementNum);
+
+	vector<uint32_t> slotOffsets;
+	for (uint32_t i = 0; i < desc.InputElementNum; ++i) {
+		const INPUT_ELEMENT_DESC& source = desc.InputElements[i];
+		if (slotOffsets.size() <= source.InputSlot) { slotOffsets.resize(source.InputSlot + 1, 0); }
+
+		NULL_INPUT_ELEMENT& element = pipeline.InputElements[i];
+		element.SemanticName = source.SemanticName;
+		element.SemanticIndex = source.SemanticIndex;
+		element.Format = source.Format;
+		element.InputSlot = source.InputSlot;
+		element.Offset = slotOffsets[source.InputSlot];
+		element.InputSlotClass = source.InputSlotClass;
+		element.InstanceDataStepRate = source.InstanceDataStepRate;
+		slotOffsets[source.InputSlot] += VertexFormat::GetElementSize(source.Format);
+	}
+	return pipeline;
+}
+
+// パイプラインを直列化する
+void NullBackend::SerializePipeline(const NULL_PIPELINE& pipeline, vector<uint8_t>* data) {
+	data->clear();
+	WriteString(data, pipeline.VertexShader);
+	WriteString(data, pipeline.PixelShader);
+	WriteValue(data, static_cast<uint32_t>(pipeline.InputElements.size()));
+	for (const NULL_INPUT_ELEMENT& element : pipeline.InputElements) {
+		WriteString(data, element.SemanticName);
+		WriteValue(data, element.SemanticIndex);
+		WriteValue(data, static_cast<uint32_t>(element.Format));
+		WriteValue(data, element.InputSlot);
+		WriteValue(data, element.Offset);
+		WriteValue(data, static_cast<uint32_t>(element.InputSlotClass));
+		WriteValue(data, element.InstanceDataStepRate);
+	}
+}
+
+// 直列化したパイプラインを読む
+// キーが衝突していても別のパイプラインを使わないように、シェーダーと要素の並びが記述と同じかも確かめる
+bool NullBackend::DeserializePipeline(const void* data, size_t size, const PIPELINE_DESC& desc, NULL_PIPELINE* pipeline) {
+
+	const uint8_t* position = static_cast<const uint8_t*>(data);
+	const uint8_t* end = position + size;
+
+	uint32_t elementNum = 0;
+	bool valid = ReadString(&position, end, &pipeline->VertexShader) && ReadString(&position, end, &pipeline->PixelShader) && ReadValue(&position, end, &elementNum);
+	valid = valid && pipeline->VertexShader == desc.VertexShader && pipeline->PixelShader == desc.PixelShader && elementNum == desc.InputElementNum;
+	if (!valid) { return false; }
+
+	pipeline->InputElements.resize(elementNum);
+	for (uint32_t i = 0; i < elementNum; ++i) {
+		NULL_INPUT_ELEMENT& element = pipeline->InputElements[i];
+		uint32_t format = 0, inputSlotClass = 0;
+		valid = ReadString(&position, end, &element.SemanticName) && ReadValue(&position, end, &element.SemanticIndex) && ReadValue(&position, end, &format)
+			&& ReadValue(&position, end, &element.InputSlot) && ReadValue(&position, end, &element.Offset) && ReadValue(&position, end, &inputSlotClass) && ReadValue(&position, end, &element.InstanceDataStepRate);
+		valid = valid && format <= static_cast<uint32_t>(ELEMENT_FORMAT::R8G8B8A8_UNORM) && inputSlotClass <= static_cast<uint32_t>(INPUT_CLASSIFICATION::PER_INSTANCE_DATA);
+		valid = valid && element.SemanticName == desc.InputElements[i].SemanticName && element.InputSlot == desc.InputElements[i].InputSlot;
+		if (!valid) { return false; }
+		element.Format = static_cast<ELEMENT_FORMAT>(format);
+		element.InputSlotClass = static_cast<INPUT_CLASSIFICATION>(inputSlotClass);
+	}
+	return position == end;
+}
+
+// パイプラインステートを作成
+// キャッシュにあれば解決済みの入力レイアウトを読み、なければ解決して直列化したものを格納する (読めなければ捨てて作り直す)
+PIPELINE_HANDLE NullBackend::CreatePipelineState(const PIPELINE_DESC& desc) {
+	PROFILE_ZONE("NullBackend::CreatePipelineState");
+
+	// バイトコードは読まないのでシェーダーはファイル名で区別する
+	uint64_t key = 0;
+	bool loaded = false;
+	NULL_PIPELINE pipeline;
+	if (m_PipelineCache != nullptr) {
+		PipelineHash backendKey;
+		backendKey.AddString(m_PipelineCacheName);
+		backendKey.AddValue(NULL_PIPELINE_CACHE_VERSION);
+
+		key = PipelineCache::ComputePipelineKey(desc, m_RootSignatureKeys.at(desc.RootSignature),
+			desc.VertexShader, wcslen(desc.VertexShader) * sizeof(wchar_t), desc.PixelShader, wcslen(desc.PixelShader) * sizeof(wchar_t), backendKey.GetValue());
+
+		const void* data = nullptr;
+		size_t size = 0;
+		if (m_PipelineCache->Find(key, &data, &size)) {
+			loaded = DeserializePipeline(data, size, desc, &pipeline);
+			if (!loaded) { m_PipelineCache->Reject(key); }
+		}
+	}
+
+	if (!loaded) {
+		pipeline = BuildPipeline(desc);
+		if (m_PipelineCache != nullptr) {
+			vector<uint8_t> data;
+			SerializePipeline(pipeline, &data);
+			m_PipelineCache->Store(key, data.data(), data.size());
+		}
+	}
+
+	m_Pipelines.push_back(move(pipeline));
+	++m_Statistics.PipelineCount;
+	return static_cast<PIPELINE_HANDLE>(m_Pipelines.size() - 1);
+}
+
+// コマンドリストを作成
+unique_ptr<CommandList> NullBackend::CreateCommandList() {
+	++m_Statistics.CommandListCount;
+	return make_unique<NullCommandList>(this);
+}
+
+// コマンドリストを実行
+void NullBackend::ExecuteCommandLists(uint32_t num, CommandList* const* lists) {
+
+	for (uint32_t i = 0; i < num; ++i) {
+		NullCommandList* list = static_cast<NullCommandList*>(lists[i]);
+		if (list->m_Recording) { throw runtime_error("閉じられていないコマンドリストが実行されました。"); }
+
+		// 追跡している状態と合わないバリアを数える
+		for (const RESOURCE_BARRIER& barrier : list->m_Barriers) {
+			NULL_RESOURCE& resource = m_Resources.at(barrier.Resource);
+			if (resource.State != barrier.StateBefore) { ++m_Statistics.InvalidBarrierCount; }
+			resource.State = barrier.StateAfter;
+		}
+
+		for (const NullCommandList::COPY_COMMAND& copy : list->m_Copies) {
+			NULL_RESOURCE& dest = m_Resources.at(copy.Dest);
+			NULL_RESOURCE& src = m_Resources.at(copy.Src);
+			if (copy.DestOffset + copy.Size > dest.Memory.size() || copy.SrcOffset + copy.Size > src.Memory.size()) {
+				throw runtime_error("バッファの範囲外へのコピーです。");
+			}
+			memcpy(dest.Memory.data() + copy.DestOffset, src.Memory.data() + copy.SrcOffset, static_cast<size_t>(copy.Size));
+		}
+
+		Accumulate(m_Statistics, list->m_Statistics);
+	}
+	++m_Statistics.ExecuteCount;
+}
+
+// バックバッファを取得
+RESOURCE_HANDLE NullBackend::GetBackBuffer(uint32_t index) { return m_BackBuffers.at(index); }
+
+// 現在のバックバッファの番号を取得
+uint32_t NullBackend::GetCurrentBackBufferIndex() { return m_BackBufferIndex; }
+
+// 表示 (フレームの区切りとして統計を締める)
+void NullBackend::Present() {
+	++m_Statistics.PresentCount;
+	m_BackBufferIndex = (m_BackBufferIndex + 1) % m_FrameCount;
+
+	m_LastFrame = Subtract(m_Statistics, m_FrameStart);
+	m_FrameStart = m_Statistics;
+}
+
+// 時刻を過ぎたフェンスを完了させる
+void NullBackend::UpdateCompletedValue() {
+	auto now = chrono::steady_clock::now();
+	while (!m_PendingFences.empty() && m_PendingFences.front().CompletionTime <= now) {
+		m_CompletedValue = max(m_CompletedValue, m_PendingFences.front().Value);
+		m_PendingFences.pop_front();
+	}
+}
+
+// フェンスに値を書き込む
+// GPU の処理時間が 0 なら即座に追いつき、そうでなければ前の仕事の後ろに並べる
+void NullBackend::Signal(uint64_t value) {
+	if (m_GPUFrameTime == chrono::steady_clock::duration::zero() && m_PendingFences.empty()) {
+		if (value > m_CompletedValue) { m_CompletedValue = value; }
+		return;
+	}
+	m_GPUBusyUntil = max(m_GPUBusyUntil, chrono::steady_clock::now()) + m_GPUFrameTime;
+	m_PendingFences.push_back({ value, m_GPUBusyUntil });
+}
+
+// 完了したフェンス値を取得
+uint64_t NullBackend::GetCompletedValue() {
+	UpdateCompletedValue();
+	return m_CompletedValue;
+}
+
+// フェンス値を待つ (まだ終わっていないときだけ、GPU が終える時刻まで眠る)
+void NullBackend::WaitForValue(uint64_t value) {
+	PROFILE_ZONE("NullBackend::WaitForValue");
+	UpdateCompletedValue();
+	if (value <= m_CompletedValue) { return; }
+	++m_Statistics.FenceWaitCount;
+
+	for (const PENDING_FENCE& fence : m_PendingFences) {
+		if (fence.Value >= value) {
+			this_thread::sleep_until(fence.CompletionTime);
+			break;
+		}
+	}
+	UpdateCompletedValue();
+	if (value > m_CompletedValue) { m_CompletedValue = value; }
+}
+
+// GPU の処理時間を設定
+void NullBackend::SetGPUFrameTime(double milliseconds) {
+	m_GPUFrameTime = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, milli>(max(milliseconds, 0.0)));
+}
+
+// 累計の統計情報を取得
+NULL_BACKEND_STATISTICS NullBackend::GetStatistics() const { return m_Statistics; }
+
+// 直前のフレームの統計情報を取得
+NULL_BACKEND_STATISTICS NullBackend::GetFrameStatistics() const { return m_LastFrame; }
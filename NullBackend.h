@@ -0,0 +1,200 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "RenderBackend.h"
+
+using namespace std;
+
+// 記録用バックエンドの統計情報
+struct NULL_BACKEND_STATISTICS {
+	uint64_t ResourceCount;
+	uint64_t ResourceBytes;
+	uint64_t PipelineCount;
+	uint64_t CommandListCount;
+	uint64_t ExecuteCount;
+	uint64_t PresentCount;
+	uint64_t FenceWaitCount;
+	uint64_t BarrierCount;
+	uint64_t InvalidBarrierCount;
+	uint64_t CopyCount;
+	uint64_t CopyBytes;
+	uint64_t StateCallCount;
+	uint64_t DrawCount;
+	uint64_t InstanceCount;
+	uint64_t IndexCount;
+};
+
+// 記録用バックエンドのリソース
+struct NULL_RESOURCE {
+	HEAP_TYPE HeapType;
+	RESOURCE_STATE State;
+	GPU_ADDRESS Address;
+	vector<uint8_t> Memory;
+};
+
+// 記録用バックエンドのパイプラインの入力要素 (スロット内の位置を解決したもの)
+struct NULL_INPUT_ELEMENT {
+	string SemanticName;
+	uint32_t SemanticIndex;
+	ELEMENT_FORMAT Format;
+	uint32_t InputSlot;
+	uint32_t Offset; // スロットの先頭からのバイト数 (D3D12_APPEND_ALIGNED_ELEMENT と同じく詰めて並べる)
+	INPUT_CLASSIFICATION InputSlotClass;
+	uint32_t InstanceDataStepRate;
+};
+
+// 記録用バックエンドのパイプライン
+// 記述から入力レイアウトを解決したもので、パイプラインキャッシュにはこれを直列化して格納する
+struct NULL_PIPELINE {
+	wstring VertexShader;
+	wstring PixelShader;
+	vector<NULL_INPUT_ELEMENT> InputElements;
+};
+
+class NullBackend;
+
+// 記録用コマンドリスト
+// コマンドは数えるだけで、コピーとバリアだけを実行時に反映するために残しておく
+class NullCommandList : public CommandList {
+
+	friend class NullBackend;
+
+private:
+	// 実行時に反映するコピー
+	struct COPY_COMMAND {
+		RESOURCE_HANDLE Dest;
+		uint64_t DestOffset;
+		RESOURCE_HANDLE Src;
+		uint64_t SrcOffset;
+		uint64_t Size;
+	};
+
+	NullBackend* m_Backend;
+	bool m_Recording;
+	vector<RESOURCE_BARRIER> m_Barriers;
+	vector<COPY_COMMAND> m_Copies;
+	NULL_BACKEND_STATISTICS m_Statistics;
+
+public:
+	NullCommandList(NullBackend* backend);
+
+	void Reset(uint32_t frameIndex) override;
+	void Close() override;
+
+	void ResourceBarrier(uint32_t num, const RESOURCE_BARRIER* barriers) override;
+	void CopyBufferRegion(RESOURCE_HANDLE dest, uint64_t destOffset, RESOURCE_HANDLE src, uint64_t srcOffset, uint64_t size) override;
+
+	void OMSetRenderTarget(RESOURCE_HANDLE renderTarget) override;
+	void ClearRenderTargetView(RESOURCE_HANDLE renderTarget, const float color[4]) override;
+
+	void SetGraphicsRootSignature(ROOT_SIGNATURE_HANDLE rootSignature) override;
+	void SetDescriptorHeaps(uint32_t num, const DESCRIPTOR_HEAP_HANDLE* heaps) override;
+	void SetGraphicsRootConstantBufferView(uint32_t parameterIndex, GPU_ADDRESS address) override;
+	void SetPipelineState(PIPELINE_HANDLE pipelineState) override;
+
+	void IASetPrimitiveTopology(PRIMITIVE_TOPOLOGY topology) override;
+	void IASetVertexBuffers(uint32_t startSlot, uint32_t num, const VERTEX_BUFFER_VIEW* views) override;
+	void IASetIndexBuffer(const INDEX_BUFFER_VIEW* view) override;
+	void RSSetViewports(uint32_t num, const VIEWPORT* viewports) override;
+	void RSSetScissorRects(uint32_t num, const SCISSOR_RECT* rects) override;
+
+	void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) override;
+};
+
+// 記録用バックエンド (ヘッドレス)
+// ウィンドウも GPU も持たず、受け取った呼び出しを数えるだけなので Linux でもフレーム処理を動かせる
+// バッファは CPU メモリで確保し、GPU はコマンドリストを即座に実行し終えたものとして扱う
+// SetGPUFrameTime で GPU の処理時間を与えると、フェンスは時間を追って順に完了する (フレームの進み方の確認用)
+class NullBackend : public RenderBackend {
+
+	friend class NullCommandList;
+
+protected:
+	uint32_t m_FrameCount;
+	uint32_t m_BackBufferIndex;
+
+	// リソース
+	vector<NULL_RESOURCE> m_Resources;
+	vector<RESOURCE_HANDLE> m_BackBuffers;
+	GPU_ADDRESS m_NextAddress;
+	uint32_t m_RootSignatureCount;
+	uint32_t m_DescriptorHeapCount;
+
+	// パイプライン (ハンドルが添え字)
+	vector<NULL_PIPELINE> m_Pipelines;
+
+	// パイプラインキャッシュ (ルートシグニチャごとのキーを覚えておき、パイプラインのキーに混ぜる)
+	// キーにはバックエンドの名前を混ぜるので、派生したバックエンドとはエントリを共有しない
+	PipelineCache* m_PipelineCache;
+	const char* m_PipelineCacheName;
+	vector<uint64_t> m_RootSignatureKeys;
+
+	// フェンス
+	uint64_t m_CompletedValue;
+
+	// 仮想的な GPU の時間軸 (Signal した値と、それを GPU が終える時刻)
+	struct PENDING_FENCE {
+		uint64_t Value;
+		chrono::steady_clock::time_point CompletionTime;
+	};
+	chrono::steady_clock::duration m_GPUFrameTime;
+	chrono::steady_clock::time_point m_GPUBusyUntil;
+	deque<PENDING_FENCE> m_PendingFences;
+
+	void UpdateCompletedValue();
+
+	// 統計 (累計と直前のフレーム)
+	NULL_BACKEND_STATISTICS m_Statistics;
+	NULL_BACKEND_STATISTICS m_FrameStart;
+	NULL_BACKEND_STATISTICS m_LastFrame;
+
+	RESOURCE_HANDLE AddResource(HEAP_TYPE heapType, uint64_t size, RESOURCE_STATE initialState);
+
+	// パイプラインの入力レイアウトを解決する、直列化する、直列化したものを読む (壊れているか記述と合わなければ false)
+	static NULL_PIPELINE BuildPipeline(const PIPELINE_DESC& desc);
+	static void SerializePipeline(const NULL_PIPELINE& pipeline, vector<uint8_t>* data);
+	static bool DeserializePipeline(const void* data, size_t size, const PIPELINE_DESC& desc, NULL_PIPELINE* pipeline);
+
+public:
+	NullBackend();
+	~NullBackend() = default;
+
+	void Initialize(const BACKEND_DESC& desc) override;
+	void Terminate() override;
+	bool ProcessMessage(bool* quit) override;
+
+	RESOURCE_HANDLE CreateBuffer(HEAP_TYPE heapType, uint64_t size, RESOURCE_STATE initialState) override;
+	void* Map(RESOURCE_HANDLE resource) override;
+	GPU_ADDRESS GetGPUVirtualAddress(RESOURCE_HANDLE resource) override;
+	void ReleaseResource(RESOURCE_HANDLE resource) override;
+
+	DESCRIPTOR_HEAP_HANDLE CreateDescriptorHeap(DESCRIPTOR_HEAP_TYPE type, uint32_t num, bool shaderVisible) override;
+	void CreateConstantBufferView(DESCRIPTOR_HEAP_HANDLE heap, uint32_t index, GPU_ADDRESS address, uint32_t size) override;
+
+	ROOT_SIGNATURE_HANDLE CreateRootSignature(const ROOT_SIGNATURE_DESC& desc) override;
+	PIPELINE_HANDLE CreatePipelineState(const PIPELINE_DESC& desc) override;
+
+	unique_ptr<CommandList> CreateCommandList() override;
+	void ExecuteCommandLists(uint32_t num, CommandList* const* lists) override;
+
+	RESOURCE_HANDLE GetBackBuffer(uint32_t index) override;
+	uint32_t GetCurrentBackBufferIndex() override;
+	void Present() override;
+
+	void Signal(uint64_t value) override;
+	uint64_t GetCompletedValue() override;
+	void WaitForValue(uint64_t value) override;
+
+	// GPU が 1 回の Signal までにかかる時間を設定 (ミリ秒、0 なら即座に完了)
+	void SetGPUFrameTime(double milliseconds);
+
+	// 統計情報を取得
+	NULL_BACKEND_STATISTICS GetStatistics() const;
+	NULL_BACKEND_STATISTICS GetFrameStatistics() const;
+};
@@ -0,0 +1,305 @@
+﻿#include "PipelineCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+static_assert(sizeof(PIPELINE_CACHE_HEADER) == 48, "PIPELINE_CACHE_HEADER の大きさが変わっています。");
+static_assert(sizeof(PIPELINE_CACHE_ENTRY) == 32, "PIPELINE_CACHE_ENTRY の大きさが変わっています。");
+
+// 境界に切り上げる
+static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// 経過時間 (ミリ秒)
+static double ElapsedMilliseconds(chrono::steady_clock::time_point start) {
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// コンストラクタ
+PipelineHash::PipelineHash():
+	m_Value(m_OffsetBasis) {}
+
+// バイト列を混ぜる
+void PipelineHash::AddBytes(const void* data, size_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t value = m_Value;
+	for (size_t i = 0; i < size; ++i) {
+		value ^= bytes[i];
+		value *= m_Prime;
+	}
+	m_Value = value;
+}
+
+// 文字列を混ぜる (区切りが分かるように長さも混ぜる)
+void PipelineHash::AddString(const char* text) {
+	uint64_t length = text != nullptr ? strlen(text) : 0;
+	AddValue(length);
+	AddBytes(text, static_cast<size_t>(length));
+}
+
+// ワイド文字列を混ぜる (wchar_t の大きさは環境で違うので 16 ビットに揃える)
+void PipelineHash::AddString(const wchar_t* text) {
+	uint64_t length = 0;
+	while (text != nullptr && text[length] != L'\0') { ++length; }
+	AddValue(length);
+	for (uint64_t i = 0; i < length; ++i) { AddValue(static_cast<uint16_t>(text[i])); }
+}
+
+// ハッシュ値を取得
+uint64_t PipelineHash::GetValue() const {
+	return m_Value;
+}
+
+// バイト列のハッシュ値を求める
+uint64_t PipelineHash::Compute(const void* data, size_t size) {
+	PipelineHash hash;
+	hash.AddBytes(data, size);
+	return hash.GetValue();
+}
+
+// コンストラクタ
+PipelineCache::PipelineCache():
+	m_Path(),
+	m_File(),
+	m_Entries(),
+	m_StoredData(),
+	m_Dirty(false),
+	m_Statistics({ 0 }) {}
+
+// ファイルを開く
+void PipelineCache::Open(const char* path) {
+
+	auto start = chrono::steady_clock::now();
+
+	m_Path = path;
+	m_Entries.clear();
+	m_StoredData.clear();
+	m_Dirty = false;
+	m_Statistics = { 0 };
+
+	// 壊れていれば空から始め、次の Save で作り直す
+	if (!Load()) {
+		m_File.Close();
+		m_Entries.clear();
+		m_Dirty = true;
+	}
+
+	m_Statistics.OpenTime = ElapsedMilliseconds(start);
+}
+
+// ファイルをマップして表を読む (ファイルがなければ空のまま true、壊れていれば false)
+bool PipelineCache::Load() {
+
+	if (!filesystem::exists(m_Path)) { return true; }
+	if (!m_File.Open(m_Path.c_str()) || m_File.GetSize() < sizeof(PIPELINE_CACHE_HEADER)) {
+		++m_Statistics.RejectedNum;
+		return false;
+	}
+
+	const uint8_t* data = m_File.GetData();
+	const uint64_t fileSize = m_File.GetSize();
+	const PIPELINE_CACHE_HEADER* header = reinterpret_cast<const PIPELINE_CACHE_HEADER*>(data);
+
+	// ヘッダ
+	bool valid = header->Magic == PIPELINE_CACHE_MAGIC && header->Version == PIPELINE_CACHE_VERSION && header->HeaderSize == sizeof(PIPELINE_CACHE_HEADER);
+	valid = valid && header->HeaderChecksum == PipelineHash::Compute(header, offsetof(PIPELINE_CACHE_HEADER, HeaderChecksum));
+	valid = valid && header->FileSize == fileSize && header->TableOffset >= sizeof(PIPELINE_CACHE_HEADER) && header->TableOffset <= fileSize;
+	valid = valid && header->EntryNum <= (fileSize - header->TableOffset) / sizeof(PIPELINE_CACHE_ENTRY);
+	if (!valid) {
+		++m_Statistics.RejectedNum;
+		return false;
+	}
+
+	// エントリの表
+	const PIPELINE_CACHE_ENTRY* table = reinterpret_cast<const PIPELINE_CACHE_ENTRY*>(data + header->TableOffset);
+	if (header->TableChecksum != PipelineHash::Compute(table, header->EntryNum * sizeof(PIPELINE_CACHE_ENTRY))) {
+		++m_Statistics.RejectedNum;
+		return false;
+	}
+
+	// データの中身はまだ読まない (引いたときに確かめるので、使わないページには触れない)
+	const uint64_t dataBegin = header->TableOffset + header->EntryNum * sizeof(PIPELINE_CACHE_ENTRY);
+	for (uint32_t i = 0; i < header->EntryNum; ++i) {
+		const PIPELINE_CACHE_ENTRY& entry = table[i];
+		if (entry.Offset < dataBegin || entry.Offset > fileSize || entry.Size > fileSize - entry.Offset) {
+			++m_Statistics.RejectedNum;
+			continue;
+		}
+		m_Entries[entry.Key] = { data + entry.Offset, entry.Size, entry.Checksum, false };
+		++m_Statistics.LoadedNum;
+	}
+
+	m_Statistics.FileBytes = fileSize;
+	return true;
+}
+
+// ファイルに書き出す
+bool PipelineCache::Save() {
+
+	if (!m_Dirty || m_Path.empty()) { return true; }
+
+	auto start = chrono::steady_clock::now();
+
+	// キーの順に並べて、同じ中身なら同じファイルになるようにする
+	vector<uint64_t> keys;
+	keys.reserve(m_Entries.size());
+	for (const auto& entry : m_Entries) { keys.push_back(entry.first); }
+	sort(keys.begin(), keys.end());
+
+	PIPELINE_CACHE_HEADER header = {};
+	header.Magic = PIPELINE_CACHE_MAGIC;
+	header.Version = PIPELINE_CACHE_VERSION;
+	header.HeaderSize = sizeof(PIPELINE_CACHE_HEADER);
+	header.EntryNum = static_cast<uint32_t>(keys.size());
+	header.TableOffset = sizeof(PIPELINE_CACHE_HEADER);
+
+	vector<PIPELINE_CACHE_ENTRY> table(keys.size());
+	uint64_t offset = header.TableOffset + table.size() * sizeof(PIPELINE_CACHE_ENTRY);
+	for (size_t i = 0; i < keys.size(); ++i) {
+		const CACHE_ENTRY& entry = m_Entries[keys[i]];
+		offset = AlignUp(offset, PIPELINE_CACHE_ALIGNMENT);
+		table[i] = { keys[i], offset, entry.Size, entry.Checksum };
+		offset += entry.Size;
+	}
+	header.FileSize = offset;
+	header.TableChecksum = PipelineHash::Compute(table.data(), table.size() * sizeof(PIPELINE_CACHE_ENTRY));
+	header.HeaderChecksum = PipelineHash::Compute(&header, offsetof(PIPELINE_CACHE_HEADER, HeaderChecksum));
+
+	// 一時ファイルに書いてから置き換える (途中で落ちても元のファイルは壊れない)
+	string temporaryPath = m_Path + ".tmp";
+	{
+		ofstream file(temporaryPath, ios::binary);
+		if (!file) { return false; }
+
+		const char padding[PIPELINE_CACHE_ALIGNMENT] = {};
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(table.data()), static_cast<streamsize>(table.size() * sizeof(PIPELINE_CACHE_ENTRY)));
+
+		uint64_t position = header.TableOffset + table.size() * sizeof(PIPELINE_CACHE_ENTRY);
+		for (size_t i = 0; i < keys.size(); ++i) {
+			file.write(padding, static_cast<streamsize>(table[i].Offset - position));
+			file.write(reinterpret_cast<const char*>(m_Entries[keys[i]].Data), static_cast<streamsize>(table[i].Size));
+			position = table[i].Offset + table[i].Size;
+		}
+		if (!file) { return false; }
+	}
+
+	// マップしたままでは置き換えられないので、一度閉じてから開き直す
+	m_File.Close();
+	m_Entries.clear();
+	m_StoredData.clear();
+
+	// 置き換えられなければ一時ファイルを消して失敗を返す (古いファイルは開き直さず、キャッシュは空のままにする)
+	error_code error;
+	filesystem::rename(temporaryPath, m_Path, error);
+	if (error) {
+		filesystem::remove(temporaryPath, error);
+		m_Statistics.SaveTime = ElapsedMilliseconds(start);
+		return false;
+	}
+
+	PIPELINE_CACHE_STATISTICS statistics = m_Statistics;
+	Open(m_Path.c_str());
+	statistics.LoadedNum = m_Statistics.LoadedNum;
+	statistics.FileBytes = m_Statistics.FileBytes;
+	statistics.SaveTime = ElapsedMilliseconds(start);
+	m_Statistics = statistics;
+	return true;
+}
+
+// 引く
+bool PipelineCache::Find(uint64_t key, const void** data, size_t* size) {
+
+	auto it = m_Entries.find(key);
+	if (it == m_Entries.end()) {
+		++m_Statistics.MissCount;
+		return false;
+	}
+
+	// 初めて引いたときに中身を確かめる
+	CACHE_ENTRY& entry = it->second;
+	if (!entry.Verified) {
+		if (PipelineHash::Compute(entry.Data, static_cast<size_t>(entry.Size)) != entry.Checksum) {
+			m_Entries.erase(it);
+			m_Dirty = true;
+			++m_Statistics.RejectedNum;
+			++m_Statistics.MissCount;
+			return false;
+		}
+		entry.Verified = true;
+	}
+
+	*data = entry.Data;
+	*size = static_cast<size_t>(entry.Size);
+	++m_Statistics.HitCount;
+	return true;
+}
+
+// 追加する
+void PipelineCache::Store(uint64_t key, const void* data, size_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	m_StoredData.emplace_back(bytes, bytes + size);
+	m_Entries[key] = { m_StoredData.back().data(), size, PipelineHash::Compute(data, size), true };
+	m_Dirty = true;
+	++m_Statistics.StoreCount;
+}
+
+// 受け付けられなかったエントリを捨てる
+void PipelineCache::Reject(uint64_t key) {
+	if (m_Entries.erase(key) == 0) { return; }
+	m_Dirty = true;
+	++m_Statistics.RejectedNum;
+	if (m_Statistics.HitCount > 0) { --m_Statistics.HitCount; }
+	++m_Statistics.MissCount;
+}
+
+// 統計情報を取得
+PIPELINE_CACHE_STATISTICS PipelineCache::GetStatistics() const {
+	PIPELINE_CACHE_STATISTICS statistics = m_Statistics;
+	statistics.EntryNum = static_cast<uint32_t>(m_Entries.size());
+	return statistics;
+}
+
+// ルートシグニチャのキー
+uint64_t PipelineCache::ComputeRootSignatureKey(const ROOT_SIGNATURE_DESC& desc, uint64_t backendKey) {
+	PipelineHash hash;
+	hash.AddString("ROOT_SIGNATURE");
+	hash.AddValue(backendKey);
+	hash.AddValue(desc.ParameterNum);
+	for (uint32_t i = 0; i < desc.ParameterNum; ++i) {
+		hash.AddValue(desc.Parameters[i].ShaderRegister);
+		hash.AddValue(static_cast<uint8_t>(desc.Parameters[i].VertexOnly));
+	}
+	return hash.GetValue();
+}
+
+// パイプラインステートのキー
+uint64_t PipelineCache::ComputePipelineKey(const PIPELINE_DESC& desc, uint64_t rootSignatureKey, const void* vertexShader, size_t vertexShaderSize, const void* pixelShader, size_t pixelShaderSize, uint64_t backendKey) {
+	PipelineHash hash;
+	hash.AddString("PIPELINE");
+	hash.AddValue(backendKey);
+	hash.AddValue(rootSignatureKey);
+
+	// シェーダーは長さと中身
+	hash.AddValue(static_cast<uint64_t>(vertexShaderSize));
+	hash.AddBytes(vertexShader, vertexShaderSize);
+	hash.AddValue(static_cast<uint64_t>(pixelShaderSize));
+	hash.AddBytes(pixelShader, pixelShaderSize);
+
+	// 入力レイアウト (セマンティクス名はポインタではなく文字列で混ぜる)
+	hash.AddValue(desc.InputElementNum);
+	for (uint32_t i = 0; i < desc.InputElementNum; ++i) {
+		const INPUT_ELEMENT_DESC& element = desc.InputElements[i];
+		hash.AddString(element.SemanticName);
+		hash.AddValue(element.SemanticIndex);
+		hash.AddValue(static_cast<uint32_t>(element.Format));
+		hash.AddValue(element.InputSlot);
+		hash.AddValue(static_cast<uint32_t>(element.InputSlotClass));
+		hash.AddValue(element.InstanceDataStepRate);
+	}
+	return hash.GetValue();
+}
@@ -0,0 +1,139 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.h"
+#include "RenderBackend.h"
+
+using namespace std;
+
+// パイプラインキャッシュファイルの識別子と版
+static const uint32_t PIPELINE_CACHE_MAGIC = 0x43535050; // "PPSC"
+static const uint32_t PIPELINE_CACHE_VERSION = 1;
+
+// データの配置の境界
+static const uint64_t PIPELINE_CACHE_ALIGNMENT = 16;
+
+// パイプラインキャッシュファイルのヘッダ (リトルエンディアン)
+// ヘッダの後ろにエントリの表、その後ろに各エントリのデータを PIPELINE_CACHE_ALIGNMENT 境界で並べる
+struct PIPELINE_CACHE_HEADER {
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t HeaderSize;
+	uint32_t EntryNum;
+	uint64_t TableOffset;
+	uint64_t FileSize;
+	uint64_t TableChecksum;  // エントリの表のハッシュ
+	uint64_t HeaderChecksum; // ここより前のハッシュ
+};
+
+// パイプラインキャッシュファイルのエントリ
+struct PIPELINE_CACHE_ENTRY {
+	uint64_t Key;
+	uint64_t Offset;
+	uint64_t Size;
+	uint64_t Checksum; // データのハッシュ
+};
+
+// パイプラインキャッシュの統計情報
+struct PIPELINE_CACHE_STATISTICS {
+	uint32_t EntryNum;
+	uint32_t LoadedNum;   // ファイルから読み込んだエントリ数
+	uint32_t RejectedNum; // 壊れていた、またはデバイスに受け付けられなかったエントリ数
+	uint64_t HitCount;
+	uint64_t MissCount;
+	uint64_t StoreCount;
+	uint64_t FileBytes;
+	double OpenTime;      // ファイルを開いて表を確かめるまでの時間 (ミリ秒)
+	double SaveTime;      // ファイルを書き出すまでの時間 (ミリ秒)
+};
+
+// 64 ビットの FNV-1a ハッシュ
+// キャッシュのキーとファイルの検査に使う (バイト列にだけ依存するので、どの環境でも同じ値になる)
+class PipelineHash {
+
+private:
+	static const uint64_t m_OffsetBasis = 0xCBF29CE484222325ull;
+	static const uint64_t m_Prime = 0x100000001B3ull;
+
+	uint64_t m_Value;
+
+public:
+	PipelineHash();
+
+	void AddBytes(const void* data, size_t size);
+	void AddString(const char* text);    // 終端の 0 まで (長さも混ぜる)
+	void AddString(const wchar_t* text);
+
+	// 詰め物のない値をそのまま混ぜる
+	template <typename T>
+	void AddValue(const T& value) {
+		static_assert(is_trivially_copyable<T>::value, "バイト列として扱えない型です。");
+		AddBytes(&value, sizeof(T));
+	}
+
+	uint64_t GetValue() const;
+
+	static uint64_t Compute(const void* data, size_t size);
+};
+
+// パイプラインキャッシュ
+// パイプラインの入力 (シェーダーのバイト列、入力レイアウト、ルートシグニチャ、バックエンド固有の固定ステート) のハッシュをキーに、
+// バックエンドが作ったデータ (D3D12 ならシリアライズしたルートシグニチャと ID3D12PipelineState::GetCachedBlob) を引く
+// ファイルはメモリマップしたまま参照し、エントリのデータは初めて引いたときにハッシュを確かめる
+// 壊れたファイルやエントリは捨てて作り直す (起動を止めない)
+class PipelineCache {
+
+private:
+	// メモリ上のエントリ (データはマップしたファイルか m_StoredData を指す)
+	struct CACHE_ENTRY {
+		const uint8_t* Data;
+		uint64_t Size;
+		uint64_t Checksum;
+		bool Verified;
+	};
+
+	string m_Path;
+	MappedFile m_File;
+	unordered_map<uint64_t, CACHE_ENTRY> m_Entries;
+	list<vector<uint8_t>> m_StoredData;
+	bool m_Dirty;
+
+	PIPELINE_CACHE_STATISTICS m_Statistics;
+
+	bool Load();
+
+public:
+	PipelineCache();
+	~PipelineCache() = default;
+	PipelineCache(const PipelineCache&) = delete;
+	PipelineCache& operator=(const PipelineCache&) = delete;
+
+	// ファイルを開く (なければ空のキャッシュとして始め、壊れていれば中身を捨てる)
+	void Open(const char* path);
+
+	// 追加されたエントリがあればファイルに書き出す (一時ファイルに書いてから置き換える)
+	bool Save();
+
+	// 引く (見つかれば data と size を設定して true)
+	bool Find(uint64_t key, const void** data, size_t* size);
+
+	// 追加する (同じキーがあれば置き換える)
+	void Store(uint64_t key, const void* data, size_t size);
+
+	// 引いたデータがデバイスに受け付けられなかったときに呼ぶ (ヒットを取り消してエントリを捨てる)
+	void Reject(uint64_t key);
+
+	PIPELINE_CACHE_STATISTICS GetStatistics() const;
+
+	// キー (backendKey にはバックエンドの種類と、ハッシュに含めるべき固定ステートを混ぜた値を渡す)
+	// バイトコードを持たないバックエンドはシェーダーのファイル名をバイト列として渡す
+	static uint64_t ComputeRootSignatureKey(const ROOT_SIGNATURE_DESC& desc, uint64_t backendKey);
+	static uint64_t ComputePipelineKey(const PIPELINE_DESC& desc, uint64_t rootSignatureKey, const void* vertexShader, size_t vertexShaderSize, const void* pixelShader, size_t pixelShaderSize, uint64_t backendKey);
+};
@@ -0,0 +1,210 @@
+﻿#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+// スレッドごとのバッファの容量 (2 のべき乗)
+static const uint32_t PROFILE_BUFFER_CAPACITY = 64 * 1024;
+
+// 読み出して溜めておく区間の上限 (超えた分は捨てて数える)
+static const size_t PROFILE_EVENT_LIMIT = 4 * 1024 * 1024;
+
+// このスレッドのバッファ
+static thread_local PROFILE_BUFFER* s_ThreadBuffer = nullptr;
+
+// 静的メンバ
+atomic<bool> Profiler::m_Enabled(false);
+const chrono::steady_clock::time_point Profiler::m_Origin = chrono::steady_clock::now();
+mutex Profiler::m_Mutex;
+vector<unique_ptr<PROFILE_BUFFER>> Profiler::m_Buffers;
+vector<PROFILE_EVENT> Profiler::m_Events;
+uint64_t Profiler::m_DroppedNum = 0;
+
+// 有効・無効を設定
+void Profiler::SetEnabled(bool enabled) {
+	m_Enabled.store(enabled, memory_order_relaxed);
+}
+
+// このスレッドのバッファを取得 (初めてならここで作る)
+PROFILE_BUFFER* Profiler::GetThreadBuffer() {
+	if (s_ThreadBuffer == nullptr) {
+		lock_guard<mutex> lock(m_Mutex);
+		unique_ptr<PROFILE_BUFFER> buffer = make_unique<PROFILE_BUFFER>();
+		buffer->Events.resize(PROFILE_BUFFER_CAPACITY);
+		buffer->Head.store(0, memory_order_relaxed);
+		buffer->Tail.store(0, memory_order_relaxed);
+		buffer->DroppedNum.store(0, memory_order_relaxed);
+		buffer->Thread = static_cast<uint32_t>(m_Buffers.size());
+		s_ThreadBuffer = buffer.get();
+		m_Buffers.push_back(move(buffer));
+	}
+	return s_ThreadBuffer;
+}
+
+// 区間を書き込む
+void Profiler::Record(const char* name, uint64_t begin, uint64_t end) {
+
+	PROFILE_BUFFER* buffer = GetThreadBuffer();
+	uint64_t head = buffer->Head.load(memory_order_relaxed);
+	if (head - buffer->Tail.load(memory_order_acquire) >= PROFILE_BUFFER_CAPACITY) {
+		buffer->DroppedNum.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	buffer->Events[head & (PROFILE_BUFFER_CAPACITY - 1)] = { name, begin, end, buffer->Thread };
+	buffer->Head.store(head + 1, memory_order_release);
+}
+
+// 全スレッドのバッファを読み出す
+void Profiler::Collect() {
+
+	lock_guard<mutex> lock(m_Mutex);
+	for (unique_ptr<PROFILE_BUFFER>& buffer : m_Buffers) {
+		uint64_t tail = buffer->Tail.load(memory_order_relaxed);
+		uint64_t head = buffer->Head.load(memory_order_acquire);
+		for (uint64_t i = tail; i < head; ++i) {
+			if (m_Events.size() < PROFILE_EVENT_LIMIT) { m_Events.push_back(buffer->Events[i & (PROFILE_BUFFER_CAPACITY - 1)]); }
+			else { ++m_DroppedNum; }
+		}
+		buffer->Tail.store(head, memory_order_release);
+		m_DroppedNum += buffer->DroppedNum.exchange(0, memory_order_relaxed);
+	}
+}
+
+// 読み出した区間を捨てる
+void Profiler::Clear() {
+	lock_guard<mutex> lock(m_Mutex);
+	m_Events.clear();
+	m_DroppedNum = 0;
+}
+
+// 区間ごとに集計する (合計の長い順)
+vector<PROFILE_ZONE_STATISTICS> Profiler::Summarize() {
+
+	lock_guard<mutex> lock(m_Mutex);
+
+	// 名前ごとに長さを集める (名前は文字列リテラルなので、同じ区間はアドレスで見分けられる)
+	unordered_map<const char*, vector<double>> durations;
+	for (const PROFILE_EVENT& event : m_Events) {
+		durations[event.Name].push_back((event.End - event.Begin) / 1.0e6);
+	}
+
+	vector<PROFILE_ZONE_STATISTICS> zones;
+	zones.reserve(durations.size());
+	for (auto& [name, times] : durations) {
+		sort(times.begin(), times.end());
+		PROFILE_ZONE_STATISTICS zone = { name, static_cast<uint32_t>(times.size()), times.front(), 0.0, 0.0, times.back(), 0.0 };
+		for (double time : times) { zone.Total += time; }
+		zone.Avg = zone.Total / times.size();
+		zone.P99 = times[static_cast<size_t>(0.99 * (times.size() - 1) + 0.5)];
+		zones.push_back(zone);
+	}
+	sort(zones.begin(), zones.end(), [](const PROFILE_ZONE_STATISTICS& a, const PROFILE_ZONE_STATISTICS& b) { return a.Total > b.Total; });
+	return zones;
+}
+
+// 区間ごとの集計を出力する
+void Profiler::PrintSummary() {
+	for (const PROFILE_ZONE_STATISTICS& zone : Summarize()) {
+		cout << "zone " << zone.Name << " : " << zone.Count << " calls, min " << zone.Min << " ms, avg " << zone.Avg << " ms, p99 " << zone.P99 << " ms, max " << zone.Max << " ms, total " << zone.Total << " ms" << endl;
+	}
+	if (GetDroppedNum() > 0) { cout << "dropped zones : " << GetDroppedNum() << endl; }
+}
+
+// Chrome / Perfetto のトレース (JSON) に書き出す
+bool Profiler::ExportChromeTrace(const char* path) {
+
+	lock_guard<mutex> lock(m_Mutex);
+
+	ofstream stream(path, ios::binary | ios::trunc);
+	if (!stream) { return false; }
+
+	// 名前に " と \ が入っていても壊れないようにする
+	auto writeString = [&stream](const char* text) {
+		stream << '"';
+		for (const char* c = text; *c != '\0'; ++c) {
+			if (*c == '"' || *c == '\\') { stream << '\\'; }
+			stream << *c;
+		}
+		stream << '"';
+	};
+
+	// 時刻はマイクロ秒で書く
+	stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	for (const unique_ptr<PROFILE_BUFFER>& buffer : m_Buffers) {
+		stream << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->Thread;
+		stream << ",\"args\":{\"name\":\"thread " << buffer->Thread << "\"}}";
+		first = false;
+	}
+	stream.precision(3);
+	stream << fixed;
+	for (const PROFILE_EVENT& event : m_Events) {
+		stream << (first ? "" : ",") << "{\"name\":";
+		writeString(event.Name);
+		stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.Thread << ",\"ts\":" << event.Begin / 1000.0 << ",\"dur\":" << (event.End - event.Begin) / 1000.0 << "}";
+		first = false;
+	}
+	stream << "]}" << endl;
+
+	return static_cast<bool>(stream);
+}
+
+// 捨てた区間の数を取得
+uint64_t Profiler::GetDroppedNum() {
+	return m_DroppedNum;
+}
+
+// 計測の負荷を計測
+void Profiler::RunOverheadBenchmark(uint32_t iterationNum) {
+
+	iterationNum = max(iterationNum, 1u);
+	const bool enabled = IsEnabled();
+	volatile uint32_t sink = 0;
+
+	auto elapsed = [](chrono::steady_clock::time_point begin) {
+		return chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count();
+	};
+
+	// 区間を置かない
+	auto begin = chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterationNum; ++i) { sink = sink + 1; }
+	double baseline = elapsed(begin) / iterationNum;
+
+	// 無効な区間
+	SetEnabled(false);
+	begin = chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterationNum; ++i) {
+		PROFILE_ZONE("Benchmark");
+		sink = sink + 1;
+	}
+	double disabled = elapsed(begin) / iterationNum;
+
+	// 有効な区間 (バッファがあふれないように、計測の外で読み出しながら)
+	SetEnabled(true);
+	double total = 0.0;
+	for (uint32_t done = 0; done < iterationNum;) {
+		uint32_t count = min(iterationNum - done, PROFILE_BUFFER_CAPACITY / 2);
+		begin = chrono::steady_clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			PROFILE_ZONE("Benchmark");
+			sink = sink + 1;
+		}
+		total += elapsed(begin);
+		done += count;
+		Collect();
+		Clear();
+	}
+	double enabledTime = total / iterationNum;
+	SetEnabled(enabled);
+
+	cout << "iterations : " << iterationNum << endl;
+#if defined(PROFILER_DISABLED)
+	cout << "profiler : compiled out" << endl;
+#endif
+	cout << "no zone : " << baseline << " ns" << endl;
+	cout << "disabled zone : " << disabled << " ns (" << disabled - baseline << " ns overhead)" << endl;
+	cout << "enabled zone : " << enabledTime << " ns (" << enabledTime - baseline << " ns overhead)" << endl;
+}
@@ -0,0 +1,116 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// 計測した区間 1 つ分 (時刻はナノ秒)
+struct PROFILE_EVENT {
+	const char* Name;
+	uint64_t Begin;
+	uint64_t End;
+	uint32_t Thread;
+};
+
+// 区間ごとの集計 (時間はミリ秒)
+struct PROFILE_ZONE_STATISTICS {
+	const char* Name;
+	uint32_t Count;
+	double Min;
+	double Avg;
+	double P99;
+	double Max;
+	double Total;
+};
+
+// スレッドごとのリングバッファ (書き込むのは持ち主のスレッドだけ、読み出すのは Collect だけ)
+struct PROFILE_BUFFER {
+	vector<PROFILE_EVENT> Events;
+	atomic<uint64_t> Head;
+	atomic<uint64_t> Tail;
+	atomic<uint64_t> DroppedNum;
+	uint32_t Thread;
+};
+
+// CPU プロファイラ
+// PROFILE_ZONE を置いたスコープの開始と終了の時刻を、スレッドごとのリングバッファにロックせずに書き込む
+// Collect でバッファを読み出して溜め、区間ごとの集計や Chrome / Perfetto で開けるトレースに書き出す
+// 無効なときは PROFILE_ZONE は有効かどうかを 1 回読むだけで、PROFILER_DISABLED を定義すればコードごと消える
+class Profiler {
+
+private:
+	static atomic<bool> m_Enabled;
+	static const chrono::steady_clock::time_point m_Origin;
+
+	// 全スレッドのバッファ (スレッドが終わっても読み出せるように、ここで持ち続ける)
+	static mutex m_Mutex;
+	static vector<unique_ptr<PROFILE_BUFFER>> m_Buffers;
+
+	// 読み出した区間
+	static vector<PROFILE_EVENT> m_Events;
+	static uint64_t m_DroppedNum;
+
+	static PROFILE_BUFFER* GetThreadBuffer();
+
+public:
+	Profiler() = delete;
+
+	static void SetEnabled(bool enabled);
+
+	// 区間の計測ごとに呼ばれるので、ヘッダーで定義してインライン展開させる
+	static bool IsEnabled() { return m_Enabled.load(memory_order_relaxed); }
+	static uint64_t GetTimestamp() { return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - m_Origin).count()); }
+
+	// 区間を書き込む (バッファがいっぱいなら捨てて数える)
+	static void Record(const char* name, uint64_t begin, uint64_t end);
+
+	// 全スレッドのバッファを読み出す
+	static void Collect();
+
+	// 読み出した区間を捨てる
+	static void Clear();
+
+	static vector<PROFILE_ZONE_STATISTICS> Summarize();
+	static void PrintSummary();
+	static bool ExportChromeTrace(const char* path);
+	static uint64_t GetDroppedNum();
+
+	// 区間を置かない場合・無効な場合・有効な場合の 1 区間あたりの時間を計測する
+	static void RunOverheadBenchmark(uint32_t iterationNum);
+};
+
+// スコープの開始から終了までを計測する
+class ProfileScope {
+
+private:
+	const char* m_Name;
+	uint64_t m_Begin;
+
+public:
+	ProfileScope(const char* name):
+		m_Name(Profiler::IsEnabled() ? name : nullptr),
+		m_Begin(m_Name != nullptr ? Profiler::GetTimestamp() : 0) {
+
+	}
+
+	~ProfileScope() {
+		if (m_Name != nullptr) { Profiler::Record(m_Name, m_Begin, Profiler::GetTimestamp()); }
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+// 区間の計測 (name は文字列リテラル)
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#if defined(PROFILER_DISABLED)
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#endif
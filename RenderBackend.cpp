@@ -0,0 +1,19 @@
+﻿#include "RenderBackend.h"
+
+#include <stdexcept>
+
+#include "D3D12Backend.h"
+#include "NullBackend.h"
+#include "SoftwareBackend.h"
+
+// 種類を指定して作成
+unique_ptr<RenderBackend> RenderBackend::Create(BACKEND_TYPE type) {
+	switch (type) {
+#if defined(_WIN32)
+	case BACKEND_TYPE::D3D12: return make_unique<D3D12Backend>();
+#endif
+	case BACKEND_TYPE::NULL_DEVICE: return make_unique<NullBackend>();
+	case BACKEND_TYPE::SOFTWARE: return make_unique<SoftwareBackend>();
+	default: throw runtime_error("この環境では使えない描画バックエンドです。");
+	}
+}
@@ -0,0 +1,233 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+class PipelineCache;
+
+// ハンドル
+typedef uint32_t RESOURCE_HANDLE;
+typedef uint32_t ROOT_SIGNATURE_HANDLE;
+typedef uint32_t PIPELINE_HANDLE;
+typedef uint32_t DESCRIPTOR_HEAP_HANDLE;
+static const uint32_t INVALID_HANDLE = UINT32_MAX;
+
+// GPU 上のアドレス
+typedef uint64_t GPU_ADDRESS;
+
+// 描画バックエンドの種類
+enum class BACKEND_TYPE {
+	D3D12,
+	NULL_DEVICE,
+	SOFTWARE,
+};
+
+// ヒープの種類
+enum class HEAP_TYPE {
+	DEFAULT,
+	UPLOAD,
+};
+
+// リソースの状態
+enum class RESOURCE_STATE {
+	COMMON,
+	PRESENT,
+	RENDER_TARGET,
+	COPY_DEST,
+	VERTEX_AND_CONSTANT_BUFFER,
+	INDEX_BUFFER,
+	GENERIC_READ,
+};
+
+// ディスクリプタヒープの種類
+enum class DESCRIPTOR_HEAP_TYPE {
+	CBV_SRV_UAV,
+	RTV,
+	DSV,
+};
+
+// 頂点要素の形式
+enum class ELEMENT_FORMAT {
+	R32G32B32_FLOAT,
+	R32G32B32A32_FLOAT,
+	R16G16B16A16_FLOAT,
+	R16G16B16A16_SNORM,
+	R8G8B8A8_UNORM,
+};
+
+// インデックスの形式
+enum class INDEX_FORMAT {
+	R16_UINT,
+	R32_UINT,
+};
+
+// 頂点要素の入力単位
+enum class INPUT_CLASSIFICATION {
+	PER_VERTEX_DATA,
+	PER_INSTANCE_DATA,
+};
+
+// プリミティブの種類
+enum class PRIMITIVE_TOPOLOGY {
+	TRIANGLELIST,
+};
+
+// 頂点要素
+struct INPUT_ELEMENT_DESC {
+	const char* SemanticName;
+	uint32_t SemanticIndex;
+	ELEMENT_FORMAT Format;
+	uint32_t InputSlot;
+	INPUT_CLASSIFICATION InputSlotClass;
+	uint32_t InstanceDataStepRate;
+};
+
+// ルートパラメータ (定数バッファビューのみ)
+struct ROOT_PARAMETER {
+	uint32_t ShaderRegister;
+	bool VertexOnly;
+};
+
+// ルートシグニチャ
+struct ROOT_SIGNATURE_DESC {
+	const ROOT_PARAMETER* Parameters;
+	uint32_t ParameterNum;
+};
+
+// パイプラインステート
+struct PIPELINE_DESC {
+	ROOT_SIGNATURE_HANDLE RootSignature;
+	const wchar_t* VertexShader;
+	const wchar_t* PixelShader;
+	const INPUT_ELEMENT_DESC* InputElements;
+	uint32_t InputElementNum;
+};
+
+// 頂点バッファビュー
+struct VERTEX_BUFFER_VIEW {
+	GPU_ADDRESS BufferLocation;
+	uint32_t SizeInBytes;
+	uint32_t StrideInBytes;
+};
+
+// インデックスバッファビュー
+struct INDEX_BUFFER_VIEW {
+	GPU_ADDRESS BufferLocation;
+	uint32_t SizeInBytes;
+	INDEX_FORMAT Format;
+};
+
+// ビューポート
+struct VIEWPORT {
+	float TopLeftX;
+	float TopLeftY;
+	float Width;
+	float Height;
+	float MinDepth;
+	float MaxDepth;
+};
+
+// シザー矩形
+struct SCISSOR_RECT {
+	int32_t Left;
+	int32_t Top;
+	int32_t Right;
+	int32_t Bottom;
+};
+
+// リソースバリア (状態遷移)
+struct RESOURCE_BARRIER {
+	RESOURCE_HANDLE Resource;
+	RESOURCE_STATE StateBefore;
+	RESOURCE_STATE StateAfter;
+};
+
+// バックエンドの初期化情報
+struct BACKEND_DESC {
+	const wchar_t* ClassName;
+	const wchar_t* WindowName;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t FrameCount;   // バックバッファの数
+	uint32_t FrameLatency; // 同時に処理中にできるフレーム数 (コマンドアロケータの数)
+	PipelineCache* PipelineStateCache; // ルートシグニチャとパイプラインステートのキャッシュ (nullptr なら使わない)
+};
+
+// コマンドリスト
+// 処理中にできるフレームの数だけアロケータを持ち、Reset でそのフレームのアロケータから記録を始める
+class CommandList {
+public:
+	virtual ~CommandList() = default;
+
+	virtual void Reset(uint32_t frameIndex) = 0;
+	virtual void Close() = 0;
+
+	virtual void ResourceBarrier(uint32_t num, const RESOURCE_BARRIER* barriers) = 0;
+	virtual void CopyBufferRegion(RESOURCE_HANDLE dest, uint64_t destOffset, RESOURCE_HANDLE src, uint64_t srcOffset, uint64_t size) = 0;
+
+	virtual void OMSetRenderTarget(RESOURCE_HANDLE renderTarget) = 0;
+	virtual void ClearRenderTargetView(RESOURCE_HANDLE renderTarget, const float color[4]) = 0;
+
+	virtual void SetGraphicsRootSignature(ROOT_SIGNATURE_HANDLE rootSignature) = 0;
+	virtual void SetDescriptorHeaps(uint32_t num, const DESCRIPTOR_HEAP_HANDLE* heaps) = 0;
+	virtual void SetGraphicsRootConstantBufferView(uint32_t parameterIndex, GPU_ADDRESS address) = 0;
+	virtual void SetPipelineState(PIPELINE_HANDLE pipelineState) = 0;
+
+	virtual void IASetPrimitiveTopology(PRIMITIVE_TOPOLOGY topology) = 0;
+	virtual void IASetVertexBuffers(uint32_t startSlot, uint32_t num, const VERTEX_BUFFER_VIEW* views) = 0;
+	virtual void IASetIndexBuffer(const INDEX_BUFFER_VIEW* view) = 0;
+	virtual void RSSetViewports(uint32_t num, const VIEWPORT* viewports) = 0;
+	virtual void RSSetScissorRects(uint32_t num, const SCISSOR_RECT* rects) = 0;
+
+	virtual void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) = 0;
+};
+
+// 描画バックエンド
+// ウィンドウ・デバイス・リソース・フェンスをまとめて抽象化し、Graphic のフレーム処理を描画 API から切り離す
+// 失敗した場合は例外を投げる
+class RenderBackend {
+public:
+	virtual ~RenderBackend() = default;
+
+	// 種類を指定して作成
+	static unique_ptr<RenderBackend> Create(BACKEND_TYPE type);
+
+	// 初期化と終了
+	virtual void Initialize(const BACKEND_DESC& desc) = 0;
+	virtual void Terminate() = 0;
+
+	// メッセージを 1 つ処理する (処理したら true、終了要求が来たら quit を立てる)
+	virtual bool ProcessMessage(bool* quit) = 0;
+
+	// リソース
+	virtual RESOURCE_HANDLE CreateBuffer(HEAP_TYPE heapType, uint64_t size, RESOURCE_STATE initialState) = 0;
+	virtual void* Map(RESOURCE_HANDLE resource) = 0;
+	virtual GPU_ADDRESS GetGPUVirtualAddress(RESOURCE_HANDLE resource) = 0;
+
+	// リソースを解放 (GPU が使い終えてから呼ぶ。ハンドルは使い回さない)
+	virtual void ReleaseResource(RESOURCE_HANDLE resource) = 0;
+
+	// ディスクリプタ
+	virtual DESCRIPTOR_HEAP_HANDLE CreateDescriptorHeap(DESCRIPTOR_HEAP_TYPE type, uint32_t num, bool shaderVisible) = 0;
+	virtual void CreateConstantBufferView(DESCRIPTOR_HEAP_HANDLE heap, uint32_t index, GPU_ADDRESS address, uint32_t size) = 0;
+
+	// パイプライン
+	virtual ROOT_SIGNATURE_HANDLE CreateRootSignature(const ROOT_SIGNATURE_DESC& desc) = 0;
+	virtual PIPELINE_HANDLE CreatePipelineState(const PIPELINE_DESC& desc) = 0;
+
+	// コマンド
+	virtual unique_ptr<CommandList> CreateCommandList() = 0;
+	virtual void ExecuteCommandLists(uint32_t num, CommandList* const* lists) = 0;
+
+	// スワップチェイン
+	virtual RESOURCE_HANDLE GetBackBuffer(uint32_t index) = 0;
+	virtual uint32_t GetCurrentBackBufferIndex() = 0;
+	virtual void Present() = 0;
+
+	// フェンス
+	virtual void Signal(uint64_t value) = 0;
+	virtual uint64_t GetCompletedValue() = 0;
+	virtual void WaitForValue(uint64_t value) = 0;
+};
@@ -1,14 +1,46 @@
 ﻿#include "RenderObject.h"
+#include "TransformEngine.h"
+
+#include <algorithm>
+#include <cmath>
+
+// 相似変換 (回転・一様な拡大縮小・平行移動) の拡大率を求める (相似変換でなければ false)
+// 3 行が互いに直交して長さが揃っていれば、どの向きの長さも同じ倍率になる
+static bool GetUniformScale(FXMMATRIX matrix, float* scale) {
+
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, matrix);
+	if (m._14 != 0.0f || m._24 != 0.0f || m._34 != 0.0f || m._44 != 1.0f) { return false; }
+
+	const float tolerance = 1e-4f;
+	XMVECTOR rows[3] = { XMVectorSet(m._11, m._12, m._13, 0.0f), XMVectorSet(m._21, m._22, m._23, 0.0f), XMVectorSet(m._31, m._32, m._33, 0.0f) };
+	float lengthSq[3];
+	for (int i = 0; i < 3; ++i) { lengthSq[i] = XMVectorGetX(XMVector3LengthSq(rows[i])); }
+
+	float maxLengthSq = max(lengthSq[0], max(lengthSq[1], lengthSq[2]));
+	if (maxLengthSq == 0.0f) { return false; }
+	for (int i = 0; i < 3; ++i) {
+		if (fabsf(lengthSq[i] - maxLengthSq) > maxLengthSq * tolerance) { return false; }
+		if (fabsf(XMVectorGetX(XMVector3Dot(rows[i], rows[(i + 1) % 3]))) > maxLengthSq * tolerance) { return false; }
+	}
+
+	// 誤差で球がはみ出さないように、いちばん長い行に少し余裕を持たせる
+	*scale = sqrtf(maxLengthSq) * (1.0f + tolerance);
+	return true;
+}
 
 // コンストラクタ
 RenderObject::RenderObject():
 	m_Vertices(nullptr),
 	m_VertexNum(0),
 	m_Indices(nullptr),
-	m_IndexNum(0) {}
+	m_IndexNum(0),
+	m_Bounds({}),
+	m_OwnsData(true) {}
 
 // デストラクタ
 RenderObject::~RenderObject() {
+	if (!m_OwnsData) { return; }
 	if (m_Vertices != nullptr) { delete[] m_Vertices; }
 	if (m_Indices != nullptr) { delete[] m_Indices; }
 }
@@ -25,23 +57,79 @@ uint32_t* RenderObject::GetIndices() const { return m_Indices; }
 // ポリゴンデータの長さを取得
 size_t RenderObject::GetIndexNum() const { return m_IndexNum; }
 
-// 移動
-void RenderObject::Translate(XMFLOAT3 offset) {
+// 境界ボリュームを取得
+const BOUNDS& RenderObject::GetBounds() const { return m_Bounds; }
+
+// 頂点から境界ボリュームを計算し直す
+void RenderObject::UpdateBounds() {
 
-	// 変換行列を計算
-	XMVECTOR vOffset = XMLoadFloat3(&offset);
-	XMMATRIX transform = XMMatrixTranslationFromVector(vOffset);
+	if (m_Vertices == nullptr || m_VertexNum == 0) {
+		m_Bounds = {};
+		return;
+	}
 
-	// 座標変換を適用
-	for (int i = 0; i < m_VertexNum; ++i) {
+	XMVECTOR vMin = XMLoadFloat3(&m_Vertices[0].Position);
+	XMVECTOR vMax = vMin;
+	for (size_t i = 1; i < m_VertexNum; ++i) {
 		XMVECTOR vPosition = XMLoadFloat3(&m_Vertices[i].Position);
-		vPosition = XMVector3Transform(vPosition, transform);
-		XMStoreFloat3(&m_Vertices[i].Position, vPosition);
+		vMin = XMVectorMin(vMin, vPosition);
+		vMax = XMVectorMax(vMax, vPosition);
+	}
+
+	// 境界球の中心は境界箱の中心に合わせる
+	XMVECTOR vCenter = XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f);
+	float radiusSq = 0.0f;
+	for (size_t i = 0; i < m_VertexNum; ++i) {
+		XMVECTOR vOffset = XMVectorSubtract(XMLoadFloat3(&m_Vertices[i].Position), vCenter);
+		radiusSq = max(radiusSq, XMVectorGetX(XMVector3LengthSq(vOffset)));
 	}
+
+	XMStoreFloat3(&m_Bounds.Center, vCenter);
+	XMStoreFloat3(&m_Bounds.Min, vMin);
+	XMStoreFloat3(&m_Bounds.Max, vMax);
+	m_Bounds.Radius = sqrtf(radiusSq);
+}
+
+// 移動
+void RenderObject::Translate(XMFLOAT3 offset) {
+	Transform(XMMatrixTranslation(offset.x, offset.y, offset.z));
 }
 
 // 回転
 void RenderObject::Rotate(XMFLOAT3 axis, float angle) {
+	XMVECTOR vAxis = XMLoadFloat3(&axis);
+	Transform(XMMatrixRotationAxis(vAxis, angle));
+}
+
+// 拡大縮小
+void RenderObject::Scale(XMFLOAT3 scale) {
+	Transform(XMMatrixScaling(scale.x, scale.y, scale.z));
+}
+
+// 座標変換を適用
+// 境界箱は変換と同じパスで求める
+// 相似変換なら境界球は中心を動かして半径を拡大率倍するだけにし、それ以外は新しい境界箱の中心から半径を求め直す
+void RenderObject::Transform(FXMMATRIX matrix) {
+
+	if (m_Vertices == nullptr || m_VertexNum == 0) { return; }
+
+	TransformEngine::TransformPositions(&m_Vertices->Position, sizeof(VERTEX), m_VertexNum, matrix, &m_Bounds.Min, &m_Bounds.Max);
+
+	float scale = 0.0f;
+	if (GetUniformScale(matrix, &scale)) {
+		XMStoreFloat3(&m_Bounds.Center, XMVector3Transform(XMLoadFloat3(&m_Bounds.Center), matrix));
+		m_Bounds.Radius *= scale;
+		return;
+	}
+
+	XMVECTOR vCenter = XMVectorScale(XMVectorAdd(XMLoadFloat3(&m_Bounds.Min), XMLoadFloat3(&m_Bounds.Max)), 0.5f);
+	float radiusSq = 0.0f;
+	for (size_t i = 0; i < m_VertexNum; ++i) {
+		XMVECTOR vOffset = XMVectorSubtract(XMLoadFloat3(&m_Vertices[i].Position), vCenter);
+		radiusSq = max(radiusSq, XMVectorGetX(XMVector3LengthSq(vOffset)));
+	}
+	XMStoreFloat3(&m_Bounds.Center, vCenter);
+	m_Bounds.Radius = sqrtf(radiusSq);
 }
 
 // 正六面体
@@ -70,6 +158,8 @@ Hexahedron::Hexahedron() {
 		0, 4, 5, 0, 5, 1,
 		6, 2, 3, 6, 3, 7,
 	};
+
+	UpdateBounds();
 }
 
 // 正八面体
@@ -98,4 +188,56 @@ Octahedron::Octahedron() {
 		5, 4, 3,
 		5, 1, 4
 	};
+
+	UpdateBounds();
+}
+
+// 平面の格子
+Grid::Grid(uint32_t divisions) {
+
+	if (divisions == 0) { divisions = 1; }
+	const uint32_t side = divisions + 1;
+	const float step = 2.0f / divisions;
+
+	// 頂点を設定 (色は位置から決める)
+	m_VertexNum = static_cast<size_t>(side) * side;
+	m_Vertices = new VERTEX[m_VertexNum];
+	for (uint32_t y = 0; y < side; ++y) {
+		for (uint32_t x = 0; x < side; ++x) {
+			float u = static_cast<float>(x) / divisions;
+			float v = static_cast<float>(y) / divisions;
+			m_Vertices[static_cast<size_t>(y) * side + x] = { XMFLOAT3(-1.0f + step * x, -1.0f + step * y, 0.0f), XMFLOAT4(u, v, 1.0f - u, 1.0f) };
+		}
+	}
+
+	// ポリゴンを設定
+	m_IndexNum = static_cast<size_t>(divisions) * divisions * 6;
+	m_Indices = new uint32_t[m_IndexNum];
+	size_t index = 0;
+	for (uint32_t y = 0; y < divisions; ++y) {
+		for (uint32_t x = 0; x < divisions; ++x) {
+			uint32_t v0 = y * side + x;
+			uint32_t v1 = v0 + 1;
+			uint32_t v2 = v0 + side;
+			uint32_t v3 = v2 + 1;
+			m_Indices[index++] = v0; m_Indices[index++] = v1; m_Indices[index++] = v2;
+			m_Indices[index++] = v1; m_Indices[index++] = v3; m_Indices[index++] = v2;
+		}
+	}
+
+	UpdateBounds();
+}
+
+// 頂点とインデックスを渡して作るメッシュ
+GeneratedMesh::GeneratedMesh(const VERTEX* vertices, size_t vertexNum, const uint32_t* indices, size_t indexNum) {
+
+	m_VertexNum = vertexNum;
+	m_Vertices = new VERTEX[m_VertexNum];
+	copy(vertices, vertices + vertexNum, m_Vertices);
+
+	m_IndexNum = indexNum;
+	m_Indices = new uint32_t[m_IndexNum];
+	copy(indices, indices + indexNum, m_Indices);
+
+	UpdateBounds();
 }
@@ -3,11 +3,9 @@
 #include <cstdint>
 #include <memory>
 #include <DirectXMath.h>
-#include <wrl/client.h>
 
 using namespace std;
 using namespace DirectX;
-using namespace Microsoft::WRL;
 
 // 頂点情報
 struct VERTEX {
@@ -15,6 +13,14 @@ struct VERTEX {
 	XMFLOAT4 Color;
 };
 
+// 境界ボリューム (境界球と軸平行境界箱)
+struct BOUNDS {
+	XMFLOAT3 Center;
+	float Radius;
+	XMFLOAT3 Min;
+	XMFLOAT3 Max;
+};
+
 // レンダリングオブジェクト
 class RenderObject {
 
@@ -25,6 +31,11 @@ protected:
 	uint32_t* m_Indices;
 	size_t m_IndexNum;
 
+	BOUNDS m_Bounds;
+
+	// 頂点とインデックスを自分で確保したか (外部のメモリを参照しているだけなら false)
+	bool m_OwnsData;
+
 public:
 	RenderObject();
 	~RenderObject();
@@ -35,8 +46,13 @@ public:
 	uint32_t* GetIndices() const;
 	size_t GetIndexNum() const;
 
+	const BOUNDS& GetBounds() const;
+	void UpdateBounds();
+
 	void Translate(XMFLOAT3 offset);
 	void Rotate(XMFLOAT3 axis, float angle);
+	void Scale(XMFLOAT3 scale);
+	void Transform(FXMMATRIX matrix);
 };
 
 // 正六面体
@@ -49,4 +65,16 @@ public:
 class Octahedron : public RenderObject {
 public:
 	Octahedron();
+};
+
+// 平面の格子 (XY 平面上の [-1, 1] を divisions × divisions の四角形に分ける)
+class Grid : public RenderObject {
+public:
+	Grid(uint32_t divisions);
+};
+
+// 頂点とインデックスを渡して作るメッシュ (生成したメッシュを入れる)
+class GeneratedMesh : public RenderObject {
+public:
+	GeneratedMesh(const VERTEX* vertices, size_t vertexNum, const uint32_t* indices, size_t indexNum);
 };
\ No newline at end of file
@@ -0,0 +1,244 @@
+﻿#include "RenderQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+#include "Profiler.h"
+
+// 1 つの区間に入れる最小のドロー数 (これより少なければ分けない)
+static const uint32_t RENDER_QUEUE_BATCH_SIZE = 16 * 1024;
+
+// 基数ソートの 1 桁 (8 ビット) のとりうる値の数
+static const uint32_t RADIX_SIZE = 256;
+
+// コンストラクタ
+RenderQueue::RenderQueue():
+	m_Keys(),
+	m_Values(),
+	m_TempKeys(),
+	m_TempValues(),
+	m_Histograms(),
+	m_Statistics({ 0 }) {
+
+}
+
+// キーを作る
+uint64_t RenderQueue::MakeKey(RENDER_PASS pass, PIPELINE_HANDLE pipeline, MESH_HANDLE mesh, float depth) {
+
+	// 幅に収まらないハンドルは切り詰める (並びが崩れるだけで、値で描くドローは変わらない)
+	const uint64_t maxDepth = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+	uint64_t depthBits = static_cast<uint64_t>(min(max(depth, 0.0f), 1.0f) * maxDepth + 0.5f);
+	uint64_t pipelineBits = pipeline & ((1ull << RENDER_KEY_PIPELINE_BITS) - 1);
+	uint64_t meshBits = mesh & ((1ull << RENDER_KEY_MESH_BITS) - 1);
+	uint64_t passBits = static_cast<uint64_t>(pass) << 56;
+
+	if (pass == RENDER_PASS::DEPTH_SORTED) {
+		return passBits | ((maxDepth - depthBits) << 32) | (pipelineBits << RENDER_KEY_MESH_BITS) | meshBits;
+	}
+	return passBits | (pipelineBits << (RENDER_KEY_MESH_BITS + RENDER_KEY_DEPTH_BITS)) | (meshBits << RENDER_KEY_DEPTH_BITS) | depthBits;
+}
+
+// キーからパス・パイプライン・メッシュを取り出す
+void RenderQueue::DecodeKey(uint64_t key, RENDER_PASS* pass, PIPELINE_HANDLE* pipeline, MESH_HANDLE* mesh) {
+	*pass = static_cast<RENDER_PASS>(key >> 56);
+	if (*pass == RENDER_PASS::DEPTH_SORTED) {
+		*pipeline = static_cast<PIPELINE_HANDLE>((key >> RENDER_KEY_MESH_BITS) & ((1ull << RENDER_KEY_PIPELINE_BITS) - 1));
+		*mesh = static_cast<MESH_HANDLE>(key & ((1ull << RENDER_KEY_MESH_BITS) - 1));
+	}
+	else {
+		*pipeline = static_cast<PIPELINE_HANDLE>((key >> (RENDER_KEY_MESH_BITS + RENDER_KEY_DEPTH_BITS)) & ((1ull << RENDER_KEY_PIPELINE_BITS) - 1));
+		*mesh = static_cast<MESH_HANDLE>((key >> RENDER_KEY_DEPTH_BITS) & ((1ull << RENDER_KEY_MESH_BITS) - 1));
+	}
+}
+
+// ドローを投入
+void RenderQueue::Submit(uint64_t key, uint32_t value) {
+	m_Keys.push_back(key);
+	m_Values.push_back(value);
+}
+
+// 容量を確保
+void RenderQueue::Reserve(size_t count) {
+	m_Keys.reserve(count);
+	m_Values.reserve(count);
+	m_TempKeys.reserve(count);
+	m_TempValues.reserve(count);
+}
+
+// 投入されたドローを破棄
+void RenderQueue::Clear() {
+	m_Keys.clear();
+	m_Values.clear();
+}
+
+// 今の並びでの状態の切り替え回数を数える
+void RenderQueue::CountStateChanges(uint32_t* pipelineChanges, uint32_t* meshChanges) const {
+	*pipelineChanges = 0;
+	*meshChanges = 0;
+
+	PIPELINE_HANDLE lastPipeline = INVALID_HANDLE;
+	MESH_HANDLE lastMesh = INVALID_MESH_HANDLE;
+	for (uint64_t key : m_Keys) {
+		RENDER_PASS pass;
+		PIPELINE_HANDLE pipeline;
+		MESH_HANDLE mesh;
+		DecodeKey(key, &pass, &pipeline, &mesh);
+		if (pipeline != lastPipeline) { ++*pipelineChanges; }
+		if (mesh != lastMesh) { ++*meshChanges; }
+		lastPipeline = pipeline;
+		lastMesh = mesh;
+	}
+}
+
+// キーの昇順に並べ替える
+void RenderQueue::Sort(JobSystem* jobSystem) {
+	PROFILE_ZONE("RenderQueue::Sort");
+
+	const uint32_t drawNum = static_cast<uint32_t>(m_Keys.size());
+
+	m_Statistics.DrawNum = drawNum;
+	m_Statistics.SortPasses = 0;
+	CountStateChanges(&m_Statistics.UnsortedPipelineChanges, &m_Statistics.UnsortedMeshChanges);
+
+	auto begin = chrono::steady_clock::now();
+
+	if (drawNum > 1) {
+		// キーを区間に分ける (区間ごとにジョブを 1 つ)
+		uint32_t chunkNum = jobSystem != nullptr ? min(jobSystem->GetThreadNum(), (drawNum + RENDER_QUEUE_BATCH_SIZE - 1) / RENDER_QUEUE_BATCH_SIZE) : 1;
+		uint32_t chunkSize = (drawNum + chunkNum - 1) / chunkNum;
+		auto run = [jobSystem, chunkNum](const JOB_FUNCTION& function) {
+			if (chunkNum > 1) { jobSystem->Run(chunkNum, function); }
+			else { function(0, 0); }
+		};
+
+		m_TempKeys.resize(drawNum);
+		m_TempValues.resize(drawNum);
+		m_Histograms.resize(static_cast<size_t>(chunkNum) * RADIX_SIZE);
+
+		// 全キーで同じ桁は並べ替えなくてよいので、違いのあるビットを調べておく
+		vector<uint64_t> differences(chunkNum, 0);
+		run([&](uint32_t job, uint32_t thread) {
+			uint32_t first = job * chunkSize, last = min(first + chunkSize, drawNum);
+			uint64_t difference = 0;
+			for (uint32_t i = first; i < last; ++i) { difference |= m_Keys[i] ^ m_Keys[0]; }
+			differences[job] = difference;
+		});
+		uint64_t difference = 0;
+		for (uint64_t bits : differences) { difference |= bits; }
+
+		for (uint32_t shift = 0; shift < 64; shift += 8) {
+			if (((difference >> shift) & (RADIX_SIZE - 1)) == 0) { continue; }
+			++m_Statistics.SortPasses;
+
+			const uint64_t* keys = m_Keys.data();
+			const uint32_t* values = m_Values.data();
+			uint64_t* tempKeys = m_TempKeys.data();
+			uint32_t* tempValues = m_TempValues.data();
+
+			// 区間ごとに桁の出現数を数える
+			run([&](uint32_t job, uint32_t thread) {
+				uint32_t* histogram = &m_Histograms[static_cast<size_t>(job) * RADIX_SIZE];
+				fill(histogram, histogram + RADIX_SIZE, 0u);
+				uint32_t first = job * chunkSize, last = min(first + chunkSize, drawNum);
+				for (uint32_t i = first; i < last; ++i) { ++histogram[(keys[i] >> shift) & (RADIX_SIZE - 1)]; }
+			});
+
+			// 桁の値ごと、その中では区間の順に書き込み位置を決める
+			uint32_t offset = 0;
+			for (uint32_t digit = 0; digit < RADIX_SIZE; ++digit) {
+				for (uint32_t chunk = 0; chunk < chunkNum; ++chunk) {
+					uint32_t& count = m_Histograms[static_cast<size_t>(chunk) * RADIX_SIZE + digit];
+					uint32_t next = offset + count;
+					count = offset;
+					offset = next;
+				}
+			}
+
+			// 区間ごとに書き込む
+			run([&](uint32_t job, uint32_t thread) {
+				uint32_t* position = &m_Histograms[static_cast<size_t>(job) * RADIX_SIZE];
+				uint32_t first = job * chunkSize, last = min(first + chunkSize, drawNum);
+				for (uint32_t i = first; i < last; ++i) {
+					uint32_t index = position[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+					tempKeys[index] = keys[i];
+					tempValues[index] = values[i];
+				}
+			});
+
+			m_Keys.swap(m_TempKeys);
+			m_Values.swap(m_TempValues);
+		}
+	}
+
+	m_Statistics.SortTime = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+	CountStateChanges(&m_Statistics.PipelineChanges, &m_Statistics.MeshChanges);
+}
+
+// 並べ替えた後のキーを取得
+const uint64_t* RenderQueue::GetKeys() const { return m_Keys.data(); }
+
+// 並べ替えた後の値を取得
+const uint32_t* RenderQueue::GetValues() const { return m_Values.data(); }
+
+// ドローの数を取得
+uint32_t RenderQueue::GetDrawNum() const { return static_cast<uint32_t>(m_Keys.size()); }
+
+// 統計情報を取得
+RENDER_QUEUE_STATISTICS RenderQueue::GetStatistics() const { return m_Statistics; }
+
+// 並べ替えの時間を計測
+void RenderQueue::RunBenchmark(uint32_t drawNum, uint32_t threadNum) {
+
+	const uint32_t frameNum = 20;
+	drawNum = max(drawNum, 1u);
+
+	// パイプライン 16 種類、メッシュ 1 万種類をばらばらの奥行きで投入し、1 割は奥から描くパスに入れる
+	mt19937 random(1);
+	uniform_int_distribution<uint32_t> pipelines(0, 15);
+	uniform_int_distribution<uint32_t> meshes(0, 9999);
+	uniform_real_distribution<float> depths(0.0f, 1.0f);
+	vector<uint64_t> keys(drawNum);
+	for (uint64_t& key : keys) {
+		RENDER_PASS pass = random() % 10 == 0 ? RENDER_PASS::DEPTH_SORTED : RENDER_PASS::STATE_SORTED;
+		key = MakeKey(pass, pipelines(random), meshes(random), depths(random));
+	}
+
+	JobSystem jobSystem(threadNum);
+	RenderQueue queue;
+	queue.Reserve(drawNum);
+
+	double radixTime = 0.0;
+	for (uint32_t frame = 0; frame < frameNum; ++frame) {
+		queue.Clear();
+		for (uint32_t i = 0; i < drawNum; ++i) { queue.Submit(keys[i], i); }
+		queue.Sort(&jobSystem);
+		radixTime += queue.GetStatistics().SortTime;
+	}
+
+	// 比較のために std::sort でキーと値の組を並べ替える (同じキーは値の順にして安定ソートと同じ結果にする)
+	vector<pair<uint64_t, uint32_t>> pairs(drawNum);
+	double stdTime = 0.0;
+	for (uint32_t frame = 0; frame < frameNum; ++frame) {
+		for (uint32_t i = 0; i < drawNum; ++i) { pairs[i] = { keys[i], i }; }
+		auto begin = chrono::steady_clock::now();
+		sort(pairs.begin(), pairs.end());
+		stdTime += chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+	}
+
+	bool matched = true;
+	for (uint32_t i = 0; i < drawNum && matched; ++i) {
+		matched = queue.GetKeys()[i] == pairs[i].first && queue.GetValues()[i] == pairs[i].second;
+	}
+
+	RENDER_QUEUE_STATISTICS statistics = queue.GetStatistics();
+	cout << "draws : " << drawNum << endl;
+	cout << "threads : " << jobSystem.GetThreadNum() << endl;
+	cout << "radix sort : " << radixTime / frameNum << " ms (" << statistics.SortPasses << " passes)" << endl;
+	cout << "std::sort : " << stdTime / frameNum << " ms" << endl;
+	cout << "result : " << (matched ? "matched" : "MISMATCH") << endl;
+	cout << "pipeline changes : " << statistics.PipelineChanges << " (" << statistics.UnsortedPipelineChanges << " unsorted)" << endl;
+	cout << "mesh changes : " << statistics.MeshChanges << " (" << statistics.UnsortedMeshChanges << " unsorted)" << endl;
+}
@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "JobSystem.h"
+#include "MeshRegistry.h"
+#include "RenderBackend.h"
+
+using namespace std;
+
+// 描画のパス (キーの最上位に入るので、この順に描かれる)
+// STATE_SORTED : パイプライン・メッシュ・手前から奥の順 (状態の切り替えを減らす)
+// DEPTH_SORTED : 奥から手前・パイプライン・メッシュの順 (深度テストに頼らず重なりを正しく描く)
+enum class RENDER_PASS : uint8_t {
+	STATE_SORTED = 0,
+	DEPTH_SORTED = 1,
+};
+
+// ソートキーの各部分の幅
+// STATE_SORTED : [63:56] パス  [55:44] パイプライン  [43:24] メッシュ  [23:0] 奥行き
+// DEPTH_SORTED : [63:56] パス  [55:32] 奥行き (反転)  [31:20] パイプライン  [19:0] メッシュ
+static const uint32_t RENDER_KEY_PIPELINE_BITS = 12;
+static const uint32_t RENDER_KEY_MESH_BITS = 20;
+static const uint32_t RENDER_KEY_DEPTH_BITS = 24;
+
+// メッシュの部分にはハンドルの添え字だけが入る (世代は並びに関係しない)
+static_assert(RENDER_KEY_MESH_BITS == MESH_HANDLE_INDEX_BITS, "ソートキーのメッシュの幅とハンドルの添え字の幅が違います。");
+
+// 描画キューの統計情報 (直前のフレーム)
+struct RENDER_QUEUE_STATISTICS {
+	uint32_t DrawNum;
+	uint32_t PipelineChanges;         // 並べ替えた後のパイプラインの切り替え回数
+	uint32_t MeshChanges;             // 並べ替えた後のメッシュの切り替え回数
+	uint32_t UnsortedPipelineChanges; // 投入された順のままだった場合
+	uint32_t UnsortedMeshChanges;
+	uint32_t SortPasses;              // 実際に並べ替えた桁の数 (全キーで同じ桁は飛ばす)
+	double SortTime;                  // ミリ秒
+};
+
+// 描画キュー
+// ドローごとに 64 ビットのソートキーと値 (呼び出し側のドローの番号) を受け取り、キーの昇順に並べ替える
+// 8 ビットずつの LSD 基数ソートで、各桁はキーを区間に分けてスレッドごとに数え、区間の順に書き込むので安定になる
+class RenderQueue {
+
+private:
+	vector<uint64_t> m_Keys;
+	vector<uint32_t> m_Values;
+	vector<uint64_t> m_TempKeys;
+	vector<uint32_t> m_TempValues;
+
+	// 区間ごとの桁の出現数と書き込み位置 (区間数 × 256)
+	vector<uint32_t> m_Histograms;
+
+	RENDER_QUEUE_STATISTICS m_Statistics;
+
+	void CountStateChanges(uint32_t* pipelineChanges, uint32_t* meshChanges) const;
+
+public:
+	RenderQueue();
+	~RenderQueue() = default;
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	// キーを作る (depth は 0 が手前、1 が奥になるように正規化した奥行き)
+	static uint64_t MakeKey(RENDER_PASS pass, PIPELINE_HANDLE pipeline, MESH_HANDLE mesh, float depth);
+
+	// キーからパス・パイプライン・メッシュを取り出す
+	static void DecodeKey(uint64_t key, RENDER_PASS* pass, PIPELINE_HANDLE* pipeline, MESH_HANDLE* mesh);
+
+	// ドローを投入
+	void Submit(uint64_t key, uint32_t value);
+	void Reserve(size_t count);
+	void Clear();
+
+	// キーの昇順に並べ替える (jobSystem が nullptr なら呼び出し元のスレッドだけで並べ替える)
+	void Sort(JobSystem* jobSystem = nullptr);
+
+	// 並べ替えた後のキーと値
+	const uint64_t* GetKeys() const;
+	const uint32_t* GetValues() const;
+	uint32_t GetDrawNum() const;
+
+	RENDER_QUEUE_STATISTICS GetStatistics() const;
+
+	// drawNum 個のドローを並べ替える時間を std::sort と比べて計測する
+	static void RunBenchmark(uint32_t drawNum, uint32_t threadNum);
+};
@@ -0,0 +1,589 @@
+﻿#include "Scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+
+#include "Profiler.h"
+
+// オブジェクトが入っている格子の印 (削除したオブジェクトと大きなオブジェクト)
+static const uint32_t FREE_OBJECT_CELL = UINT32_MAX;
+static const uint32_t OVERSIZED_CELL = UINT32_MAX - 1;
+
+// ハッシュ表の空き
+static const uint32_t EMPTY_SLOT = UINT32_MAX;
+
+// 視錐台のすべての平面
+static const uint32_t FRUSTUM_ALL_PLANES = 0x3F;
+
+// ハッシュ表の最初の大きさ (2 のべき乗)
+static const uint32_t INITIAL_TABLE_SIZE = 64;
+
+// 格子の座標の上限 (これより遠いオブジェクトは大きなオブジェクトと一緒に並べる)
+static const float MAX_CELL_COORDINATE = 1.0e9f;
+
+// 格子の座標のハッシュ
+static uint32_t HashCell(int32_t x, int32_t y, int32_t z) {
+	return (static_cast<uint32_t>(x) * 73856093u) ^ (static_cast<uint32_t>(y) * 19349663u) ^ (static_cast<uint32_t>(z) * 83492791u);
+}
+
+// 点と境界箱の距離の 2 乗
+static float DistanceSquared(const float point[3], const float min[3], const float max[3]) {
+	float distance = 0.0f;
+	for (int a = 0; a < 3; ++a) {
+		float d = point[a] < min[a] ? min[a] - point[a] : (point[a] > max[a] ? point[a] - max[a] : 0.0f);
+		distance += d * d;
+	}
+	return distance;
+}
+
+// 境界箱どうしが重なるか
+static bool Overlaps(const BOUNDS& bounds, const XMFLOAT3& min, const XMFLOAT3& max) {
+	return bounds.Min.x <= max.x && bounds.Max.x >= min.x && bounds.Min.y <= max.y && bounds.Max.y >= min.y && bounds.Min.z <= max.z && bounds.Max.z >= min.z;
+}
+
+// 視錐台の平面のうち mask の平面と境界ボリュームを判定する (FrustumCuller と同じく、平面ごとに境界球と境界箱の半径の小さい方を使う)
+static bool IsInsideFrustum(const BOUNDS& bounds, const FRUSTUM& frustum, uint32_t mask) {
+	const XMFLOAT3& c = bounds.Center;
+	float ex = max(bounds.Max.x - c.x, c.x - bounds.Min.x);
+	float ey = max(bounds.Max.y - c.y, c.y - bounds.Min.y);
+	float ez = max(bounds.Max.z - c.z, c.z - bounds.Min.z);
+	for (int p = 0; p < 6; ++p) {
+		if ((mask & (1u << p)) == 0) { continue; }
+		const XMFLOAT4& plane = frustum.Planes[p];
+		float distance = plane.x * c.x + plane.y * c.y + plane.z * c.z + plane.w;
+		float boxRadius = fabsf(plane.x) * ex + fabsf(plane.y) * ey + fabsf(plane.z) * ez;
+		if (distance < -fminf(bounds.Radius, boxRadius)) { return false; }
+	}
+	return true;
+}
+
+// 視錐台の 8 つの角を囲む境界箱 (遠平面がないなど角が有限でなければ false)
+static bool GetFrustumBounds(const FRUSTUM& frustum, float min[3], float max[3]) {
+	for (int a = 0; a < 3; ++a) {
+		min[a] = FLT_MAX;
+		max[a] = -FLT_MAX;
+	}
+	for (int corner = 0; corner < 8; ++corner) {
+		// 左右・下上・近遠から 1 つずつ選んだ 3 平面の交点
+		const XMFLOAT4* planes[3] = { &frustum.Planes[corner & 1], &frustum.Planes[2 + ((corner >> 1) & 1)], &frustum.Planes[4 + ((corner >> 2) & 1)] };
+		XMVECTOR n[3];
+		for (int i = 0; i < 3; ++i) { n[i] = XMVectorSet(planes[i]->x, planes[i]->y, planes[i]->z, 0.0f); }
+		XMVECTOR c12 = XMVector3Cross(n[1], n[2]), c20 = XMVector3Cross(n[2], n[0]), c01 = XMVector3Cross(n[0], n[1]);
+		float determinant = XMVectorGetX(XMVector3Dot(n[0], c12));
+		if (fabsf(determinant) < 1e-12f) { return false; }
+		XMVECTOR sum = XMVectorAdd(XMVectorAdd(XMVectorScale(c12, planes[0]->w), XMVectorScale(c20, planes[1]->w)), XMVectorScale(c01, planes[2]->w));
+		XMFLOAT3 point;
+		XMStoreFloat3(&point, XMVectorScale(sum, -1.0f / determinant));
+		const float* p = &point.x;
+		for (int a = 0; a < 3; ++a) {
+			if (!isfinite(p[a])) { return false; }
+			min[a] = fminf(min[a], p[a]);
+			max[a] = fmaxf(max[a], p[a]);
+		}
+	}
+	return true;
+}
+
+// コンストラクタ
+Scene::Scene(float cellSize):
+	m_CellSize(cellSize),
+	m_InverseCellSize(1.0f / cellSize),
+	m_Objects(),
+	m_Values(),
+	m_Locations(),
+	m_FreeObjects(),
+	m_Cells(),
+	m_CellTable(INITIAL_TABLE_SIZE, EMPTY_SLOT),
+	m_Oversized(),
+	m_Statistics({ 0 }),
+	m_CullingStatistics({ 0 }) {
+
+}
+
+// 境界箱の中心が入る格子を選ぶ (格子に収まらなければ false)
+bool Scene::SelectCell(const BOUNDS& bounds, int32_t cell[3]) const {
+	const float* min = &bounds.Min.x;
+	const float* max = &bounds.Max.x;
+	for (int a = 0; a < 3; ++a) {
+		if (max[a] - min[a] > m_CellSize) { return false; }
+		float coordinate = floorf((min[a] + max[a]) * 0.5f * m_InverseCellSize);
+		if (!(fabsf(coordinate) < MAX_CELL_COORDINATE)) { return false; }
+		cell[a] = static_cast<int32_t>(coordinate);
+	}
+	return true;
+}
+
+// 座標の格子が入っているハッシュ表の位置 (なければ探索が止まった空きの位置)
+uint32_t Scene::FindSlot(int32_t x, int32_t y, int32_t z) const {
+	const uint32_t mask = static_cast<uint32_t>(m_CellTable.size()) - 1;
+	uint32_t slot = HashCell(x, y, z) & mask;
+	while (m_CellTable[slot] != EMPTY_SLOT) {
+		const SCENE_CELL& cell = m_Cells[m_CellTable[slot]];
+		if (cell.X == x && cell.Y == y && cell.Z == z) { break; }
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// 座標の格子の番号 (なければ EMPTY_SLOT)
+uint32_t Scene::FindCell(int32_t x, int32_t y, int32_t z) const { return m_CellTable[FindSlot(x, y, z)]; }
+
+// 座標の格子の番号 (なければ作る)
+uint32_t Scene::AcquireCell(const int32_t cell[3]) {
+	uint32_t slot = FindSlot(cell[0], cell[1], cell[2]);
+	if (m_CellTable[slot] != EMPTY_SLOT) { return m_CellTable[slot]; }
+
+	uint32_t index = static_cast<uint32_t>(m_Cells.size());
+	m_Cells.push_back({ cell[0], cell[1], cell[2], {} });
+	m_CellTable[slot] = index;
+
+	// 埋まっている割合が半分を超えたら広げる
+	if (m_Cells.size() * 2 > m_CellTable.size()) { GrowTable(); }
+	return index;
+}
+
+// 空いた格子を取り除く (最後の格子を空いた場所へ移す)
+void Scene::ReleaseCell(uint32_t cell) {
+	RemoveSlot(FindSlot(m_Cells[cell].X, m_Cells[cell].Y, m_Cells[cell].Z));
+
+	uint32_t last = static_cast<uint32_t>(m_Cells.size()) - 1;
+	if (cell != last) {
+		SCENE_CELL& moved = m_Cells[last];
+		m_CellTable[FindSlot(moved.X, moved.Y, moved.Z)] = cell;
+		for (const SCENE_ITEM& item : moved.Items) { m_Locations[item.Object].Cell = cell; }
+		m_Cells[cell] = move(moved);
+	}
+	m_Cells.pop_back();
+}
+
+// ハッシュ表から取り除き、後ろに続く項目を詰め直す (墓標を残さない)
+void Scene::RemoveSlot(uint32_t slot) {
+	const uint32_t mask = static_cast<uint32_t>(m_CellTable.size()) - 1;
+	uint32_t hole = slot;
+	uint32_t next = slot;
+	for (;;) {
+		m_CellTable[hole] = EMPTY_SLOT;
+		for (;;) {
+			next = (next + 1) & mask;
+			if (m_CellTable[next] == EMPTY_SLOT) { return; }
+
+			// 本来の位置が (hole, next] の外にある項目は hole へ移せる
+			const SCENE_CELL& cell = m_Cells[m_CellTable[next]];
+			uint32_t home = HashCell(cell.X, cell.Y, cell.Z) & mask;
+			bool between = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+			if (!between) { break; }
+		}
+		m_CellTable[hole] = m_CellTable[next];
+		hole = next;
+	}
+}
+
+// ハッシュ表を 2 倍に広げて入れ直す
+void Scene::GrowTable() {
+	m_CellTable.assign(m_CellTable.size() * 2, EMPTY_SLOT);
+	for (uint32_t i = 0; i < m_Cells.size(); ++i) { m_CellTable[FindSlot(m_Cells[i].X, m_Cells[i].Y, m_Cells[i].Z)] = i; }
+}
+
+// 番号の格子 (大きなオブジェクトの並びを含む)
+Scene::SCENE_CELL& Scene::GetCell(uint32_t cell) { return cell == OVERSIZED_CELL ? m_Oversized : m_Cells[cell]; }
+
+// 格子の末尾に入れる
+void Scene::Link(SCENE_OBJECT object, uint32_t cell, const BOUNDS& bounds) {
+	vector<SCENE_ITEM>& items = GetCell(cell).Items;
+	m_Locations[object] = { cell, static_cast<uint32_t>(items.size()) };
+	items.push_back({ bounds, object });
+}
+
+// 格子から外す (末尾の項目を空いた位置へ移し、格子が空いたら取り除く)
+void Scene::Unlink(SCENE_OBJECT object) {
+	const SCENE_LOCATION location = m_Locations[object];
+	const uint32_t cell = location.Cell;
+	vector<SCENE_ITEM>& items = GetCell(cell).Items;
+	if (location.Slot + 1 != items.size()) {
+		items[location.Slot] = items.back();
+		m_Locations[items[location.Slot].Object].Slot = location.Slot;
+	}
+	items.pop_back();
+	m_Locations[object].Cell = FREE_OBJECT_CELL;
+
+	if (cell != OVERSIZED_CELL && items.empty()) { ReleaseCell(cell); }
+}
+
+// オブジェクトを追加
+SCENE_OBJECT Scene::Insert(const RenderObject* object, const BOUNDS& bounds, uint32_t value) {
+
+	SCENE_OBJECT index;
+	if (!m_FreeObjects.empty()) {
+		index = m_FreeObjects.back();
+		m_FreeObjects.pop_back();
+		m_Objects[index] = object;
+		m_Values[index] = value;
+	}
+	else {
+		index = static_cast<SCENE_OBJECT>(m_Objects.size());
+		m_Objects.push_back(object);
+		m_Values.push_back(value);
+		m_Locations.push_back({ FREE_OBJECT_CELL, 0 });
+	}
+
+	int32_t cell[3];
+	Link(index, SelectCell(bounds, cell) ? AcquireCell(cell) : OVERSIZED_CELL, bounds);
+	++m_Statistics.ObjectNum;
+	return index;
+}
+
+// 境界ボリュームを更新
+void Scene::Move(SCENE_OBJECT object, const BOUNDS& bounds) {
+	++m_Statistics.MoveNum;
+
+	// 同じ格子に収まっていればその場で書き換える
+	int32_t cell[3];
+	bool fits = SelectCell(bounds, cell);
+	const SCENE_LOCATION location = m_Locations[object];
+	SCENE_CELL& entry = GetCell(location.Cell);
+	bool same = fits ? location.Cell != OVERSIZED_CELL && entry.X == cell[0] && entry.Y == cell[1] && entry.Z == cell[2] : location.Cell == OVERSIZED_CELL;
+	if (same) {
+		entry.Items[location.Slot].Bounds = bounds;
+		return;
+	}
+
+	Unlink(object);
+	Link(object, fits ? AcquireCell(cell) : OVERSIZED_CELL, bounds);
+	++m_Statistics.RebucketNum;
+}
+
+// オブジェクトを削除
+void Scene::Remove(SCENE_OBJECT object) {
+	if (m_Locations[object].Cell == FREE_OBJECT_CELL) { return; }
+	Unlink(object);
+	m_Objects[object] = nullptr;
+	m_FreeObjects.push_back(object);
+	--m_Statistics.ObjectNum;
+}
+
+// 容量を確保
+void Scene::Reserve(size_t count) {
+	m_Objects.reserve(count);
+	m_Values.reserve(count);
+	m_Locations.reserve(count);
+}
+
+// すべてのオブジェクトを削除
+void Scene::Clear() {
+	m_Objects.clear();
+	m_Values.clear();
+	m_Locations.clear();
+	m_FreeObjects.clear();
+	m_Cells.clear();
+	m_CellTable.assign(INITIAL_TABLE_SIZE, EMPTY_SLOT);
+	m_Oversized.Items.clear();
+	m_Statistics.ObjectNum = 0;
+}
+
+// 格子を半分ずつ広げた範囲が [min, max] と重なる格子を順に渡す
+// 範囲の格子が入っている格子より多ければ、入っている格子を順に見て座標で選ぶ
+void Scene::ForEachCell(const float min[3], const float max[3], const function<void(const SCENE_CELL& cell)>& function) const {
+
+	int64_t begin[3], end[3];
+	double cellNum = 1.0;
+	for (int a = 0; a < 3; ++a) {
+		begin[a] = static_cast<int64_t>(clamp(floor((static_cast<double>(min[a]) - m_CellSize * 0.5) * m_InverseCellSize), -2147483648.0, 2147483647.0));
+		end[a] = static_cast<int64_t>(clamp(floor((static_cast<double>(max[a]) + m_CellSize * 0.5) * m_InverseCellSize), -2147483648.0, 2147483647.0));
+		if (end[a] < begin[a]) { return; }
+		cellNum *= static_cast<double>(end[a] - begin[a] + 1);
+	}
+
+	if (cellNum > static_cast<double>(m_Cells.size())) {
+		for (const SCENE_CELL& cell : m_Cells) {
+			if (cell.X < begin[0] || cell.X > end[0] || cell.Y < begin[1] || cell.Y > end[1] || cell.Z < begin[2] || cell.Z > end[2]) { continue; }
+			function(cell);
+		}
+		return;
+	}
+	for (int64_t z = begin[2]; z <= end[2]; ++z) {
+		for (int64_t y = begin[1]; y <= end[1]; ++y) {
+			for (int64_t x = begin[0]; x <= end[0]; ++x) {
+				uint32_t cell = FindCell(static_cast<int32_t>(x), static_cast<int32_t>(y), static_cast<int32_t>(z));
+				if (cell != EMPTY_SLOT) { function(m_Cells[cell]); }
+			}
+		}
+	}
+}
+
+// 境界箱が [min, max] と重なるオブジェクト
+uint32_t Scene::QueryRegion(const XMFLOAT3& min, const XMFLOAT3& max, vector<SCENE_OBJECT>* results) const {
+	results->clear();
+
+	auto gather = [&](const SCENE_CELL& cell) {
+		for (const SCENE_ITEM& item : cell.Items) {
+			if (Overlaps(item.Bounds, min, max)) { results->push_back(item.Object); }
+		}
+	};
+	gather(m_Oversized);
+
+	// 中心がこの範囲の格子に入るオブジェクトだけが重なりうる
+	ForEachCell(&min.x, &max.x, gather);
+	return static_cast<uint32_t>(results->size());
+}
+
+// 視錐台に入るオブジェクト
+uint32_t Scene::QueryFrustum(const FRUSTUM& frustum, vector<SCENE_OBJECT>* results) {
+	PROFILE_ZONE("Scene::QueryFrustum");
+
+	results->clear();
+	for (const SCENE_ITEM& item : m_Oversized.Items) {
+		if (IsInsideFrustum(item.Bounds, frustum, FRUSTUM_ALL_PLANES)) { results->push_back(item.Object); }
+	}
+
+	// 格子を広げた箱 (中心と各軸の半分の長さ) を平面と判定する
+	// 全て内側なら中のオブジェクトは判定せず、一部だけ入るなら箱がまたぐ平面だけでオブジェクトを判定する
+	const float extent = m_CellSize;
+	float planeRadius[6];
+	for (int p = 0; p < 6; ++p) { planeRadius[p] = (fabsf(frustum.Planes[p].x) + fabsf(frustum.Planes[p].y) + fabsf(frustum.Planes[p].z)) * extent; }
+	auto testCell = [&](const SCENE_CELL& cell) {
+		float center[3] = { (cell.X + 0.5f) * m_CellSize, (cell.Y + 0.5f) * m_CellSize, (cell.Z + 0.5f) * m_CellSize };
+		uint32_t straddled = 0;
+		for (int p = 0; p < 6; ++p) {
+			const XMFLOAT4& plane = frustum.Planes[p];
+			float distance = plane.x * center[0] + plane.y * center[1] + plane.z * center[2] + plane.w;
+			if (distance < -planeRadius[p]) { return; }
+			if (distance < planeRadius[p]) { straddled |= 1u << p; }
+		}
+		for (const SCENE_ITEM& item : cell.Items) {
+			if (straddled == 0 || IsInsideFrustum(item.Bounds, frustum, straddled)) { results->push_back(item.Object); }
+		}
+	};
+
+	// 視錐台の角から求めた境界箱の範囲の格子だけを見る (角が求まらなければすべての格子を見る)
+	float frustumMin[3], frustumMax[3];
+	if (GetFrustumBounds(frustum, frustumMin, frustumMax)) { ForEachCell(frustumMin, frustumMax, testCell); }
+	else {
+		for (const SCENE_CELL& cell : m_Cells) { testCell(cell); }
+	}
+
+	uint32_t visibleNum = static_cast<uint32_t>(results->size());
+	m_CullingStatistics.Tested = m_Statistics.ObjectNum;
+	m_CullingStatistics.Visible = visibleNum;
+	m_CullingStatistics.Culled = m_Statistics.ObjectNum - visibleNum;
+	return visibleNum;
+}
+
+// 境界箱が point に最も近いオブジェクト
+SCENE_OBJECT Scene::FindNearest(const XMFLOAT3& point, float maxDistance, float* distance) const {
+
+	const float* p = &point.x;
+	SCENE_OBJECT nearest = INVALID_SCENE_OBJECT;
+	float best = maxDistance < FLT_MAX ? maxDistance * maxDistance : FLT_MAX;
+
+	auto visit = [&](const SCENE_CELL& cell) {
+		for (const SCENE_ITEM& item : cell.Items) {
+			float d = DistanceSquared(p, &item.Bounds.Min.x, &item.Bounds.Max.x);
+			if (d < best || (nearest == INVALID_SCENE_OBJECT && d <= best)) {
+				best = d;
+				nearest = item.Object;
+			}
+		}
+	};
+	visit(m_Oversized);
+
+	// 点の格子から 1 つずつ外側の殻 (チェビシェフ距離が ring の格子) を見ていく
+	// 殻 ring の格子のオブジェクトは、中心が (ring - 1) 格子以上、境界箱が (ring - 1.5) 格子以上離れている
+	int32_t origin[3];
+	bool inGrid = true;
+	for (int a = 0; a < 3; ++a) {
+		float coordinate = floorf(p[a] * m_InverseCellSize);
+		inGrid = inGrid && fabsf(coordinate) < MAX_CELL_COORDINATE;
+		origin[a] = inGrid ? static_cast<int32_t>(coordinate) : 0;
+	}
+
+	uint64_t visitedCellNum = 0;
+	for (int32_t ring = 0; inGrid; ++ring) {
+		float bound = max(0.0f, (ring - 1.5f) * m_CellSize);
+		if (bound * bound > best) { break; }
+
+		// 殻の格子が入っている格子より多くなったら、残りは入っている格子を順に見る
+		uint64_t side = static_cast<uint64_t>(ring) * 2 + 1;
+		uint64_t ringCellNum = ring == 0 ? 1 : side * side * side - (side - 2) * (side - 2) * (side - 2);
+		if (visitedCellNum + ringCellNum > m_Cells.size()) {
+			for (const SCENE_CELL& cell : m_Cells) {
+				int32_t chebyshev = max(max(abs(cell.X - origin[0]), abs(cell.Y - origin[1])), abs(cell.Z - origin[2]));
+				if (chebyshev < ring) { continue; }
+				float cellMin[3] = { (cell.X - 0.5f) * m_CellSize, (cell.Y - 0.5f) * m_CellSize, (cell.Z - 0.5f) * m_CellSize };
+				float cellMax[3] = { cellMin[0] + m_CellSize * 2.0f, cellMin[1] + m_CellSize * 2.0f, cellMin[2] + m_CellSize * 2.0f };
+				if (DistanceSquared(p, cellMin, cellMax) > best) { continue; }
+				visit(cell);
+			}
+			break;
+		}
+		visitedCellNum += ringCellNum;
+
+		for (int32_t z = -ring; z <= ring; ++z) {
+			for (int32_t y = -ring; y <= ring; ++y) {
+				bool face = abs(z) == ring || abs(y) == ring;
+				for (int32_t x = -ring; x <= ring; x += face ? 1 : ring * 2) {
+					uint32_t cell = FindCell(origin[0] + x, origin[1] + y, origin[2] + z);
+					if (cell != EMPTY_SLOT) { visit(m_Cells[cell]); }
+				}
+			}
+		}
+	}
+
+	if (distance != nullptr) { *distance = nearest != INVALID_SCENE_OBJECT ? sqrtf(best) : FLT_MAX; }
+	return nearest;
+}
+
+// オブジェクトを取得
+const RenderObject* Scene::GetRenderObject(SCENE_OBJECT object) const { return m_Objects[object]; }
+
+// 境界ボリュームを取得
+const BOUNDS& Scene::GetBounds(SCENE_OBJECT object) const {
+	const SCENE_LOCATION& location = m_Locations[object];
+	return (location.Cell == OVERSIZED_CELL ? m_Oversized : m_Cells[location.Cell]).Items[location.Slot].Bounds;
+}
+
+// 呼び出し元が使う値を取得
+uint32_t Scene::GetValue(SCENE_OBJECT object) const { return m_Values[object]; }
+
+// オブジェクトの数を取得
+uint32_t Scene::GetObjectNum() const { return m_Statistics.ObjectNum; }
+
+// 統計情報を取得
+SCENE_STATISTICS Scene::GetStatistics() const {
+	SCENE_STATISTICS statistics = m_Statistics;
+	statistics.CellNum = static_cast<uint32_t>(m_Cells.size());
+	statistics.OversizedNum = static_cast<uint32_t>(m_Oversized.Items.size());
+	return statistics;
+}
+
+// 直前の QueryFrustum の統計情報を取得
+CULLING_STATISTICS Scene::GetCullingStatistics() const { return m_CullingStatistics; }
+
+// objectNum 個のオブジェクトで更新時間と問い合わせの速さを計測して出力する
+void Scene::RunBenchmark(uint32_t objectNum, float moveRate) {
+
+	const uint32_t frameNum = 60;
+	const uint32_t queryNum = 10000;
+	const uint32_t checkNum = 100;
+	objectNum = max(objectNum, 1u);
+
+	// 8 単位の立方体に 1 つ程度の密度で、大きさの違うオブジェクトを並べる (1 万個に 1 つは格子に収まらない大きさにする)
+	const float side = cbrtf(objectNum * 8.0f);
+	mt19937 random(1);
+	uniform_real_distribution<float> position(0.0f, side);
+	uniform_real_distribution<float> size(0.1f, 1.0f);
+	uniform_real_distribution<float> offset(-0.5f, 0.5f);
+	auto makeBounds = [](const XMFLOAT3& center, float extent) {
+		BOUNDS bounds;
+		bounds.Center = center;
+		bounds.Radius = extent * 1.7320508f;
+		bounds.Min = XMFLOAT3(center.x - extent, center.y - extent, center.z - extent);
+		bounds.Max = XMFLOAT3(center.x + extent, center.y + extent, center.z + extent);
+		return bounds;
+	};
+
+	Scene scene;
+	scene.Reserve(objectNum);
+	vector<float> extents(objectNum);
+	auto insertBegin = chrono::steady_clock::now();
+	for (uint32_t i = 0; i < objectNum; ++i) {
+		extents[i] = i % 10000 == 9999 ? size(random) * 20.0f : size(random);
+		scene.Insert(nullptr, makeBounds(XMFLOAT3(position(random), position(random), position(random)), extents[i]), i);
+	}
+	double insertTime = chrono::duration<double, milli>(chrono::steady_clock::now() - insertBegin).count();
+
+	// 毎フレーム一部のオブジェクトを少しずつ動かす (立方体の外に出たら反対側へ回す)
+	const uint32_t moveNum = max(static_cast<uint32_t>(objectNum * moveRate), 1u);
+	uniform_int_distribution<uint32_t> pick(0, objectNum - 1);
+	vector<SCENE_OBJECT> moved(moveNum);
+	vector<BOUNDS> targets(moveNum);
+	double moveTime = 0.0;
+	SCENE_STATISTICS before = scene.GetStatistics();
+	for (uint32_t frame = 0; frame < frameNum; ++frame) {
+		for (uint32_t i = 0; i < moveNum; ++i) {
+			moved[i] = pick(random);
+			XMFLOAT3 center = scene.GetBounds(moved[i]).Center;
+			center.x = fmodf(center.x + offset(random) + side, side);
+			center.y = fmodf(center.y + offset(random) + side, side);
+			center.z = fmodf(center.z + offset(random) + side, side);
+			targets[i] = makeBounds(center, extents[moved[i]]);
+		}
+		auto begin = chrono::steady_clock::now();
+		for (uint32_t i = 0; i < moveNum; ++i) { scene.Move(moved[i], targets[i]); }
+		moveTime += chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+	}
+	SCENE_STATISTICS after = scene.GetStatistics();
+
+	// 1 回分の時間 (ミリ秒) の平均
+	auto measure = [](uint32_t repeatNum, const function<void(uint32_t)>& function) {
+		auto begin = chrono::steady_clock::now();
+		for (uint32_t repeat = 0; repeat < repeatNum; ++repeat) { function(repeat); }
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count() / repeatNum;
+	};
+
+	// 問い合わせ (一辺 10 の箱・最も近いオブジェクト・中心から外を向いたカメラの視錐台)
+	vector<XMFLOAT3> points(queryNum);
+	for (XMFLOAT3& point : points) { point = XMFLOAT3(position(random), position(random), position(random)); }
+	vector<SCENE_OBJECT> results;
+	uint64_t regionResultNum = 0;
+	double regionTime = measure(queryNum, [&](uint32_t i) {
+		XMFLOAT3 min(points[i].x - 5.0f, points[i].y - 5.0f, points[i].z - 5.0f), max(points[i].x + 5.0f, points[i].y + 5.0f, points[i].z + 5.0f);
+		regionResultNum += scene.QueryRegion(min, max, &results);
+	});
+	vector<SCENE_OBJECT> nearest(queryNum);
+	double nearestTime = measure(queryNum, [&](uint32_t i) { nearest[i] = scene.FindNearest(points[i]); });
+
+	XMVECTOR eye = XMVectorSet(side * 0.5f, side * 0.5f, side * 0.5f, 0.0f);
+	XMMATRIX view = XMMatrixLookAtRH(eye, XMVectorAdd(eye, XMVectorSet(1.0f, 0.2f, 0.3f, 0.0f)), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	FRUSTUM frustum = FrustumCuller::ExtractFrustum(XMMatrixMultiply(view, XMMatrixPerspectiveFovRH(XMConvertToRadians(60.0f), 16.0f / 9.0f, 0.1f, side * 0.25f)));
+	double frustumTime = measure(20, [&](uint32_t) { scene.QueryFrustum(frustum, &results); });
+	vector<SCENE_OBJECT> frustumResults = results;
+
+	// 比較のためにすべてのオブジェクトを FrustumCuller で判定する
+	FrustumCuller culler;
+	culler.Reserve(objectNum);
+	for (uint32_t i = 0; i < objectNum; ++i) { culler.Add(scene.GetBounds(i)); }
+	double cullerTime = measure(20, [&](uint32_t) { culler.Cull(frustum); });
+
+	// 総当たりと比べる (視錐台の境界箱と重ならない格子は除くので、FrustumCuller で残ってもその境界箱の外にあるものは除かれる)
+	bool matched = true;
+	vector<SCENE_OBJECT> expected;
+	float frustumMin[3], frustumMax[3];
+	GetFrustumBounds(frustum, frustumMin, frustumMax);
+	XMFLOAT3 frustumLower(frustumMin[0], frustumMin[1], frustumMin[2]), frustumUpper(frustumMax[0], frustumMax[1], frustumMax[2]);
+	for (uint32_t i = 0; i < culler.GetVisibleNum(); ++i) {
+		SCENE_OBJECT object = culler.GetVisible()[i];
+		if (Overlaps(scene.GetBounds(object), frustumLower, frustumUpper)) { expected.push_back(object); }
+	}
+	sort(frustumResults.begin(), frustumResults.end());
+	matched = matched && includes(culler.GetVisible(), culler.GetVisible() + culler.GetVisibleNum(), frustumResults.begin(), frustumResults.end()) && includes(frustumResults.begin(), frustumResults.end(), expected.begin(), expected.end());
+	for (uint32_t i = 0; i < checkNum; ++i) {
+		XMFLOAT3 min(points[i].x - 5.0f, points[i].y - 5.0f, points[i].z - 5.0f), max(points[i].x + 5.0f, points[i].y + 5.0f, points[i].z + 5.0f);
+		scene.QueryRegion(min, max, &results);
+		sort(results.begin(), results.end());
+		expected.clear();
+		float best = FLT_MAX;
+		for (uint32_t object = 0; object < objectNum; ++object) {
+			const BOUNDS& bounds = scene.GetBounds(object);
+			if (Overlaps(bounds, min, max)) { expected.push_back(object); }
+			best = fminf(best, DistanceSquared(&points[i].x, &bounds.Min.x, &bounds.Max.x));
+		}
+		const BOUNDS& found = scene.GetBounds(nearest[i]);
+		matched = matched && results == expected && DistanceSquared(&points[i].x, &found.Min.x, &found.Max.x) == best;
+	}
+
+	SCENE_STATISTICS statistics = scene.GetStatistics();
+	uint64_t rebucketNum = after.RebucketNum - before.RebucketNum;
+	cout << "objects : " << objectNum << " (" << statistics.CellNum << " cells, " << statistics.OversizedNum << " oversized)" << endl;
+	cout << "insert : " << insertTime << " ms" << endl;
+	cout << "moved / frame : " << moveNum << " (" << rebucketNum / frameNum << " rebucketed)" << endl;
+	cout << "update / frame : " << moveTime / frameNum << " ms (" << moveNum * frameNum / (moveTime * 1000.0) << " M moves/s)" << endl;
+	cout << "region query : " << regionTime * 1000.0 << " us (" << 1000.0 / regionTime << " queries/s, " << regionResultNum / queryNum << " objects)" << endl;
+	cout << "nearest query : " << nearestTime * 1000.0 << " us (" << 1000.0 / nearestTime << " queries/s)" << endl;
+	cout << "frustum query : " << frustumTime << " ms (" << frustumResults.size() << " visible)" << endl;
+	cout << "frustum all objects : " << cullerTime << " ms" << endl;
+	cout << "result : " << (matched ? "matched" : "MISMATCH") << endl;
+}
@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include <cfloat>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "FrustumCuller.h"
+#include "RenderObject.h"
+
+using namespace std;
+using namespace DirectX;
+
+// シーンのオブジェクトの番号
+typedef uint32_t SCENE_OBJECT;
+static const SCENE_OBJECT INVALID_SCENE_OBJECT = UINT32_MAX;
+
+// シーンの統計情報
+struct SCENE_STATISTICS {
+	uint32_t ObjectNum;
+	uint32_t CellNum;        // オブジェクトが入っている格子の数
+	uint32_t OversizedNum;   // 格子に収まらない大きさで、別に並べているオブジェクトの数
+	uint64_t MoveNum;        // Move を呼んだ回数
+	uint64_t RebucketNum;    // そのうち格子を移った回数
+};
+
+// シーン
+// オブジェクトを境界箱の中心が入る格子に入れる、ハッシュした緩い一様格子
+// 格子の大きさまでのオブジェクトは、格子を全方向に半分ずつ広げた範囲に必ず収まるので、その範囲だけ見ればよい
+// それより大きいオブジェクトは別に並べて、問い合わせのたびにすべて判定する
+// 境界ボリュームは格子ごとに詰めて持ち、問い合わせでは格子の中を順に読む
+// Move では中心が格子の外に出たときだけ入れ替え、格子は空いたら取り除く (座標に上限はない)
+class Scene {
+
+private:
+	// 格子の中のオブジェクト
+	struct SCENE_ITEM {
+		BOUNDS Bounds;
+		SCENE_OBJECT Object;
+	};
+
+	// オブジェクトが入っている格子と、格子の Items の中の位置
+	struct SCENE_LOCATION {
+		uint32_t Cell;
+		uint32_t Slot;
+	};
+
+	// 格子
+	struct SCENE_CELL {
+		int32_t X;
+		int32_t Y;
+		int32_t Z;
+		vector<SCENE_ITEM> Items;
+	};
+
+	float m_CellSize;
+	float m_InverseCellSize;
+
+	// オブジェクト (SoA、番号は削除したものから使い回す)
+	vector<const RenderObject*> m_Objects;
+	vector<uint32_t> m_Values;
+	vector<SCENE_LOCATION> m_Locations;
+	vector<SCENE_OBJECT> m_FreeObjects;
+
+	// 格子 (詰めて並べ、座標から番号へはハッシュ表の線形探索で引く)
+	vector<SCENE_CELL> m_Cells;
+	vector<uint32_t> m_CellTable;
+	SCENE_CELL m_Oversized;
+
+	SCENE_STATISTICS m_Statistics;
+	CULLING_STATISTICS m_CullingStatistics;
+
+	bool SelectCell(const BOUNDS& bounds, int32_t cell[3]) const;
+	uint32_t FindSlot(int32_t x, int32_t y, int32_t z) const;
+	uint32_t FindCell(int32_t x, int32_t y, int32_t z) const;
+	uint32_t AcquireCell(const int32_t cell[3]);
+	void ReleaseCell(uint32_t cell);
+	void RemoveSlot(uint32_t slot);
+	void GrowTable();
+	SCENE_CELL& GetCell(uint32_t cell);
+	void ForEachCell(const float min[3], const float max[3], const function<void(const SCENE_CELL& cell)>& function) const;
+	void Link(SCENE_OBJECT object, uint32_t cell, const BOUNDS& bounds);
+	void Unlink(SCENE_OBJECT object);
+
+public:
+	// cellSize は格子の 1 辺の長さ (オブジェクトの大きさの 2 倍程度にする)
+	Scene(float cellSize = 4.0f);
+	~Scene() = default;
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	// オブジェクトを境界ボリュームと一緒に追加 (value は呼び出し元が使う値で、メッシュのハンドルなどを入れる)
+	SCENE_OBJECT Insert(const RenderObject* object, const BOUNDS& bounds, uint32_t value = 0);
+
+	// 境界ボリュームを更新 (中心が格子の外に出たときだけ格子を入れ替える)
+	void Move(SCENE_OBJECT object, const BOUNDS& bounds);
+
+	void Remove(SCENE_OBJECT object);
+	void Reserve(size_t count);
+	void Clear();
+
+	// 境界箱が [min, max] と重なるオブジェクト
+	uint32_t QueryRegion(const XMFLOAT3& min, const XMFLOAT3& max, vector<SCENE_OBJECT>* results) const;
+
+	// 視錐台に入るオブジェクト (判定は FrustumCuller と同じで、視錐台に全て入る格子のオブジェクトは判定しない)
+	// 視錐台の角を囲む境界箱と重ならない格子はまとめて除くので、FrustumCuller より少なくなることがある
+	uint32_t QueryFrustum(const FRUSTUM& frustum, vector<SCENE_OBJECT>* results);
+
+	// 境界箱が point に最も近いオブジェクト (maxDistance より遠ければ INVALID_SCENE_OBJECT)
+	SCENE_OBJECT FindNearest(const XMFLOAT3& point, float maxDistance = FLT_MAX, float* distance = nullptr) const;
+
+	const RenderObject* GetRenderObject(SCENE_OBJECT object) const;
+	const BOUNDS& GetBounds(SCENE_OBJECT object) const;
+	uint32_t GetValue(SCENE_OBJECT object) const;
+	uint32_t GetObjectNum() const;
+	SCENE_STATISTICS GetStatistics() const;
+	CULLING_STATISTICS GetCullingStatistics() const;
+
+	// objectNum 個のオブジェクトを並べ、毎フレーム moveRate の割合を動かして更新時間と問い合わせの速さを計測する
+	static void RunBenchmark(uint32_t objectNum, float moveRate);
+};
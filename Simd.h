@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include <cstdint>
+
+// x86 系のターゲットであれば SSE / AVX2 のカーネルを有効にする
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// AVX2 カーネル用の関数属性
+// MSVC はそのまま組み込み関数を使えるが、GCC / Clang は関数単位でターゲットを指定する
+#if defined(SIMD_X86) && !defined(_MSC_VER)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define SIMD_TARGET_AVX2
+#endif
+
+// AVX2 と FMA が実行時に使えるかどうか
+inline bool IsAVX2Supported() {
+#if defined(SIMD_X86)
+	static const bool supported = [] {
+#if defined(_MSC_VER)
+		int info[4] = {};
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+		if (!osxsave || !fma) { return false; }
+		if ((_xgetbv(0) & 0x6) != 0x6) { return false; }
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}();
+	return supported;
+#else
+	return false;
+#endif
+}
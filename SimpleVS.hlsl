@@ -12,12 +12,19 @@ struct VSOutput
     float4 Color : COLOR;
 };
 
-// 萔obt@
-cbuffer Transform : register(b0)
+// t[Ƃ̒萔obt@
+cbuffer FrameConstants : register(b0)
 {
-    float4x4 World : packoffset(c0);
-    float4x4 View : packoffset(c4);
-    float4x4 Project : packoffset(c8);
+    float4x4 View : packoffset(c0);
+    float4x4 Project : packoffset(c4);
+    float4x4 ViewProject : packoffset(c8); // View  Project |
+    float4 PositionScale : packoffset(c12); // ʎqʒu͈̔͂ɖ߂l
+};
+
+// IuWFNgƂ̒萔obt@
+cbuffer ObjectConstants : register(b1)
+{
+    float4x4 WorldViewProject : packoffset(c0); // CPU ł܂Ƃ߂Ċ|
 };
 
 // Gg[|Cg
@@ -25,10 +32,8 @@ VSOutput main(VSInput input)
 {
     VSOutput output = (VSOutput) 0;
     
-    float4 localPos = float4(input.Position, 1.0f);
-    float4 worldPos = mul(World, localPos);
-    float4 viewPos = mul(View, worldPos);
-    float4 projectPos = mul(Project, viewPos);
+    float4 localPos = float4(input.Position * PositionScale.xyz, 1.0f);
+    float4 projectPos = mul(WorldViewProject, localPos);
     
     output.Position = projectPos;
     output.Color = input.Color;
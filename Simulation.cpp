@@ -0,0 +1,277 @@
+﻿#include "Simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <tuple>
+
+#include "Profiler.h"
+
+// シーンの格子の 1 辺の長さ (オブジェクトが 1 ステップで動く距離より十分大きくする)
+static const float SIMULATION_CELL_SIZE = 1.0f;
+
+// 1 単位の立方体あたりのオブジェクトの数
+static const float SIMULATION_DENSITY = 2.0f;
+
+// 計測で 1 つのスナップショットごとに確かめる行列の数
+static const uint32_t CHECK_WORLD_NUM = 16;
+
+// 今の時刻 (steady_clock のナノ秒)
+static uint64_t GetNanoseconds() {
+	return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// コンストラクタ (オブジェクトは原点の奥に、数に合わせて広げた立方体の中に並べる)
+Simulation::Simulation(uint32_t objectNum, const FRUSTUM& frustum, double stepRate, bool paced):
+	m_Bodies(objectNum),
+	m_Objects(objectNum),
+	m_Scene(make_unique<Scene>(SIMULATION_CELL_SIZE)),
+	m_TimeStep(1.0 / max(stepRate, 1.0)),
+	m_Paced(paced),
+	m_Visible(),
+	m_Snapshots(),
+	m_Inputs(),
+	m_InputFrame(0),
+	m_Thread(),
+	m_Exit(false),
+	m_Statistics({ 0 }) {
+
+	const float side = max(cbrtf(objectNum / SIMULATION_DENSITY), 1.0f);
+	mt19937 random(1);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	m_Scene->Reserve(objectNum);
+	for (uint32_t i = 0; i < objectNum; ++i) {
+		SIMULATION_BODY& body = m_Bodies[i];
+		body.Center = XMFLOAT3((unit(random) - 0.5f) * side, (unit(random) - 0.5f) * side, -unit(random) * side);
+		body.Radius = 0.05f + 0.35f * unit(random);
+		body.Speed = 0.5f + 1.5f * unit(random);
+		body.Phase = XM_2PI * unit(random);
+		body.Scale = 0.03f + 0.03f * unit(random);
+	}
+
+	// 近くにあるオブジェクトが並ぶように格子の順に並べ替える (毎ステップ順に動かすとき、シーンの同じ格子を続けて触るようにする)
+	auto cellOf = [](const SIMULATION_BODY& body) {
+		return make_tuple(floorf(body.Center.z / SIMULATION_CELL_SIZE), floorf(body.Center.y / SIMULATION_CELL_SIZE), floorf(body.Center.x / SIMULATION_CELL_SIZE));
+	};
+	sort(m_Bodies.begin(), m_Bodies.end(), [&cellOf](const SIMULATION_BODY& a, const SIMULATION_BODY& b) { return cellOf(a) < cellOf(b); });
+
+	for (uint32_t i = 0; i < objectNum; ++i) {
+		m_Objects[i] = m_Scene->Insert(nullptr, GetBounds(m_Bodies[i], GetPosition(m_Bodies[i], 0.0)), i);
+	}
+
+	// 最初の入力 (描画側が何も渡さないうちはこの視錐台を使う)
+	SubmitInput(frustum);
+}
+
+// デストラクタ
+Simulation::~Simulation() {
+	Stop();
+}
+
+// シミュレーションのスレッドを開始
+void Simulation::Start() {
+	if (m_Thread.joinable()) { return; }
+	m_Exit = false;
+	m_Thread = thread(&Simulation::ThreadMain, this);
+}
+
+// シミュレーションのスレッドを停止 (処理中のステップが終わるまで待つ)
+void Simulation::Stop() {
+	if (!m_Thread.joinable()) { return; }
+	m_Exit = true;
+	m_Thread.join();
+}
+
+// シミュレーションのスレッドの処理
+void Simulation::ThreadMain() {
+	auto origin = chrono::steady_clock::now();
+	uint64_t step = 0;
+	while (!m_Exit.load(memory_order_relaxed)) {
+		uint64_t next = step + 1;
+
+		// 次のステップの時刻まで眠り、遅れていたら間のステップを飛ばす
+		if (m_Paced) {
+			double elapsed = chrono::duration<double>(chrono::steady_clock::now() - origin).count();
+			uint64_t target = static_cast<uint64_t>(elapsed / m_TimeStep);
+			if (target < next) {
+				this_thread::sleep_until(origin + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(next * m_TimeStep)));
+				continue;
+			}
+			m_Statistics.SkippedNum += target - next;
+			next = target;
+		}
+
+		auto begin = chrono::steady_clock::now();
+		Step(next);
+		double time = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+		m_Statistics.TotalStepTime += time;
+		m_Statistics.MaxStepTime = max(m_Statistics.MaxStepTime, time);
+		++m_Statistics.StepNum;
+		step = next;
+	}
+}
+
+// 1 ステップ進めてスナップショットを公開する
+void Simulation::Step(uint64_t step) {
+	PROFILE_ZONE("Simulation::Step");
+
+	double time = step * m_TimeStep;
+
+	// オブジェクトを動かす (格子を移ったものだけシーンの中で入れ替わる)
+	for (size_t i = 0; i < m_Bodies.size(); ++i) {
+		m_Scene->Move(m_Objects[i], GetBounds(m_Bodies[i], GetPosition(m_Bodies[i], time)));
+	}
+
+	// 描画側から新しい入力が届いていれば受け取る (なければ前の入力を使い続ける)
+	if (m_Inputs.Update()) { ++m_Statistics.InputNum; }
+	const SIMULATION_INPUT& input = m_Inputs.GetReadBuffer();
+
+	// 視錐台に入るものを書き込み用の領域に詰める (領域の配列は使い回すので、大きさが落ち着けば確保しない)
+	m_Scene->QueryFrustum(input.Frustum, &m_Visible);
+
+	SIMULATION_SNAPSHOT& snapshot = m_Snapshots.GetWriteBuffer();
+	snapshot.Step = step;
+	snapshot.InputFrame = input.Frame;
+	snapshot.Time = time;
+	snapshot.Visible.resize(m_Visible.size());
+	snapshot.Worlds.resize(m_Visible.size());
+	for (size_t i = 0; i < m_Visible.size(); ++i) {
+		uint32_t body = m_Scene->GetValue(m_Visible[i]);
+		snapshot.Visible[i] = body;
+		GetWorld(m_Bodies[body], m_Scene->GetBounds(m_Visible[i]).Center, &snapshot.Worlds[i]);
+	}
+	snapshot.PublishTime = GetNanoseconds();
+
+	if (m_Snapshots.Publish()) { ++m_Statistics.DroppedNum; }
+}
+
+// 時刻 time の位置
+XMFLOAT3 Simulation::GetPosition(const SIMULATION_BODY& body, double time) {
+	double angle = body.Speed * time + body.Phase;
+	float c = static_cast<float>(cos(angle));
+	float s = static_cast<float>(sin(angle));
+	return XMFLOAT3(body.Center.x + body.Radius * c, body.Center.y + body.Radius * 0.5f * s, body.Center.z + body.Radius * s);
+}
+
+// 位置 position にあるときの境界ボリューム
+BOUNDS Simulation::GetBounds(const SIMULATION_BODY& body, const XMFLOAT3& position) {
+	BOUNDS bounds;
+	bounds.Center = position;
+	bounds.Radius = body.Scale * 1.7320508f;
+	bounds.Min = XMFLOAT3(position.x - body.Scale, position.y - body.Scale, position.z - body.Scale);
+	bounds.Max = XMFLOAT3(position.x + body.Scale, position.y + body.Scale, position.z + body.Scale);
+	return bounds;
+}
+
+// ワールド行列
+void Simulation::GetWorld(const SIMULATION_BODY& body, const XMFLOAT3& position, XMFLOAT4X4* world) {
+	XMStoreFloat4x4(world, XMMatrixMultiply(XMMatrixScaling(body.Scale, body.Scale, body.Scale), XMMatrixTranslation(position.x, position.y, position.z)));
+}
+
+// 最後に公開されたスナップショット
+const SIMULATION_SNAPSHOT& Simulation::Acquire(bool* updated) {
+	bool received = m_Snapshots.Update();
+	++m_Statistics.AcquireNum;
+	if (received) { ++m_Statistics.UpdatedNum; }
+	if (updated != nullptr) { *updated = received; }
+	return m_Snapshots.GetReadBuffer();
+}
+
+// このフレームの視錐台を渡す
+void Simulation::SubmitInput(const FRUSTUM& frustum) {
+	SIMULATION_INPUT& input = m_Inputs.GetWriteBuffer();
+	input.Frame = m_InputFrame++;
+	input.Frustum = frustum;
+	m_Inputs.Publish();
+}
+
+// 統計情報を取得
+SIMULATION_STATISTICS Simulation::GetStatistics() const {
+	return m_Statistics;
+}
+
+// ステップの処理時間と受け渡しの速さを計測する
+void Simulation::RunBenchmark(uint32_t objectNum, uint32_t stepNum) {
+
+	objectNum = max(objectNum, 1u);
+	stepNum = max(stepNum, 1u);
+
+	// 描画と同じカメラ (16:9) で、フレームごとに左右へ振った向きの視錐台
+	vector<FRUSTUM> frustums;
+	auto makeFrustum = [](uint64_t frame) {
+		float yaw = 0.3f * sinf(frame * 0.05f);
+		XMVECTOR eye = XMVectorSet(0.0f, 0.0f, 5.0f, 0.0f);
+		XMMATRIX view = XMMatrixLookAtRH(eye, XMVectorAdd(eye, XMVectorSet(sinf(yaw), 0.0f, -cosf(yaw), 0.0f)), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		return FrustumCuller::ExtractFrustum(XMMatrixMultiply(view, XMMatrixPerspectiveFovRH(XMConvertToRadians(37.5f), 16.0f / 9.0f, 1.0f, 1000.0f)));
+	};
+	frustums.push_back(makeFrustum(0));
+
+	Simulation simulation(objectNum, frustums.back(), 60.0, false);
+
+	// 境界球が視錐台の内側にかかっているか (丸めの分だけ緩める)
+	auto inside = [](const FRUSTUM& frustum, const XMFLOAT4X4& world, float radius) {
+		for (const XMFLOAT4& plane : frustum.Planes) {
+			if (plane.x * world._41 + plane.y * world._42 + plane.z * world._43 + plane.w < -radius - 1e-4f) { return false; }
+		}
+		return true;
+	};
+
+	// 受け取ったスナップショットは、ステップが進んでいることと、一部の行列が時刻から求め直したものと一致することを確かめる
+	uint64_t lastStep = 0;
+	uint64_t lastInputFrame = 0;
+	uint64_t visibleNum = 0;
+	uint64_t latency = 0;
+	uint64_t brokenNum = 0;
+	double acquireTime = 0.0;
+
+	auto begin = chrono::steady_clock::now();
+	simulation.Start();
+	while (lastStep < stepNum) {
+		auto acquireBegin = chrono::steady_clock::now();
+		bool updated = false;
+		const SIMULATION_SNAPSHOT& snapshot = simulation.Acquire(&updated);
+		acquireTime += chrono::duration<double, nano>(chrono::steady_clock::now() - acquireBegin).count();
+		// 新しいものがなければ少し眠る (コアが少なくてもシミュレーションのスレッドの邪魔をしないように)
+		if (!updated) {
+			this_thread::sleep_for(chrono::microseconds(50));
+			continue;
+		}
+		latency += GetNanoseconds() - snapshot.PublishTime;
+
+		bool broken = snapshot.Step <= lastStep || snapshot.Time != snapshot.Step * simulation.m_TimeStep || snapshot.Visible.size() != snapshot.Worlds.size();
+		broken = broken || snapshot.InputFrame < lastInputFrame || snapshot.InputFrame >= frustums.size();
+		uint32_t stride = max(static_cast<uint32_t>(snapshot.Visible.size()) / CHECK_WORLD_NUM, 1u);
+		for (size_t i = 0; !broken && i < snapshot.Visible.size(); i += stride) {
+			const SIMULATION_BODY& body = simulation.m_Bodies[snapshot.Visible[i]];
+			XMFLOAT4X4 expected;
+			GetWorld(body, GetPosition(body, snapshot.Time), &expected);
+			broken = memcmp(&expected, &snapshot.Worlds[i], sizeof(XMFLOAT4X4)) != 0 || !inside(frustums[snapshot.InputFrame], expected, GetBounds(body, XMFLOAT3()).Radius);
+		}
+		if (broken) { ++brokenNum; }
+		visibleNum += snapshot.Visible.size();
+		lastStep = snapshot.Step;
+		lastInputFrame = min<uint64_t>(snapshot.InputFrame, frustums.size() - 1);
+
+		// 次のフレームの視錐台を渡す
+		frustums.push_back(makeFrustum(frustums.size()));
+		simulation.SubmitInput(frustums.back());
+	}
+	simulation.Stop();
+	double totalTime = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+
+	SIMULATION_STATISTICS statistics = simulation.GetStatistics();
+	cout << "objects : " << objectNum << endl;
+	cout << "steps : " << statistics.StepNum << " (" << statistics.StepNum * 1000.0 / totalTime << " steps/s)" << endl;
+	cout << "step avg : " << statistics.TotalStepTime / statistics.StepNum << " ms" << endl;
+	cout << "step max : " << statistics.MaxStepTime << " ms" << endl;
+	cout << "snapshots received : " << statistics.UpdatedNum << " (" << visibleNum / max<uint64_t>(statistics.UpdatedNum, 1) << " visible)" << endl;
+	cout << "snapshots dropped : " << statistics.DroppedNum << endl;
+	cout << "inputs : " << frustums.size() << " submitted, " << statistics.InputNum << " received" << endl;
+	cout << "acquire : " << acquireTime / statistics.AcquireNum << " ns (" << statistics.AcquireNum << " calls)" << endl;
+	cout << "handoff latency : " << latency / 1000.0 / max<uint64_t>(statistics.UpdatedNum, 1) << " us" << endl;
+	cout << "result : " << (brokenNum == 0 && (statistics.StepNum < 2 || statistics.InputNum > 1) ? "matched" : "MISMATCH") << endl;
+}
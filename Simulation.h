@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "FrustumCuller.h"
+#include "Scene.h"
+#include "TripleBuffer.h"
+
+using namespace std;
+using namespace DirectX;
+
+// 描画側からシミュレーションへ渡す入力 (フレームごとに公開する)
+struct SIMULATION_INPUT {
+	uint64_t Frame;             // 何フレーム目に渡したものか (0 なら作ったときに渡したもの)
+	FRUSTUM Frustum;            // そのフレームのビューの視錐台
+};
+
+// シミュレーションの 1 ステップ分の結果 (公開した後は書き換えない)
+struct SIMULATION_SNAPSHOT {
+	uint64_t Step;              // 何ステップ目の結果か (0 ならまだ何も公開していない)
+	uint64_t InputFrame;        // 見えるものを集めるのに使った入力のフレーム
+	double Time;                // シミュレーション上の時刻 (秒)
+	uint64_t PublishTime;       // 公開した時刻 (steady_clock のナノ秒)
+	vector<uint32_t> Visible;   // 視錐台に入るオブジェクトの番号
+	vector<XMFLOAT4X4> Worlds;  // 見えるオブジェクトのワールド行列 (Visible と同じ順)
+};
+
+// シミュレーションの統計情報
+struct SIMULATION_STATISTICS {
+	uint64_t StepNum;        // 実際に処理したステップの数
+	uint64_t SkippedNum;     // 実時間に追いつくために飛ばしたステップの数
+	uint64_t DroppedNum;     // 読まれる前に次のものに置き換わったスナップショットの数
+	uint64_t InputNum;       // シミュレーションのスレッドが受け取った入力の数
+	double TotalStepTime;    // ステップの処理時間の合計 (ミリ秒)
+	double MaxStepTime;
+	uint64_t AcquireNum;     // Acquire を呼んだ回数
+	uint64_t UpdatedNum;     // そのうち新しいスナップショットを受け取った回数
+};
+
+// シミュレーション
+// 専用のスレッドで固定の時間刻みでオブジェクトを動かしてシーンを更新し、視錐台に入るものとそのワールド行列を集める
+// 結果はステップごとにトリプルバッファで公開し、レンダースレッドは Acquire で最新のものを待たずに受け取る
+// 逆向きにはレンダースレッドが SubmitInput でフレームごとの視錐台を別のトリプルバッファで渡し、次のステップから使われる
+// 動きは時刻から直接求まるので、処理が遅れたときは間のステップを飛ばして実時間に追いつく
+// Acquire と SubmitInput は 1 つのスレッド (作ったスレッド) から呼ぶこと
+class Simulation {
+
+private:
+	// 動かすオブジェクト (中心の周りを傾いた円を描いて回る)
+	struct SIMULATION_BODY {
+		XMFLOAT3 Center;
+		float Radius;
+		float Speed;    // 角速度 (ラジアン毎秒)
+		float Phase;
+		float Scale;    // 立方体の半分の長さ
+	};
+
+	vector<SIMULATION_BODY> m_Bodies;
+	vector<SCENE_OBJECT> m_Objects;
+	unique_ptr<Scene> m_Scene;
+	double m_TimeStep;
+	bool m_Paced;
+
+	// 視錐台に入るオブジェクト (シミュレーションのスレッドの作業用)
+	vector<SCENE_OBJECT> m_Visible;
+
+	// 公開したスナップショットと、描画側から受け取る入力
+	TripleBuffer<SIMULATION_SNAPSHOT> m_Snapshots;
+	TripleBuffer<SIMULATION_INPUT> m_Inputs;
+	uint64_t m_InputFrame;
+
+	thread m_Thread;
+	atomic<bool> m_Exit;
+	SIMULATION_STATISTICS m_Statistics;
+
+	void ThreadMain();
+	void Step(uint64_t step);
+	static XMFLOAT3 GetPosition(const SIMULATION_BODY& body, double time);
+	static BOUNDS GetBounds(const SIMULATION_BODY& body, const XMFLOAT3& position);
+	static void GetWorld(const SIMULATION_BODY& body, const XMFLOAT3& position, XMFLOAT4X4* world);
+
+public:
+	// objectNum 個のオブジェクトを frustum の前に並べる (frustum は最初の入力として渡す)
+	// stepRate は 1 秒あたりのステップ数で、paced が false なら実時間を待たずに進め続ける (計測用)
+	Simulation(uint32_t objectNum, const FRUSTUM& frustum, double stepRate = 60.0, bool paced = true);
+	~Simulation();
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	// シミュレーションのスレッドを開始・停止する
+	void Start();
+	void Stop();
+
+	// 最後に公開されたスナップショット (updated には新しく受け取ったかを返す)
+	// 返した参照は次に Acquire を呼ぶまで有効
+	const SIMULATION_SNAPSHOT& Acquire(bool* updated = nullptr);
+
+	// このフレームの視錐台を渡す (読まれる前に次を渡したら前のものは捨てられる)
+	void SubmitInput(const FRUSTUM& frustum);
+
+	// Stop の後に呼ぶこと
+	SIMULATION_STATISTICS GetStatistics() const;
+
+	// objectNum 個のオブジェクトを stepNum ステップ待たずに進め、別のスレッドでスナップショットを受け取りながら
+	// ステップの処理時間と受け渡しの速さを計測し、受け取った内容が壊れていないかを確かめる
+	// 受け取るたびに向きを変えた視錐台を入力として渡し、見えるものがその入力の視錐台で集められたことも確かめる
+	static void RunBenchmark(uint32_t objectNum, uint32_t stepNum);
+};
@@ -0,0 +1,432 @@
+﻿#include "SoftwareBackend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "VertexFormat.h"
+
+// コンストラクタ
+SoftwareCommandList::SoftwareCommandList(SoftwareBackend* backend):
+	NullCommandList(backend),
+	m_State(),
+	m_Commands() {
+
+	m_State.RenderTarget = INVALID_HANDLE;
+	m_State.Pipeline = INVALID_HANDLE;
+}
+
+// 記録を始める
+void SoftwareCommandList::Reset(uint32_t frameIndex) {
+	NullCommandList::Reset(frameIndex);
+	m_State = {};
+	m_State.RenderTarget = INVALID_HANDLE;
+	m_State.Pipeline = INVALID_HANDLE;
+	m_Commands.clear();
+}
+
+// レンダーターゲットを設定
+void SoftwareCommandList::OMSetRenderTarget(RESOURCE_HANDLE renderTarget) {
+	NullCommandList::OMSetRenderTarget(renderTarget);
+	m_State.RenderTarget = renderTarget;
+}
+
+// レンダーターゲットを塗りつぶす
+void SoftwareCommandList::ClearRenderTargetView(RESOURCE_HANDLE renderTarget, const float color[4]) {
+	NullCommandList::ClearRenderTargetView(renderTarget, color);
+
+	SOFTWARE_COMMAND command = m_State;
+	command.Clear = true;
+	command.RenderTarget = renderTarget;
+	memcpy(command.ClearColor, color, sizeof(command.ClearColor));
+	m_Commands.push_back(command);
+}
+
+// 定数バッファビューを設定
+void SoftwareCommandList::SetGraphicsRootConstantBufferView(uint32_t parameterIndex, GPU_ADDRESS address) {
+	NullCommandList::SetGraphicsRootConstantBufferView(parameterIndex, address);
+	if (parameterIndex == 0) { m_State.ConstantBuffer = address; }
+	else if (parameterIndex == 1) { m_State.ObjectConstantBuffer = address; }
+}
+
+// パイプラインステートを設定
+void SoftwareCommandList::SetPipelineState(PIPELINE_HANDLE pipelineState) {
+	NullCommandList::SetPipelineState(pipelineState);
+	m_State.Pipeline = pipelineState;
+}
+
+// 頂点バッファを設定
+void SoftwareCommandList::IASetVertexBuffers(uint32_t startSlot, uint32_t num, const VERTEX_BUFFER_VIEW* views) {
+	NullCommandList::IASetVertexBuffers(startSlot, num, views);
+	for (uint32_t i = 0; i < num && startSlot + i < 2; ++i) { m_State.VertexBuffers[startSlot + i] = views[i]; }
+}
+
+// インデックスバッファを設定
+void SoftwareCommandList::IASetIndexBuffer(const INDEX_BUFFER_VIEW* view) {
+	NullCommandList::IASetIndexBuffer(view);
+	m_State.IndexBuffer = *view;
+}
+
+// ビューポートを設定
+void SoftwareCommandList::RSSetViewports(uint32_t num, const VIEWPORT* viewports) {
+	NullCommandList::RSSetViewports(num, viewports);
+	if (num > 0) { m_State.Viewport = viewports[0]; }
+}
+
+// シザー矩形を設定
+void SoftwareCommandList::RSSetScissorRects(uint32_t num, const SCISSOR_RECT* rects) {
+	NullCommandList::RSSetScissorRects(num, rects);
+	if (num > 0) { m_State.Scissor = rects[0]; }
+}
+
+// 描画
+void SoftwareCommandList::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) {
+	NullCommandList::DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+
+	SOFTWARE_COMMAND command = m_State;
+	command.Clear = false;
+	command.IndexCount = indexCount;
+	command.InstanceCount = instanceCount;
+	command.StartIndex = startIndex;
+	command.BaseVertex = baseVertex;
+	command.StartInstance = startInstance;
+	m_Commands.push_back(command);
+}
+
+// コンストラクタ
+SoftwareBackend::SoftwareBackend():
+	NullBackend(),
+	m_Rasterizer(nullptr),
+	m_Width(0),
+	m_Height(0),
+	m_PresentedIndex(0),
+	m_SoftwarePipelines(),
+	m_DecodedVertices(),
+	m_DecodedIndices() {
+
+	m_PipelineCacheName = "SOFTWARE";
+}
+
+// GPU 上のアドレスを CPU メモリへ変換する (size バイト読めなければ例外)
+const uint8_t* SoftwareBackend::Translate(GPU_ADDRESS address, uint64_t size) const {
+
+	// リソースはアドレスの昇順に並んでいる
+	auto it = upper_bound(m_Resources.begin(), m_Resources.end(), address, [](GPU_ADDRESS value, const NULL_RESOURCE& resource) {
+		return value < resource.Address;
+	});
+	if (it != m_Resources.begin()) {
+		const NULL_RESOURCE& resource = *(it - 1);
+		uint64_t offset = address - resource.Address;
+		if (offset + size <= resource.Memory.size()) { return resource.Memory.data() + offset; }
+	}
+	throw runtime_error("リソースの範囲外のアドレスです。");
+}
+
+// コマンドを 1 つ実行する
+void SoftwareBackend::Replay(const SOFTWARE_COMMAND& command) {
+
+	NULL_RESOURCE& target = m_Resources.at(command.RenderTarget);
+	if (target.Memory.size() < static_cast<size_t>(m_Width) * m_Height * 4) { throw runtime_error("バックバッファ以外には描画できません。"); }
+	m_Rasterizer->SetRenderTarget(reinterpret_cast<uint32_t*>(target.Memory.data()), m_Width, m_Height);
+
+	if (command.Clear) {
+		m_Rasterizer->Clear(command.ClearColor);
+		return;
+	}
+
+	if (command.Pipeline >= m_SoftwarePipelines.size()) { throw runtime_error("パイプラインが設定されていません。"); }
+	const SOFTWARE_PIPELINE& pipeline = m_SoftwarePipelines[command.Pipeline];
+
+	// フレームごとの定数バッファ (View, Project, ViewProject の後ろの PositionScale だけを使う)
+	XMFLOAT4 positionScale;
+	memcpy(&positionScale, Translate(command.ConstantBuffer + sizeof(XMFLOAT4X4) * 3, sizeof(positionScale)), sizeof(positionScale));
+
+	// インデックス (32 ビットに広げる)
+	const INDEX_BUFFER_VIEW& indexBuffer = command.IndexBuffer;
+	uint32_t indexStride = VertexFormat::GetIndexSize(indexBuffer.Format);
+	uint64_t indexOffset = static_cast<uint64_t>(command.StartIndex) * indexStride;
+	uint64_t indexSize = static_cast<uint64_t>(command.IndexCount) * indexStride;
+	if (indexOffset + indexSize > indexBuffer.SizeInBytes) { throw runtime_error("インデックスバッファの範囲外を参照しています。"); }
+	const uint8_t* indexData = Translate(indexBuffer.BufferLocation + indexOffset, indexSize);
+
+	m_DecodedIndices.resize(command.IndexCount);
+	uint32_t maxIndex = 0;
+	for (uint32_t i = 0; i < command.IndexCount; ++i) {
+		if (indexBuffer.Format == INDEX_FORMAT::R16_UINT) {
+			uint16_t index;
+			memcpy(&index, indexData + static_cast<size_t>(i) * sizeof(uint16_t), sizeof(uint16_t));
+			m_DecodedIndices[i] = index;
+		}
+		else {
+			memcpy(&m_DecodedIndices[i], indexData + static_cast<size_t>(i) * sizeof(uint32_t), sizeof(uint32_t));
+		}
+		maxIndex = max(maxIndex, m_DecodedIndices[i]);
+	}
+
+	// 頂点 (参照されている範囲だけを展開する)
+	const VERTEX_BUFFER_VIEW& vertexBuffer = command.VertexBuffers[0];
+	const uint32_t vertexStride = vertexBuffer.StrideInBytes;
+	if (vertexStride == 0 || command.BaseVertex < 0) { throw runtime_error("対応していない頂点バッファです。"); }
+	uint64_t vertexOffset = static_cast<uint64_t>(command.BaseVertex) * vertexStride;
+	uint32_t vertexNum = command.IndexCount > 0 ? maxIndex + 1 : 0;
+	if (vertexOffset + static_cast<uint64_t>(vertexNum) * vertexStride > vertexBuffer.SizeInBytes) { throw runtime_error("頂点バッファの範囲外を参照しています。"); }
+	const uint8_t* vertexData = Translate(vertexBuffer.BufferLocation + vertexOffset, static_cast<uint64_t>(vertexNum) * vertexStride);
+
+	m_DecodedVertices.resize(vertexNum);
+	for (uint32_t i = 0; i < vertexNum; ++i) {
+		const uint8_t* vertex = vertexData + static_cast<size_t>(i) * vertexStride;
+		XMFLOAT4 position = VertexFormat::DecodeElement(pipeline.PositionFormat, vertex + pipeline.PositionOffset);
+		m_DecodedVertices[i].Position = XMFLOAT3(position.x * positionScale.x, position.y * positionScale.y, position.z * positionScale.z);
+		m_DecodedVertices[i].Color = VertexFormat::DecodeElement(pipeline.ColorFormat, vertex + pipeline.ColorOffset);
+	}
+	const VERTEX* vertices = m_DecodedVertices.data();
+	const uint32_t* indices = m_DecodedIndices.data();
+
+	m_Rasterizer->SetViewport(command.Viewport);
+	m_Rasterizer->SetScissor(command.Scissor);
+
+	bool instanced = pipeline.Instanced;
+	for (uint32_t i = 0; i < command.InstanceCount; ++i) {
+		if (instanced) {
+			// インスタンスのワールド・ビュー・射影行列 (行ごとに格納されている)
+			const VERTEX_BUFFER_VIEW& instanceBuffer = command.VertexBuffers[1];
+			uint64_t offset = static_cast<uint64_t>(command.StartInstance + i) * instanceBuffer.StrideInBytes;
+			if (offset + sizeof(XMFLOAT4X4) > instanceBuffer.SizeInBytes) { throw runtime_error("インスタンスバッファの範囲外を参照しています。"); }
+
+			XMFLOAT4X4 instanceWorldViewProject;
+			memcpy(&instanceWorldViewProject, Translate(instanceBuffer.BufferLocation + offset, sizeof(instanceWorldViewProject)), sizeof(instanceWorldViewProject));
+			m_Rasterizer->SetTransform(XMLoadFloat4x4(&instanceWorldViewProject));
+		}
+		else {
+			// オブジェクトごとの定数バッファ (WorldViewProject)
+			XMFLOAT4X4 worldViewProject;
+			memcpy(&worldViewProject, Translate(command.ObjectConstantBuffer, sizeof(worldViewProject)), sizeof(worldViewProject));
+			m_Rasterizer->SetTransform(XMLoadFloat4x4(&worldViewProject));
+		}
+		m_Rasterizer->Draw(vertices, vertexNum, indices, command.IndexCount);
+	}
+}
+
+// 初期化
+void SoftwareBackend::Initialize(const BACKEND_DESC& desc) {
+	NullBackend::Initialize(desc);
+	m_Width = desc.Width;
+	m_Height = desc.Height;
+	m_PresentedIndex = 0;
+	m_Rasterizer = make_unique<SoftwareRasterizer>();
+}
+
+// パイプラインステートを作成
+// 入力レイアウトの解決とキャッシュは記録用バックエンドに任せ、解決済みの要素から POSITION と COLOR の読み方を拾う
+PIPELINE_HANDLE SoftwareBackend::CreatePipelineState(const PIPELINE_DESC& desc) {
+	PROFILE_ZONE("SoftwareBackend::CreatePipelineState");
+	PIPELINE_HANDLE handle = NullBackend::CreatePipelineState(desc);
+	if (m_SoftwarePipelines.size() <= handle) { m_SoftwarePipelines.resize(handle + 1); }
+
+	SOFTWARE_PIPELINE pipeline = { false, ELEMENT_FORMAT::R32G32B32_FLOAT, 0, ELEMENT_FORMAT::R32G32B32A32_FLOAT, 12 };
+	for (const NULL_INPUT_ELEMENT& element : m_Pipelines[handle].InputElements) {
+		if (element.InputSlotClass == INPUT_CLASSIFICATION::PER_INSTANCE_DATA && element.SemanticName == "WVP") { pipeline.Instanced = true; }
+		if (element.InputSlot != 0) { continue; }
+
+		if (element.SemanticName == "POSITION") {
+			pipeline.PositionFormat = element.Format;
+			pipeline.PositionOffset = element.Offset;
+		}
+		else if (element.SemanticName == "COLOR") {
+			pipeline.ColorFormat = element.Format;
+			pipeline.ColorOffset = element.Offset;
+		}
+	}
+
+	m_SoftwarePipelines[handle] = pipeline;
+	return handle;
+}
+
+// コマンドリストを作成
+unique_ptr<CommandList> SoftwareBackend::CreateCommandList() {
+	++m_Statistics.CommandListCount;
+	return make_unique<SoftwareCommandList>(this);
+}
+
+// コマンドリストを実行 (コピーとバリアを反映してからドローを塗る)
+void SoftwareBackend::ExecuteCommandLists(uint32_t num, CommandList* const* lists) {
+	for (uint32_t i = 0; i < num; ++i) {
+		NullBackend::ExecuteCommandLists(1, &lists[i]);
+
+		SoftwareCommandList* list = static_cast<SoftwareCommandList*>(lists[i]);
+		for (const SOFTWARE_COMMAND& command : list->m_Commands) { Replay(command); }
+		m_Rasterizer->Flush();
+	}
+}
+
+// 表示
+void SoftwareBackend::Present() {
+	PROFILE_ZONE("SoftwareBackend::Present");
+	m_PresentedIndex = m_BackBufferIndex;
+	NullBackend::Present();
+}
+
+// 直前に表示したバックバッファを取得
+const uint32_t* SoftwareBackend::GetPresentedImage() const {
+	if (m_BackBuffers.empty()) { return nullptr; }
+	return reinterpret_cast<const uint32_t*>(m_Resources[m_BackBuffers[m_PresentedIndex]].Memory.data());
+}
+
+// 幅を取得
+uint32_t SoftwareBackend::GetWidth() const { return m_Width; }
+
+// 高さを取得
+uint32_t SoftwareBackend::GetHeight() const { return m_Height; }
+
+// TGA のヘッダー (RLE 圧縮した 32bit、左上原点で書き出す)
+static const uint32_t TGA_HEADER_SIZE = 18;
+static const uint8_t TGA_TYPE_RAW = 2;
+static const uint8_t TGA_TYPE_RLE = 10;
+
+// RGBA8 の画素を BGRA に並べ替える
+static uint32_t SwapRedBlue(uint32_t pixel) {
+	return (pixel & 0xFF00FF00u) | ((pixel >> 16) & 0xFFu) | ((pixel & 0xFFu) << 16);
+}
+
+// 直前に表示したバックバッファを TGA (32bit, 左上原点, RLE 圧縮) で書き出す
+// 背景が続く行はほとんどが 1 つの連なりになるので、参照画像としてリポジトリに置ける大きさになる
+bool SoftwareBackend::SaveImage(const char* path) const {
+
+	const uint32_t* pixels = GetPresentedImage();
+	if (pixels == nullptr) { return false; }
+
+	ofstream file(path, ios::binary);
+	if (!file) { return false; }
+
+	uint8_t header[TGA_HEADER_SIZE] = {};
+	header[2] = TGA_TYPE_RLE;
+	header[12] = static_cast<uint8_t>(m_Width & 0xFF);
+	header[13] = static_cast<uint8_t>(m_Width >> 8);
+	header[14] = static_cast<uint8_t>(m_Height & 0xFF);
+	header[15] = static_cast<uint8_t>(m_Height >> 8);
+	header[16] = 32;
+	header[17] = 0x28;
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+	// 1 つの塊は行をまたがず 128 画素まで (同じ画素の連なりか、そのまま並べた画素)
+	vector<uint8_t> packets;
+	for (uint32_t y = 0; y < m_Height; ++y) {
+		const uint32_t* row = pixels + static_cast<size_t>(y) * m_Width;
+		packets.clear();
+		for (uint32_t x = 0; x < m_Width;) {
+			uint32_t run = 1;
+			while (x + run < m_Width && run < 128 && row[x + run] == row[x]) { ++run; }
+			if (run > 1) {
+				uint32_t pixel = SwapRedBlue(row[x]);
+				packets.push_back(static_cast<uint8_t>(0x80 | (run - 1)));
+				packets.insert(packets.end(), reinterpret_cast<const uint8_t*>(&pixel), reinterpret_cast<const uint8_t*>(&pixel) + 4);
+				x += run;
+				continue;
+			}
+
+			uint32_t raw = 1;
+			while (x + raw < m_Width && raw < 128 && (x + raw + 1 >= m_Width || row[x + raw] != row[x + raw + 1])) { ++raw; }
+			packets.push_back(static_cast<uint8_t>(raw - 1));
+			for (uint32_t i = 0; i < raw; ++i) {
+				uint32_t pixel = SwapRedBlue(row[x + i]);
+				packets.insert(packets.end(), reinterpret_cast<const uint8_t*>(&pixel), reinterpret_cast<const uint8_t*>(&pixel) + 4);
+			}
+			x += raw;
+		}
+		file.write(reinterpret_cast<const char*>(packets.data()), packets.size());
+	}
+
+	return static_cast<bool>(file);
+}
+
+// TGA (32bit、圧縮なしか RLE 圧縮) を RGBA8 で読み込む
+static bool LoadImage(const char* path, vector<uint32_t>* pixels, uint32_t* width, uint32_t* height) {
+
+	ifstream file(path, ios::binary);
+	if (!file) { return false; }
+
+	uint8_t header[TGA_HEADER_SIZE] = {};
+	if (!file.read(reinterpret_cast<char*>(header), sizeof(header))) { return false; }
+	if ((header[2] != TGA_TYPE_RAW && header[2] != TGA_TYPE_RLE) || header[1] != 0 || header[16] != 32) { return false; }
+	file.seekg(header[0], ios::cur);
+
+	*width = header[12] | (header[13] << 8);
+	*height = header[14] | (header[15] << 8);
+	const size_t pixelNum = static_cast<size_t>(*width) * *height;
+	pixels->assign(pixelNum, 0);
+
+	auto readPixel = [&file](uint32_t* pixel) {
+		if (!file.read(reinterpret_cast<char*>(pixel), sizeof(uint32_t))) { return false; }
+		*pixel = SwapRedBlue(*pixel);
+		return true;
+	};
+
+	for (size_t i = 0; i < pixelNum;) {
+		if (header[2] == TGA_TYPE_RAW) {
+			if (!readPixel(&(*pixels)[i++])) { return false; }
+			continue;
+		}
+
+		uint8_t packet = 0;
+		if (!file.read(reinterpret_cast<char*>(&packet), 1)) { return false; }
+		size_t count = (packet & 0x7F) + 1;
+		if (i + count > pixelNum) { return false; }
+		if (packet & 0x80) {
+			uint32_t pixel = 0;
+			if (!readPixel(&pixel)) { return false; }
+			fill(pixels->begin() + i, pixels->begin() + i + count, pixel);
+		}
+		else {
+			for (size_t j = 0; j < count; ++j) {
+				if (!readPixel(&(*pixels)[i + j])) { return false; }
+			}
+		}
+		i += count;
+	}
+
+	// 左下原点なら上下を入れ替える
+	if ((header[17] & 0x20) == 0) {
+		for (uint32_t y = 0; y < *height / 2; ++y) {
+			swap_ranges(pixels->begin() + static_cast<size_t>(y) * *width, pixels->begin() + static_cast<size_t>(y + 1) * *width, pixels->begin() + static_cast<size_t>(*height - 1 - y) * *width);
+		}
+	}
+	return true;
+}
+
+// 直前に表示したバックバッファを参照画像と比べる
+// 1 つでもチャンネルの値が違う画素を数え、その割合が tolerance (%) 以下なら一致とする
+bool SoftwareBackend::CompareImage(const char* path, float tolerance, IMAGE_COMPARISON* result) const {
+
+	*result = {};
+
+	const uint32_t* pixels = GetPresentedImage();
+	vector<uint32_t> reference;
+	uint32_t width = 0, height = 0;
+	if (pixels == nullptr || !LoadImage(path, &reference, &width, &height)) { return false; }
+
+	result->Loaded = true;
+	result->PixelNum = static_cast<uint64_t>(m_Width) * m_Height;
+	if (width != m_Width || height != m_Height) { return false; }
+
+	for (size_t i = 0; i < reference.size(); ++i) {
+		if (pixels[i] == reference[i]) { continue; }
+		++result->DifferentNum;
+		for (int shift = 0; shift < 32; shift += 8) {
+			int difference = abs(static_cast<int>((pixels[i] >> shift) & 0xFF) - static_cast<int>((reference[i] >> shift) & 0xFF));
+			result->MaxDifference = max(result->MaxDifference, static_cast<uint32_t>(difference));
+		}
+	}
+
+	result->DifferentRate = 100.0f * static_cast<float>(static_cast<double>(result->DifferentNum) / static_cast<double>(result->PixelNum));
+	result->Matched = result->DifferentRate <= tolerance;
+	return result->Matched;
+}
+
+// ラスタライザの統計情報を取得
+RASTERIZER_STATISTICS SoftwareBackend::GetRasterizerStatistics() const {
+	return m_Rasterizer != nullptr ? m_Rasterizer->GetStatistics() : RASTERIZER_STATISTICS{ 0 };
+}
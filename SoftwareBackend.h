@@ -0,0 +1,124 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "NullBackend.h"
+#include "SoftwareRasterizer.h"
+
+using namespace std;
+
+// ソフトウェア描画のパイプライン (頂点の読み方とインスタンス描画の有無)
+struct SOFTWARE_PIPELINE {
+	bool Instanced;
+	ELEMENT_FORMAT PositionFormat;
+	uint32_t PositionOffset;
+	ELEMENT_FORMAT ColorFormat;
+	uint32_t ColorOffset;
+};
+
+// ソフトウェア描画のコマンド (塗りつぶしかドロー)
+struct SOFTWARE_COMMAND {
+	bool Clear;
+	float ClearColor[4];
+	RESOURCE_HANDLE RenderTarget;
+	PIPELINE_HANDLE Pipeline;
+	GPU_ADDRESS ConstantBuffer;
+	GPU_ADDRESS ObjectConstantBuffer;
+	VERTEX_BUFFER_VIEW VertexBuffers[2];
+	INDEX_BUFFER_VIEW IndexBuffer;
+	VIEWPORT Viewport;
+	SCISSOR_RECT Scissor;
+	uint32_t IndexCount;
+	uint32_t InstanceCount;
+	uint32_t StartIndex;
+	int32_t BaseVertex;
+	uint32_t StartInstance;
+};
+
+// 参照画像との比較の結果
+struct IMAGE_COMPARISON {
+	bool Loaded;          // 参照画像を読めたか
+	bool Matched;         // 違う画素の割合が許容値以下か
+	uint64_t PixelNum;
+	uint64_t DifferentNum; // 1 つでもチャンネルの値が違う画素の数
+	float DifferentRate;   // 違う画素の割合 (%)
+	uint32_t MaxDifference; // チャンネルの値の差の最大
+};
+
+class SoftwareBackend;
+
+// ソフトウェア描画用コマンドリスト
+// 記録用コマンドリストの集計に加え、ドローごとにその時点の状態を残しておく
+class SoftwareCommandList : public NullCommandList {
+
+	friend class SoftwareBackend;
+
+private:
+	SOFTWARE_COMMAND m_State;
+	vector<SOFTWARE_COMMAND> m_Commands;
+
+public:
+	SoftwareCommandList(SoftwareBackend* backend);
+
+	void Reset(uint32_t frameIndex) override;
+
+	void OMSetRenderTarget(RESOURCE_HANDLE renderTarget) override;
+	void ClearRenderTargetView(RESOURCE_HANDLE renderTarget, const float color[4]) override;
+	void SetGraphicsRootConstantBufferView(uint32_t parameterIndex, GPU_ADDRESS address) override;
+	void SetPipelineState(PIPELINE_HANDLE pipelineState) override;
+	void IASetVertexBuffers(uint32_t startSlot, uint32_t num, const VERTEX_BUFFER_VIEW* views) override;
+	void IASetIndexBuffer(const INDEX_BUFFER_VIEW* view) override;
+	void RSSetViewports(uint32_t num, const VIEWPORT* viewports) override;
+	void RSSetScissorRects(uint32_t num, const SCISSOR_RECT* rects) override;
+
+	void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) override;
+};
+
+// ソフトウェア描画バックエンド (ヘッドレス)
+// 記録用バックエンドと同じく CPU メモリ上で動き、ドローを SoftwareRasterizer で実際にバックバッファへ塗る
+// 頂点はパイプラインの入力レイアウトに従って POSITION と COLOR を読み、VERTEX に展開してから塗る
+// 定数バッファは SimpleVS の FrameConstants (View, Project, ViewProject, PositionScale) と ObjectConstants (WorldViewProject) として読む
+// WVP を毎インスタンスで読むパイプラインは InstancedVS と同じくインスタンスのワールド・ビュー・射影行列を使う
+class SoftwareBackend : public NullBackend {
+
+private:
+	unique_ptr<SoftwareRasterizer> m_Rasterizer;
+	uint32_t m_Width;
+	uint32_t m_Height;
+	uint32_t m_PresentedIndex;
+
+	// パイプラインごとの頂点の読み方
+	vector<SOFTWARE_PIPELINE> m_SoftwarePipelines;
+
+	// 展開した頂点と 32 ビットに広げたインデックス (ドローごとに使い回す)
+	vector<VERTEX> m_DecodedVertices;
+	vector<uint32_t> m_DecodedIndices;
+
+	const uint8_t* Translate(GPU_ADDRESS address, uint64_t size) const;
+	void Replay(const SOFTWARE_COMMAND& command);
+
+public:
+	SoftwareBackend();
+	~SoftwareBackend() = default;
+
+	void Initialize(const BACKEND_DESC& desc) override;
+	PIPELINE_HANDLE CreatePipelineState(const PIPELINE_DESC& desc) override;
+	unique_ptr<CommandList> CreateCommandList() override;
+	void ExecuteCommandLists(uint32_t num, CommandList* const* lists) override;
+	void Present() override;
+
+	// 直前に表示したバックバッファ (RGBA8)
+	const uint32_t* GetPresentedImage() const;
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+
+	// 直前に表示したバックバッファを TGA で書き出す
+	bool SaveImage(const char* path) const;
+
+	// 直前に表示したバックバッファを TGA の参照画像と比べる (違う画素の割合が tolerance % 以下なら true)
+	bool CompareImage(const char* path, float tolerance, IMAGE_COMPARISON* result) const;
+
+	RASTERIZER_STATISTICS GetRasterizerStatistics() const;
+};
@@ -0,0 +1,388 @@
+﻿#include "SoftwareRasterizer.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// クリップする w の下限
+static const float g_MinW = 1e-5f;
+
+// 線形 → sRGB の変換表の大きさ
+static const int g_SRGBTableSize = 4096;
+
+// 線形 → sRGB の変換表 (レンダーターゲットビューは R8G8B8A8_UNORM_SRGB)
+static const uint8_t* GetSRGBTable() {
+	static const vector<uint8_t> table = [] {
+		vector<uint8_t> result(g_SRGBTableSize);
+		for (int i = 0; i < g_SRGBTableSize; ++i) {
+			float linear = static_cast<float>(i) / (g_SRGBTableSize - 1);
+			float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+			result[i] = static_cast<uint8_t>(srgb * 255.0f + 0.5f);
+		}
+		return result;
+	}();
+	return table.data();
+}
+
+// 表の番号へ変換
+static int ToSRGBIndex(float value) {
+	value = min(max(value, 0.0f), 1.0f);
+	return static_cast<int>(value * (g_SRGBTableSize - 1) + 0.5f);
+}
+
+// 画素の座標へ変換 (画面から大きく外れた値は丸める)
+static int32_t ToPixel(float value) {
+	return static_cast<int32_t>(min(max(value, -1.0f), 1048576.0f));
+}
+
+// 線形の色を RGBA8 に詰める (アルファは線形のまま)
+static uint32_t PackColor(float r, float g, float b, float a) {
+	const uint8_t* table = GetSRGBTable();
+	uint32_t alpha = static_cast<uint32_t>(min(max(a, 0.0f), 1.0f) * 255.0f + 0.5f);
+	return table[ToSRGBIndex(r)] | (table[ToSRGBIndex(g)] << 8) | (table[ToSRGBIndex(b)] << 16) | (alpha << 24);
+}
+
+// クリップ空間の頂点 (位置と色)
+struct CLIP_VERTEX {
+	XMFLOAT4 Position;
+	XMFLOAT4 Color;
+};
+
+// w = g_MinW の平面で多角形を切る
+static uint32_t ClipPolygon(const CLIP_VERTEX* input, uint32_t inputNum, CLIP_VERTEX* output) {
+	uint32_t outputNum = 0;
+	for (uint32_t i = 0; i < inputNum; ++i) {
+		const CLIP_VERTEX& a = input[i];
+		const CLIP_VERTEX& b = input[(i + 1) % inputNum];
+		float da = a.Position.w - g_MinW;
+		float db = b.Position.w - g_MinW;
+
+		if (da >= 0.0f) { output[outputNum++] = a; }
+		if ((da >= 0.0f) != (db >= 0.0f)) {
+			float t = da / (da - db);
+			XMVECTOR position = XMVectorLerp(XMLoadFloat4(&a.Position), XMLoadFloat4(&b.Position), t);
+			XMVECTOR color = XMVectorLerp(XMLoadFloat4(&a.Color), XMLoadFloat4(&b.Color), t);
+			XMStoreFloat4(&output[outputNum].Position, position);
+			XMStoreFloat4(&output[outputNum].Color, color);
+			++outputNum;
+		}
+	}
+	return outputNum;
+}
+
+// コンストラクタ
+SoftwareRasterizer::SoftwareRasterizer(uint32_t threadNum):
+	m_RenderTarget(nullptr),
+	m_Width(0),
+	m_Height(0),
+	m_TileX(0),
+	m_TileY(0),
+	m_Viewport({ 0 }),
+	m_Scissor({ 0 }),
+	m_WorldViewProject(),
+	m_ClipPositions(),
+	m_Triangles(),
+	m_Bins(),
+	m_JobSystem(make_unique<JobSystem>(threadNum)),
+	m_PixelNum(0),
+	m_Statistics({ 0 }) {
+
+	XMStoreFloat4x4(&m_WorldViewProject, XMMatrixIdentity());
+}
+
+// 描画先を設定
+void SoftwareRasterizer::SetRenderTarget(uint32_t* pixels, uint32_t width, uint32_t height) {
+	if (pixels == m_RenderTarget && width == m_Width && height == m_Height) { return; }
+
+	Flush();
+
+	m_RenderTarget = pixels;
+	m_Width = width;
+	m_Height = height;
+	m_TileX = (width + m_TileSize - 1) / m_TileSize;
+	m_TileY = (height + m_TileSize - 1) / m_TileSize;
+	m_Bins.assign(static_cast<size_t>(m_TileX) * m_TileY, vector<uint32_t>());
+}
+
+// ビューポートを設定
+void SoftwareRasterizer::SetViewport(const VIEWPORT& viewport) { m_Viewport = viewport; }
+
+// シザー矩形を設定
+void SoftwareRasterizer::SetScissor(const SCISSOR_RECT& scissor) { m_Scissor = scissor; }
+
+// 変換行列を設定
+void SoftwareRasterizer::SetTransform(FXMMATRIX worldViewProject) {
+	XMStoreFloat4x4(&m_WorldViewProject, worldViewProject);
+}
+
+// 塗りつぶし
+void SoftwareRasterizer::Clear(const float color[4]) {
+	Flush();
+	if (m_RenderTarget == nullptr) { return; }
+	fill(m_RenderTarget, m_RenderTarget + static_cast<size_t>(m_Width) * m_Height, PackColor(color[0], color[1], color[2], color[3]));
+}
+
+// 三角形リストを振り分ける
+void SoftwareRasterizer::Draw(const VERTEX* vertices, uint32_t vertexNum, const uint32_t* indices, uint32_t indexNum) {
+
+	if (m_RenderTarget == nullptr || indexNum < 3) { return; }
+
+	// 参照されている範囲の頂点だけを変換する
+	uint32_t minIndex = UINT32_MAX, maxIndex = 0;
+	for (uint32_t i = 0; i < indexNum; ++i) {
+		minIndex = min(minIndex, indices[i]);
+		maxIndex = max(maxIndex, indices[i]);
+	}
+	if (maxIndex >= vertexNum) { throw runtime_error("頂点バッファの範囲外を参照しています。"); }
+
+	XMMATRIX worldViewProject = XMLoadFloat4x4(&m_WorldViewProject);
+	m_ClipPositions.resize(maxIndex - minIndex + 1);
+	for (uint32_t i = minIndex; i <= maxIndex; ++i) {
+		XMVECTOR position = XMVectorSet(vertices[i].Position.x, vertices[i].Position.y, vertices[i].Position.z, 1.0f);
+		XMStoreFloat4(&m_ClipPositions[i - minIndex], XMVector4Transform(position, worldViewProject));
+	}
+
+	for (uint32_t i = 0; i + 3 <= indexNum; i += 3) {
+		++m_Statistics.TriangleNum;
+
+		CLIP_VERTEX triangle[3];
+		uint32_t outsideAll = 0x1F;
+		for (int j = 0; j < 3; ++j) {
+			const XMFLOAT4& p = m_ClipPositions[indices[i + j] - minIndex];
+			triangle[j].Position = p;
+			triangle[j].Color = vertices[indices[i + j]].Color;
+
+			uint32_t outside = 0;
+			if (p.x < -p.w) { outside |= 0x01; }
+			if (p.x > p.w) { outside |= 0x02; }
+			if (p.y < -p.w) { outside |= 0x04; }
+			if (p.y > p.w) { outside |= 0x08; }
+			if (p.w < g_MinW) { outside |= 0x10; }
+			outsideAll &= outside;
+		}
+
+		// 3 頂点とも同じ平面の外側にあれば捨てる
+		if (outsideAll != 0) {
+			++m_Statistics.CulledTriangleNum;
+			continue;
+		}
+
+		// w が小さすぎる頂点があれば切ってから扇形に分ける
+		if (triangle[0].Position.w < g_MinW || triangle[1].Position.w < g_MinW || triangle[2].Position.w < g_MinW) {
+			++m_Statistics.ClippedTriangleNum;
+
+			CLIP_VERTEX polygon[4];
+			uint32_t polygonNum = ClipPolygon(triangle, 3, polygon);
+			for (uint32_t j = 1; j + 1 < polygonNum; ++j) {
+				XMFLOAT4 positions[3] = { polygon[0].Position, polygon[j].Position, polygon[j + 1].Position };
+				XMFLOAT4 colors[3] = { polygon[0].Color, polygon[j].Color, polygon[j + 1].Color };
+				SetupTriangle(positions, colors);
+			}
+			continue;
+		}
+
+		XMFLOAT4 positions[3] = { triangle[0].Position, triangle[1].Position, triangle[2].Position };
+		XMFLOAT4 colors[3] = { triangle[0].Color, triangle[1].Color, triangle[2].Color };
+		SetupTriangle(positions, colors);
+	}
+}
+
+// 三角形を画面に並べてタイルに振り分ける
+void SoftwareRasterizer::SetupTriangle(const XMFLOAT4* positions, const XMFLOAT4* colors) {
+
+	// ビューポート変換
+	float x[3], y[3], invW[3];
+	for (int i = 0; i < 3; ++i) {
+		invW[i] = 1.0f / positions[i].w;
+		x[i] = m_Viewport.TopLeftX + (positions[i].x * invW[i] + 1.0f) * 0.5f * m_Viewport.Width;
+		y[i] = m_Viewport.TopLeftY + (1.0f - positions[i].y * invW[i]) * 0.5f * m_Viewport.Height;
+	}
+
+	// 描画範囲 (ビューポート・シザー矩形・描画先の共通部分) と境界矩形
+	int32_t clipMinX = max({ static_cast<int32_t>(floorf(m_Viewport.TopLeftX)), m_Scissor.Left, 0 });
+	int32_t clipMinY = max({ static_cast<int32_t>(floorf(m_Viewport.TopLeftY)), m_Scissor.Top, 0 });
+	int32_t clipMaxX = min({ static_cast<int32_t>(ceilf(m_Viewport.TopLeftX + m_Viewport.Width)), m_Scissor.Right, static_cast<int32_t>(m_Width) });
+	int32_t clipMaxY = min({ static_cast<int32_t>(ceilf(m_Viewport.TopLeftY + m_Viewport.Height)), m_Scissor.Bottom, static_cast<int32_t>(m_Height) });
+
+	// 面積が 0 のものは捨てる (カリングはしないので裏向きは向きを揃える)
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area == 0.0f || !isfinite(area)) {
+		++m_Statistics.CulledTriangleNum;
+		return;
+	}
+	float sign = area > 0.0f ? 1.0f : -1.0f;
+	float invArea = 1.0f / (area * sign);
+
+	RASTER_TRIANGLE triangle = {};
+	triangle.MinX = max(clipMinX, ToPixel(floorf(min({ x[0], x[1], x[2] }))));
+	triangle.MinY = max(clipMinY, ToPixel(floorf(min({ y[0], y[1], y[2] }))));
+	triangle.MaxX = min(clipMaxX, ToPixel(ceilf(max({ x[0], x[1], x[2] }))));
+	triangle.MaxY = min(clipMaxY, ToPixel(ceilf(max({ y[0], y[1], y[2] }))));
+	if (triangle.MinX >= triangle.MaxX || triangle.MinY >= triangle.MaxY) {
+		++m_Statistics.CulledTriangleNum;
+		return;
+	}
+
+	// 辺関数 (頂点 i の向かいの辺、内側が正)
+	for (int i = 0; i < 3; ++i) {
+		int j = (i + 1) % 3, k = (i + 2) % 3;
+		triangle.EdgeA[i] = (y[j] - y[k]) * sign;
+		triangle.EdgeB[i] = (x[k] - x[j]) * sign;
+		triangle.EdgeC[i] = (x[j] * y[k] - x[k] * y[j]) * sign;
+
+		// 左上ルール (値が 0 の画素は上の辺と左の辺だけが持つ)
+		bool topLeft = triangle.EdgeA[i] > 0.0f || (triangle.EdgeA[i] == 0.0f && triangle.EdgeB[i] > 0.0f);
+		if (topLeft) { triangle.TopLeft |= 1u << i; }
+	}
+
+	// 1/w と 色/w の平面式
+	float attributes[5][3];
+	for (int i = 0; i < 3; ++i) {
+		attributes[0][i] = invW[i];
+		attributes[1][i] = colors[i].x * invW[i];
+		attributes[2][i] = colors[i].y * invW[i];
+		attributes[3][i] = colors[i].z * invW[i];
+		attributes[4][i] = colors[i].w * invW[i];
+	}
+	for (int a = 0; a < 5; ++a) {
+		triangle.PlaneP[a] = (triangle.EdgeA[0] * attributes[a][0] + triangle.EdgeA[1] * attributes[a][1] + triangle.EdgeA[2] * attributes[a][2]) * invArea;
+		triangle.PlaneQ[a] = (triangle.EdgeB[0] * attributes[a][0] + triangle.EdgeB[1] * attributes[a][1] + triangle.EdgeB[2] * attributes[a][2]) * invArea;
+		triangle.PlaneR[a] = (triangle.EdgeC[0] * attributes[a][0] + triangle.EdgeC[1] * attributes[a][1] + triangle.EdgeC[2] * attributes[a][2]) * invArea;
+	}
+
+	// 境界矩形が重なるタイルに振り分ける
+	uint32_t index = static_cast<uint32_t>(m_Triangles.size());
+	m_Triangles.push_back(triangle);
+
+	int32_t tileMinX = triangle.MinX / m_TileSize, tileMaxX = (triangle.MaxX - 1) / m_TileSize;
+	int32_t tileMinY = triangle.MinY / m_TileSize, tileMaxY = (triangle.MaxY - 1) / m_TileSize;
+	for (int32_t ty = tileMinY; ty <= tileMaxY; ++ty) {
+		for (int32_t tx = tileMinX; tx <= tileMaxX; ++tx) {
+			m_Bins[static_cast<size_t>(ty) * m_TileX + tx].push_back(index);
+			++m_Statistics.BinnedTriangleNum;
+		}
+	}
+}
+
+// 振り分けた三角形をすべて塗る
+void SoftwareRasterizer::Flush() {
+
+	if (m_Triangles.empty()) { return; }
+
+	// 三角形のあるタイルを 1 つずつジョブにする
+	m_PixelNum = 0;
+	m_JobSystem->Run(static_cast<uint32_t>(m_Bins.size()), [this](uint32_t tile, uint32_t thread) {
+		if (!m_Bins[tile].empty()) { RasterizeTile(tile); }
+	});
+
+	m_Statistics.PixelNum += m_PixelNum;
+	m_Triangles.clear();
+	for (vector<uint32_t>& bin : m_Bins) { bin.clear(); }
+}
+
+// タイルを 1 つ塗る
+void SoftwareRasterizer::RasterizeTile(uint32_t tile) {
+
+	const uint8_t* table = GetSRGBTable();
+
+	const int32_t tileMinX = static_cast<int32_t>(tile % m_TileX) * m_TileSize;
+	const int32_t tileMinY = static_cast<int32_t>(tile / m_TileX) * m_TileSize;
+	const int32_t tileMaxX = min(tileMinX + m_TileSize, static_cast<int32_t>(m_Width));
+	const int32_t tileMaxY = min(tileMinY + m_TileSize, static_cast<int32_t>(m_Height));
+
+	uint64_t pixelNum = 0;
+
+	for (uint32_t index : m_Bins[tile]) {
+		const RASTER_TRIANGLE& t = m_Triangles[index];
+		const int32_t minX = max(t.MinX, tileMinX), maxX = min(t.MaxX, tileMaxX);
+		const int32_t minY = max(t.MinY, tileMinY), maxY = min(t.MaxY, tileMaxY);
+
+		for (int32_t py = minY; py < maxY; ++py) {
+			uint32_t* row = m_RenderTarget + static_cast<size_t>(py) * m_Width;
+			const float cy = static_cast<float>(py) + 0.5f;
+			int32_t px = minX;
+
+#if defined(SIMD_X86)
+			// 4 画素ずつ辺関数を評価する
+			// 前の画素から足していくと丸めがスカラー版とずれるので、画素ごとにスカラー版と同じ順の演算で直接求める
+			const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			__m128 edgeA[3], edgeB[3], edgeC[3], topLeft[3];
+			for (int i = 0; i < 3; ++i) {
+				edgeA[i] = _mm_set1_ps(t.EdgeA[i]);
+				edgeB[i] = _mm_set1_ps(t.EdgeB[i] * cy);
+				edgeC[i] = _mm_set1_ps(t.EdgeC[i]);
+				topLeft[i] = _mm_castsi128_ps(_mm_set1_epi32((t.TopLeft >> i) & 1 ? -1 : 0));
+			}
+
+			for (; px < maxX; px += 4) {
+				__m128 x = _mm_add_ps(_mm_set1_ps(static_cast<float>(px)), laneOffset);
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int i = 0; i < 3; ++i) {
+					__m128 edge = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[i], x), edgeB[i]), edgeC[i]);
+					__m128 positive = _mm_cmpgt_ps(edge, _mm_setzero_ps());
+					__m128 onEdge = _mm_and_ps(_mm_cmpeq_ps(edge, _mm_setzero_ps()), topLeft[i]);
+					inside = _mm_and_ps(inside, _mm_or_ps(positive, onEdge));
+				}
+
+				int mask = _mm_movemask_ps(inside);
+				if (maxX - px < 4) { mask &= (1 << (maxX - px)) - 1; }
+				if (mask == 0) { continue; }
+
+				// 透視補正した色 (平面式もスカラー版と同じ順に評価する)
+				__m128 value[5];
+				for (int a = 0; a < 5; ++a) {
+					value[a] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.PlaneP[a]), x), _mm_set1_ps(t.PlaneQ[a] * cy)), _mm_set1_ps(t.PlaneR[a]));
+				}
+				__m128 w = _mm_div_ps(_mm_set1_ps(1.0f), value[0]);
+				__m128 scale = _mm_set1_ps(static_cast<float>(g_SRGBTableSize - 1));
+				__m128i index[3];
+				for (int c = 0; c < 3; ++c) {
+					__m128 color = _mm_min_ps(_mm_max_ps(_mm_mul_ps(value[c + 1], w), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+					index[c] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(color, scale), _mm_set1_ps(0.5f)));
+				}
+				__m128 alpha = _mm_min_ps(_mm_max_ps(_mm_mul_ps(value[4], w), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+				__m128i alphaByte = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(alpha, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+
+				alignas(16) int32_t r[4], g[4], b[4], a[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(r), index[0]);
+				_mm_store_si128(reinterpret_cast<__m128i*>(g), index[1]);
+				_mm_store_si128(reinterpret_cast<__m128i*>(b), index[2]);
+				_mm_store_si128(reinterpret_cast<__m128i*>(a), alphaByte);
+
+				// 隣のタイルの画素には触れないように、覆われた画素だけを書く
+				for (int lane = 0; lane < 4; ++lane) {
+					if ((mask >> lane) & 1) {
+						row[px + lane] = table[r[lane]] | (table[g[lane]] << 8) | (table[b[lane]] << 16) | (static_cast<uint32_t>(a[lane]) << 24);
+						++pixelNum;
+					}
+				}
+			}
+#else
+			for (; px < maxX; ++px) {
+				const float cx = static_cast<float>(px) + 0.5f;
+				bool inside = true;
+				for (int i = 0; i < 3 && inside; ++i) {
+					float edge = t.EdgeA[i] * cx + t.EdgeB[i] * cy + t.EdgeC[i];
+					inside = edge > 0.0f || (edge == 0.0f && ((t.TopLeft >> i) & 1));
+				}
+				if (!inside) { continue; }
+
+				float value[5];
+				for (int a = 0; a < 5; ++a) { value[a] = t.PlaneP[a] * cx + t.PlaneQ[a] * cy + t.PlaneR[a]; }
+				float w = 1.0f / value[0];
+				row[px] = PackColor(value[1] * w, value[2] * w, value[3] * w, value[4] * w);
+				++pixelNum;
+			}
+#endif
+		}
+	}
+
+	m_PixelNum += pixelNum;
+}
+
+// スレッド数を取得
+uint32_t SoftwareRasterizer::GetThreadNum() const { return m_JobSystem->GetThreadNum(); }
+
+// 統計情報を取得
+RASTERIZER_STATISTICS SoftwareRasterizer::GetStatistics() const { return m_Statistics; }
@@ -0,0 +1,101 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "JobSystem.h"
+#include "RenderBackend.h"
+#include "RenderObject.h"
+
+using namespace std;
+using namespace DirectX;
+
+// ラスタライザの統計情報
+struct RASTERIZER_STATISTICS {
+	uint64_t TriangleNum;
+	uint64_t CulledTriangleNum;
+	uint64_t ClippedTriangleNum;
+	uint64_t BinnedTriangleNum;
+	uint64_t PixelNum;
+};
+
+// 画面に並べたあとの三角形
+// 辺関数と、1/w・色/w の画面上の平面式を持つ (a(x, y) = P * x + Q * y + R)
+struct RASTER_TRIANGLE {
+	float EdgeA[3];
+	float EdgeB[3];
+	float EdgeC[3];
+	float PlaneP[5];
+	float PlaneQ[5];
+	float PlaneR[5];
+	int32_t MinX;
+	int32_t MinY;
+	int32_t MaxX;
+	int32_t MaxY;
+	uint32_t TopLeft;
+};
+
+// ソフトウェアラスタライザ
+// SimpleVS / SimplePS と同じく World → View → Project で変換し、色を透視補正して RGBA8 (sRGB) に書き込む
+// 三角形は画面のタイルに振り分けておき、Flush でタイルごとに複数スレッドで塗る
+// 深度テストはなく、同じタイルの中では投入順に上書きする
+// SSE 版とスカラー版は辺関数と平面式を画素ごとに同じ順の演算で求めるので、どちらでも同じ画像になる
+class SoftwareRasterizer {
+
+private:
+	static const int32_t m_TileSize = 64;
+
+	// 描画先
+	uint32_t* m_RenderTarget;
+	uint32_t m_Width;
+	uint32_t m_Height;
+	uint32_t m_TileX;
+	uint32_t m_TileY;
+
+	// 描画範囲と変換行列
+	VIEWPORT m_Viewport;
+	SCISSOR_RECT m_Scissor;
+	XMFLOAT4X4 m_WorldViewProject;
+
+	// 変換後の頂点 (クリップ空間)
+	vector<XMFLOAT4> m_ClipPositions;
+
+	// タイルに振り分けた三角形
+	vector<RASTER_TRIANGLE> m_Triangles;
+	vector<vector<uint32_t>> m_Bins;
+
+	// タイルを塗るスレッド
+	unique_ptr<JobSystem> m_JobSystem;
+	atomic<uint64_t> m_PixelNum;
+
+	RASTERIZER_STATISTICS m_Statistics;
+
+	void SetupTriangle(const XMFLOAT4* positions, const XMFLOAT4* colors);
+	void RasterizeTile(uint32_t tile);
+
+public:
+	// threadNum が 0 なら論理コア数だけ使う
+	SoftwareRasterizer(uint32_t threadNum = 0);
+	~SoftwareRasterizer() = default;
+
+	// 描画先 (width * height の RGBA8)
+	void SetRenderTarget(uint32_t* pixels, uint32_t width, uint32_t height);
+	void SetViewport(const VIEWPORT& viewport);
+	void SetScissor(const SCISSOR_RECT& scissor);
+	void SetTransform(FXMMATRIX worldViewProject);
+
+	// 塗りつぶし (色は線形で指定する)
+	void Clear(const float color[4]);
+
+	// 三角形リストを振り分ける (indices は vertices の先頭からの番号)
+	void Draw(const VERTEX* vertices, uint32_t vertexNum, const uint32_t* indices, uint32_t indexNum);
+
+	// 振り分けた三角形をすべて塗る
+	void Flush();
+
+	uint32_t GetThreadNum() const;
+	RASTERIZER_STATISTICS GetStatistics() const;
+};
@@ -0,0 +1,208 @@
+﻿#include "StateFilterCommandList.h"
+
+#include <cstring>
+
+// 頂点バッファビューが同じかどうか
+static bool IsSameView(const VERTEX_BUFFER_VIEW& a, const VERTEX_BUFFER_VIEW& b) {
+	return a.BufferLocation == b.BufferLocation && a.SizeInBytes == b.SizeInBytes && a.StrideInBytes == b.StrideInBytes;
+}
+
+// インデックスバッファビューが同じかどうか
+static bool IsSameView(const INDEX_BUFFER_VIEW& a, const INDEX_BUFFER_VIEW& b) {
+	return a.BufferLocation == b.BufferLocation && a.SizeInBytes == b.SizeInBytes && a.Format == b.Format;
+}
+
+// コンストラクタ
+StateFilterCommandList::StateFilterCommandList(unique_ptr<CommandList> commandList):
+	m_CommandList(move(commandList)),
+	m_Enabled(true),
+	m_State(),
+	m_Statistics() {
+
+	Invalidate();
+}
+
+// 状態の写しを捨てる
+void StateFilterCommandList::Invalidate() {
+	memset(&m_State, 0, sizeof(m_State));
+}
+
+// 呼び出しを渡すかどうかを数える
+bool StateFilterCommandList::Filter(STATE_CALL call, bool redundant) {
+	size_t index = static_cast<size_t>(call);
+	if (m_Enabled && redundant) {
+		++m_Statistics.Elided[index];
+		return false;
+	}
+	++m_Statistics.Issued[index];
+	m_State.Valid[index] = true;
+	return true;
+}
+
+// 有効・無効を設定
+void StateFilterCommandList::SetEnabled(bool enabled) { m_Enabled = enabled; }
+
+// 有効かどうか
+bool StateFilterCommandList::IsEnabled() const { return m_Enabled; }
+
+// 下のコマンドリストを取得
+CommandList* StateFilterCommandList::GetCommandList() const { return m_CommandList.get(); }
+
+// 統計情報を取得
+STATE_FILTER_STATISTICS StateFilterCommandList::GetStatistics() const { return m_Statistics; }
+
+// 統計情報を 0 に戻す
+void StateFilterCommandList::ResetStatistics() { m_Statistics = STATE_FILTER_STATISTICS(); }
+
+// 呼び出しの種類の名前を取得
+const char* StateFilterCommandList::GetCallName(STATE_CALL call) {
+	static const char* names[] = {
+		"OMSetRenderTarget",
+		"SetGraphicsRootSignature",
+		"SetDescriptorHeaps",
+		"SetGraphicsRootConstantBufferView",
+		"SetPipelineState",
+		"IASetPrimitiveTopology",
+		"IASetVertexBuffers",
+		"IASetIndexBuffer",
+		"RSSetViewports",
+		"RSSetScissorRects",
+	};
+	static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(STATE_CALL::NUM), "STATE_CALL の名前が足りません。");
+	return names[static_cast<size_t>(call)];
+}
+
+// 記録を始める (状態は何も設定されていないところから)
+void StateFilterCommandList::Reset(uint32_t frameIndex) {
+	Invalidate();
+	m_CommandList->Reset(frameIndex);
+}
+
+// 記録を終える
+void StateFilterCommandList::Close() { m_CommandList->Close(); }
+
+// 状態に関わらない呼び出しはそのまま渡す
+void StateFilterCommandList::ResourceBarrier(uint32_t num, const RESOURCE_BARRIER* barriers) { m_CommandList->ResourceBarrier(num, barriers); }
+void StateFilterCommandList::CopyBufferRegion(RESOURCE_HANDLE dest, uint64_t destOffset, RESOURCE_HANDLE src, uint64_t srcOffset, uint64_t size) { m_CommandList->CopyBufferRegion(dest, destOffset, src, srcOffset, size); }
+void StateFilterCommandList::ClearRenderTargetView(RESOURCE_HANDLE renderTarget, const float color[4]) { m_CommandList->ClearRenderTargetView(renderTarget, color); }
+void StateFilterCommandList::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) { m_CommandList->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance); }
+
+// レンダーターゲット
+void StateFilterCommandList::OMSetRenderTarget(RESOURCE_HANDLE renderTarget) {
+	bool redundant = m_State.Valid[static_cast<size_t>(STATE_CALL::RENDER_TARGET)] && m_State.RenderTarget == renderTarget;
+	if (!Filter(STATE_CALL::RENDER_TARGET, redundant)) { return; }
+	m_State.RenderTarget = renderTarget;
+	m_CommandList->OMSetRenderTarget(renderTarget);
+}
+
+// ルートシグニチャ (変わればルート引数も設定し直しになる)
+void StateFilterCommandList::SetGraphicsRootSignature(ROOT_SIGNATURE_HANDLE rootSignature) {
+	bool redundant = m_State.Valid[static_cast<size_t>(STATE_CALL::ROOT_SIGNATURE)] && m_State.RootSignature == rootSignature;
+	if (!Filter(STATE_CALL::ROOT_SIGNATURE, redundant)) { return; }
+	m_State.RootSignature = rootSignature;
+	memset(m_State.RootConstantBufferValid, 0, sizeof(m_State.RootConstantBufferValid));
+	m_CommandList->SetGraphicsRootSignature(rootSignature);
+}
+
+// ディスクリプタヒープ
+void StateFilterCommandList::SetDescriptorHeaps(uint32_t num, const DESCRIPTOR_HEAP_HANDLE* heaps) {
+	bool redundant = m_State.Valid[static_cast<size_t>(STATE_CALL::DESCRIPTOR_HEAPS)] && m_State.DescriptorHeapNum == num && memcmp(m_State.DescriptorHeaps, heaps, num * sizeof(DESCRIPTOR_HEAP_HANDLE)) == 0;
+	if (!Filter(STATE_CALL::DESCRIPTOR_HEAPS, redundant)) { return; }
+
+	// 写しに収まらなければ、次は必ず渡す
+	if (num <= m_MaxDescriptorHeaps) {
+		m_State.DescriptorHeapNum = num;
+		memcpy(m_State.DescriptorHeaps, heaps, num * sizeof(DESCRIPTOR_HEAP_HANDLE));
+	}
+	else {
+		m_State.Valid[static_cast<size_t>(STATE_CALL::DESCRIPTOR_HEAPS)] = false;
+	}
+	m_CommandList->SetDescriptorHeaps(num, heaps);
+}
+
+// ルートの定数バッファビュー (パラメータごと)
+void StateFilterCommandList::SetGraphicsRootConstantBufferView(uint32_t parameterIndex, GPU_ADDRESS address) {
+	bool tracked = parameterIndex < m_MaxRootParameters;
+	bool redundant = tracked && m_State.RootConstantBufferValid[parameterIndex] && m_State.RootConstantBuffers[parameterIndex] == address;
+	if (!Filter(STATE_CALL::ROOT_CONSTANT_BUFFER_VIEW, redundant)) { return; }
+	if (tracked) {
+		m_State.RootConstantBufferValid[parameterIndex] = true;
+		m_State.RootConstantBuffers[parameterIndex] = address;
+	}
+	m_CommandList->SetGraphicsRootConstantBufferView(parameterIndex, address);
+}
+
+// パイプラインステート
+void StateFilterCommandList::SetPipelineState(PIPELINE_HANDLE pipelineState) {
+	bool redundant = m_State.Valid[static_cast<size_t>(STATE_CALL::PIPELINE_STATE)] && m_State.PipelineState == pipelineState;
+	if (!Filter(STATE_CALL::PIPELINE_STATE, redundant)) { return; }
+	m_State.PipelineState = pipelineState;
+	m_CommandList->SetPipelineState(pipelineState);
+}
+
+// プリミティブの種類
+void StateFilterCommandList::IASetPrimitiveTopology(PRIMITIVE_TOPOLOGY topology) {
+	bool redundant = m_State.Valid[static_cast<size_t>(STATE_CALL::PRIMITIVE_TOPOLOGY)] && m_State.PrimitiveTopology == topology;
+	if (!Filter(STATE_CALL::PRIMITIVE_TOPOLOGY, redundant)) { return; }
+	m_State.PrimitiveTopology = topology;
+	m_CommandList->IASetPrimitiveTopology(topology);
+}
+
+// 頂点バッファ (スロットごと、すべて同じときだけ省く)
+void StateFilterCommandList::IASetVertexBuffers(uint32_t startSlot, uint32_t num, const VERTEX_BUFFER_VIEW* views) {
+	bool tracked = startSlot + num <= m_MaxVertexBuffers && views != nullptr;
+	bool redundant = tracked;
+	for (uint32_t i = 0; i < num && redundant; ++i) {
+		redundant = m_State.VertexBufferValid[startSlot + i] && IsSameView(m_State.VertexBuffers[startSlot + i], views[i]);
+	}
+	if (!Filter(STATE_CALL::VERTEX_BUFFERS, redundant)) { return; }
+
+	// 追えない範囲を設定されたら、すべてのスロットを分からないものとする
+	if (tracked) {
+		for (uint32_t i = 0; i < num; ++i) {
+			m_State.VertexBufferValid[startSlot + i] = true;
+			m_State.VertexBuffers[startSlot + i] = views[i];
+		}
+	}
+	else {
+		memset(m_State.VertexBufferValid, 0, sizeof(m_State.VertexBufferValid));
+	}
+	m_CommandList->IASetVertexBuffers(startSlot, num, views);
+}
+
+// インデックスバッファ (nullptr は外す)
+void StateFilterCommandList::IASetIndexBuffer(const INDEX_BUFFER_VIEW* view) {
+	bool redundant = m_State.Valid[static_cast<size_t>(STATE_CALL::INDEX_BUFFER)] && m_State.IndexBufferBound == (view != nullptr) && (view == nullptr || IsSameView(m_State.IndexBuffer, *view));
+	if (!Filter(STATE_CALL::INDEX_BUFFER, redundant)) { return; }
+	m_State.IndexBufferBound = view != nullptr;
+	if (view != nullptr) { m_State.IndexBuffer = *view; }
+	m_CommandList->IASetIndexBuffer(view);
+}
+
+// ビューポート
+void StateFilterCommandList::RSSetViewports(uint32_t num, const VIEWPORT* viewports) {
+	bool redundant = m_State.Valid[static_cast<size_t>(STATE_CALL::VIEWPORTS)] && m_State.ViewportNum == num && memcmp(m_State.Viewports, viewports, num * sizeof(VIEWPORT)) == 0;
+	if (!Filter(STATE_CALL::VIEWPORTS, redundant)) { return; }
+	if (num <= m_MaxViewports) {
+		m_State.ViewportNum = num;
+		memcpy(m_State.Viewports, viewports, num * sizeof(VIEWPORT));
+	}
+	else {
+		m_State.Valid[static_cast<size_t>(STATE_CALL::VIEWPORTS)] = false;
+	}
+	m_CommandList->RSSetViewports(num, viewports);
+}
+
+// シザー矩形
+void StateFilterCommandList::RSSetScissorRects(uint32_t num, const SCISSOR_RECT* rects) {
+	bool redundant = m_State.Valid[static_cast<size_t>(STATE_CALL::SCISSOR_RECTS)] && m_State.ScissorRectNum == num && memcmp(m_State.ScissorRects, rects, num * sizeof(SCISSOR_RECT)) == 0;
+	if (!Filter(STATE_CALL::SCISSOR_RECTS, redundant)) { return; }
+	if (num <= m_MaxViewports) {
+		m_State.ScissorRectNum = num;
+		memcpy(m_State.ScissorRects, rects, num * sizeof(SCISSOR_RECT));
+	}
+	else {
+		m_State.Valid[static_cast<size_t>(STATE_CALL::SCISSOR_RECTS)] = false;
+	}
+	m_CommandList->RSSetScissorRects(num, rects);
+}
@@ -0,0 +1,112 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "RenderBackend.h"
+
+using namespace std;
+
+// 状態を設定する呼び出しの種類
+enum class STATE_CALL {
+	RENDER_TARGET,
+	ROOT_SIGNATURE,
+	DESCRIPTOR_HEAPS,
+	ROOT_CONSTANT_BUFFER_VIEW,
+	PIPELINE_STATE,
+	PRIMITIVE_TOPOLOGY,
+	VERTEX_BUFFERS,
+	INDEX_BUFFER,
+	VIEWPORTS,
+	SCISSOR_RECTS,
+	NUM,
+};
+
+// 状態の呼び出しの統計情報 (種類ごとに、下のコマンドリストへ渡した数と省いた数)
+struct STATE_FILTER_STATISTICS {
+	uint64_t Issued[static_cast<size_t>(STATE_CALL::NUM)];
+	uint64_t Elided[static_cast<size_t>(STATE_CALL::NUM)];
+};
+
+// 冗長な状態の設定を省くコマンドリスト
+// 下のコマンドリストに設定した状態の写しを持ち、写しと同じ値を設定する呼び出しは渡さずに数えるだけにする
+// 状態はコマンドリストごとに始めからやり直しになるので、Reset で写しを捨てる
+// ルートシグニチャを変えるとルート引数も無効になるので、ルートの定数バッファビューの写しも捨てる
+class StateFilterCommandList : public CommandList {
+
+private:
+	static const uint32_t m_MaxRootParameters = 16;
+	static const uint32_t m_MaxVertexBuffers = 16;
+	static const uint32_t m_MaxDescriptorHeaps = 2;
+	static const uint32_t m_MaxViewports = 16;
+
+	unique_ptr<CommandList> m_CommandList;
+	bool m_Enabled;
+
+	// 下のコマンドリストに設定した状態 (Valid が false のものはまだ設定していない)
+	struct SHADOW_STATE {
+		bool Valid[static_cast<size_t>(STATE_CALL::NUM)];
+		RESOURCE_HANDLE RenderTarget;
+		ROOT_SIGNATURE_HANDLE RootSignature;
+		uint32_t DescriptorHeapNum;
+		DESCRIPTOR_HEAP_HANDLE DescriptorHeaps[m_MaxDescriptorHeaps];
+		bool RootConstantBufferValid[m_MaxRootParameters];
+		GPU_ADDRESS RootConstantBuffers[m_MaxRootParameters];
+		PIPELINE_HANDLE PipelineState;
+		PRIMITIVE_TOPOLOGY PrimitiveTopology;
+		bool VertexBufferValid[m_MaxVertexBuffers];
+		VERTEX_BUFFER_VIEW VertexBuffers[m_MaxVertexBuffers];
+		bool IndexBufferBound;
+		INDEX_BUFFER_VIEW IndexBuffer;
+		uint32_t ViewportNum;
+		VIEWPORT Viewports[m_MaxViewports];
+		uint32_t ScissorRectNum;
+		SCISSOR_RECT ScissorRects[m_MaxViewports];
+	};
+	SHADOW_STATE m_State;
+
+	STATE_FILTER_STATISTICS m_Statistics;
+
+	void Invalidate();
+
+	// 呼び出しを渡すかどうかを数える (渡すなら true)
+	bool Filter(STATE_CALL call, bool redundant);
+
+public:
+	StateFilterCommandList(unique_ptr<CommandList> commandList);
+
+	// 無効にすると、すべての呼び出しを下のコマンドリストに渡す (数えるのは同じ)
+	void SetEnabled(bool enabled);
+	bool IsEnabled() const;
+
+	// 下のコマンドリスト (ExecuteCommandLists にはこちらを渡す)
+	CommandList* GetCommandList() const;
+
+	STATE_FILTER_STATISTICS GetStatistics() const;
+	void ResetStatistics();
+
+	// 呼び出しの種類の名前
+	static const char* GetCallName(STATE_CALL call);
+
+	void Reset(uint32_t frameIndex) override;
+	void Close() override;
+
+	void ResourceBarrier(uint32_t num, const RESOURCE_BARRIER* barriers) override;
+	void CopyBufferRegion(RESOURCE_HANDLE dest, uint64_t destOffset, RESOURCE_HANDLE src, uint64_t srcOffset, uint64_t size) override;
+
+	void OMSetRenderTarget(RESOURCE_HANDLE renderTarget) override;
+	void ClearRenderTargetView(RESOURCE_HANDLE renderTarget, const float color[4]) override;
+
+	void SetGraphicsRootSignature(ROOT_SIGNATURE_HANDLE rootSignature) override;
+	void SetDescriptorHeaps(uint32_t num, const DESCRIPTOR_HEAP_HANDLE* heaps) override;
+	void SetGraphicsRootConstantBufferView(uint32_t parameterIndex, GPU_ADDRESS address) override;
+	void SetPipelineState(PIPELINE_HANDLE pipelineState) override;
+
+	void IASetPrimitiveTopology(PRIMITIVE_TOPOLOGY topology) override;
+	void IASetVertexBuffers(uint32_t startSlot, uint32_t num, const VERTEX_BUFFER_VIEW* views) override;
+	void IASetIndexBuffer(const INDEX_BUFFER_VIEW* view) override;
+	void RSSetViewports(uint32_t num, const VIEWPORT* viewports) override;
+	void RSSetScissorRects(uint32_t num, const SCISSOR_RECT* rects) override;
+
+	void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) override;
+};
@@ -0,0 +1,102 @@
+﻿#include "TestScene.h"
+#include "MeshOptimizer.h"
+
+// コンストラクタ
+TestScene::TestScene(Graphic* graphic):
+	m_Graphic(graphic),
+	m_DemoNodes(),
+	m_ObjectMesh(INVALID_MESH_HANDLE),
+	m_ObjectNum(0),
+	m_Streams(),
+	m_SphereChain(nullptr),
+	m_SphereMeshes(),
+	m_SphereNum(0),
+	m_Simulation(nullptr) {
+
+	// 登録する前に頂点を並べ替えておく (深度テストなしで描くので三角形の順は保つ)
+	Octahedron object;
+	MeshOptimizer::OptimizeKeepingOrder(object);
+	m_ObjectMesh = m_Graphic->RegisterMesh(object);
+
+	// 球の LOD チェイン (各段階は作るときに並べ替え済み)
+	m_SphereChain = LodChain::CreateSphere(Octahedron(), 6);
+	for (uint32_t level = 0; level < m_SphereChain->GetLevelNum(); ++level) {
+		m_SphereMeshes.push_back(m_Graphic->RegisterMesh(m_SphereChain->GetLevel(level)));
+	}
+}
+
+// 描くものを積む
+void TestScene::Submit() {
+
+	// デモ用のインスタンス
+	for (TRANSFORM_NODE node : m_DemoNodes) {
+		m_Graphic->DrawInstance(m_ObjectMesh, m_Graphic->GetWorldMatrix(node));
+	}
+
+	// 画面上部に格子状に並べる
+	for (uint32_t i = 0; i < m_ObjectNum; ++i) {
+		XMMATRIX scale = XMMatrixScaling(0.05f, 0.05f, 0.05f);
+		XMMATRIX translate = XMMatrixTranslation(-2.4f + 0.15f * (i % 32), 1.4f - 0.15f * ((i / 32) % 8), -0.1f * (i / 256));
+		m_Graphic->DrawObject(m_ObjectMesh, XMMatrixMultiply(scale, translate));
+	}
+
+	// 後から読み込んだメッシュ (まだ登録されていないものは飛ばす)
+	for (size_t i = 0; i < m_Streams.size(); ++i) {
+		MESH_HANDLE mesh = m_Graphic->GetStreamedMesh(m_Streams[i]);
+		if (mesh == INVALID_MESH_HANDLE) { continue; }
+		XMMATRIX scale = XMMatrixScaling(0.08f, 0.08f, 0.08f);
+		XMMATRIX translate = XMMatrixTranslation(-2.3f + 0.2f * (i % 24), -0.5f - 0.2f * ((i / 24) % 3), 0.0f);
+		m_Graphic->DrawObject(mesh, XMMatrixMultiply(scale, translate));
+	}
+
+	// 球 (重なるので奥から描くパスに入れる)
+	for (uint32_t i = 0; i < m_SphereNum; ++i) {
+		XMMATRIX scale = XMMatrixScaling(0.3f, 0.3f, 0.3f);
+		XMMATRIX translate = XMMatrixTranslation(-2.0f + 1.0f * (i % 5), 0.6f, -2.0f * (i / 5));
+		XMMATRIX world = XMMatrixMultiply(scale, translate);
+		m_Graphic->DrawObject(m_SphereMeshes[m_Graphic->SelectLod(*m_SphereChain, world)], world, RENDER_PASS::DEPTH_SORTED);
+	}
+
+	// 別のスレッドで動かしているオブジェクト (新しいスナップショットがなければ前のものをもう一度描く)
+	// 視錐台は次のステップから使われるので、描くものは 1 ステップ分遅れたビューで集めたものになる
+	if (m_Simulation != nullptr) {
+		m_Simulation->SubmitInput(m_Graphic->GetFrustum());
+		const SIMULATION_SNAPSHOT& snapshot = m_Simulation->Acquire();
+		for (const XMFLOAT4X4& world : snapshot.Worlds) { m_Graphic->DrawInstance(m_ObjectMesh, XMLoadFloat4x4(&world)); }
+	}
+}
+
+// デモ用のインスタンスを置く
+void TestScene::CreateDemo() {
+	TRANSFORM_NODE root = m_Graphic->AddTransformNode(INVALID_TRANSFORM_NODE, XMFLOAT3(0.0f, -1.2f, 0.0f));
+	for (int i = 0; i < 16; ++i) {
+		m_DemoNodes.push_back(m_Graphic->AddTransformNode(root, XMFLOAT3(-2.25f + 0.3f * i, 0.0f, 0.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), XMFLOAT3(0.1f, 0.1f, 0.1f)));
+	}
+}
+
+// オブジェクトの数を設定
+void TestScene::SetObjectNum(uint32_t num) {
+	m_ObjectNum = num;
+}
+
+// 格子を num 個要求する
+void TestScene::RequestStreams(uint32_t num) {
+	for (uint32_t i = 0; i < num; ++i) {
+		m_Streams.push_back(m_Graphic->StreamMesh([] { return make_unique<Grid>(16); }));
+	}
+}
+
+// メッシュファイルを要求する
+void TestScene::RequestStream(const char* path) {
+	m_Streams.push_back(m_Graphic->StreamMesh(path));
+}
+
+// 球の数を設定
+void TestScene::SetSphereNum(uint32_t num) {
+	m_SphereNum = num;
+}
+
+// 別のスレッドで動かしているオブジェクトを設定
+void TestScene::SetSimulation(Simulation* simulation) {
+	m_Simulation = simulation;
+}
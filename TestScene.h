@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "Graphic.h"
+#include "Simulation.h"
+
+using namespace std;
+using namespace DirectX;
+
+// 負荷計測用とデモ用のシーン
+// 描画インタフェースの外から、アプリケーションと同じ公開の関数でメッシュを登録し、フレームごとに描くものを積む
+class TestScene {
+
+private:
+	Graphic* m_Graphic;
+
+	// デモ用のインスタンス (変換の階層で 1 つの親の子として画面下部に並べる)
+	vector<TRANSFORM_NODE> m_DemoNodes;
+
+	// 画面上部に格子状に並べるオブジェクト (1 つにつき 1 回のドロー)
+	MESH_HANDLE m_ObjectMesh;
+	uint32_t m_ObjectNum;
+
+	// 後から読み込むメッシュ (登録できたものから画面下部に並べる)
+	vector<STREAM_REQUEST> m_Streams;
+
+	// 正八面体から作った球の LOD (段階をすべて登録し、奥へ行くほど粗い段階が選ばれるように奥へ並べる)
+	unique_ptr<LodChain> m_SphereChain;
+	vector<MESH_HANDLE> m_SphereMeshes;
+	uint32_t m_SphereNum;
+
+	// 別のスレッドで動かしているオブジェクト (アプリケーションが持つ、なければ nullptr)
+	Simulation* m_Simulation;
+
+public:
+	TestScene(Graphic* graphic);
+	~TestScene() = default;
+	TestScene(const TestScene&) = delete;
+	TestScene& operator=(const TestScene&) = delete;
+
+	// フレームの始めに呼ばれ、描くものを積む
+	void Submit();
+
+	// デモ用のインスタンスを置く (負荷計測では -demo を付けたときだけ置く)
+	void CreateDemo();
+
+	void SetObjectNum(uint32_t num);
+
+	// 格子を num 個ワーカースレッドで作るように要求する
+	void RequestStreams(uint32_t num);
+
+	// メッシュファイルをワーカースレッドで読むように要求する
+	void RequestStream(const char* path);
+
+	void SetSphereNum(uint32_t num);
+
+	// フレームごとに視錐台を渡し、公開された最新のスナップショットをインスタンスとして描く
+	void SetSimulation(Simulation* simulation);
+};
@@ -0,0 +1,510 @@
+﻿#include "TransformEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Profiler.h"
+#include "Simd.h"
+
+// 1 つのジョブでまとめて変換するレンダリングオブジェクトの数
+static const uint32_t TRANSFORM_OBJECT_BATCH_SIZE = 16;
+
+// スカラー版 (Bounds なら変換後の位置の最小と最大を minimum / maximum に混ぜる)
+template <bool Bounds>
+static void TransformScalar(uint8_t* base, size_t stride, size_t count, const XMFLOAT4X4& m, XMFLOAT3* minimum, XMFLOAT3* maximum) {
+	for (size_t i = 0; i < count; ++i) {
+		XMFLOAT3* p = reinterpret_cast<XMFLOAT3*>(base + stride * i);
+		float x = p->x, y = p->y, z = p->z;
+		p->x = x * m._11 + y * m._21 + z * m._31 + m._41;
+		p->y = x * m._12 + y * m._22 + z * m._32 + m._42;
+		p->z = x * m._13 + y * m._23 + z * m._33 + m._43;
+		if (Bounds) {
+			minimum->x = min(minimum->x, p->x); maximum->x = max(maximum->x, p->x);
+			minimum->y = min(minimum->y, p->y); maximum->y = max(maximum->y, p->y);
+			minimum->z = min(minimum->z, p->z); maximum->z = max(maximum->z, p->z);
+		}
+	}
+}
+
+#if defined(SIMD_X86)
+
+// 成分ごとの最小と最大 (x, y, z の順に 4 レーン分) を minimum / maximum に混ぜる
+static void MergeBounds(const __m128 lower[3], const __m128 upper[3], XMFLOAT3* minimum, XMFLOAT3* maximum) {
+	alignas(16) float values[4];
+	float* minimums = &minimum->x;
+	float* maximums = &maximum->x;
+	for (int k = 0; k < 3; ++k) {
+		_mm_store_ps(values, lower[k]);
+		minimums[k] = min(minimums[k], min(min(values[0], values[1]), min(values[2], values[3])));
+		_mm_store_ps(values, upper[k]);
+		maximums[k] = max(maximums[k], max(max(values[0], values[1]), max(values[2], values[3])));
+	}
+}
+
+// 4 行 4 列を転置する (r0..r3 を置き換える)
+// シャッフルはレーンごとに働くので、AVX2 版でも 128 ビットずつ別の 4 行を入れて同じ手順で使う
+#define TRANSPOSE4(SUFFIX, r0, r1, r2, r3) { \
+	decltype(r0) t0 = _mm##SUFFIX##_unpacklo_ps(r0, r1), t1 = _mm##SUFFIX##_unpacklo_ps(r2, r3); \
+	decltype(r0) t2 = _mm##SUFFIX##_unpackhi_ps(r0, r1), t3 = _mm##SUFFIX##_unpackhi_ps(r2, r3); \
+	r0 = _mm##SUFFIX##_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)); r1 = _mm##SUFFIX##_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)); \
+	r2 = _mm##SUFFIX##_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)); r3 = _mm##SUFFIX##_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2)); }
+
+// ストライドのある位置ストリーム (VERTEX の配列など) の SSE 版 (4 頂点ずつ)
+// 1 頂点ごとに位置とその後ろの 4 バイトを 16 バイトのロードで読み、転置して成分ごとに分ける
+// 書き戻すときも後ろの 4 バイトは読んだ値のまま 16 バイトでストアする (同じ配列を別のスレッドが書き換えていないこと)
+// 最後の頂点の後ろは配列の外かもしれないので、最後の頂点を含むブロックはスカラー版に残す
+// stride が 16 バイト未満なら後ろの 4 バイトが次の頂点の位置と重なるので使わない
+template <bool Bounds>
+static size_t TransformSSE(uint8_t* base, size_t stride, size_t count, const XMFLOAT4X4& m, XMFLOAT3* minimum, XMFLOAT3* maximum) {
+
+	if (stride < sizeof(__m128)) { return 0; }
+
+	const __m128 m11 = _mm_set1_ps(m._11), m12 = _mm_set1_ps(m._12), m13 = _mm_set1_ps(m._13);
+	const __m128 m21 = _mm_set1_ps(m._21), m22 = _mm_set1_ps(m._22), m23 = _mm_set1_ps(m._23);
+	const __m128 m31 = _mm_set1_ps(m._31), m32 = _mm_set1_ps(m._32), m33 = _mm_set1_ps(m._33);
+	const __m128 m41 = _mm_set1_ps(m._41), m42 = _mm_set1_ps(m._42), m43 = _mm_set1_ps(m._43);
+
+	const __m128 largest = _mm_set1_ps(numeric_limits<float>::max()), smallest = _mm_set1_ps(-numeric_limits<float>::max());
+	__m128 lower[3] = { largest, largest, largest };
+	__m128 upper[3] = { smallest, smallest, smallest };
+
+	size_t i = 0;
+	for (; i + 4 < count; i += 4) {
+		float* p0 = reinterpret_cast<float*>(base + stride * i);
+		float* p1 = reinterpret_cast<float*>(base + stride * (i + 1));
+		float* p2 = reinterpret_cast<float*>(base + stride * (i + 2));
+		float* p3 = reinterpret_cast<float*>(base + stride * (i + 3));
+
+		__m128 vx = _mm_loadu_ps(p0), vy = _mm_loadu_ps(p1), vz = _mm_loadu_ps(p2), vw = _mm_loadu_ps(p3);
+		TRANSPOSE4(, vx, vy, vz, vw);
+
+		__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m11), _mm_mul_ps(vy, m21)), _mm_add_ps(_mm_mul_ps(vz, m31), m41));
+		__m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m12), _mm_mul_ps(vy, m22)), _mm_add_ps(_mm_mul_ps(vz, m32), m42));
+		__m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m13), _mm_mul_ps(vy, m23)), _mm_add_ps(_mm_mul_ps(vz, m33), m43));
+
+		if (Bounds) {
+			lower[0] = _mm_min_ps(lower[0], rx); upper[0] = _mm_max_ps(upper[0], rx);
+			lower[1] = _mm_min_ps(lower[1], ry); upper[1] = _mm_max_ps(upper[1], ry);
+			lower[2] = _mm_min_ps(lower[2], rz); upper[2] = _mm_max_ps(upper[2], rz);
+		}
+
+		TRANSPOSE4(, rx, ry, rz, vw);
+		_mm_storeu_ps(p0, rx);
+		_mm_storeu_ps(p1, ry);
+		_mm_storeu_ps(p2, rz);
+		_mm_storeu_ps(p3, vw);
+	}
+
+	if (Bounds && i > 0) { MergeBounds(lower, upper, minimum, maximum); }
+	return i;
+}
+
+// ストライドのある位置ストリームの AVX2 版 (8 頂点、下位 128 ビットに前の 4 頂点、上位に後ろの 4 頂点を入れる)
+template <bool Bounds>
+SIMD_TARGET_AVX2 static size_t TransformAVX2(uint8_t* base, size_t stride, size_t count, const XMFLOAT4X4& m, XMFLOAT3* minimum, XMFLOAT3* maximum) {
+
+	if (stride < sizeof(__m128)) { return 0; }
+
+	const __m256 m11 = _mm256_set1_ps(m._11), m12 = _mm256_set1_ps(m._12), m13 = _mm256_set1_ps(m._13);
+	const __m256 m21 = _mm256_set1_ps(m._21), m22 = _mm256_set1_ps(m._22), m23 = _mm256_set1_ps(m._23);
+	const __m256 m31 = _mm256_set1_ps(m._31), m32 = _mm256_set1_ps(m._32), m33 = _mm256_set1_ps(m._33);
+	const __m256 m41 = _mm256_set1_ps(m._41), m42 = _mm256_set1_ps(m._42), m43 = _mm256_set1_ps(m._43);
+
+	const __m256 largest = _mm256_set1_ps(numeric_limits<float>::max()), smallest = _mm256_set1_ps(-numeric_limits<float>::max());
+	__m256 lower[3] = { largest, largest, largest };
+	__m256 upper[3] = { smallest, smallest, smallest };
+
+	size_t i = 0;
+	for (; i + 8 < count; i += 8) {
+		float* p[8];
+		for (int j = 0; j < 8; ++j) { p[j] = reinterpret_cast<float*>(base + stride * (i + j)); }
+
+		__m256 vx = _mm256_loadu2_m128(p[4], p[0]), vy = _mm256_loadu2_m128(p[5], p[1]);
+		__m256 vz = _mm256_loadu2_m128(p[6], p[2]), vw = _mm256_loadu2_m128(p[7], p[3]);
+		TRANSPOSE4(256, vx, vy, vz, vw);
+
+		__m256 rx = _mm256_fmadd_ps(vx, m11, _mm256_fmadd_ps(vy, m21, _mm256_fmadd_ps(vz, m31, m41)));
+		__m256 ry = _mm256_fmadd_ps(vx, m12, _mm256_fmadd_ps(vy, m22, _mm256_fmadd_ps(vz, m32, m42)));
+		__m256 rz = _mm256_fmadd_ps(vx, m13, _mm256_fmadd_ps(vy, m23, _mm256_fmadd_ps(vz, m33, m43)));
+
+		if (Bounds) {
+			lower[0] = _mm256_min_ps(lower[0], rx); upper[0] = _mm256_max_ps(upper[0], rx);
+			lower[1] = _mm256_min_ps(lower[1], ry); upper[1] = _mm256_max_ps(upper[1], ry);
+			lower[2] = _mm256_min_ps(lower[2], rz); upper[2] = _mm256_max_ps(upper[2], rz);
+		}
+
+		TRANSPOSE4(256, rx, ry, rz, vw);
+		_mm256_storeu2_m128(p[4], p[0], rx);
+		_mm256_storeu2_m128(p[5], p[1], ry);
+		_mm256_storeu2_m128(p[6], p[2], rz);
+		_mm256_storeu2_m128(p[7], p[3], vw);
+	}
+
+	if (Bounds && i > 0) {
+		__m128 lower128[3], upper128[3];
+		for (int k = 0; k < 3; ++k) {
+			lower128[k] = _mm_min_ps(_mm256_castps256_ps128(lower[k]), _mm256_extractf128_ps(lower[k], 1));
+			upper128[k] = _mm_max_ps(_mm256_castps256_ps128(upper[k]), _mm256_extractf128_ps(upper[k], 1));
+		}
+		MergeBounds(lower128, upper128, minimum, maximum);
+	}
+	return i;
+}
+
+// 詰めて並んだ位置ストリームの 4 頂点 (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) を成分ごとに分ける
+// シャッフルはレーンごとに働くので、AVX2 版でも 128 ビットずつ別の 4 頂点を入れて同じ手順で使う
+#define DEINTERLEAVE_XYZ(SUFFIX, a, b, c, x, y, z) \
+	x = _mm##SUFFIX##_shuffle_ps(a, _mm##SUFFIX##_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 0, 2)), _MM_SHUFFLE(3, 0, 3, 0)); \
+	y = _mm##SUFFIX##_shuffle_ps(_mm##SUFFIX##_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 0, 1)), _mm##SUFFIX##_shuffle_ps(b, c, _MM_SHUFFLE(2, 0, 0, 3)), _MM_SHUFFLE(3, 0, 3, 0)); \
+	z = _mm##SUFFIX##_shuffle_ps(_mm##SUFFIX##_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 0, 2)), _mm##SUFFIX##_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 0, 0)), _MM_SHUFFLE(3, 0, 3, 0));
+
+// 成分ごとの 4 頂点を位置ストリームの並びに戻す
+#define INTERLEAVE_XYZ(SUFFIX, x, y, z, a, b, c) \
+	a = _mm##SUFFIX##_shuffle_ps(_mm##SUFFIX##_unpacklo_ps(x, y), _mm##SUFFIX##_unpacklo_ps(z, x), _MM_SHUFFLE(3, 0, 1, 0)); \
+	b = _mm##SUFFIX##_shuffle_ps(_mm##SUFFIX##_unpacklo_ps(y, z), _mm##SUFFIX##_unpackhi_ps(x, y), _MM_SHUFFLE(1, 0, 3, 2)); \
+	c = _mm##SUFFIX##_shuffle_ps(_mm##SUFFIX##_unpackhi_ps(z, x), _mm##SUFFIX##_unpackhi_ps(y, z), _MM_SHUFFLE(3, 2, 3, 0));
+
+// 詰めて並んだ位置ストリームの SSE 版 (4 頂点を 3 回のロードとストアで読み書きする)
+template <bool Bounds>
+static size_t TransformPackedSSE(float* positions, size_t count, const XMFLOAT4X4& m, XMFLOAT3* minimum, XMFLOAT3* maximum) {
+
+	const __m128 m11 = _mm_set1_ps(m._11), m12 = _mm_set1_ps(m._12), m13 = _mm_set1_ps(m._13);
+	const __m128 m21 = _mm_set1_ps(m._21), m22 = _mm_set1_ps(m._22), m23 = _mm_set1_ps(m._23);
+	const __m128 m31 = _mm_set1_ps(m._31), m32 = _mm_set1_ps(m._32), m33 = _mm_set1_ps(m._33);
+	const __m128 m41 = _mm_set1_ps(m._41), m42 = _mm_set1_ps(m._42), m43 = _mm_set1_ps(m._43);
+
+	const __m128 largest = _mm_set1_ps(numeric_limits<float>::max()), smallest = _mm_set1_ps(-numeric_limits<float>::max());
+	__m128 lower[3] = { largest, largest, largest };
+	__m128 upper[3] = { smallest, smallest, smallest };
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		float* p = positions + i * 3;
+		__m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+		__m128 vx, vy, vz;
+		DEINTERLEAVE_XYZ(, a, b, c, vx, vy, vz);
+
+		__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m11), _mm_mul_ps(vy, m21)), _mm_add_ps(_mm_mul_ps(vz, m31), m41));
+		__m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m12), _mm_mul_ps(vy, m22)), _mm_add_ps(_mm_mul_ps(vz, m32), m42));
+		__m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m13), _mm_mul_ps(vy, m23)), _mm_add_ps(_mm_mul_ps(vz, m33), m43));
+
+		if (Bounds) {
+			lower[0] = _mm_min_ps(lower[0], rx); upper[0] = _mm_max_ps(upper[0], rx);
+			lower[1] = _mm_min_ps(lower[1], ry); upper[1] = _mm_max_ps(upper[1], ry);
+			lower[2] = _mm_min_ps(lower[2], rz); upper[2] = _mm_max_ps(upper[2], rz);
+		}
+
+		INTERLEAVE_XYZ(, rx, ry, rz, a, b, c);
+		_mm_storeu_ps(p, a);
+		_mm_storeu_ps(p + 4, b);
+		_mm_storeu_ps(p + 8, c);
+	}
+
+	if (Bounds && i > 0) { MergeBounds(lower, upper, minimum, maximum); }
+	return i;
+}
+
+// 詰めて並んだ位置ストリームの AVX2 版 (8 頂点、下位 128 ビットに前の 4 頂点、上位に後ろの 4 頂点を入れる)
+template <bool Bounds>
+SIMD_TARGET_AVX2 static size_t TransformPackedAVX2(float* positions, size_t count, const XMFLOAT4X4& m, XMFLOAT3* minimum, XMFLOAT3* maximum) {
+
+	const __m256 m11 = _mm256_set1_ps(m._11), m12 = _mm256_set1_ps(m._12), m13 = _mm256_set1_ps(m._13);
+	const __m256 m21 = _mm256_set1_ps(m._21), m22 = _mm256_set1_ps(m._22), m23 = _mm256_set1_ps(m._23);
+	const __m256 m31 = _mm256_set1_ps(m._31), m32 = _mm256_set1_ps(m._32), m33 = _mm256_set1_ps(m._33);
+	const __m256 m41 = _mm256_set1_ps(m._41), m42 = _mm256_set1_ps(m._42), m43 = _mm256_set1_ps(m._43);
+
+	const __m256 largest = _mm256_set1_ps(numeric_limits<float>::max()), smallest = _mm256_set1_ps(-numeric_limits<float>::max());
+	__m256 lower[3] = { largest, largest, largest };
+	__m256 upper[3] = { smallest, smallest, smallest };
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		float* p = positions + i * 3;
+		__m256 a = _mm256_loadu2_m128(p + 12, p), b = _mm256_loadu2_m128(p + 16, p + 4), c = _mm256_loadu2_m128(p + 20, p + 8);
+		__m256 vx, vy, vz;
+		DEINTERLEAVE_XYZ(256, a, b, c, vx, vy, vz);
+
+		__m256 rx = _mm256_fmadd_ps(vx, m11, _mm256_fmadd_ps(vy, m21, _mm256_fmadd_ps(vz, m31, m41)));
+		__m256 ry = _mm256_fmadd_ps(vx, m12, _mm256_fmadd_ps(vy, m22, _mm256_fmadd_ps(vz, m32, m42)));
+		__m256 rz = _mm256_fmadd_ps(vx, m13, _mm256_fmadd_ps(vy, m23, _mm256_fmadd_ps(vz, m33, m43)));
+
+		if (Bounds) {
+			lower[0] = _mm256_min_ps(lower[0], rx); upper[0] = _mm256_max_ps(upper[0], rx);
+			lower[1] = _mm256_min_ps(lower[1], ry); upper[1] = _mm256_max_ps(upper[1], ry);
+			lower[2] = _mm256_min_ps(lower[2], rz); upper[2] = _mm256_max_ps(upper[2], rz);
+		}
+
+		INTERLEAVE_XYZ(256, rx, ry, rz, a, b, c);
+		_mm256_storeu2_m128(p + 12, p, a);
+		_mm256_storeu2_m128(p + 16, p + 4, b);
+		_mm256_storeu2_m128(p + 20, p + 8, c);
+	}
+
+	if (Bounds && i > 0) {
+		__m128 lower128[3], upper128[3];
+		for (int k = 0; k < 3; ++k) {
+			lower128[k] = _mm_min_ps(_mm256_castps256_ps128(lower[k]), _mm256_extractf128_ps(lower[k], 1));
+			upper128[k] = _mm_max_ps(_mm256_castps256_ps128(upper[k]), _mm256_extractf128_ps(upper[k], 1));
+		}
+		MergeBounds(lower128, upper128, minimum, maximum);
+	}
+	return i;
+}
+
+#undef TRANSPOSE4
+#undef DEINTERLEAVE_XYZ
+#undef INTERLEAVE_XYZ
+
+#endif
+
+// 位置ストリームを変換する (Bounds なら minimum / maximum に変換後の位置の最小と最大を混ぜる)
+template <bool Bounds>
+static void TransformStream(XMFLOAT3* positions, size_t stride, size_t count, const XMFLOAT4X4& m, XMFLOAT3* minimum, XMFLOAT3* maximum) {
+
+	uint8_t* base = reinterpret_cast<uint8_t*>(positions);
+	size_t done = 0;
+
+#if defined(SIMD_X86)
+	// 詰めて並んでいれば連続したロードとシャッフルで、ストライドがあれば 1 頂点 16 バイトのロードと転置で成分を分ける
+	if (stride == sizeof(XMFLOAT3)) {
+		float* packed = &positions->x;
+		if (IsAVX2Supported()) { done = TransformPackedAVX2<Bounds>(packed, count, m, minimum, maximum); }
+		else { done = TransformPackedSSE<Bounds>(packed, count, m, minimum, maximum); }
+	}
+	else {
+		if (IsAVX2Supported()) { done = TransformAVX2<Bounds>(base, stride, count, m, minimum, maximum); }
+		else { done = TransformSSE<Bounds>(base, stride, count, m, minimum, maximum); }
+	}
+#endif
+
+	TransformScalar<Bounds>(base + stride * done, stride, count - done, m, minimum, maximum);
+}
+
+// 任意のストライドで並んだ位置ストリームを変換
+void TransformEngine::TransformPositions(XMFLOAT3* positions, size_t stride, size_t count, FXMMATRIX matrix) {
+
+	if (positions == nullptr || count == 0) { return; }
+
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, matrix);
+	TransformStream<false>(positions, stride, count, m, nullptr, nullptr);
+}
+
+// 任意のストライドで並んだ位置ストリームを変換し、変換後の位置の最小と最大も求める
+void TransformEngine::TransformPositions(XMFLOAT3* positions, size_t stride, size_t count, FXMMATRIX matrix, XMFLOAT3* minimum, XMFLOAT3* maximum) {
+
+	if (positions == nullptr || count == 0) {
+		*minimum = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		*maximum = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		return;
+	}
+
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, matrix);
+	const float largest = numeric_limits<float>::max();
+	*minimum = XMFLOAT3(largest, largest, largest);
+	*maximum = XMFLOAT3(-largest, -largest, -largest);
+	TransformStream<true>(positions, stride, count, m, minimum, maximum);
+}
+
+// 詰めて並んだ位置ストリームを変換
+void TransformEngine::TransformPositions(XMFLOAT3* positions, size_t count, FXMMATRIX matrix) {
+	TransformPositions(positions, sizeof(XMFLOAT3), count, matrix);
+}
+
+// 頂点配列を変換
+void TransformEngine::Transform(VERTEX* vertices, size_t count, FXMMATRIX matrix) {
+	if (vertices == nullptr) { return; }
+	TransformPositions(&vertices->Position, sizeof(VERTEX), count, matrix);
+}
+
+// 複数のレンダリングオブジェクトをそれぞれの行列で変換
+// オブジェクトどうしは頂点を共有しないので、ジョブシステムがあればオブジェクトの範囲ごとに分けて変換する
+void TransformEngine::Transform(RenderObject* const* objects, const XMMATRIX* matrices, size_t count, JobSystem* jobSystem) {
+	PROFILE_ZONE("TransformEngine::Transform");
+
+	if (jobSystem == nullptr || count <= TRANSFORM_OBJECT_BATCH_SIZE) {
+		for (size_t i = 0; i < count; ++i) { objects[i]->Transform(matrices[i]); }
+		return;
+	}
+	jobSystem->ParallelFor(static_cast<uint32_t>(count), TRANSFORM_OBJECT_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+		for (uint32_t i = begin; i < end; ++i) { objects[i]->Transform(matrices[i]); }
+	});
+}
+
+// 複数のレンダリングオブジェクトを同じ行列で変換
+void TransformEngine::Transform(RenderObject* const* objects, size_t count, FXMMATRIX matrix, JobSystem* jobSystem) {
+	PROFILE_ZONE("TransformEngine::Transform");
+
+	XMMATRIX shared = matrix;
+	if (jobSystem == nullptr || count <= TRANSFORM_OBJECT_BATCH_SIZE) {
+		for (size_t i = 0; i < count; ++i) { objects[i]->Transform(shared); }
+		return;
+	}
+	jobSystem->ParallelFor(static_cast<uint32_t>(count), TRANSFORM_OBJECT_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+		for (uint32_t i = begin; i < end; ++i) { objects[i]->Transform(shared); }
+	});
+}
+
+// 頂点の変換の速さを計測する
+void TransformEngine::RunBenchmark(uint32_t vertexNum, uint32_t threadNum) {
+
+	const uint32_t repeatNum = 20;
+	const uint32_t objectNum = 64;
+	vertexNum = max(vertexNum, 1u);
+
+	// 詰めた位置ストリームと VERTEX の配列に同じ位置を入れる
+	mt19937 random(1);
+	uniform_real_distribution<float> unit(-10.0f, 10.0f);
+	vector<XMFLOAT3> source(vertexNum);
+	for (XMFLOAT3& position : source) { position = XMFLOAT3(unit(random), unit(random), unit(random)); }
+	vector<VERTEX> sourceVertices(vertexNum);
+	for (uint32_t i = 0; i < vertexNum; ++i) { sourceVertices[i] = { source[i], XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f) }; }
+
+	XMMATRIX matrix = XMMatrixAffineTransformation(XMVectorSet(1.5f, 0.5f, 2.0f, 0.0f), XMVectorZero(), XMQuaternionRotationAxis(XMVector3Normalize(XMVectorSet(0.3f, 1.1f, -0.7f, 0.0f)), 1.2f), XMVectorSet(3.0f, -2.0f, 5.0f, 0.0f));
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, matrix);
+
+	// 毎回元の位置から変換し、1 回分の時間 (ミリ秒) の平均を返す
+	vector<XMFLOAT3> positions(vertexNum);
+	vector<VERTEX> vertices(vertexNum);
+	auto measure = [&](const function<void()>& reset, const function<void()>& function) {
+		double total = 0.0;
+		for (uint32_t repeat = 0; repeat < repeatNum; ++repeat) {
+			reset();
+			auto begin = chrono::steady_clock::now();
+			function();
+			total += chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+		}
+		return total / repeatNum;
+	};
+	auto resetPositions = [&] { copy(source.begin(), source.end(), positions.begin()); };
+	auto resetVertices = [&] { copy(sourceVertices.begin(), sourceVertices.end(), vertices.begin()); };
+
+	// スカラー版との差 (値の大きさに対する相対誤差) の最大
+	float maxError = 0.0f;
+	vector<XMFLOAT3> expected(vertexNum);
+	auto check = [&](const XMFLOAT3* results, size_t stride) {
+		for (uint32_t i = 0; i < vertexNum; ++i) {
+			const XMFLOAT3& result = *reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(results) + stride * i);
+			const float* r = &result.x;
+			const float* e = &expected[i].x;
+			for (int k = 0; k < 3; ++k) { maxError = max(maxError, fabsf(r[k] - e[k]) / max(1.0f, fabsf(e[k]))); }
+		}
+	};
+
+	double scalarTime = measure(resetPositions, [&] { TransformScalar<false>(reinterpret_cast<uint8_t*>(positions.data()), sizeof(XMFLOAT3), vertexNum, m, nullptr, nullptr); });
+	expected = positions;
+
+	// 1 秒あたりの頂点数 (百万)
+	auto rate = [vertexNum](double milliseconds) { return vertexNum / (milliseconds * 1000.0); };
+
+	double scalarVertexTime = measure(resetVertices, [&] { TransformScalar<false>(reinterpret_cast<uint8_t*>(&vertices.data()->Position), sizeof(VERTEX), vertexNum, m, nullptr, nullptr); });
+	check(&vertices.data()->Position, sizeof(VERTEX));
+
+	cout << "vertices : " << vertexNum << endl;
+	cout << "scalar packed : " << scalarTime << " ms (" << rate(scalarTime) << " M vertices/s)" << endl;
+	cout << "scalar vertex : " << scalarVertexTime << " ms (" << rate(scalarVertexTime) << " M vertices/s)" << endl;
+
+#if defined(SIMD_X86)
+	// 端数はスカラーで処理する
+	auto packed = [&](size_t (*kernel)(float*, size_t, const XMFLOAT4X4&, XMFLOAT3*, XMFLOAT3*)) {
+		size_t done = kernel(&positions.data()->x, vertexNum, m, nullptr, nullptr);
+		TransformScalar<false>(reinterpret_cast<uint8_t*>(positions.data() + done), sizeof(XMFLOAT3), vertexNum - done, m, nullptr, nullptr);
+	};
+	auto strided = [&](size_t (*kernel)(uint8_t*, size_t, size_t, const XMFLOAT4X4&, XMFLOAT3*, XMFLOAT3*)) {
+		uint8_t* base = reinterpret_cast<uint8_t*>(&vertices.data()->Position);
+		size_t done = kernel(base, sizeof(VERTEX), vertexNum, m, nullptr, nullptr);
+		TransformScalar<false>(base + sizeof(VERTEX) * done, sizeof(VERTEX), vertexNum - done, m, nullptr, nullptr);
+	};
+
+	double sseTime = measure(resetPositions, [&] { packed(TransformPackedSSE<false>); });
+	check(positions.data(), sizeof(XMFLOAT3));
+	double sseVertexTime = measure(resetVertices, [&] { strided(TransformSSE<false>); });
+	check(&vertices.data()->Position, sizeof(VERTEX));
+	cout << "sse packed : " << sseTime << " ms (" << rate(sseTime) << " M vertices/s)" << endl;
+	cout << "sse vertex : " << sseVertexTime << " ms (" << rate(sseVertexTime) << " M vertices/s)" << endl;
+
+	if (IsAVX2Supported()) {
+		double avx2Time = measure(resetPositions, [&] { packed(TransformPackedAVX2<false>); });
+		check(positions.data(), sizeof(XMFLOAT3));
+		double avx2VertexTime = measure(resetVertices, [&] { strided(TransformAVX2<false>); });
+		check(&vertices.data()->Position, sizeof(VERTEX));
+		cout << "avx2 packed : " << avx2Time << " ms (" << rate(avx2Time) << " M vertices/s)" << endl;
+		cout << "avx2 vertex : " << avx2VertexTime << " ms (" << rate(avx2VertexTime) << " M vertices/s)" << endl;
+	}
+	else {
+		cout << "avx2 : not supported" << endl;
+	}
+#endif
+
+	// 公開している入口 (端数の処理と振り分けも含む)
+	double publicTime = measure(resetPositions, [&] { TransformPositions(positions.data(), vertexNum, matrix); });
+	check(positions.data(), sizeof(XMFLOAT3));
+	cout << "TransformPositions : " << publicTime << " ms (" << rate(publicTime) << " M vertices/s)" << endl;
+
+	// 境界ボリュームの更新まで含めたレンダリングオブジェクトの変換 (変換の後に頂点を読み直す場合と、変換と同じパスで求める場合)
+	vector<uint32_t> indices = { 0, 0, 0 };
+	GeneratedMesh object(sourceVertices.data(), vertexNum, indices.data(), indices.size());
+	auto resetObject = [&] { copy(sourceVertices.begin(), sourceVertices.end(), object.GetVertices()); };
+	double separateTime = measure(resetObject, [&] { Transform(object.GetVertices(), object.GetVertexNum(), matrix); object.UpdateBounds(); });
+	double fusedTime = measure(resetObject, [&] { object.Transform(matrix); });
+	check(&object.GetVertices()->Position, sizeof(VERTEX));
+	cout << "transform + bounds pass : " << separateTime << " ms (" << rate(separateTime) << " M vertices/s)" << endl;
+	cout << "transform with bounds : " << fusedTime << " ms (" << rate(fusedTime) << " M vertices/s)" << endl;
+
+	// 変換と同じパスで求めた境界箱は頂点を読み直したものと一致し、境界球はすべての頂点を囲む
+	BOUNDS fused = object.GetBounds();
+	object.UpdateBounds();
+	const BOUNDS& recomputed = object.GetBounds();
+	bool boundsMatched = fused.Min.x == recomputed.Min.x && fused.Min.y == recomputed.Min.y && fused.Min.z == recomputed.Min.z;
+	boundsMatched = boundsMatched && fused.Max.x == recomputed.Max.x && fused.Max.y == recomputed.Max.y && fused.Max.z == recomputed.Max.z;
+	for (uint32_t i = 0; i < vertexNum; ++i) {
+		XMVECTOR vOffset = XMVectorSubtract(XMLoadFloat3(&object.GetVertices()[i].Position), XMLoadFloat3(&fused.Center));
+		boundsMatched = boundsMatched && XMVectorGetX(XMVector3Length(vOffset)) <= fused.Radius * 1.0001f;
+	}
+
+	// 頂点を objectNum 個のオブジェクトに分けて、ジョブシステムなしとありで変換する
+	vector<unique_ptr<GeneratedMesh>> objects;
+	vector<RenderObject*> objectPointers;
+	for (uint32_t i = 0; i < objectNum; ++i) {
+		uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(vertexNum) * i / objectNum);
+		uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(vertexNum) * (i + 1) / objectNum);
+		if (begin == end) { continue; }
+		objects.push_back(make_unique<GeneratedMesh>(sourceVertices.data() + begin, end - begin, indices.data(), indices.size()));
+		objectPointers.push_back(objects.back().get());
+	}
+	auto resetObjects = [&] {
+		size_t offset = 0;
+		for (const auto& each : objects) {
+			copy(sourceVertices.begin() + offset, sourceVertices.begin() + offset + each->GetVertexNum(), each->GetVertices());
+			offset += each->GetVertexNum();
+		}
+	};
+	JobSystem jobSystem(threadNum);
+	double serialTime = measure(resetObjects, [&] { Transform(objectPointers.data(), objectPointers.size(), matrix); });
+	double parallelTime = measure(resetObjects, [&] { Transform(objectPointers.data(), objectPointers.size(), matrix, &jobSystem); });
+	size_t offset = 0;
+	for (const auto& each : objects) {
+		for (size_t i = 0; i < each->GetVertexNum(); ++i) {
+			const float* r = &each->GetVertices()[i].Position.x;
+			const float* e = &expected[offset + i].x;
+			for (int k = 0; k < 3; ++k) { maxError = max(maxError, fabsf(r[k] - e[k]) / max(1.0f, fabsf(e[k]))); }
+		}
+		offset += each->GetVertexNum();
+	}
+	cout << "objects : " << objectPointers.size() << ", threads : " << jobSystem.GetThreadNum() << endl;
+	cout << "objects serial : " << serialTime << " ms (" << rate(serialTime) << " M vertices/s)" << endl;
+	cout << "objects jobs : " << parallelTime << " ms (" << rate(parallelTime) << " M vertices/s)" << endl;
+
+	cout << "bounds : " << (boundsMatched ? "matched" : "MISMATCH") << endl;
+	cout << "max error : " << maxError << endl;
+	cout << "result : " << (maxError <= 1e-5f && boundsMatched ? "matched" : "MISMATCH") << endl;
+}
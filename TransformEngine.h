@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <DirectXMath.h>
+
+#include "JobSystem.h"
+#include "RenderObject.h"
+
+using namespace std;
+using namespace DirectX;
+
+// 頂点座標の一括変換
+// 位置ストリームを 8 頂点 (AVX2) / 4 頂点 (SSE) 単位で変換し、端数はスカラーで処理する
+// 詰めて並んだ位置は連続したロードとシャッフルで、ストライドのある位置 (VERTEX の配列) は 1 頂点 16 バイトのロードと転置で成分に分ける
+// 境界箱が要るときは変換と同じパスで最小と最大を求め、頂点を読み直さない
+class TransformEngine {
+public:
+	// 任意のストライドで並んだ位置ストリームを変換 (stride が sizeof(XMFLOAT3) なら詰めた版を使う)
+	static void TransformPositions(XMFLOAT3* positions, size_t stride, size_t count, FXMMATRIX matrix);
+
+	// 変換し、変換後の位置の成分ごとの最小と最大も求める (count が 0 なら両方 0)
+	static void TransformPositions(XMFLOAT3* positions, size_t stride, size_t count, FXMMATRIX matrix, XMFLOAT3* minimum, XMFLOAT3* maximum);
+
+	// 詰めて並んだ位置ストリームを変換
+	static void TransformPositions(XMFLOAT3* positions, size_t count, FXMMATRIX matrix);
+
+	// 頂点配列を変換
+	static void Transform(VERTEX* vertices, size_t count, FXMMATRIX matrix);
+
+	// 複数のレンダリングオブジェクトをそれぞれの行列で変換 (境界ボリュームも更新する、jobSystem があればオブジェクトを分けて並列に変換する)
+	static void Transform(RenderObject* const* objects, const XMMATRIX* matrices, size_t count, JobSystem* jobSystem = nullptr);
+
+	// 複数のレンダリングオブジェクトを同じ行列で変換
+	static void Transform(RenderObject* const* objects, size_t count, FXMMATRIX matrix, JobSystem* jobSystem = nullptr);
+
+	// vertexNum 個の頂点をスカラー・SSE・AVX2 で変換する速さと、境界ボリュームの更新や複数オブジェクトの変換まで含めた速さを計測し、結果をスカラー版と比べる
+	static void RunBenchmark(uint32_t vertexNum, uint32_t threadNum);
+};
@@ -0,0 +1,283 @@
+﻿#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include "Profiler.h"
+
+// 1 スレッドに渡す最小のノード数
+static const uint32_t TRANSFORM_BATCH_SIZE = 4096;
+
+// コンストラクタ
+TransformHierarchy::TransformHierarchy():
+	m_Levels(),
+	m_NodeLevel(),
+	m_NodeIndex(),
+	m_NodeParent(),
+	m_RangeResults(),
+	m_Statistics({ 0 }) {
+
+}
+
+// 計算し直す印を付ける
+void TransformHierarchy::MarkDirty(TRANSFORM_NODE node) {
+	TRANSFORM_LEVEL& level = m_Levels[m_NodeLevel[node]];
+	uint32_t index = m_NodeIndex[node];
+	level.Dirty[index] = 1;
+	level.DirtyBegin = min(level.DirtyBegin, index);
+	level.DirtyEnd = max(level.DirtyEnd, index + 1);
+}
+
+// 印を外す
+static void ClearDirty(TRANSFORM_LEVEL& level) {
+	if (level.DirtyBegin < level.DirtyEnd) { fill(level.Dirty.begin() + level.DirtyBegin, level.Dirty.begin() + level.DirtyEnd, static_cast<uint8_t>(0)); }
+	level.DirtyBegin = UINT32_MAX;
+	level.DirtyEnd = 0;
+}
+
+// ノードを追加
+TRANSFORM_NODE TransformHierarchy::AddNode(TRANSFORM_NODE parent, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale) {
+
+	TRANSFORM_NODE node = static_cast<TRANSFORM_NODE>(m_NodeParent.size());
+	if (parent != INVALID_TRANSFORM_NODE && parent >= node) { throw runtime_error("親のノードが追加されていません。"); }
+
+	uint32_t depth = parent != INVALID_TRANSFORM_NODE ? m_NodeLevel[parent] + 1 : 0;
+	if (depth == m_Levels.size()) {
+		TRANSFORM_LEVEL level = {};
+		level.DirtyBegin = UINT32_MAX;
+		level.DirtyEnd = 0;
+		m_Levels.push_back(move(level));
+	}
+
+	// 自分の深さの末尾に足す
+	TRANSFORM_LEVEL& level = m_Levels[depth];
+	uint32_t index = static_cast<uint32_t>(level.Parent.size());
+	level.Parent.push_back(parent != INVALID_TRANSFORM_NODE ? m_NodeIndex[parent] : UINT32_MAX);
+	level.LocalPosition.push_back(position);
+	level.LocalRotation.push_back(rotation);
+	level.LocalScale.push_back(scale);
+	level.World.push_back(XMFLOAT4X4());
+	level.Dirty.push_back(0);
+	level.ChildBegin.push_back(UINT32_MAX);
+	level.ChildEnd.push_back(0);
+
+	// 親の子の範囲を広げる
+	if (parent != INVALID_TRANSFORM_NODE) {
+		TRANSFORM_LEVEL& parentLevel = m_Levels[depth - 1];
+		uint32_t parentIndex = m_NodeIndex[parent];
+		parentLevel.ChildBegin[parentIndex] = min(parentLevel.ChildBegin[parentIndex], index);
+		parentLevel.ChildEnd[parentIndex] = max(parentLevel.ChildEnd[parentIndex], index + 1);
+	}
+
+	m_NodeLevel.push_back(depth);
+	m_NodeIndex.push_back(index);
+	m_NodeParent.push_back(parent);
+	MarkDirty(node);
+
+	m_Statistics.NodeNum = node + 1;
+	m_Statistics.LevelNum = static_cast<uint32_t>(m_Levels.size());
+	return node;
+}
+
+// 容量を確保 (深さごとの配列は分かれ方が分からないので、番号からの対応だけ確保する)
+void TransformHierarchy::Reserve(size_t count) {
+	m_NodeLevel.reserve(count);
+	m_NodeIndex.reserve(count);
+	m_NodeParent.reserve(count);
+}
+
+// すべてのノードを削除
+void TransformHierarchy::Clear() {
+	m_Levels.clear();
+	m_NodeLevel.clear();
+	m_NodeIndex.clear();
+	m_NodeParent.clear();
+	m_Statistics.NodeNum = 0;
+	m_Statistics.LevelNum = 0;
+}
+
+// ローカルの位置を設定
+void TransformHierarchy::SetLocalPosition(TRANSFORM_NODE node, const XMFLOAT3& position) {
+	m_Levels[m_NodeLevel[node]].LocalPosition[m_NodeIndex[node]] = position;
+	MarkDirty(node);
+}
+
+// ローカルの回転を設定
+void TransformHierarchy::SetLocalRotation(TRANSFORM_NODE node, const XMFLOAT4& rotation) {
+	m_Levels[m_NodeLevel[node]].LocalRotation[m_NodeIndex[node]] = rotation;
+	MarkDirty(node);
+}
+
+// ローカルの拡大率を設定
+void TransformHierarchy::SetLocalScale(TRANSFORM_NODE node, const XMFLOAT3& scale) {
+	m_Levels[m_NodeLevel[node]].LocalScale[m_NodeIndex[node]] = scale;
+	MarkDirty(node);
+}
+
+// すべてのノードを計算し直す印を付ける
+void TransformHierarchy::MarkAllDirty() {
+	for (TRANSFORM_LEVEL& level : m_Levels) {
+		fill(level.Dirty.begin(), level.Dirty.end(), static_cast<uint8_t>(1));
+		level.DirtyBegin = 0;
+		level.DirtyEnd = static_cast<uint32_t>(level.Dirty.size());
+	}
+}
+
+// 1 つの深さの範囲を先頭から順に計算し直す (1 つ浅い深さは計算済みであること)
+void TransformHierarchy::UpdateRange(uint32_t level, uint32_t begin, uint32_t end, RANGE_RESULT& result) {
+
+	TRANSFORM_LEVEL& current = m_Levels[level];
+	const TRANSFORM_LEVEL* parentLevel = level > 0 ? &m_Levels[level - 1] : nullptr;
+
+	for (uint32_t i = begin; i < end; ++i) {
+
+		// 親に印が付いていれば自分にも付ける (1 つ深い深さへ伝えるため)
+		if (!current.Dirty[i]) {
+			if (parentLevel == nullptr || !parentLevel->Dirty[current.Parent[i]]) { continue; }
+			current.Dirty[i] = 1;
+		}
+
+		// 拡大 × 回転 × 平行移動 を行ごとに組み立てる
+		XMMATRIX world = XMMatrixRotationQuaternion(XMLoadFloat4(&current.LocalRotation[i]));
+		XMVECTOR scale = XMLoadFloat3(&current.LocalScale[i]);
+		world.r[0] = XMVectorMultiply(world.r[0], XMVectorSplatX(scale));
+		world.r[1] = XMVectorMultiply(world.r[1], XMVectorSplatY(scale));
+		world.r[2] = XMVectorMultiply(world.r[2], XMVectorSplatZ(scale));
+		world.r[3] = XMVectorSetW(XMLoadFloat3(&current.LocalPosition[i]), 1.0f);
+
+		// 行ベクトルなのでローカル × 親のワールド
+		if (parentLevel != nullptr) { world = XMMatrixMultiply(world, XMLoadFloat4x4(&parentLevel->World[current.Parent[i]])); }
+		XMStoreFloat4x4(&current.World[i], world);
+
+		result.UpdatedNum++;
+		result.ChildBegin = min(result.ChildBegin, current.ChildBegin[i]);
+		result.ChildEnd = max(result.ChildEnd, current.ChildEnd[i]);
+	}
+}
+
+// 印の付いたノードのワールド行列を計算し直す
+void TransformHierarchy::Update(JobSystem* jobSystem) {
+	PROFILE_ZONE("TransformHierarchy::Update");
+
+	auto begin = chrono::steady_clock::now();
+	const uint32_t levelNum = static_cast<uint32_t>(m_Levels.size());
+	m_RangeResults.resize(jobSystem != nullptr ? jobSystem->GetThreadNum() : 1);
+
+	// 浅い順に計算する (同じ深さのノードは互いに依存しないので分けて並べられる)
+	uint32_t updateNum = 0;
+	for (uint32_t level = 0; level < levelNum; ++level) {
+
+		TRANSFORM_LEVEL& current = m_Levels[level];
+		if (current.DirtyBegin < current.DirtyEnd) {
+			fill(m_RangeResults.begin(), m_RangeResults.end(), RANGE_RESULT{ 0, UINT32_MAX, 0 });
+
+			uint32_t first = current.DirtyBegin;
+			uint32_t count = current.DirtyEnd - current.DirtyBegin;
+			if (jobSystem != nullptr && count > TRANSFORM_BATCH_SIZE) {
+				jobSystem->ParallelFor(count, TRANSFORM_BATCH_SIZE, [this, level, first](uint32_t begin, uint32_t end, uint32_t thread) { UpdateRange(level, first + begin, first + end, m_RangeResults[thread]); });
+			}
+			else {
+				UpdateRange(level, first, first + count, m_RangeResults[0]);
+			}
+
+			// 計算し直したノードの子の範囲を 1 つ深い深さの範囲に足す
+			for (const RANGE_RESULT& result : m_RangeResults) {
+				updateNum += result.UpdatedNum;
+				if (level + 1 < levelNum && result.ChildBegin < result.ChildEnd) {
+					m_Levels[level + 1].DirtyBegin = min(m_Levels[level + 1].DirtyBegin, result.ChildBegin);
+					m_Levels[level + 1].DirtyEnd = max(m_Levels[level + 1].DirtyEnd, result.ChildEnd);
+				}
+			}
+		}
+
+		// 1 つ浅い深さの印はもう見ないので外す
+		if (level > 0) { ClearDirty(m_Levels[level - 1]); }
+	}
+	if (levelNum > 0) { ClearDirty(m_Levels[levelNum - 1]); }
+
+	double time = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+	m_Statistics.LastUpdatedNum = updateNum;
+	m_Statistics.TotalUpdatedNum += updateNum;
+	m_Statistics.UpdateCount++;
+	m_Statistics.LastUpdateTime = time;
+	m_Statistics.TotalUpdateTime += time;
+}
+
+// 親を取得
+TRANSFORM_NODE TransformHierarchy::GetParent(TRANSFORM_NODE node) const { return m_NodeParent[node]; }
+
+// ローカルの位置を取得
+const XMFLOAT3& TransformHierarchy::GetLocalPosition(TRANSFORM_NODE node) const { return m_Levels[m_NodeLevel[node]].LocalPosition[m_NodeIndex[node]]; }
+
+// ローカルの回転を取得
+const XMFLOAT4& TransformHierarchy::GetLocalRotation(TRANSFORM_NODE node) const { return m_Levels[m_NodeLevel[node]].LocalRotation[m_NodeIndex[node]]; }
+
+// ローカルの拡大率を取得
+const XMFLOAT3& TransformHierarchy::GetLocalScale(TRANSFORM_NODE node) const { return m_Levels[m_NodeLevel[node]].LocalScale[m_NodeIndex[node]]; }
+
+// ワールド行列を取得
+const XMFLOAT4X4& TransformHierarchy::GetWorld(TRANSFORM_NODE node) const { return m_Levels[m_NodeLevel[node]].World[m_NodeIndex[node]]; }
+
+// ワールド行列を取得
+XMMATRIX TransformHierarchy::GetWorldMatrix(TRANSFORM_NODE node) const { return XMLoadFloat4x4(&GetWorld(node)); }
+
+// ノード数を取得
+uint32_t TransformHierarchy::GetNodeNum() const { return static_cast<uint32_t>(m_NodeParent.size()); }
+
+// 統計情報を取得
+TRANSFORM_HIERARCHY_STATISTICS TransformHierarchy::GetStatistics() const { return m_Statistics; }
+
+// 更新時間を計測
+void TransformHierarchy::RunBenchmark(uint32_t nodeNum, float changeRate, uint32_t threadNum) {
+
+	const uint32_t frameNum = 60;
+	nodeNum = max(nodeNum, 1u);
+
+	// 各ノードに平均 4 つの子を持たせた木 (親は自分より前のノードから選ぶ)
+	mt19937 random(1);
+	uniform_real_distribution<float> offset(-1.0f, 1.0f);
+	TransformHierarchy hierarchy;
+	hierarchy.Reserve(nodeNum);
+	for (uint32_t i = 0; i < nodeNum; ++i) {
+		TRANSFORM_NODE parent = i > 0 ? (i - 1) / 4 : INVALID_TRANSFORM_NODE;
+		hierarchy.AddNode(parent, XMFLOAT3(offset(random), offset(random), offset(random)));
+	}
+
+	JobSystem jobSystem(threadNum);
+	hierarchy.Update(&jobSystem);
+	double buildTime = hierarchy.GetStatistics().LastUpdateTime;
+
+	// 毎フレーム一部のノードを回す
+	const uint32_t changeNum = max(static_cast<uint32_t>(nodeNum * changeRate), 1u);
+	uniform_int_distribution<uint32_t> pick(0, nodeNum - 1);
+	TRANSFORM_HIERARCHY_STATISTICS before = hierarchy.GetStatistics();
+	for (uint32_t frame = 0; frame < frameNum; ++frame) {
+		XMFLOAT4 rotation;
+		XMStoreFloat4(&rotation, XMQuaternionRotationAxis(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), 0.01f * frame));
+		for (uint32_t i = 0; i < changeNum; ++i) { hierarchy.SetLocalRotation(pick(random), rotation); }
+		hierarchy.Update(&jobSystem);
+	}
+	TRANSFORM_HIERARCHY_STATISTICS incremental = hierarchy.GetStatistics();
+	double incrementalTime = (incremental.TotalUpdateTime - before.TotalUpdateTime) / frameNum;
+	uint64_t updatedNum = (incremental.TotalUpdatedNum - before.TotalUpdatedNum) / frameNum;
+
+	// 比較のために毎フレームすべて計算し直す
+	for (uint32_t frame = 0; frame < frameNum; ++frame) {
+		hierarchy.MarkAllDirty();
+		hierarchy.Update(&jobSystem);
+	}
+	double fullTime = (hierarchy.GetStatistics().TotalUpdateTime - incremental.TotalUpdateTime) / frameNum;
+
+	cout << "nodes : " << nodeNum << " (" << hierarchy.GetStatistics().LevelNum << " levels)" << endl;
+	cout << "threads : " << jobSystem.GetThreadNum() << endl;
+	cout << "build : " << buildTime << " ms" << endl;
+	cout << "changed / frame : " << changeNum << " (" << updatedNum << " updated with descendants)" << endl;
+	cout << "incremental update : " << incrementalTime << " ms" << endl;
+	cout << "full update : " << fullTime << " ms" << endl;
+	if (incrementalTime > 0.0) {
+		cout << "speedup : " << fullTime / incrementalTime << "x" << endl;
+	}
+}
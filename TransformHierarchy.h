@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "JobSystem.h"
+
+using namespace std;
+using namespace DirectX;
+
+// ノードの番号
+typedef uint32_t TRANSFORM_NODE;
+static const TRANSFORM_NODE INVALID_TRANSFORM_NODE = UINT32_MAX;
+
+// 階層の更新の統計情報
+struct TRANSFORM_HIERARCHY_STATISTICS {
+	uint32_t NodeNum;
+	uint32_t LevelNum;        // 最も深いノードの深さ + 1
+	uint32_t LastUpdatedNum;  // 直前の Update で計算し直したノード数 (子孫へ伝わった分を含む)
+	uint64_t TotalUpdatedNum;
+	uint32_t UpdateCount;
+	double LastUpdateTime;    // ミリ秒
+	double TotalUpdateTime;
+};
+
+// 同じ深さのノードの値 (SoA)
+// 親は 1 つ浅い深さの中の位置で持ち、子は 1 つ深い深さの中で占める範囲を持つ
+struct TRANSFORM_LEVEL {
+	vector<uint32_t> Parent;
+	vector<XMFLOAT3> LocalPosition;
+	vector<XMFLOAT4> LocalRotation; // 四元数
+	vector<XMFLOAT3> LocalScale;
+	vector<XMFLOAT4X4> World;
+	vector<uint8_t> Dirty;
+	vector<uint32_t> ChildBegin;
+	vector<uint32_t> ChildEnd;
+
+	// 印の付いたノードを含む範囲 (空なら DirtyBegin >= DirtyEnd)
+	uint32_t DirtyBegin;
+	uint32_t DirtyEnd;
+};
+
+// 変換の階層
+// ノードの値を深さごとに分けた配列 (SoA) に持つ。親は必ず先に追加するので、ノードは自分の深さの末尾に足すだけでよい
+// ローカルの変換を書き換えたノードに印を付け、深さごとに印の付いた範囲を覚えておく
+// Update では浅い順に、その深さの範囲を先頭から順に見て印の付いたノード (親に印の付いたノードを含む) を計算し直し、子の範囲を 1 つ深い深さの範囲に足す
+// 同じ深さの範囲はスレッドに分けて並べて計算する
+class TransformHierarchy {
+
+private:
+	vector<TRANSFORM_LEVEL> m_Levels;
+
+	// ノードの番号から深さと深さの中の位置への対応
+	vector<uint32_t> m_NodeLevel;
+	vector<uint32_t> m_NodeIndex;
+	vector<TRANSFORM_NODE> m_NodeParent;
+
+	// スレッドごとの計算結果 (計算し直した数と、1 つ深い深さで印を伝える範囲)
+	struct RANGE_RESULT {
+		uint32_t UpdatedNum;
+		uint32_t ChildBegin;
+		uint32_t ChildEnd;
+	};
+	vector<RANGE_RESULT> m_RangeResults;
+
+	TRANSFORM_HIERARCHY_STATISTICS m_Statistics;
+
+	void MarkDirty(TRANSFORM_NODE node);
+	void UpdateRange(uint32_t level, uint32_t begin, uint32_t end, RANGE_RESULT& result);
+
+public:
+	TransformHierarchy();
+	~TransformHierarchy() = default;
+	TransformHierarchy(const TransformHierarchy&) = delete;
+	TransformHierarchy& operator=(const TransformHierarchy&) = delete;
+
+	// ノードを追加 (parent は追加済みのノードか INVALID_TRANSFORM_NODE)
+	TRANSFORM_NODE AddNode(TRANSFORM_NODE parent, const XMFLOAT3& position = XMFLOAT3(0.0f, 0.0f, 0.0f), const XMFLOAT4& rotation = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), const XMFLOAT3& scale = XMFLOAT3(1.0f, 1.0f, 1.0f));
+	void Reserve(size_t count);
+	void Clear();
+
+	// ローカルの変換を設定 (子孫は次の Update で計算し直す)
+	void SetLocalPosition(TRANSFORM_NODE node, const XMFLOAT3& position);
+	void SetLocalRotation(TRANSFORM_NODE node, const XMFLOAT4& rotation);
+	void SetLocalScale(TRANSFORM_NODE node, const XMFLOAT3& scale);
+
+	// すべてのノードを計算し直す印を付ける
+	void MarkAllDirty();
+
+	// 印の付いたノードのワールド行列を計算し直す (jobSystem が nullptr なら呼び出し元のスレッドだけで計算する)
+	void Update(JobSystem* jobSystem = nullptr);
+
+	TRANSFORM_NODE GetParent(TRANSFORM_NODE node) const;
+	const XMFLOAT3& GetLocalPosition(TRANSFORM_NODE node) const;
+	const XMFLOAT4& GetLocalRotation(TRANSFORM_NODE node) const;
+	const XMFLOAT3& GetLocalScale(TRANSFORM_NODE node) const;
+
+	// ワールド行列 (直前の Update の結果)
+	const XMFLOAT4X4& GetWorld(TRANSFORM_NODE node) const;
+	XMMATRIX GetWorldMatrix(TRANSFORM_NODE node) const;
+
+	uint32_t GetNodeNum() const;
+	TRANSFORM_HIERARCHY_STATISTICS GetStatistics() const;
+
+	// nodeNum 個のノードの木を作り、毎フレーム changeRate の割合のノードを動かして更新時間を計測する
+	static void RunBenchmark(uint32_t nodeNum, float changeRate, uint32_t threadNum);
+};
@@ -0,0 +1,755 @@
+﻿#include "TriangleBvh.h"
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include "Profiler.h"
+#include "Simd.h"
+
+// 葉に入れる三角形の最大数 (BVH_TRIANGLE4 の 1 ブロック分)
+static const uint32_t BVH_LEAF_SIZE = 4;
+
+// SAH で重心を分けるビンの数
+static const uint32_t BVH_BIN_NUM = 16;
+
+// これより深い節は SAH を使わず中央値で分ける (探索のスタックが溢れないように深さを抑える)
+static const uint32_t BVH_MEDIAN_DEPTH = 32;
+
+// 探索のスタックの大きさ
+static const uint32_t BVH_STACK_SIZE = 64;
+
+// 並列に作る部分木の最小の三角形数
+static const uint32_t BVH_TASK_MIN_SIZE = 4096;
+
+// 並列に作る部分木の仮の節の印 (Count に入れる)
+static const uint32_t BVH_TASK_NODE = UINT32_MAX;
+
+// 境界箱の表面積の半分
+static float HalfArea(const float min[3], const float max[3]) {
+	float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+// 光線の向きの逆数 (0 の成分は符号を保った小さな値に置き換えて、0 と無限大の積を避ける)
+static void InverseDirection(const XMFLOAT3& direction, float inverse[3]) {
+	const float* d = &direction.x;
+	for (int a = 0; a < 3; ++a) {
+		float value = fabs(d[a]) < 1e-20f ? copysign(1e-20f, d[a]) : d[a];
+		inverse[a] = 1.0f / value;
+	}
+}
+
+// 光線と節の境界箱 (当たれば入る距離を tNear に入れる)
+static bool IntersectBox(const BVH_NODE& node, const float origin[3], const float inverse[3], float maxDistance, float* tNear) {
+	const float* min = &node.Min.x;
+	const float* max = &node.Max.x;
+	float t0 = 0.0f, t1 = maxDistance;
+	for (int a = 0; a < 3; ++a) {
+		float n = (min[a] - origin[a]) * inverse[a];
+		float f = (max[a] - origin[a]) * inverse[a];
+		if (inverse[a] < 0.0f) { swap(n, f); }
+		t0 = n > t0 ? n : t0;
+		t1 = f < t1 ? f : t1;
+	}
+	*tNear = t0;
+	return t0 <= t1;
+}
+
+// 光線と 4 つの三角形 (Möller–Trumbore、maxDistance より手前で当たった三角形のビットを返す)
+static uint32_t IntersectTriangle4(const BVH_TRIANGLE4& triangle, const float origin[3], const float direction[3], float maxDistance, float t[4], float u[4], float v[4]) {
+
+#if defined(SIMD_X86)
+	__m128 o[3], d[3], e1[3], e2[3], s[3];
+	for (int a = 0; a < 3; ++a) {
+		o[a] = _mm_set1_ps(origin[a]);
+		d[a] = _mm_set1_ps(direction[a]);
+		e1[a] = _mm_loadu_ps(triangle.Edge1[a]);
+		e2[a] = _mm_loadu_ps(triangle.Edge2[a]);
+		s[a] = _mm_sub_ps(o[a], _mm_loadu_ps(triangle.V0[a]));
+	}
+
+	// p = d × e2, q = s × e1
+	__m128 px = _mm_sub_ps(_mm_mul_ps(d[1], e2[2]), _mm_mul_ps(d[2], e2[1]));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(d[2], e2[0]), _mm_mul_ps(d[0], e2[2]));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(d[0], e2[1]), _mm_mul_ps(d[1], e2[0]));
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1]));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2]));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0]));
+
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], px), _mm_mul_ps(e1[1], py)), _mm_mul_ps(e1[2], pz));
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+	__m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s[0], px), _mm_mul_ps(s[1], py)), _mm_mul_ps(s[2], pz)), inv);
+	__m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz)), inv);
+	__m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], qx), _mm_mul_ps(e2[1], qy)), _mm_mul_ps(e2[2], qz)), inv);
+
+	const __m128 zero = _mm_setzero_ps();
+	__m128 mask = _mm_cmpneq_ps(det, zero);
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(uu, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(vv, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+	mask = _mm_and_ps(mask, _mm_cmpgt_ps(tt, zero));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(tt, _mm_set1_ps(maxDistance)));
+
+	_mm_storeu_ps(t, tt);
+	_mm_storeu_ps(u, uu);
+	_mm_storeu_ps(v, vv);
+	return static_cast<uint32_t>(_mm_movemask_ps(mask));
+#else
+	uint32_t mask = 0;
+	for (int lane = 0; lane < 4; ++lane) {
+		float e1[3], e2[3], s[3];
+		for (int a = 0; a < 3; ++a) {
+			e1[a] = triangle.Edge1[a][lane];
+			e2[a] = triangle.Edge2[a][lane];
+			s[a] = origin[a] - triangle.V0[a][lane];
+		}
+		float p[3] = { direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2], direction[0] * e2[1] - direction[1] * e2[0] };
+		float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+		float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+		if (det == 0.0f) { continue; }
+		float inv = 1.0f / det;
+		u[lane] = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+		v[lane] = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inv;
+		t[lane] = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+		if (u[lane] >= 0.0f && v[lane] >= 0.0f && u[lane] + v[lane] <= 1.0f && t[lane] > 0.0f && t[lane] < maxDistance) { mask |= 1u << lane; }
+	}
+	return mask;
+#endif
+}
+
+#if defined(SIMD_X86)
+
+// 8 本の光線 (SoA)
+struct RAY_PACKET8 {
+	__m256 Origin[3];
+	__m256 Direction[3];
+	__m256 Inverse[3];
+};
+
+// 8 本の光線と節の境界箱 (当たった光線のビットを返し、入る距離を tNear に入れる)
+SIMD_TARGET_AVX2 static uint32_t IntersectBox8(const BVH_NODE& node, const RAY_PACKET8& packet, __m256 maxDistance, __m256* tNear) {
+	const float* min = &node.Min.x;
+	const float* max = &node.Max.x;
+	__m256 t0 = _mm256_setzero_ps(), t1 = maxDistance;
+	for (int a = 0; a < 3; ++a) {
+		__m256 n = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(min[a]), packet.Origin[a]), packet.Inverse[a]);
+		__m256 f = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(max[a]), packet.Origin[a]), packet.Inverse[a]);
+		t0 = _mm256_max_ps(t0, _mm256_min_ps(n, f));
+		t1 = _mm256_min_ps(t1, _mm256_max_ps(n, f));
+	}
+	*tNear = t0;
+	return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)));
+}
+
+// 8 本の光線と 1 つの三角形 (当たった光線の距離・重心座標・三角形の番号を更新する)
+SIMD_TARGET_AVX2 static void IntersectTriangle8(const BVH_TRIANGLE4& triangle, int lane, const RAY_PACKET8& packet, __m256* tMax, __m256i* hitTriangle, __m256* hitU, __m256* hitV) {
+	__m256 e1[3], e2[3], s[3];
+	const __m256* d = packet.Direction;
+	for (int a = 0; a < 3; ++a) {
+		e1[a] = _mm256_set1_ps(triangle.Edge1[a][lane]);
+		e2[a] = _mm256_set1_ps(triangle.Edge2[a][lane]);
+		s[a] = _mm256_sub_ps(packet.Origin[a], _mm256_set1_ps(triangle.V0[a][lane]));
+	}
+
+	__m256 px = _mm256_sub_ps(_mm256_mul_ps(d[1], e2[2]), _mm256_mul_ps(d[2], e2[1]));
+	__m256 py = _mm256_sub_ps(_mm256_mul_ps(d[2], e2[0]), _mm256_mul_ps(d[0], e2[2]));
+	__m256 pz = _mm256_sub_ps(_mm256_mul_ps(d[0], e2[1]), _mm256_mul_ps(d[1], e2[0]));
+	__m256 qx = _mm256_sub_ps(_mm256_mul_ps(s[1], e1[2]), _mm256_mul_ps(s[2], e1[1]));
+	__m256 qy = _mm256_sub_ps(_mm256_mul_ps(s[2], e1[0]), _mm256_mul_ps(s[0], e1[2]));
+	__m256 qz = _mm256_sub_ps(_mm256_mul_ps(s[0], e1[1]), _mm256_mul_ps(s[1], e1[0]));
+
+	__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1[0], px), _mm256_mul_ps(e1[1], py)), _mm256_mul_ps(e1[2], pz));
+	__m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+	__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s[0], px), _mm256_mul_ps(s[1], py)), _mm256_mul_ps(s[2], pz)), inv);
+	__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d[0], qx), _mm256_mul_ps(d[1], qy)), _mm256_mul_ps(d[2], qz)), inv);
+	__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2[0], qx), _mm256_mul_ps(e2[1], qy)), _mm256_mul_ps(e2[2], qz)), inv);
+
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 mask = _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ);
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, *tMax, _CMP_LT_OQ));
+	if (_mm256_movemask_ps(mask) == 0) { return; }
+
+	*tMax = _mm256_blendv_ps(*tMax, t, mask);
+	*hitU = _mm256_blendv_ps(*hitU, u, mask);
+	*hitV = _mm256_blendv_ps(*hitV, v, mask);
+	*hitTriangle = _mm256_blendv_epi8(*hitTriangle, _mm256_set1_epi32(static_cast<int>(triangle.Triangle[lane])), _mm256_castps_si256(mask));
+}
+
+// 8 本の光線をまとめて探索する (束の中の光線が多く当たる子から先に降りる)
+SIMD_TARGET_AVX2 static void IntersectPacket8(const BVH_NODE* nodes, const BVH_TRIANGLE4* triangles, const RAY* rays, RAY_HIT* hits) {
+
+	alignas(32) float values[3][3][8];
+	alignas(32) float maxDistance[8];
+	for (int i = 0; i < 8; ++i) {
+		float inverse[3];
+		InverseDirection(rays[i].Direction, inverse);
+		for (int a = 0; a < 3; ++a) {
+			values[0][a][i] = (&rays[i].Origin.x)[a];
+			values[1][a][i] = (&rays[i].Direction.x)[a];
+			values[2][a][i] = inverse[a];
+		}
+		maxDistance[i] = rays[i].MaxDistance;
+	}
+	RAY_PACKET8 packet;
+	for (int a = 0; a < 3; ++a) {
+		packet.Origin[a] = _mm256_load_ps(values[0][a]);
+		packet.Direction[a] = _mm256_load_ps(values[1][a]);
+		packet.Inverse[a] = _mm256_load_ps(values[2][a]);
+	}
+
+	__m256 tMax = _mm256_load_ps(maxDistance);
+	__m256i hitTriangle = _mm256_set1_epi32(-1);
+	__m256 hitU = _mm256_setzero_ps(), hitV = _mm256_setzero_ps();
+
+	uint32_t stack[BVH_STACK_SIZE];
+	uint32_t stackSize = 0;
+	__m256 tNear, tNearRight;
+	if (IntersectBox8(nodes[0], packet, tMax, &tNear) != 0) { stack[stackSize++] = 0; }
+
+	while (stackSize > 0) {
+		uint32_t index = stack[--stackSize];
+		const BVH_NODE& node = nodes[index];
+
+		if (node.Count > 0) {
+			const BVH_TRIANGLE4& triangle = triangles[node.LeftOrFirst];
+			for (uint32_t lane = 0; lane < node.Count; ++lane) { IntersectTriangle8(triangle, lane, packet, &tMax, &hitTriangle, &hitU, &hitV); }
+			continue;
+		}
+
+		uint32_t left = index + 1, right = node.LeftOrFirst;
+		uint32_t leftMask = IntersectBox8(nodes[left], packet, tMax, &tNear);
+		uint32_t rightMask = IntersectBox8(nodes[right], packet, tMax, &tNearRight);
+		if (leftMask != 0 && rightMask != 0) {
+			uint32_t both = leftMask & rightMask;
+			uint32_t rightFirst = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNearRight, tNear, _CMP_LT_OQ))) & both;
+			if (popcount(rightFirst) * 2 > popcount(both)) { swap(left, right); }
+			stack[stackSize++] = right;
+			stack[stackSize++] = left;
+		}
+		else if (leftMask != 0) { stack[stackSize++] = left; }
+		else if (rightMask != 0) { stack[stackSize++] = right; }
+	}
+
+	alignas(32) float distance[8], u[8], v[8];
+	alignas(32) uint32_t triangle[8];
+	_mm256_store_ps(distance, tMax);
+	_mm256_store_ps(u, hitU);
+	_mm256_store_ps(v, hitV);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(triangle), hitTriangle);
+	for (int i = 0; i < 8; ++i) { hits[i] = { triangle[i], distance[i], u[i], v[i] }; }
+}
+
+#endif
+
+// コンストラクタ
+TriangleBvh::TriangleBvh():
+	m_Nodes(),
+	m_Triangles(),
+	m_BuildTriangles(),
+	m_Statistics() {}
+
+// レンダリングオブジェクトから作る
+void TriangleBvh::Build(const RenderObject& object, JobSystem* jobSystem) {
+	Build(object.GetVertices(), object.GetVertexNum(), object.GetIndices(), object.GetIndexNum(), jobSystem);
+}
+
+// 頂点とインデックスから作る
+void TriangleBvh::Build(const VERTEX* vertices, size_t vertexNum, const uint32_t* indices, size_t indexNum, JobSystem* jobSystem) {
+	PROFILE_ZONE("TriangleBvh::Build");
+
+	auto start = chrono::steady_clock::now();
+
+	// 三角形ごとの境界箱と重心
+	const uint32_t triangleNum = static_cast<uint32_t>(indexNum / 3);
+	m_BuildTriangles.resize(triangleNum);
+	for (uint32_t i = 0; i < triangleNum; ++i) {
+		BUILD_TRIANGLE& triangle = m_BuildTriangles[i];
+		XMVECTOR p[3];
+		for (int k = 0; k < 3; ++k) {
+			uint32_t index = indices[i * 3 + k];
+			if (index >= vertexNum) { throw runtime_error("BVH を作る三角形のインデックスが頂点の数を超えています。"); }
+			p[k] = XMLoadFloat3(&vertices[index].Position);
+		}
+		XMStoreFloat3(&triangle.Min, XMVectorMin(p[0], XMVectorMin(p[1], p[2])));
+		XMStoreFloat3(&triangle.Max, XMVectorMax(p[0], XMVectorMax(p[1], p[2])));
+		XMStoreFloat3(&triangle.Centroid, XMVectorScale(XMVectorAdd(p[0], XMVectorAdd(p[1], p[2])), 1.0f / 3.0f));
+		triangle.Triangle = i;
+	}
+
+	m_Nodes.clear();
+	m_Triangles.clear();
+	m_Statistics = {};
+	m_Statistics.TriangleNum = triangleNum;
+
+	if (triangleNum > 0) {
+		uint32_t maxDepth = 0;
+		uint32_t threadNum = jobSystem != nullptr ? jobSystem->GetThreadNum() : 1;
+
+		if (threadNum > 1 && triangleNum > BVH_TASK_MIN_SIZE * 2) {
+			// 上の段を作って小さくなった部分木を仮の節にしておき、部分木をそれぞれ別の配列に並列に作ってからつなげる
+			uint32_t taskSize = max(triangleNum / (threadNum * 4), BVH_TASK_MIN_SIZE);
+			vector<BVH_NODE> top;
+			vector<BUILD_TASK> tasks;
+			BuildNode(top, 0, triangleNum, 0, &maxDepth, taskSize, &tasks);
+
+			jobSystem->Run(static_cast<uint32_t>(tasks.size()), [&](uint32_t job, uint32_t thread) {
+				BUILD_TASK& task = tasks[job];
+				task.MaxDepth = task.Depth;
+				BuildNode(task.Nodes, task.Begin, task.End, task.Depth, &task.MaxDepth, 0, nullptr);
+			});
+
+			size_t nodeNum = top.size();
+			for (const BUILD_TASK& task : tasks) {
+				nodeNum += task.Nodes.size();
+				maxDepth = max(maxDepth, task.MaxDepth);
+			}
+			m_Nodes.reserve(nodeNum);
+			Flatten(top, 0, tasks);
+			m_Statistics.TaskNum = static_cast<uint32_t>(tasks.size());
+		}
+		else {
+			m_Nodes.reserve(static_cast<size_t>(triangleNum) * 2 / BVH_LEAF_SIZE + 1);
+			BuildNode(m_Nodes, 0, triangleNum, 0, &maxDepth, 0, nullptr);
+		}
+
+		// 葉の三角形を SoA に詰め、SAH のコストを求める
+		const float rootArea = max(HalfArea(&m_Nodes[0].Min.x, &m_Nodes[0].Max.x), FLT_MIN);
+		float cost = 0.0f;
+		m_Triangles.reserve(triangleNum / 2 + 1);
+		for (BVH_NODE& node : m_Nodes) {
+			cost += HalfArea(&node.Min.x, &node.Max.x) / rootArea;
+			if (node.Count == 0) { continue; }
+			CreateLeafTriangles(node, vertices, indices);
+			++m_Statistics.LeafNum;
+		}
+		m_Statistics.NodeNum = static_cast<uint32_t>(m_Nodes.size());
+		m_Statistics.MaxDepth = maxDepth;
+		m_Statistics.SAHCost = cost;
+	}
+
+	m_Statistics.BuildTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// [begin, end) の三角形の節を作る (作った節の番号を返す)
+// tasks を渡すと、三角形が taskSize 以下になった部分木は仮の節にして tasks に積む
+uint32_t TriangleBvh::BuildNode(vector<BVH_NODE>& nodes, uint32_t begin, uint32_t end, uint32_t depth, uint32_t* maxDepth, uint32_t taskSize, vector<BUILD_TASK>* tasks) {
+
+	const uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back({});
+
+	// 境界箱と重心の範囲
+	float boxMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, boxMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	float centroidMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, centroidMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t i = begin; i < end; ++i) {
+		const BUILD_TRIANGLE& triangle = m_BuildTriangles[i];
+		for (int a = 0; a < 3; ++a) {
+			boxMin[a] = min(boxMin[a], (&triangle.Min.x)[a]);
+			boxMax[a] = max(boxMax[a], (&triangle.Max.x)[a]);
+			centroidMin[a] = min(centroidMin[a], (&triangle.Centroid.x)[a]);
+			centroidMax[a] = max(centroidMax[a], (&triangle.Centroid.x)[a]);
+		}
+	}
+	nodes[index].Min = XMFLOAT3(boxMin[0], boxMin[1], boxMin[2]);
+	nodes[index].Max = XMFLOAT3(boxMax[0], boxMax[1], boxMax[2]);
+
+	const uint32_t count = end - begin;
+	if (tasks != nullptr && count <= taskSize) {
+		nodes[index].LeftOrFirst = static_cast<uint32_t>(tasks->size());
+		nodes[index].Count = BVH_TASK_NODE;
+		tasks->push_back({ begin, end, depth, {}, depth });
+		return index;
+	}
+
+	*maxDepth = max(*maxDepth, depth);
+	if (count <= BVH_LEAF_SIZE) {
+		nodes[index].LeftOrFirst = begin;
+		nodes[index].Count = count;
+		return index;
+	}
+
+	// 軸ごとに重心をビンに分け、左右の表面積と 4 つ組の数の積が最も小さくなる境目を選ぶ
+	int bestAxis = -1;
+	uint32_t bestBin = 0;
+	float bestCost = FLT_MAX;
+	auto binOf = [&](const BUILD_TRIANGLE& triangle, int axis, float scale) {
+		uint32_t bin = static_cast<uint32_t>(((&triangle.Centroid.x)[axis] - centroidMin[axis]) * scale);
+		return min(bin, BVH_BIN_NUM - 1);
+	};
+	for (int axis = 0; axis < 3 && depth < BVH_MEDIAN_DEPTH; ++axis) {
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f) { continue; }
+		float scale = BVH_BIN_NUM / extent;
+
+		uint32_t binCount[BVH_BIN_NUM] = {};
+		float binMin[BVH_BIN_NUM][3], binMax[BVH_BIN_NUM][3];
+		for (uint32_t b = 0; b < BVH_BIN_NUM; ++b) {
+			for (int a = 0; a < 3; ++a) { binMin[b][a] = FLT_MAX; binMax[b][a] = -FLT_MAX; }
+		}
+		for (uint32_t i = begin; i < end; ++i) {
+			const BUILD_TRIANGLE& triangle = m_BuildTriangles[i];
+			uint32_t b = binOf(triangle, axis, scale);
+			++binCount[b];
+			for (int a = 0; a < 3; ++a) {
+				binMin[b][a] = min(binMin[b][a], (&triangle.Min.x)[a]);
+				binMax[b][a] = max(binMax[b][a], (&triangle.Max.x)[a]);
+			}
+		}
+
+		// 右から累積した表面積と数 (境目 b はビン b から右)
+		float rightArea[BVH_BIN_NUM] = {};
+		uint32_t rightCount[BVH_BIN_NUM] = {};
+		float accumulatedMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, accumulatedMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		uint32_t accumulatedCount = 0;
+		for (uint32_t b = BVH_BIN_NUM - 1; b > 0; --b) {
+			for (int a = 0; a < 3; ++a) {
+				accumulatedMin[a] = min(accumulatedMin[a], binMin[b][a]);
+				accumulatedMax[a] = max(accumulatedMax[a], binMax[b][a]);
+			}
+			accumulatedCount += binCount[b];
+			rightArea[b] = accumulatedCount > 0 ? HalfArea(accumulatedMin, accumulatedMax) : 0.0f;
+			rightCount[b] = accumulatedCount;
+		}
+
+		for (int a = 0; a < 3; ++a) { accumulatedMin[a] = FLT_MAX; accumulatedMax[a] = -FLT_MAX; }
+		accumulatedCount = 0;
+		for (uint32_t b = 1; b < BVH_BIN_NUM; ++b) {
+			for (int a = 0; a < 3; ++a) {
+				accumulatedMin[a] = min(accumulatedMin[a], binMin[b - 1][a]);
+				accumulatedMax[a] = max(accumulatedMax[a], binMax[b - 1][a]);
+			}
+			accumulatedCount += binCount[b - 1];
+			if (accumulatedCount == 0 || rightCount[b] == 0) { continue; }
+			float cost = HalfArea(accumulatedMin, accumulatedMax) * ((accumulatedCount + BVH_LEAF_SIZE - 1) / BVH_LEAF_SIZE)
+				+ rightArea[b] * ((rightCount[b] + BVH_LEAF_SIZE - 1) / BVH_LEAF_SIZE);
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	uint32_t middle;
+	if (bestAxis >= 0) {
+		float scale = BVH_BIN_NUM / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		auto split = partition(m_BuildTriangles.begin() + begin, m_BuildTriangles.begin() + end, [&](const BUILD_TRIANGLE& triangle) {
+			return binOf(triangle, bestAxis, scale) < bestBin;
+		});
+		middle = static_cast<uint32_t>(split - m_BuildTriangles.begin());
+	}
+	else {
+		// 重心が重なっているか深すぎる場合は、重心の範囲が最も長い軸の中央値で分ける
+		int axis = 0;
+		for (int a = 1; a < 3; ++a) {
+			if (centroidMax[a] - centroidMin[a] > centroidMax[axis] - centroidMin[axis]) { axis = a; }
+		}
+		middle = begin + count / 2;
+		nth_element(m_BuildTriangles.begin() + begin, m_BuildTriangles.begin() + middle, m_BuildTriangles.begin() + end, [axis](const BUILD_TRIANGLE& a, const BUILD_TRIANGLE& b) {
+			return (&a.Centroid.x)[axis] < (&b.Centroid.x)[axis];
+		});
+	}
+
+	BuildNode(nodes, begin, middle, depth + 1, maxDepth, taskSize, tasks);
+	uint32_t right = BuildNode(nodes, middle, end, depth + 1, maxDepth, taskSize, tasks);
+	nodes[index].LeftOrFirst = right;
+	nodes[index].Count = 0;
+	return index;
+}
+
+// 上の段の節と部分木を深さ優先の順に m_Nodes へ詰める (右の子の番号を付け直す)
+void TriangleBvh::Flatten(const vector<BVH_NODE>& top, uint32_t node, const vector<BUILD_TASK>& tasks) {
+
+	const BVH_NODE& source = top[node];
+	if (source.Count == BVH_TASK_NODE) {
+		uint32_t offset = static_cast<uint32_t>(m_Nodes.size());
+		for (BVH_NODE child : tasks[source.LeftOrFirst].Nodes) {
+			if (child.Count == 0) { child.LeftOrFirst += offset; }
+			m_Nodes.push_back(child);
+		}
+		return;
+	}
+
+	uint32_t index = static_cast<uint32_t>(m_Nodes.size());
+	m_Nodes.push_back(source);
+	if (source.Count > 0) { return; }
+
+	Flatten(top, node + 1, tasks);
+	m_Nodes[index].LeftOrFirst = static_cast<uint32_t>(m_Nodes.size());
+	Flatten(top, source.LeftOrFirst, tasks);
+}
+
+// 葉の三角形を 4 つ組に詰める (LeftOrFirst を三角形の番号からブロックの番号に置き換える)
+void TriangleBvh::CreateLeafTriangles(BVH_NODE& leaf, const VERTEX* vertices, const uint32_t* indices) {
+
+	BVH_TRIANGLE4 block = {};
+	for (uint32_t lane = 0; lane < BVH_LEAF_SIZE; ++lane) {
+		block.Triangle[lane] = INVALID_TRIANGLE;
+		if (lane >= leaf.Count) { continue; }
+
+		uint32_t triangle = m_BuildTriangles[leaf.LeftOrFirst + lane].Triangle;
+		const XMFLOAT3& p0 = vertices[indices[triangle * 3 + 0]].Position;
+		const XMFLOAT3& p1 = vertices[indices[triangle * 3 + 1]].Position;
+		const XMFLOAT3& p2 = vertices[indices[triangle * 3 + 2]].Position;
+		const float* v0 = &p0.x;
+		const float* v1 = &p1.x;
+		const float* v2 = &p2.x;
+		for (int a = 0; a < 3; ++a) {
+			block.V0[a][lane] = v0[a];
+			block.Edge1[a][lane] = v1[a] - v0[a];
+			block.Edge2[a][lane] = v2[a] - v0[a];
+		}
+		block.Triangle[lane] = triangle;
+	}
+
+	leaf.LeftOrFirst = static_cast<uint32_t>(m_Triangles.size());
+	m_Triangles.push_back(block);
+}
+
+// 1 本の光線で探索する (anyHit なら最初に当たった時点で打ち切る)
+bool TriangleBvh::Traverse(const RAY& ray, bool anyHit, RAY_HIT* hit) const {
+
+	*hit = { INVALID_TRIANGLE, ray.MaxDistance, 0.0f, 0.0f };
+	if (m_Nodes.empty()) { return false; }
+
+	const float* origin = &ray.Origin.x;
+	const float* direction = &ray.Direction.x;
+	float inverse[3];
+	InverseDirection(ray.Direction, inverse);
+
+	// 入る距離と一緒に積み、取り出したときに既に見つけた交点より遠ければ飛ばす
+	struct STACK_ENTRY {
+		uint32_t Node;
+		float Distance;
+	};
+	STACK_ENTRY stack[BVH_STACK_SIZE];
+	uint32_t stackSize = 0;
+
+	float tMax = ray.MaxDistance;
+	float tNear, tNearRight;
+	if (!IntersectBox(m_Nodes[0], origin, inverse, tMax, &tNear)) { return false; }
+	stack[stackSize++] = { 0, tNear };
+
+	while (stackSize > 0) {
+		STACK_ENTRY entry = stack[--stackSize];
+		if (entry.Distance >= tMax) { continue; }
+		const BVH_NODE& node = m_Nodes[entry.Node];
+
+		if (node.Count > 0) {
+			const BVH_TRIANGLE4& triangle = m_Triangles[node.LeftOrFirst];
+			float t[4], u[4], v[4];
+			uint32_t mask = IntersectTriangle4(triangle, origin, direction, tMax, t, u, v);
+			while (mask != 0) {
+				int lane = countr_zero(mask);
+				mask &= mask - 1;
+				if (t[lane] >= tMax) { continue; }
+				tMax = t[lane];
+				*hit = { triangle.Triangle[lane], t[lane], u[lane], v[lane] };
+			}
+			if (anyHit && hit->Triangle != INVALID_TRIANGLE) { return true; }
+			continue;
+		}
+
+		uint32_t left = entry.Node + 1, right = node.LeftOrFirst;
+		bool hitLeft = IntersectBox(m_Nodes[left], origin, inverse, tMax, &tNear);
+		bool hitRight = IntersectBox(m_Nodes[right], origin, inverse, tMax, &tNearRight);
+		if (hitLeft && hitRight) {
+			if (tNearRight < tNear) {
+				swap(left, right);
+				swap(tNear, tNearRight);
+			}
+			stack[stackSize++] = { right, tNearRight };
+			stack[stackSize++] = { left, tNear };
+		}
+		else if (hitLeft) { stack[stackSize++] = { left, tNear }; }
+		else if (hitRight) { stack[stackSize++] = { right, tNearRight }; }
+	}
+	return hit->Triangle != INVALID_TRIANGLE;
+}
+
+// 最も近い交点を求める
+bool TriangleBvh::Intersect(const RAY& ray, RAY_HIT* hit) const { return Traverse(ray, false, hit); }
+
+// MaxDistance までに何かに当たるか
+bool TriangleBvh::IsOccluded(const RAY& ray) const {
+	RAY_HIT hit;
+	return Traverse(ray, true, &hit);
+}
+
+// 複数の光線の最も近い交点を求める (AVX2 が使えなければ、または 8 本に満たない残りは 1 本ずつ)
+void TriangleBvh::Intersect(const RAY* rays, uint32_t num, RAY_HIT* hits) const {
+	PROFILE_ZONE("TriangleBvh::Intersect");
+
+	uint32_t i = 0;
+
+#if defined(SIMD_X86)
+	if (IsAVX2Supported() && !m_Nodes.empty()) {
+		for (; i + 8 <= num; i += 8) { IntersectPacket8(m_Nodes.data(), m_Triangles.data(), rays + i, hits + i); }
+	}
+#endif
+
+	for (; i < num; ++i) { Traverse(rays[i], false, &hits[i]); }
+}
+
+// 節を取得
+const BVH_NODE* TriangleBvh::GetNodes() const { return m_Nodes.data(); }
+uint32_t TriangleBvh::GetNodeNum() const { return static_cast<uint32_t>(m_Nodes.size()); }
+
+// 統計情報を取得
+BVH_STATISTICS TriangleBvh::GetStatistics() const { return m_Statistics; }
+
+// 約 triangleNum 個の三角形で、作る時間と 1 秒あたりの光線の数を計測して出力する
+void TriangleBvh::RunBenchmark(uint32_t triangleNum, uint32_t threadNum) {
+
+	const uint32_t repeatNum = 3;
+	const uint32_t imageSize = 512;
+
+	// 起伏のある格子 (格子の 1 マスが 2 つの三角形)
+	uint32_t divisions = max(1u, static_cast<uint32_t>(sqrt(triangleNum / 2.0)));
+	Grid grid(divisions);
+	VERTEX* vertices = grid.GetVertices();
+	for (size_t i = 0; i < grid.GetVertexNum(); ++i) {
+		XMFLOAT3& p = vertices[i].Position;
+		p.z = 0.15f * sinf(p.x * 9.0f) * cosf(p.y * 7.0f) + 0.04f * sinf(p.x * 31.0f + p.y * 17.0f);
+	}
+	grid.UpdateBounds();
+	const uint32_t builtNum = static_cast<uint32_t>(grid.GetIndexNum() / 3);
+
+	// 1 回分の時間 (ミリ秒) の平均
+	auto measure = [repeatNum](const function<void()>& function) {
+		auto begin = chrono::steady_clock::now();
+		for (uint32_t repeat = 0; repeat < repeatNum; ++repeat) { function(); }
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count() / repeatNum;
+	};
+
+	// 1 スレッドと並列で作る (同じ木になるはず)
+	TriangleBvh single, bvh;
+	JobSystem jobSystem(threadNum);
+	double buildTime = measure([&] { single.Build(grid); });
+	double threadBuildTime = measure([&] { bvh.Build(grid, &jobSystem); });
+	bool sameTree = single.GetNodeNum() == bvh.GetNodeNum() && memcmp(single.GetNodes(), bvh.GetNodes(), sizeof(BVH_NODE) * bvh.GetNodeNum()) == 0;
+
+	// 揃った光線 (斜め上のカメラから画素ごとに少しずらして飛ばす) と揃っていない光線 (格子の上の乱数の位置から乱数の向き)
+	mt19937 random(1);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	const uint32_t rayNum = imageSize * imageSize;
+	vector<RAY> coherent(rayNum), incoherent(rayNum);
+	XMVECTOR eye = XMVectorSet(0.4f, -2.4f, 1.8f, 0.0f);
+	XMVECTOR forward = XMVector3Normalize(XMVectorSubtract(XMVectorZero(), eye));
+	XMVECTOR right = XMVector3Normalize(XMVector3Cross(forward, XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f)));
+	XMVECTOR up = XMVector3Cross(right, forward);
+	for (uint32_t y = 0; y < imageSize; ++y) {
+		for (uint32_t x = 0; x < imageSize; ++x) {
+			float px = ((x + 0.5f + unit(random) * 0.5f) / imageSize * 2.0f - 1.0f) * 0.6f;
+			float py = ((y + 0.5f + unit(random) * 0.5f) / imageSize * 2.0f - 1.0f) * 0.6f;
+			RAY& ray = coherent[y * imageSize + x];
+			XMStoreFloat3(&ray.Origin, eye);
+			XMStoreFloat3(&ray.Direction, XMVectorAdd(forward, XMVectorAdd(XMVectorScale(right, px), XMVectorScale(up, py))));
+			ray.MaxDistance = 100.0f;
+		}
+	}
+	for (RAY& ray : incoherent) {
+		ray.Origin = XMFLOAT3(unit(random), unit(random), 0.2f + unit(random) * 0.1f);
+		ray.Direction = XMFLOAT3(unit(random), unit(random), unit(random));
+		ray.MaxDistance = 100.0f;
+	}
+
+	vector<RAY_HIT> singleHits(rayNum), packetHits(rayNum);
+	double coherentTime = measure([&] { for (uint32_t i = 0; i < rayNum; ++i) { bvh.Intersect(coherent[i], &singleHits[i]); } });
+	double coherentPacketTime = measure([&] { bvh.Intersect(coherent.data(), rayNum, packetHits.data()); });
+
+	// 当たった点から光源への見通しの光線
+	vector<RAY> shadows;
+	XMVECTOR light = XMVectorSet(2.0f, 1.5f, 3.0f, 0.0f);
+	for (uint32_t i = 0; i < rayNum; ++i) {
+		if (singleHits[i].Triangle == INVALID_TRIANGLE) { continue; }
+		XMVECTOR point = XMVectorAdd(XMLoadFloat3(&coherent[i].Origin), XMVectorScale(XMLoadFloat3(&coherent[i].Direction), singleHits[i].Distance * 0.9999f));
+		RAY shadow;
+		XMStoreFloat3(&shadow.Origin, point);
+		XMStoreFloat3(&shadow.Direction, XMVectorSubtract(light, point));
+		shadow.MaxDistance = 1.0f;
+		shadows.push_back(shadow);
+	}
+	uint32_t occludedNum = 0;
+	double occlusionTime = measure([&] {
+		occludedNum = 0;
+		for (const RAY& shadow : shadows) { occludedNum += bvh.IsOccluded(shadow) ? 1 : 0; }
+	});
+
+	// 1 本ずつと束の結果が同じか (同じ距離で当たる辺の上では三角形が入れ替わってよい)
+	// 浅い角度で辺のすぐ近くを通る光線は、丸め方の違い (FMA など) で隣り合う三角形の両方から外れることがあるので別に数える
+	uint32_t mismatchNum = 0, edgeNum = 0;
+	auto compare = [&](const RAY_HIT& a, const RAY_HIT& b) {
+		if ((a.Triangle == INVALID_TRIANGLE) == (b.Triangle == INVALID_TRIANGLE) && fabs(a.Distance - b.Distance) <= 1e-4f * max(1.0f, a.Distance)) { return; }
+		const RAY_HIT& hit = a.Triangle != INVALID_TRIANGLE ? a : b;
+		if (min(min(hit.U, hit.V), 1.0f - hit.U - hit.V) < 1e-3f) { ++edgeNum; }
+		else { ++mismatchNum; }
+	};
+	for (uint32_t i = 0; i < rayNum; ++i) { compare(singleHits[i], packetHits[i]); }
+
+	vector<RAY_HIT> incoherentHits(rayNum);
+	double incoherentTime = measure([&] { for (uint32_t i = 0; i < rayNum; ++i) { bvh.Intersect(incoherent[i], &singleHits[i]); } });
+	double incoherentPacketTime = measure([&] { bvh.Intersect(incoherent.data(), rayNum, incoherentHits.data()); });
+	for (uint32_t i = 0; i < rayNum; ++i) { compare(singleHits[i], incoherentHits[i]); }
+
+	// 一部の光線をすべての三角形と総当たりで比べる
+	const uint32_t* indices = grid.GetIndices();
+	auto bruteForce = [&](const RAY& ray) {
+		RAY_HIT hit = { INVALID_TRIANGLE, ray.MaxDistance, 0.0f, 0.0f };
+		XMVECTOR origin = XMLoadFloat3(&ray.Origin), direction = XMLoadFloat3(&ray.Direction);
+		for (uint32_t t = 0; t < builtNum; ++t) {
+			XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3 + 0]].Position);
+			XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&vertices[indices[t * 3 + 1]].Position), p0);
+			XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&vertices[indices[t * 3 + 2]].Position), p0);
+			XMVECTOR p = XMVector3Cross(direction, e2);
+			float det = XMVectorGetX(XMVector3Dot(e1, p));
+			if (det == 0.0f) { continue; }
+			XMVECTOR s = XMVectorSubtract(origin, p0), q = XMVector3Cross(s, e1);
+			float u = XMVectorGetX(XMVector3Dot(s, p)) / det, v = XMVectorGetX(XMVector3Dot(direction, q)) / det, distance = XMVectorGetX(XMVector3Dot(e2, q)) / det;
+			if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && distance > 0.0f && distance < hit.Distance) { hit = { t, distance, u, v }; }
+		}
+		return hit;
+	};
+	const uint32_t checkNum = 64;
+	for (uint32_t i = 0; i < checkNum; ++i) {
+		uint32_t index = static_cast<uint32_t>(static_cast<uint64_t>(i) * rayNum / checkNum);
+		compare(bruteForce(coherent[index]), packetHits[index]);
+		compare(bruteForce(incoherent[index]), incoherentHits[index]);
+	}
+
+	// 1 秒あたりの光線の数 (百万)
+	auto rate = [](uint64_t num, double milliseconds) { return num / (milliseconds * 1000.0); };
+
+#if defined(SIMD_X86)
+	const char* kernel = IsAVX2Supported() ? "sse single, avx2 packet" : "sse single";
+#else
+	const char* kernel = "scalar";
+#endif
+
+	BVH_STATISTICS statistics = bvh.GetStatistics();
+	cout << "triangles : " << builtNum << endl;
+	cout << "threads : " << jobSystem.GetThreadNum() << endl;
+	cout << "kernel : " << kernel << endl;
+	cout << "build : " << buildTime << " ms (" << rate(builtNum, buildTime) << " M triangles/s)" << endl;
+	cout << "build threaded : " << threadBuildTime << " ms (" << statistics.TaskNum << " tasks, " << (sameTree ? "same tree" : "DIFFERENT TREE") << ")" << endl;
+	cout << "nodes : " << statistics.NodeNum << " (" << statistics.LeafNum << " leaves, depth " << statistics.MaxDepth << ")" << endl;
+	cout << "SAH cost : " << statistics.SAHCost << endl;
+	cout << "closest, coherent : " << coherentTime << " ms (" << rate(rayNum, coherentTime) << " M rays/s)" << endl;
+	cout << "closest packet, coherent : " << coherentPacketTime << " ms (" << rate(rayNum, coherentPacketTime) << " M rays/s)" << endl;
+	cout << "closest, incoherent : " << incoherentTime << " ms (" << rate(rayNum, incoherentTime) << " M rays/s)" << endl;
+	cout << "closest packet, incoherent : " << incoherentPacketTime << " ms (" << rate(rayNum, incoherentPacketTime) << " M rays/s)" << endl;
+	cout << "occlusion : " << occlusionTime << " ms (" << rate(shadows.size(), occlusionTime) << " M rays/s, " << occludedNum << " / " << shadows.size() << " occluded)" << endl;
+	cout << "edge rays : " << edgeNum << endl;
+	cout << "result : " << (mismatchNum == 0 ? "matched" : "MISMATCH") << endl;
+}
@@ -0,0 +1,119 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "JobSystem.h"
+#include "RenderObject.h"
+
+using namespace std;
+using namespace DirectX;
+
+// 当たらなかった場合の三角形の番号
+static const uint32_t INVALID_TRIANGLE = UINT32_MAX;
+
+// 光線 (Direction は正規化しなくてよく、距離は Direction の長さを単位とする)
+struct RAY {
+	XMFLOAT3 Origin;
+	XMFLOAT3 Direction;
+	float MaxDistance;
+};
+
+// 光線が当たった三角形 (Triangle はインデックス配列の三角形の番号、U と V は重心座標)
+struct RAY_HIT {
+	uint32_t Triangle;
+	float Distance;
+	float U;
+	float V;
+};
+
+// BVH の節 (32 バイト、深さ優先で並べ、左の子は自分のすぐ後ろに置く)
+// 内部の節は Count が 0 で LeftOrFirst が右の子の番号、葉は LeftOrFirst が三角形のブロックの番号
+struct BVH_NODE {
+	XMFLOAT3 Min;
+	uint32_t LeftOrFirst;
+	XMFLOAT3 Max;
+	uint32_t Count;
+};
+
+// 葉の三角形 4 つ分 (SoA、足りない分は面積のない三角形で埋める)
+struct BVH_TRIANGLE4 {
+	float V0[3][4];
+	float Edge1[3][4];
+	float Edge2[3][4];
+	uint32_t Triangle[4];
+};
+
+// BVH の統計情報
+struct BVH_STATISTICS {
+	uint32_t TriangleNum;
+	uint32_t NodeNum;
+	uint32_t LeafNum;
+	uint32_t MaxDepth;
+	float SAHCost;     // 根の表面積に対する節と三角形の検査の期待回数
+	double BuildTime;  // ミリ秒
+	uint32_t TaskNum;  // 並列に作った部分木の数
+};
+
+// 三角形の BVH
+// RenderObject の頂点とインデックスから、重心をビンに分けた SAH で 2 分木を作り、葉は最大 4 つの三角形にする
+// 節は深さ優先の 1 本の配列に詰め、葉の三角形は SoA の 4 つ組にして SSE で 1 度に判定する
+// 光線の束 (8 本) は AVX2 で 1 度に箱と三角形を判定し、AVX2 が使えなければ 1 本ずつ判定する
+// jobSystem を渡すと、上の段で分けた部分木を並列に作る
+class TriangleBvh {
+
+private:
+	// 作るときの三角形 (重心と境界箱)
+	struct BUILD_TRIANGLE {
+		XMFLOAT3 Min;
+		XMFLOAT3 Max;
+		XMFLOAT3 Centroid;
+		uint32_t Triangle;
+	};
+
+	// 並列に作る部分木
+	struct BUILD_TASK {
+		uint32_t Begin;
+		uint32_t End;
+		uint32_t Depth;
+		vector<BVH_NODE> Nodes;
+		uint32_t MaxDepth;
+	};
+
+	vector<BVH_NODE> m_Nodes;
+	vector<BVH_TRIANGLE4> m_Triangles;
+	vector<BUILD_TRIANGLE> m_BuildTriangles;
+	BVH_STATISTICS m_Statistics;
+
+	uint32_t BuildNode(vector<BVH_NODE>& nodes, uint32_t begin, uint32_t end, uint32_t depth, uint32_t* maxDepth, uint32_t taskSize, vector<BUILD_TASK>* tasks);
+	void Flatten(const vector<BVH_NODE>& top, uint32_t node, const vector<BUILD_TASK>& tasks);
+	void CreateLeafTriangles(BVH_NODE& leaf, const VERTEX* vertices, const uint32_t* indices);
+	bool Traverse(const RAY& ray, bool anyHit, RAY_HIT* hit) const;
+
+public:
+	TriangleBvh();
+	~TriangleBvh() = default;
+	TriangleBvh(const TriangleBvh&) = delete;
+	TriangleBvh& operator=(const TriangleBvh&) = delete;
+
+	// 作る (jobSystem が nullptr なら呼び出し元のスレッドだけで作る)
+	void Build(const RenderObject& object, JobSystem* jobSystem = nullptr);
+	void Build(const VERTEX* vertices, size_t vertexNum, const uint32_t* indices, size_t indexNum, JobSystem* jobSystem = nullptr);
+
+	// 最も近い交点を求める (当たらなければ false で、hit の Triangle は INVALID_TRIANGLE)
+	bool Intersect(const RAY& ray, RAY_HIT* hit) const;
+
+	// MaxDistance までに何かに当たるか (見通しの判定用、最初に見つけた時点で打ち切る)
+	bool IsOccluded(const RAY& ray) const;
+
+	// 複数の光線の最も近い交点を求める (8 本ずつ束にして判定する)
+	void Intersect(const RAY* rays, uint32_t num, RAY_HIT* hits) const;
+
+	const BVH_NODE* GetNodes() const;
+	uint32_t GetNodeNum() const;
+	BVH_STATISTICS GetStatistics() const;
+
+	// 約 triangleNum 個の三角形の起伏のある格子で、作る時間と 1 秒あたりの光線の数を計測して出力する
+	static void RunBenchmark(uint32_t triangleNum, uint32_t threadNum);
+};
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+// 1 つの書き手と 1 つの読み手のロックフリーなトリプルバッファ
+// 書き手は書き終えた領域を間に置いた領域と交換して公開し、読み手は新しいものがあれば間の領域と交換して受け取る
+// どちらも相手を待たず、読み手は常に最後に公開された一式だけを見る (読まれる前に次が公開されたものは捨てられる)
+template <typename T>
+class TripleBuffer {
+
+private:
+	// 間に置いた領域の番号に、まだ読まれていない公開があるかの印を合わせて 1 つの値にする
+	static const uint32_t INDEX_MASK = 3;
+	static const uint32_t FRESH_BIT = 4;
+
+	T m_Buffers[3];
+
+	// 書き手と読み手が交換する値 (別々のスレッドが触るのでキャッシュラインを分ける)
+	alignas(64) atomic<uint32_t> m_Middle;
+	alignas(64) uint32_t m_WriteIndex;
+	alignas(64) uint32_t m_ReadIndex;
+
+public:
+	TripleBuffer():
+		m_Buffers(),
+		m_Middle(1),
+		m_WriteIndex(0),
+		m_ReadIndex(2) {
+	}
+
+	~TripleBuffer() = default;
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// 書き込み用の領域 (書き手のスレッドだけが触る、前に公開したものとは別の領域で中身は古いまま)
+	T& GetWriteBuffer() { return m_Buffers[m_WriteIndex]; }
+
+	// 書き込み用の領域を公開する (読まれていない前のものを置き換えたら true)
+	bool Publish() {
+		uint32_t previous = m_Middle.exchange(m_WriteIndex | FRESH_BIT, memory_order_acq_rel);
+		m_WriteIndex = previous & INDEX_MASK;
+		return (previous & FRESH_BIT) != 0;
+	}
+
+	// 新しく公開されたものがあれば受け取る (受け取ったら true、なければ前のものを読み続ける)
+	bool Update() {
+		if ((m_Middle.load(memory_order_relaxed) & FRESH_BIT) == 0) { return false; }
+		uint32_t previous = m_Middle.exchange(m_ReadIndex, memory_order_acq_rel);
+		m_ReadIndex = previous & INDEX_MASK;
+		return true;
+	}
+
+	// 読み出し用の領域 (読み手のスレッドだけが触る)
+	const T& GetReadBuffer() const { return m_Buffers[m_ReadIndex]; }
+};
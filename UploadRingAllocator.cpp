@@ -0,0 +1,210 @@
+﻿#include "UploadRingAllocator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// アライメントに切り上げる
+static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// コンストラクタ
+UploadRingAllocator::UploadRingAllocator(void* base, uint64_t capacity):
+	m_Base(static_cast<uint8_t*>(base)),
+	m_Capacity(capacity),
+	m_Head(0),
+	m_Tail(0),
+	m_Frames(),
+	m_FrameBytes(0),
+	m_Statistics({ 0 }) {}
+
+// 範囲を割り当てる
+bool UploadRingAllocator::Allocate(uint64_t size, uint64_t alignment, UPLOAD_ALLOCATION* allocation) {
+
+	if (alignment == 0) { alignment = 1; }
+	if (size == 0 || size > m_Capacity) {
+		++m_Statistics.FailedCount;
+		return false;
+	}
+
+	// 末尾をまたぐ場合は残りを捨てて先頭から割り当てる
+	uint64_t offset = m_Head % m_Capacity;
+	uint64_t aligned = AlignUp(offset, alignment);
+	uint64_t head = m_Head + (aligned - offset) + size;
+	bool wrapped = aligned + size > m_Capacity;
+	if (wrapped) {
+		aligned = 0;
+		head = m_Head + (m_Capacity - offset) + size;
+	}
+
+	// GPU で使用中の範囲に追いついた (使用中のフレームがなければ待っても空かない)
+	if (head - m_Tail > m_Capacity) {
+		if (!m_Frames.empty()) { ++m_Statistics.StallCount; }
+		else { ++m_Statistics.FailedCount; }
+		return false;
+	}
+
+	if (wrapped) { ++m_Statistics.WrapCount; }
+
+	m_FrameBytes += size;
+	m_Head = head;
+
+	allocation->Offset = aligned;
+	allocation->Size = size;
+	allocation->CPUAddress = m_Base != nullptr ? m_Base + aligned : nullptr;
+	return true;
+}
+
+// 今フレームの割り当てをフェンス値に結びつける
+void UploadRingAllocator::FinishFrame(uint64_t fenceValue) {
+	m_Frames.push_back({ fenceValue, m_Head });
+
+	m_Statistics.LastFrameBytes = m_FrameBytes;
+	m_Statistics.TotalBytes += m_FrameBytes;
+	m_FrameBytes = 0;
+}
+
+// 完了したフェンス値までの範囲を回収する
+void UploadRingAllocator::Retire(uint64_t completedFenceValue) {
+	while (!m_Frames.empty() && m_Frames.front().FenceValue <= completedFenceValue) {
+		m_Tail = m_Frames.front().End;
+		m_Frames.pop_front();
+	}
+}
+
+// 回収待ちのうち最も古いフェンス値
+uint64_t UploadRingAllocator::GetOldestFenceValue() const {
+	return m_Frames.empty() ? 0 : m_Frames.front().FenceValue;
+}
+
+// 別のバッファに切り替える
+void UploadRingAllocator::Rebind(void* base, uint64_t capacity) {
+	m_Base = static_cast<uint8_t*>(base);
+	m_Capacity = capacity;
+	m_Head = 0;
+	m_Tail = 0;
+	m_Frames.clear();
+}
+
+// 容量を取得
+uint64_t UploadRingAllocator::GetCapacity() const { return m_Capacity; }
+
+// 統計情報を取得
+UPLOAD_STATISTICS UploadRingAllocator::GetStatistics() const {
+	UPLOAD_STATISTICS statistics = m_Statistics;
+	statistics.BytesInFlight = m_Head - m_Tail;
+	return statistics;
+}
+
+// 偽のフェンスで割り当てと回収を行って計測する
+void UploadRingAllocator::RunBenchmark(uint32_t frameNum) {
+
+	const uint64_t capacity = 4 * 1024 * 1024;
+	const uint64_t frameLatency = 3;
+	const uint32_t allocationNum = 64;
+	frameNum = max(frameNum, 1u);
+
+	// 使用中の範囲 (割り当てたフレームのフェンス値と一緒に持つ)
+	struct LIVE_RANGE {
+		uint64_t FenceValue;
+		uint64_t Offset;
+		uint64_t Size;
+	};
+
+	// 1 フレームに allocationNum 回、平均 frameBytes バイトを割り当てる
+	// フレームの始めに frameLatency フレーム前の分が GPU で終わったことにし、空きがなければ最も古いフレームが終わるのを待つ
+	// 待つフレームがなければ Graphic::Upload と同じく割り当てを諦め、その回数を数える
+	// check なら割り当てた範囲が使用中の範囲と重ならないことを確かめる (重なれば false)
+	struct RUN_RESULT {
+		double Time;
+		uint64_t WaitNum;
+		uint64_t GiveUpNum;
+		UPLOAD_STATISTICS Statistics;
+		bool Valid;
+	};
+	auto run = [&](uint64_t frameBytes, uint64_t oversizedBytes, bool check) {
+		UploadRingAllocator allocator(nullptr, capacity);
+		mt19937 random(1);
+		uniform_int_distribution<uint64_t> sizes(16, frameBytes * 2 / allocationNum);
+		const uint64_t alignments[] = { 16, 256 };
+
+		RUN_RESULT result = { 0.0, 0, 0, {}, true };
+		vector<LIVE_RANGE> live;
+		uint64_t completed = 0;
+		auto begin = chrono::steady_clock::now();
+		for (uint64_t frame = 1; frame <= frameNum; ++frame) {
+			if (frame > frameLatency) { completed = max(completed, frame - frameLatency); }
+			allocator.Retire(completed);
+
+			for (uint32_t i = 0; i <= allocationNum; ++i) {
+				// 最後に 1 つだけ大きな割り当てを混ぜる (0 なら混ぜない)
+				uint64_t size = i < allocationNum ? sizes(random) : oversizedBytes;
+				if (size == 0) { continue; }
+
+				UPLOAD_ALLOCATION allocation = {};
+				bool allocated = true;
+				while (!allocator.Allocate(size, alignments[i % 2], &allocation)) {
+					uint64_t fenceValue = allocator.GetOldestFenceValue();
+					if (fenceValue == 0) {
+						allocated = false;
+						++result.GiveUpNum;
+						break;
+					}
+					completed = fenceValue;
+					allocator.Retire(completed);
+					++result.WaitNum;
+				}
+				if (!allocated || !check) { continue; }
+
+				// 回収済みのものを除いてから重なりを調べる
+				live.erase(remove_if(live.begin(), live.end(), [completed](const LIVE_RANGE& range) { return range.FenceValue <= completed; }), live.end());
+				for (const LIVE_RANGE& range : live) {
+					if (allocation.Offset < range.Offset + range.Size && range.Offset < allocation.Offset + allocation.Size) { result.Valid = false; }
+				}
+				result.Valid = result.Valid && allocation.Offset % alignments[i % 2] == 0 && allocation.Offset + allocation.Size <= capacity;
+				live.push_back({ frame, allocation.Offset, allocation.Size });
+			}
+			allocator.FinishFrame(frame);
+		}
+		result.Time = chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count();
+		result.Statistics = allocator.GetStatistics();
+		return result;
+	};
+
+	// 余裕のある量、GPU を待つ量、容量を超える割り当てを混ぜた場合
+	struct SCENARIO {
+		const char* Name;
+		uint64_t FrameBytes;
+		uint64_t OversizedBytes;
+	};
+	const SCENARIO scenarios[] = {
+		{ "steady", capacity / 8, 0 },
+		{ "pressure", capacity / 2, 0 },
+		{ "oversized", capacity / 8, capacity + 1 },
+		{ "full frame", capacity / 8, capacity - capacity / 16 },
+	};
+
+	bool matched = true;
+	cout << "capacity : " << capacity << " bytes, frame latency : " << frameLatency << endl;
+	for (const SCENARIO& scenario : scenarios) {
+		RUN_RESULT timed = run(scenario.FrameBytes, scenario.OversizedBytes, false);
+		RUN_RESULT checked = run(scenario.FrameBytes, scenario.OversizedBytes, true);
+		const UPLOAD_STATISTICS& statistics = timed.Statistics;
+		uint64_t allocations = static_cast<uint64_t>(frameNum) * (allocationNum + (scenario.OversizedBytes > 0 ? 1 : 0));
+
+		cout << scenario.Name << " : " << timed.Time / allocations << " ns / allocation, " << statistics.TotalBytes / frameNum << " bytes / frame, ";
+		cout << statistics.WrapCount << " wraps, " << statistics.StallCount << " stalls (" << timed.WaitNum << " waits), ";
+		cout << statistics.FailedCount << " failed (" << timed.GiveUpNum << " given up)" << endl;
+
+		// 容量を超える割り当てと、そのフレームの残りに収まらない割り当ては必ず諦め、それ以外は諦めない
+		// 同じ乱数列なので確かめた回と数が一致する
+		bool expectGiveUp = scenario.OversizedBytes > 0;
+		matched = matched && checked.Valid && checked.GiveUpNum == timed.GiveUpNum && checked.WaitNum == timed.WaitNum;
+		matched = matched && (expectGiveUp ? timed.GiveUpNum == frameNum : timed.GiveUpNum == 0);
+		matched = matched && (scenario.FrameBytes * frameLatency < capacity / 2 || timed.WaitNum > 0) && statistics.WrapCount > 0;
+	}
+	cout << "result : " << (matched ? "matched" : "MISMATCH") << endl;
+}
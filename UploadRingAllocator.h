@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <deque>
+
+using namespace std;
+
+// アップロード領域の割り当て結果
+struct UPLOAD_ALLOCATION {
+	uint64_t Offset;
+	uint64_t Size;
+	void* CPUAddress;
+};
+
+// アップロードの統計情報
+struct UPLOAD_STATISTICS {
+	uint64_t LastFrameBytes;
+	uint64_t TotalBytes;
+	uint64_t StallCount;      // GPU で使用中の範囲に追いついて割り当てられなかった回数
+	uint64_t FailedCount;     // 使用中の範囲がなくても割り当てられなかった回数 (容量を超える大きさか、1 フレームで容量を使い切った)
+	uint64_t WrapCount;       // 末尾の残りを捨てて先頭に戻った回数
+	uint64_t BytesInFlight;
+};
+
+// フェンス値で解放されるリング型アップロードアロケータ
+// 割り当てはバッファ先頭から線形に進め、フレーム末尾で記録したフェンス値が完了した時点で古い範囲を回収する
+// バッファの実体やフェンスには触れないので、描画 API に依存せずに使える
+class UploadRingAllocator {
+
+private:
+	// フレームごとの使用範囲
+	struct FRAME_RANGE {
+		uint64_t FenceValue;
+		uint64_t End;
+	};
+
+	// マップ済みメモリの先頭と容量
+	uint8_t* m_Base;
+	uint64_t m_Capacity;
+
+	// 割り当て位置 (単調増加し、容量で割った余りが実際のオフセット)
+	uint64_t m_Head;
+	uint64_t m_Tail;
+
+	// GPU で使用中のフレーム
+	deque<FRAME_RANGE> m_Frames;
+
+	// 統計
+	uint64_t m_FrameBytes;
+	UPLOAD_STATISTICS m_Statistics;
+
+public:
+	UploadRingAllocator(void* base, uint64_t capacity);
+	~UploadRingAllocator() = default;
+	UploadRingAllocator(const UploadRingAllocator&) = delete;
+	UploadRingAllocator& operator=(const UploadRingAllocator&) = delete;
+
+	// 範囲を割り当てる (空きがなければ false を返すので、最古のフェンスを待って Retire してから再試行する)
+	bool Allocate(uint64_t size, uint64_t alignment, UPLOAD_ALLOCATION* allocation);
+
+	// 今フレームの割り当てをフェンス値に結びつける
+	void FinishFrame(uint64_t fenceValue);
+
+	// 完了したフェンス値までの範囲を回収する
+	void Retire(uint64_t completedFenceValue);
+
+	// 回収待ちのうち最も古いフェンス値 (なければ 0)
+	uint64_t GetOldestFenceValue() const;
+
+	// 別のバッファに切り替える (使用中の範囲は元のバッファに残るので追わず、今フレームの量と統計は引き継ぐ)
+	void Rebind(void* base, uint64_t capacity);
+
+	uint64_t GetCapacity() const;
+	UPLOAD_STATISTICS GetStatistics() const;
+
+	// 偽のフェンスで frameNum フレーム分の割り当てと回収を行って速さと統計を出力する
+	// 末尾をまたぐ場合、GPU を待つ場合、待っても割り当てられない場合を通し、使用中の範囲と重ならないことを確かめる
+	static void RunBenchmark(uint32_t frameNum);
+};
@@ -0,0 +1,218 @@
+﻿#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <DirectXPackedVector.h>
+
+using namespace DirectX::PackedVector;
+
+// 位置の要素の形式
+static ELEMENT_FORMAT ToElementFormat(POSITION_FORMAT format) {
+	switch (format) {
+	case POSITION_FORMAT::HALF4: return ELEMENT_FORMAT::R16G16B16A16_FLOAT;
+	case POSITION_FORMAT::SNORM16X4: return ELEMENT_FORMAT::R16G16B16A16_SNORM;
+	default: return ELEMENT_FORMAT::R32G32B32_FLOAT;
+	}
+}
+
+// 色の要素の形式
+static ELEMENT_FORMAT ToElementFormat(COLOR_FORMAT format) {
+	switch (format) {
+	case COLOR_FORMAT::RGBA8_UNORM: return ELEMENT_FORMAT::R8G8B8A8_UNORM;
+	default: return ELEMENT_FORMAT::R32G32B32A32_FLOAT;
+	}
+}
+
+// [-1, 1] を 16 ビットの符号付き正規化整数にする
+static int16_t ToSnorm16(float value) {
+	value = min(max(value, -1.0f), 1.0f);
+	return static_cast<int16_t>(lroundf(value * 32767.0f));
+}
+
+// [0, 1] を 8 ビットの正規化整数にする
+static uint8_t ToUnorm8(float value) {
+	value = min(max(value, 0.0f), 1.0f);
+	return static_cast<uint8_t>(lroundf(value * 255.0f));
+}
+
+// コンストラクタ
+VertexFormat::VertexFormat(const VERTEX_FORMAT& format):
+	m_Format(format),
+	m_Stride(0),
+	m_PositionOffset(0),
+	m_ColorOffset(0) {
+
+	if (m_Format.Position == POSITION_FORMAT::SNORM16X4 && !(m_Format.PositionExtent > 0.0f)) {
+		throw runtime_error("量子化する位置の範囲が正しくありません。");
+	}
+
+	// 要素は詰めて並べる (D3D12_APPEND_ALIGNED_ELEMENT と同じ)
+	m_PositionOffset = 0;
+	m_ColorOffset = GetElementSize(ToElementFormat(m_Format.Position));
+	m_Stride = m_ColorOffset + GetElementSize(ToElementFormat(m_Format.Color));
+}
+
+// 既定の形式
+VERTEX_FORMAT VertexFormat::Full() {
+	return { POSITION_FORMAT::FLOAT3, COLOR_FORMAT::FLOAT4, 1.0f };
+}
+
+// 詰めた形式
+VERTEX_FORMAT VertexFormat::Compact() {
+	return { POSITION_FORMAT::HALF4, COLOR_FORMAT::RGBA8_UNORM, 1.0f };
+}
+
+// 量子化した形式
+VERTEX_FORMAT VertexFormat::Quantized(float extent) {
+	return { POSITION_FORMAT::SNORM16X4, COLOR_FORMAT::RGBA8_UNORM, extent };
+}
+
+// 同じ詰め方か
+bool VertexFormat::IsSameFormat(const VERTEX_FORMAT& a, const VERTEX_FORMAT& b) {
+	return a.Position == b.Position && a.Color == b.Color && (a.Position != POSITION_FORMAT::SNORM16X4 || a.PositionExtent == b.PositionExtent);
+}
+
+// インデックスの形式を選ぶ
+// インデックスはメッシュ内の番号なので、頂点数が 65536 以下なら 16 ビットに収まる
+INDEX_FORMAT VertexFormat::SelectIndexFormat(uint32_t vertexNum) {
+	return vertexNum <= 0x10000 ? INDEX_FORMAT::R16_UINT : INDEX_FORMAT::R32_UINT;
+}
+
+// インデックス 1 つの大きさ
+uint32_t VertexFormat::GetIndexSize(INDEX_FORMAT format) {
+	return format == INDEX_FORMAT::R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// 頂点要素 1 つの大きさ
+uint32_t VertexFormat::GetElementSize(ELEMENT_FORMAT format) {
+	switch (format) {
+	case ELEMENT_FORMAT::R32G32B32_FLOAT: return 12;
+	case ELEMENT_FORMAT::R32G32B32A32_FLOAT: return 16;
+	case ELEMENT_FORMAT::R16G16B16A16_FLOAT: return 8;
+	case ELEMENT_FORMAT::R16G16B16A16_SNORM: return 8;
+	case ELEMENT_FORMAT::R8G8B8A8_UNORM: return 4;
+	default: return 0;
+	}
+}
+
+// 頂点要素を 1 つ読む (足りない成分は (0, 0, 0, 1) で埋める)
+XMFLOAT4 VertexFormat::DecodeElement(ELEMENT_FORMAT format, const uint8_t* data) {
+	XMFLOAT4 value(0.0f, 0.0f, 0.0f, 1.0f);
+	switch (format) {
+	case ELEMENT_FORMAT::R32G32B32_FLOAT:
+		memcpy(&value, data, 12);
+		break;
+	case ELEMENT_FORMAT::R32G32B32A32_FLOAT:
+		memcpy(&value, data, 16);
+		break;
+	case ELEMENT_FORMAT::R16G16B16A16_FLOAT: {
+		HALF half[4];
+		memcpy(half, data, sizeof(half));
+		value = XMFLOAT4(XMConvertHalfToFloat(half[0]), XMConvertHalfToFloat(half[1]), XMConvertHalfToFloat(half[2]), XMConvertHalfToFloat(half[3]));
+		break;
+	}
+	case ELEMENT_FORMAT::R16G16B16A16_SNORM: {
+		int16_t snorm[4];
+		memcpy(snorm, data, sizeof(snorm));
+		float v[4];
+		for (int i = 0; i < 4; ++i) { v[i] = max(static_cast<float>(snorm[i]) / 32767.0f, -1.0f); }
+		value = XMFLOAT4(v[0], v[1], v[2], v[3]);
+		break;
+	}
+	case ELEMENT_FORMAT::R8G8B8A8_UNORM:
+		value = XMFLOAT4(data[0] / 255.0f, data[1] / 255.0f, data[2] / 255.0f, data[3] / 255.0f);
+		break;
+	default:
+		break;
+	}
+	return value;
+}
+
+// 入力レイアウトを作る
+uint32_t VertexFormat::GetInputElements(INPUT_ELEMENT_DESC* elements, uint32_t inputSlot) const {
+	elements[0] = { "POSITION", 0, ToElementFormat(m_Format.Position), inputSlot, INPUT_CLASSIFICATION::PER_VERTEX_DATA, 0 };
+	elements[1] = { "COLOR", 0, ToElementFormat(m_Format.Color), inputSlot, INPUT_CLASSIFICATION::PER_VERTEX_DATA, 0 };
+	return 2;
+}
+
+// 位置がすべて量子化の範囲に収まるか (NaN も収まらないものとする)
+bool VertexFormat::CanEncode(const VERTEX* vertices, uint32_t vertexNum) const {
+
+	if (m_Format.Position != POSITION_FORMAT::SNORM16X4) { return true; }
+
+	const float extent = m_Format.PositionExtent;
+	for (uint32_t i = 0; i < vertexNum; ++i) {
+		const XMFLOAT3& position = vertices[i].Position;
+		if (!(fabsf(position.x) <= extent && fabsf(position.y) <= extent && fabsf(position.z) <= extent)) { return false; }
+	}
+	return true;
+}
+
+// 頂点を詰め替える
+void VertexFormat::Encode(const VERTEX* vertices, uint32_t vertexNum, void* data) const {
+
+	uint8_t* bytes = static_cast<uint8_t*>(data);
+	const float invExtent = 1.0f / m_Format.PositionExtent;
+
+	for (uint32_t i = 0; i < vertexNum; ++i) {
+		const VERTEX& vertex = vertices[i];
+		uint8_t* position = bytes + static_cast<size_t>(i) * m_Stride + m_PositionOffset;
+		uint8_t* color = bytes + static_cast<size_t>(i) * m_Stride + m_ColorOffset;
+
+		switch (m_Format.Position) {
+		case POSITION_FORMAT::FLOAT3:
+			memcpy(position, &vertex.Position, sizeof(XMFLOAT3));
+			break;
+		case POSITION_FORMAT::HALF4: {
+			HALF half[4] = { XMConvertFloatToHalf(vertex.Position.x), XMConvertFloatToHalf(vertex.Position.y), XMConvertFloatToHalf(vertex.Position.z), XMConvertFloatToHalf(1.0f) };
+			memcpy(position, half, sizeof(half));
+			break;
+		}
+		case POSITION_FORMAT::SNORM16X4: {
+			int16_t snorm[4] = { ToSnorm16(vertex.Position.x * invExtent), ToSnorm16(vertex.Position.y * invExtent), ToSnorm16(vertex.Position.z * invExtent), 32767 };
+			memcpy(position, snorm, sizeof(snorm));
+			break;
+		}
+		}
+
+		switch (m_Format.Color) {
+		case COLOR_FORMAT::FLOAT4:
+			memcpy(color, &vertex.Color, sizeof(XMFLOAT4));
+			break;
+		case COLOR_FORMAT::RGBA8_UNORM: {
+			uint8_t unorm[4] = { ToUnorm8(vertex.Color.x), ToUnorm8(vertex.Color.y), ToUnorm8(vertex.Color.z), ToUnorm8(vertex.Color.w) };
+			memcpy(color, unorm, sizeof(unorm));
+			break;
+		}
+		}
+	}
+}
+
+// 詰めた頂点を展開する (量子化した位置も元の範囲に戻す)
+void VertexFormat::Decode(const void* data, uint32_t vertexNum, VERTEX* vertices) const {
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	const XMFLOAT4 scale = GetPositionScale();
+	const ELEMENT_FORMAT positionFormat = ToElementFormat(m_Format.Position);
+	const ELEMENT_FORMAT colorFormat = ToElementFormat(m_Format.Color);
+
+	for (uint32_t i = 0; i < vertexNum; ++i) {
+		XMFLOAT4 position = DecodeElement(positionFormat, bytes + static_cast<size_t>(i) * m_Stride + m_PositionOffset);
+		vertices[i].Position = XMFLOAT3(position.x * scale.x, position.y * scale.y, position.z * scale.z);
+		vertices[i].Color = DecodeElement(colorFormat, bytes + static_cast<size_t>(i) * m_Stride + m_ColorOffset);
+	}
+}
+
+// 形式を取得
+const VERTEX_FORMAT& VertexFormat::GetFormat() const { return m_Format; }
+
+// 頂点 1 つの大きさを取得
+uint32_t VertexFormat::GetStride() const { return m_Stride; }
+
+// シェーダで位置に掛ける値を取得
+XMFLOAT4 VertexFormat::GetPositionScale() const {
+	float scale = m_Format.Position == POSITION_FORMAT::SNORM16X4 ? m_Format.PositionExtent : 1.0f;
+	return XMFLOAT4(scale, scale, scale, 1.0f);
+}
@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <DirectXMath.h>
+
+#include "RenderBackend.h"
+#include "RenderObject.h"
+
+using namespace std;
+using namespace DirectX;
+
+// 量子化する位置の範囲の既定値 (コード中のメッシュはすべて収まる)
+static const float DEFAULT_POSITION_EXTENT = 4.0f;
+
+// 頂点の位置の形式
+enum class POSITION_FORMAT {
+	FLOAT3,    // R32G32B32_FLOAT (12 バイト)
+	HALF4,     // R16G16B16A16_FLOAT (8 バイト)
+	SNORM16X4, // R16G16B16A16_SNORM (8 バイト、PositionExtent で割って量子化する)
+};
+
+// 頂点の色の形式
+enum class COLOR_FORMAT {
+	FLOAT4,      // R32G32B32A32_FLOAT (16 バイト)
+	RGBA8_UNORM, // R8G8B8A8_UNORM (4 バイト)
+};
+
+// 頂点の形式
+struct VERTEX_FORMAT {
+	POSITION_FORMAT Position;
+	COLOR_FORMAT Color;
+	float PositionExtent; // 量子化する位置の範囲 (各成分の絶対値の上限)
+};
+
+// 頂点形式
+// VERTEX を GPU に置く形式へ詰め替え、その形式に合った入力レイアウトを作る
+// 量子化した位置はシェーダで GetPositionScale の値を掛けて元に戻す
+// 範囲を超える位置は量子化すると端に張り付いて形が崩れるので、詰める前に CanEncode で確かめる
+class VertexFormat {
+
+private:
+	VERTEX_FORMAT m_Format;
+	uint32_t m_Stride;
+	uint32_t m_PositionOffset;
+	uint32_t m_ColorOffset;
+
+public:
+	VertexFormat(const VERTEX_FORMAT& format);
+	~VertexFormat() = default;
+
+	// 既定の形式 (VERTEX のまま) と詰めた形式 (half の位置と RGBA8 の色)
+	static VERTEX_FORMAT Full();
+	static VERTEX_FORMAT Compact();
+
+	// 量子化した形式 (各成分の絶対値が extent 以下の位置を 16 ビットにする、RGBA8 の色)
+	static VERTEX_FORMAT Quantized(float extent = DEFAULT_POSITION_EXTENT);
+
+	// 同じ詰め方か (量子化の範囲は SNORM16X4 のときだけ比べる)
+	static bool IsSameFormat(const VERTEX_FORMAT& a, const VERTEX_FORMAT& b);
+
+	// 頂点数からインデックスの形式を選ぶ (16 ビットで足りれば R16_UINT)
+	static INDEX_FORMAT SelectIndexFormat(uint32_t vertexNum);
+	static uint32_t GetIndexSize(INDEX_FORMAT format);
+
+	// 頂点要素 1 つの大きさと読み出し (ソフトウェア描画用)
+	static uint32_t GetElementSize(ELEMENT_FORMAT format);
+	static XMFLOAT4 DecodeElement(ELEMENT_FORMAT format, const uint8_t* data);
+
+	// 入力レイアウトを作る (POSITION と COLOR の 2 要素を書き込んで要素数を返す)
+	uint32_t GetInputElements(INPUT_ELEMENT_DESC* elements, uint32_t inputSlot) const;
+
+	// 位置がすべて量子化の範囲に収まるか (SNORM16X4 以外は常に true)
+	bool CanEncode(const VERTEX* vertices, uint32_t vertexNum) const;
+
+	// 詰め替えと展開 (範囲を超える量子化した位置は端に丸める)
+	void Encode(const VERTEX* vertices, uint32_t vertexNum, void* data) const;
+	void Decode(const void* data, uint32_t vertexNum, VERTEX* vertices) const;
+
+	const VERTEX_FORMAT& GetFormat() const;
+	uint32_t GetStride() const;
+	XMFLOAT4 GetPositionScale() const;
+};